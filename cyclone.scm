@@ -494,8 +494,8 @@
                     (list 
                       (list 'f 'k 
                             (ast:make-lambda '(_ result) 
-                                             (list '(k result)))))))
-                 ;(lambda (k f) (f k (lambda (_ result) (k result)))))
+                                             (list '(k (Cyc-arena-unwind k result))))))))
+                 ;(lambda (k f) (f k (lambda (_ result) (k (Cyc-arena-unwind k result))))))
                 cps)));)
          (else
            ;; No need for call/cc yet
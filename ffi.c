@@ -62,6 +62,7 @@ object Cyc_scm_call(gc_thread_data *parent_thd, object fnc, int argc, object *ar
   local.jmp_start = &l;
 
   gc_thread_data *td = malloc(sizeof(gc_thread_data));
+  gc_thread_starting(); /* Wait for any heap compaction to finish */
   gc_add_new_unrunning_mutator(td); /* Register this thread */
   make_c_opaque(co, td);
   make_utf8_string(NULL, name_str, "");
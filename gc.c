@@ -19,17 +19,20 @@
 #include <ck_array.h>
 #include <ck_pr.h>
 #include "cyclone/types.h"
+#include "cyclone/runtime.h"
 #include <stdint.h>
 #include <time.h>
+#include <sched.h>
+#include <errno.h>
+#include <ctype.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
 //#define DEBUG_THREADS // Debugging!!!
 #ifdef DEBUG_THREADS
 #include <sys/syscall.h>        /* Linux-only? */
 #endif
 
-// 64-bit is 3, 32-bit is 2
-#define GC_BLOCK_BITS 5
-#define GC_BLOCK_SIZE (1 << GC_BLOCK_BITS)
-
 /* HEAP definitions, based off heap from Chibi scheme */
 #define gc_heap_first_block(h) ((object)(h->data + gc_heap_align(gc_free_chunk_size)))
 #define gc_heap_last_block(h) ((object)((char*)h->data + h->size - gc_heap_align(gc_free_chunk_size)))
@@ -42,6 +45,9 @@
 //#define gc_word_align(n) gc_align((n), 2)
 #define gc_heap_align(n) gc_align(n, GC_BLOCK_BITS)
 
+/* Number of words needed for a bitmap with one bit per block */
+#define gc_bitmap_words(n) (((n) + 63) / 64)
+
 ////////////////////
 // Global variables
 
@@ -55,11 +61,194 @@ static unsigned char gc_color_purple = 1;  // There are many "shades" of purple,
 static int gc_status_col = STATUS_SYNC1;
 static int gc_stage = STAGE_RESTING;
 
+// Block size of each fixed-size heap type
+static const unsigned int gc_heap_block_sizes[LAST_FIXED_SIZE_HEAP_TYPE + 1] = {
+  32, 64, 96, 128, 160, 192, 256, 320, 384, 512, 640, 768,
+  1024, 1280, 1536, 2048, 2560, 3072, 4096 };
+
+// Heap type to use for each aligned object size, indexed by size in blocks.
+// Does not need sync, only written by gc_initialize
+unsigned char gc_heap_type_by_blocks[(GC_MAX_SIZE_CLASS >> GC_BLOCK_BITS) + 1];
+
+// Page directory, a two-level radix table mapping addresses to heap pages.
+// Pages never overlap so one directory serves every thread. Leaves are
+// only ever added, under gc_page_dir_lock, and lookups do not lock.
+#define GC_PAGE_DIR_LEAF_BITS 16
+#define GC_PAGE_DIR_ROOT_BITS \
+  (GC_PAGE_DIR_ADDR_BITS - GC_PAGE_GRANULE_BITS - GC_PAGE_DIR_LEAF_BITS)
+static gc_heap **gc_page_dir[1 << GC_PAGE_DIR_ROOT_BITS];
+static pthread_mutex_t gc_page_dir_lock;
+
+// Event-driven wakeup of the collector thread. The collector sleeps on
+// gc_wake_cond while resting, and on gc_handshake_cond while waiting for
+// mutators to handshake. Mutators only bother signalling the latter when
+// gc_handshake_waiting is set, and after a handshake only once 
+// gc_handshake_pending, the number of running mutators the collector is 
+// still waiting on, drops to zero. The collector counts those mutators 
+// each time it waits, and gc_handshake_pending is only changed while 
+// holding gc_handshake_lock.
+static pthread_mutex_t gc_wake_lock;
+static pthread_cond_t gc_wake_cond;
+static pthread_mutex_t gc_handshake_lock;
+static pthread_cond_t gc_handshake_cond;
+static int gc_handshake_waiting = 0;
+static int gc_handshake_pending = 0;
+// Running mutators that have yet to handshake, only used by the collector
+static gc_thread_data **gc_handshake_running = NULL;
+static int gc_handshake_running_len = 0;
+
+// Compaction. A mutator sets gc_compact_requested when it has to grow its 
+// heap while fragmented pages have enough free space, and the collector
+// then compacts at the end of the cycle. While gc_compact_stopping is set
+// mutators stop at their next minor GC and wait on gc_compact_cond. 
+// gc_threads_starting is the number of new threads that may use the heap
+// but are not yet mutators, it is only changed with gc_compact_lock held.
+static pthread_mutex_t gc_compact_lock;
+static pthread_cond_t gc_compact_cond;
+static int gc_compact_requested = 0;
+static int gc_compact_stopping = 0;
+static int gc_threads_starting = 0;
+
+// Incremented whenever objects may have moved, lets address-based hash 
+// tables know when they must rehash, see gc_move_epoch. A mutator's minor
+// GCs and young heap collections only move its own objects, so they only
+// increment its slot, picked by gc_thread_data_init, and the last slot. 
+// Compaction increments every slot.
+static int gc_moves[GC_MOVE_SLOTS + 1];
+static int gc_move_slots_used = 0;
+
+// Set once compaction has been enabled. Only pages created from then on
+// are ever compacted, so objects on older pages can be hashed by address 
+// without expecting them to move, see gc_may_move.
+static int gc_compact_pages = (COMPACT_THRESHOLD > 0);
+
+// Weak tables, see types.h. Tracers add each weak table they mark to 
+// gc_weak_tables, under gc_weak_lock since helper threads may mark them
+// too, and gc_weak_finish deletes the entries whose keys were not marked.
+// The markers are never interned. Their hash is left at zero, meaning it
+// has not been computed yet, so anything that hashes them uses `len`.
+#define gc_marker_symbol(name) \
+  { .hdr = {0}, .tag = symbol_tag, .desc = name, \
+    .hash = 0, .len = sizeof(name) - 1 }
+static symbol_type gc_weak_keys_marker = gc_marker_symbol("weak-keys");
+static symbol_type gc_ephemerons_marker = gc_marker_symbol("ephemerons");
+const object gc_weak_keys = &gc_weak_keys_marker;
+const object gc_ephemerons = &gc_ephemerons_marker;
+static pthread_mutex_t gc_weak_lock;
+static void **gc_weak_tables = NULL;
+static int gc_weak_tables_len = 0;
+static int gc_weak_tables_i = 0;
+
+// Heap trimming. gc_heap_bytes is the total size of all heap pages and
+// gc_soft_limit an optional limit on it, or 0 for none. The collector bumps
+// gc_trim_epoch each time it has been idle for GC_TRIM_IDLE_MS, and each 
+// mutator trims its heap the next time it cooperates.
+static uint64_t gc_heap_bytes = 0;
+static uint64_t gc_soft_limit = 0;
+static int gc_trim_epoch = 0;
+
+/** Is the heap larger than the soft limit? */
+#define gc_over_soft_limit() \
+  (ck_pr_load_64(&gc_soft_limit) != 0 && \
+   ck_pr_load_64(&gc_heap_bytes) > ck_pr_load_64(&gc_soft_limit))
+
+// Runtime GC parameters, indexed by gc_param_id. Values are only ever 
+// replaced whole by gc_set_param, readers pick up a change the next time 
+// they use a parameter.
+static struct {
+  const char *name;
+  double min, max, value;
+} gc_params[NUM_GC_PARAMS] = {
+  {"initial-heap-size", 64 * 1024, 256 * 1024 * 1024, INITIAL_HEAP_SIZE},
+  {"heap-size", 64 * 1024, 256 * 1024 * 1024, HEAP_SIZE},
+  {"grow-heap-by-size", 64 * 1024, 256 * 1024 * 1024, GROW_HEAP_BY_SIZE},
+  {"collection-threshold", 0.0, 1.0, GC_COLLECTION_THRESHOLD},
+  {"free-threshold", 0.0, 1.0, GC_FREE_THRESHOLD},
+  {"collect-under-unswept-heap-count", 0, 1024 * 1024, 
+    GC_COLLECT_UNDER_UNSWEPT_HEAP_COUNT},
+  {"stack-size", 64 * 1024, 1024 * 1024 * 1024, STACK_SIZE},
+  {"adaptive", 0, 1, 0},
+  {"max-stack-size", 64 * 1024, 1024 * 1024 * 1024, STACK_SIZE * 8},
+  {"adaptive-stack", 0, 1, 0},
+  {"young-heap-size", 0, 1024 * 1024 * 1024, YOUNG_HEAP_SIZE},
+  {"compact-threshold", 0.0, 1.0, COMPACT_THRESHOLD},
+};
+
+// Adaptive mode. Page sizes and the collection threshold are scaled by
+// gc_adaptive_scale percent. gc_heap_grown_bytes counts pages added by
+// mutators that ran out of free space, the collector checks it after each
+// cycle to see if it is keeping up.
+static int gc_adaptive_scale = 100;
+static uint64_t gc_heap_grown_bytes = 0;
+static uint64_t gc_last_cycle_start = 0;
+
+// Statistics and tracing. The collector fields of gc_collector_stats are
+// only written by the collector thread. While gc_trace_out is set one JSON
+// object per line is written to it for every collection cycle.
+static gc_stats gc_collector_stats;
+static FILE *gc_trace_out = NULL;
+static pthread_mutex_t gc_trace_lock;
+static uint64_t gc_start_ns = 0;
+
+/** Value of a runtime GC parameter */
+#define gc_param(p) (gc_params[p].value)
+
+/** Size of a heap page, scaled up by the adaptive mode */
+#define gc_scaled_page_size(p) \
+  ((size_t)(gc_param(p) * ck_pr_load_int(&gc_adaptive_scale) / 100))
+
 // Does not need sync, only used by collector thread
 static void **mark_stack = NULL;
 static int mark_stack_len = 0;
 static int mark_stack_i = 0;
 
+// Parallel marking. Each tracer has a private stack that only it touches and
+// a shared deque that other tracers may steal from. Worker 0 is always the
+// collector thread itself, the rest are helper threads.
+typedef struct gc_mark_worker_t gc_mark_worker;
+struct gc_mark_worker_t {
+  int id;
+  pthread_t thread;
+  // Last mark round a helper has seen, it waits for the next one
+  int round;
+  // Private stack, no sync needed
+  void **stack;
+  int stack_len;
+  int stack_i;
+  // Shared deque, owner takes from the tail and thieves take from the head
+  pthread_mutex_t lock;
+  void **shared;
+  int shared_len;
+  int shared_head;
+  int shared_tail;
+};
+static int gc_mark_threads = GC_MARK_THREADS;
+static gc_mark_worker *mark_workers = NULL;
+static int mark_helpers_started = 0;
+static int mark_round = 0;
+static int mark_round_workers = 0;
+static int mark_helpers_done = 0;
+static int mark_idle = 0;
+static pthread_mutex_t mark_pool_lock;
+static pthread_cond_t mark_pool_cond;
+static pthread_cond_t mark_pool_done_cond;
+
+// Background sweeping. Mutators hand off batches of pages to be swept as 
+// jobs, and sweepers return the pages via lock-free stacks in the
+// mutator's thread data.
+typedef struct gc_sweep_job_t gc_sweep_job;
+struct gc_sweep_job_t {
+  gc_thread_data *thd;
+  gc_heap *pages;
+  gc_sweep_job *next;
+};
+static int gc_sweep_threads = GC_SWEEP_THREADS;
+static int sweep_helpers_started = 0;
+static int sweep_in_flight = 0;
+static gc_sweep_job *sweep_jobs = NULL;
+static pthread_mutex_t sweep_pool_lock;
+static pthread_cond_t sweep_pool_cond;
+
 // Data for the "main" thread which is guaranteed to always be there.
 // Per SRFI 18:
 //    All threads are terminated when the primordial
@@ -165,7 +354,7 @@ static double allocated_obj_counts[25] = {
   0,0,0,0,0,
   0,0,0,0,0};
 // TODO: allocated object sizes (EG: 32, 64, etc).
-static double allocated_heap_counts[4] = {0, 0, 0, 0};
+static double allocated_heap_counts[NUM_HEAP_TYPES] = {0};
 
 void print_allocated_obj_counts()
 {
@@ -182,7 +371,7 @@ void print_allocated_obj_counts()
   }
   fprintf(stderr, "Allocated heaps:\n");
   fprintf(stderr, "Heap, Allocations\n");
-  for (i = 0; i < 4; i++){
+  for (i = 0; i < NUM_HEAP_TYPES; i++){
     fprintf(stderr, "%d, %lf\n", i, allocated_heap_counts[i]);
   }
 }
@@ -204,6 +393,10 @@ void gc_log(FILE *stream, const char *format, ...)
 }
 #endif
 
+static void gc_parse_param(gc_param_id param, const char *val, const char *src);
+static void gc_compact_check(gc_thread_data *thd, size_t new_size);
+static void gc_mark_weak_table(gc_mark_worker *w, object obj);
+
 /////////////
 // Functions
 
@@ -229,6 +422,119 @@ void gc_initialize(void)
   mark_stack_len = 128;
   mark_stack = vpbuffer_realloc(mark_stack, &(mark_stack_len));
 
+  // Size classes, map each object size to the smallest block that holds it
+  {
+    int i, heap_type = HEAP_SM;
+    for (i = 0; i <= (GC_MAX_SIZE_CLASS >> GC_BLOCK_BITS); i++) {
+      while (gc_heap_block_sizes[heap_type] < (i << GC_BLOCK_BITS)) {
+        heap_type++;
+      }
+      gc_heap_type_by_blocks[i] = heap_type;
+    }
+  }
+
+  // Page directory
+  if (pthread_mutex_init(&(gc_page_dir_lock), NULL) != 0) {
+    fprintf(stderr, "Unable to initialize page directory mutex\n");
+    exit(1);
+  }
+
+  // Collector wakeup
+  if (pthread_mutex_init(&(gc_wake_lock), NULL) != 0 ||
+      pthread_cond_init(&(gc_wake_cond), NULL) != 0 ||
+      pthread_mutex_init(&(gc_handshake_lock), NULL) != 0 ||
+      pthread_cond_init(&(gc_handshake_cond), NULL) != 0) {
+    fprintf(stderr, "Unable to initialize collector wakeup data\n");
+    exit(1);
+  }
+
+  // Compaction
+  if (pthread_mutex_init(&(gc_compact_lock), NULL) != 0 ||
+      pthread_cond_init(&(gc_compact_cond), NULL) != 0) {
+    fprintf(stderr, "Unable to initialize compaction data\n");
+    exit(1);
+  }
+
+  // Weak tables
+  if (pthread_mutex_init(&(gc_weak_lock), NULL) != 0) {
+    fprintf(stderr, "Unable to initialize weak table mutex\n");
+    exit(1);
+  }
+  gc_weak_tables_len = 128;
+  gc_weak_tables = vpbuffer_realloc(gc_weak_tables, &(gc_weak_tables_len));
+
+  // Parallel marking
+  if (pthread_mutex_init(&(mark_pool_lock), NULL) != 0 ||
+      pthread_cond_init(&(mark_pool_cond), NULL) != 0 ||
+      pthread_cond_init(&(mark_pool_done_cond), NULL) != 0) {
+    fprintf(stderr, "Unable to initialize parallel marking data\n");
+    exit(1);
+  }
+  {
+    char *val = getenv("CYC_GC_MARK_THREADS");
+    if (val != NULL) {
+      gc_set_mark_threads(atoi(val));
+    }
+  }
+
+  // Background sweeping
+  if (pthread_mutex_init(&(sweep_pool_lock), NULL) != 0 ||
+      pthread_cond_init(&(sweep_pool_cond), NULL) != 0) {
+    fprintf(stderr, "Unable to initialize background sweeping data\n");
+    exit(1);
+  }
+  {
+    char *val = getenv("CYC_GC_SWEEP_THREADS");
+    if (val != NULL) {
+      gc_set_sweep_threads(atoi(val));
+    }
+  }
+
+  // Heap trimming, the soft limit may have a K, M, or G suffix
+  {
+    char *val = getenv("CYC_GC_SOFT_LIMIT"), *end;
+    if (val != NULL) {
+      uint64_t limit = strtoull(val, &end, 10);
+      switch (*end) {
+      case 'g': case 'G': limit <<= 10; // Fall through
+      case 'm': case 'M': limit <<= 10; // Fall through
+      case 'k': case 'K': limit <<= 10;
+      default: break;
+      }
+      gc_set_soft_limit(limit);
+    }
+  }
+
+  // Runtime parameters, CYC_GC_HEAP_SIZE for "heap-size" and so on
+  {
+    char name[64], *val;
+    int i, j;
+    for (i = 0; i < NUM_GC_PARAMS; i++) {
+      snprintf(name, sizeof(name), "CYC_GC_%s", gc_params[i].name);
+      for (j = 0; name[j]; j++) {
+        name[j] = (name[j] == '-') ? '_' : toupper(name[j]);
+      }
+      val = getenv(name);
+      if (val != NULL) {
+        gc_parse_param(i, val, name);
+      }
+    }
+  }
+  gc_last_cycle_start = gc_start_ns = gc_time_ns();
+
+  // Statistics and tracing
+  if (pthread_mutex_init(&(gc_trace_lock), NULL) != 0) {
+    fprintf(stderr, "Unable to initialize GC trace mutex\n");
+    exit(1);
+  }
+  {
+    char *val = getenv("CYC_GC_TRACE");
+    if (val != NULL && !gc_set_trace_file(val)) {
+      fprintf(stderr, "Unable to open GC trace file %s\n", val);
+      exit(1);
+    }
+  }
+
   // Here is as good a place as any to do this...
   if (pthread_mutex_init(&(mutators_lock), NULL) != 0) {
     fprintf(stderr, "Unable to initialize mutators_lock mutex\n");
@@ -382,6 +688,239 @@ uint64_t gc_heap_free_size(gc_heap *h) {
   return free_size;
 }
 
+/////////////////////////////////////////////
+// Page directory and page tables
+
+/** Free space on a page, for page table purposes */
+#define gc_page_free_size(h) \
+  ((h)->is_unswept == 1 ? (uint64_t)(h)->size : (uint64_t)(h)->free_size)
+
+/**
+ * @brief Point every page directory entry covering a page at `value`
+ * @param h     Heap page
+ * @param value Page to register, or `NULL` to remove the page
+ * @return 1 if the page is covered by the directory, 0 otherwise
+ */
+static int gc_page_dir_set(gc_heap *h, gc_heap *value)
+{
+  uint64_t g = (uint64_t)(uintptr_t)h >> GC_PAGE_GRANULE_BITS,
+           g_end = ((uint64_t)(uintptr_t)(h->data + h->size) - 1) >> GC_PAGE_GRANULE_BITS;
+  gc_heap **leaf;
+  if (g_end >> (GC_PAGE_DIR_ROOT_BITS + GC_PAGE_DIR_LEAF_BITS)) {
+    return 0; // Out of range, page cannot be looked up
+  }
+  for (; g <= g_end; g++) {
+    gc_heap ***root = &(gc_page_dir[g >> GC_PAGE_DIR_LEAF_BITS]);
+    leaf = ck_pr_load_ptr(root);
+    if (!leaf) {
+      pthread_mutex_lock(&gc_page_dir_lock);
+      leaf = *root;
+      if (!leaf) {
+        leaf = calloc(1 << GC_PAGE_DIR_LEAF_BITS, sizeof(gc_heap *));
+        if (!leaf) {
+          fprintf(stderr, "Unable to allocate page directory\n");
+          exit(1);
+        }
+        ck_pr_store_ptr(root, leaf);
+      }
+      pthread_mutex_unlock(&gc_page_dir_lock);
+    }
+    ck_pr_store_ptr(&(leaf[g & ((1 << GC_PAGE_DIR_LEAF_BITS) - 1)]), value);
+  }
+  return 1;
+}
+
+/**
+ * @brief Find the heap page containing an address
+ * @param p Address to look up
+ * @return The heap page, or `NULL` if `p` is not in the data of any page
+ *
+ * Any thread may call this function, and it runs in constant time.
+ */
+gc_heap *gc_page_lookup(void *p)
+{
+  uint64_t g = (uint64_t)(uintptr_t)p >> GC_PAGE_GRANULE_BITS;
+  gc_heap **leaf, *h;
+  if (g >> (GC_PAGE_DIR_ROOT_BITS + GC_PAGE_DIR_LEAF_BITS)) {
+    return NULL;
+  }
+  leaf = ck_pr_load_ptr(&(gc_page_dir[g >> GC_PAGE_DIR_LEAF_BITS]));
+  if (!leaf) {
+    return NULL;
+  }
+  h = ck_pr_load_ptr(&(leaf[g & ((1 << GC_PAGE_DIR_LEAF_BITS) - 1)]));
+  if (h && (char *)p >= h->data && (char *)p < h->data + h->size) {
+    return h;
+  }
+  return NULL;
+}
+
+/**
+ * @brief Add a page to the list of pages with free space
+ */
+static void gc_page_avail_add(gc_page_table *pt, gc_heap *h)
+{
+  int type = h->type;
+  if (h->avail_index >= 0) {
+    return; // Already listed
+  }
+  if (pt->avail_len[type] == pt->avail_cap[type]) {
+    pt->avail_cap[type] = pt->avail_cap[type] ? pt->avail_cap[type] * 2 : 16;
+    pt->avail[type] = realloc(pt->avail[type], 
+                              sizeof(gc_heap *) * pt->avail_cap[type]);
+    if (!pt->avail[type]) {
+      fprintf(stderr, "Unable to grow page table\n");
+      exit(1);
+    }
+  }
+  h->avail_index = pt->avail_len[type];
+  pt->avail[type][pt->avail_len[type]++] = h;
+}
+
+/**
+ * @brief Remove a page from the list of pages with free space
+ */
+static void gc_page_avail_remove(gc_page_table *pt, gc_heap *h)
+{
+  int type = h->type, i = h->avail_index;
+  gc_heap *last;
+  if (i < 0) {
+    return; // Not listed
+  }
+  last = pt->avail[type][--(pt->avail_len[type])];
+  pt->avail[type][i] = last;
+  last->avail_index = i;
+  h->avail_index = -1;
+}
+
+/**
+ * @brief Add a page that was just linked into one of the heaps to the
+ *        owner's page table
+ */
+static void gc_page_attach(gc_page_table *pt, gc_heap *h)
+{
+  pt->num_pages[h->type]++;
+  pt->free_size[h->type] += gc_page_free_size(h);
+  if (!h->is_full) {
+    gc_page_avail_add(pt, h);
+  }
+}
+
+/**
+ * @brief Remove a page that is being unlinked from one of the heaps from
+ *        the owner's page table
+ */
+static void gc_page_detach(gc_page_table *pt, gc_heap *h)
+{
+  pt->num_pages[h->type]--;
+  pt->free_size[h->type] -= gc_page_free_size(h);
+  gc_page_avail_remove(pt, h);
+}
+
+/**
+ * @brief Flag a page as full, so the allocator stops looking at it until
+ *        the next collection
+ */
+static void gc_page_set_full(gc_page_table *pt, gc_heap *h)
+{
+  h->is_full = 1;
+  gc_page_avail_remove(pt, h);
+}
+
+/**
+ * @brief Recompute a heap's page table entries from its pages
+ * @param thd  Mutator's thread data
+ * @param type Heap type
+ *
+ * Called once per collection cycle, after any full pages have been made
+ * available again. This also corrects for any drift in the free space 
+ * count, for example from allocating on a page before it is swept.
+ */
+static void gc_page_table_resync(gc_thread_data *thd, int type)
+{
+  gc_page_table *pt = thd->page_table;
+  gc_heap *h;
+  unsigned int num_pages = 0;
+  uint64_t free_size = 0;
+  for (h = thd->heap->heap[type]; h; h = h->next) {
+    num_pages++;
+    free_size += gc_page_free_size(h);
+    if (!h->is_full) {
+      gc_page_avail_add(pt, h);
+    }
+  }
+  pt->num_pages[type] = num_pages;
+  pt->free_size[type] = free_size;
+}
+
+/**
+ * @brief Get page statistics for one of a mutator's heaps in constant time
+ * @param thd       Mutator's thread data
+ * @param heap_type Heap type
+ * @param stats     Receives the statistics
+ *
+ * Pages that are out for sweeping in the background are only included in
+ * the total and free sizes.
+ */
+void gc_get_page_stats(gc_thread_data *thd, int heap_type, gc_page_stats *stats)
+{
+  gc_page_table *pt = thd->page_table;
+  stats->num_pages = pt->num_pages[heap_type];
+  stats->num_available = pt->avail_len[heap_type];
+  stats->total_size = thd->cached_heap_total_sizes[heap_type];
+  stats->free_size = pt->free_size[heap_type] + 
+                     thd->cached_heap_sweep_sizes[heap_type];
+}
+
+/** Size of the mapping backing a heap page, given its padded size */
+#define gc_heap_map_size(padded_size) \
+  (((padded_size) + GC_PAGE_GRANULE - 1) & ~((size_t)GC_PAGE_GRANULE - 1))
+
+/**
+ * @brief Map memory for a heap page directly from the OS
+ * @param padded_size Padded size of the page
+ * @return Page-directory aligned memory, or `NULL` if the mapping failed
+ *
+ * Mapping each page separately means its memory goes straight back to the
+ * OS when the page is released, instead of staying in the C library's 
+ * heap. This matters most for huge pages, which hold a single object.
+ */
+static gc_heap *gc_heap_map(size_t padded_size)
+{
+  size_t size = gc_heap_map_size(padded_size), 
+         len = size + GC_PAGE_GRANULE, head, tail;
+  char *p = mmap(NULL, len, PROT_READ | PROT_WRITE, 
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    return NULL;
+  }
+  // Trim the mapping so it starts on a granule boundary
+  head = (GC_PAGE_GRANULE - ((uintptr_t)p & (GC_PAGE_GRANULE - 1))) & 
+         (GC_PAGE_GRANULE - 1);
+  tail = len - head - size;
+  if (head) {
+    munmap(p, head);
+  }
+  if (tail) {
+    munmap(p + head + size, tail);
+  }
+  return (gc_heap *)(p + head);
+}
+
+/**
+ * @brief Return the memory of a heap page that is no longer in use
+ * @param h Heap page, which must already be unlinked from its heap
+ */
+static void gc_heap_release(gc_heap *h)
+{
+  ck_pr_sub_64(&gc_heap_bytes, h->size);
+  gc_page_dir_set(h, NULL);
+  if (munmap(h, h->map_size) != 0) {
+    fprintf(stderr, "Error releasing heap page\n");
+    exit(1);
+  }
+}
+
 /**
  * @brief Create a new heap page. 
  *        The caller must hold the necessary locks.
@@ -396,20 +935,34 @@ gc_heap *gc_heap_create(int heap_type, size_t size, gc_thread_data *thd)
   gc_free_list *free, *next;
   gc_heap *h;
   size_t padded_size;
+  unsigned int num_blocks = 0;
   size = gc_heap_align(size);
   padded_size = gc_heap_pad_size(size);
-  h = malloc(padded_size);
+  if (heap_type <= LAST_FIXED_SIZE_HEAP_TYPE) {
+    // Reserve room for the free block bitmap at the end of the page
+    num_blocks = size / gc_heap_block_sizes[heap_type];
+    padded_size += gc_bitmap_words(num_blocks) * sizeof(uint64_t);
+#if GC_SIDE_MARK_BITS
+    // Followed by the side mark and allocation bitmaps
+    padded_size += 4 * gc_bitmap_words(num_blocks) * sizeof(uint64_t);
+#endif
+  }
+  // Align pages so no two share a page directory entry
+  h = gc_heap_map(padded_size);
   if (!h)
     return NULL;
+  h->map_size = gc_heap_map_size(padded_size);
   h->type = heap_type;
   h->size = size;
   h->ttl = 10;
+  ck_pr_add_64(&gc_heap_bytes, size);
   h->next_free = h;
   h->last_alloc_size = 0;
   thd->cached_heap_total_sizes[heap_type] += size;
   thd->cached_heap_free_sizes[heap_type] += size;
-  h->data = (char *)gc_heap_align(sizeof(h->data) + (uintptr_t) & (h->data));
+  h->data = (char *)gc_heap_align(sizeof(struct gc_heap_t) + (uintptr_t)h);
   h->next = NULL;
+  h->prev = NULL;
   h->num_unswept_children = 0;
   free = h->free_list = (gc_free_list *) h->data;
   next = (gc_free_list *) (((char *)free) + gc_heap_align(gc_free_chunk_size));
@@ -429,17 +982,18 @@ gc_heap *gc_heap_create(int heap_type, size_t size, gc_thread_data *thd)
           ((char *)free) + free->size, next, ((char *)next) + next->size);
 #endif
   if (heap_type <= LAST_FIXED_SIZE_HEAP_TYPE) {
-    h->block_size = (heap_type + 1) * 32;
-//
-    h->remaining = size - (size % h->block_size);
+    h->block_size = gc_heap_block_sizes[heap_type];
+    h->num_blocks = num_blocks;
+    h->free_cursor = 0;
+    h->free_bits = (uint64_t *)(h->data + size);
+    h->remaining = num_blocks * h->block_size;
     h->data_end = h->data + h->remaining;
     h->free_list = NULL; // No free lists with bump&pop
-// This is for starting with a free list, but we want bump&pop instead
-//    h->remaining = 0;
-//    h->data_end = NULL;
-//    gc_init_fixed_size_free_list(h);
   } else {
     h->block_size = 0;
+    h->num_blocks = 0;
+    h->free_cursor = 0;
+    h->free_bits = NULL;
     h->remaining = 0;
     h->data_end = NULL;
   }
@@ -447,152 +1001,496 @@ gc_heap *gc_heap_create(int heap_type, size_t size, gc_thread_data *thd)
   h->free_size = size;
   h->is_full = 0;
   h->is_unswept = 0;
+  // Page table
+  h->avail_index = -1;
+  h->arena = NULL;
+  h->from_arena = 0;
+  h->has_pinned = 0;
+  h->compacting = 0;
+  h->compactable = ck_pr_load_int(&gc_compact_pages);
+#if GC_SIDE_MARK_BITS
+  // Side marks can only be found for pages in the page directory
+  if (gc_page_dir_set(h, h) && h->free_bits) {
+    unsigned int i, words = gc_bitmap_words(num_blocks);
+    for (i = 0; i < 2; i++) {
+      h->mark_bits[i] = h->free_bits + ((1 + i) * words);
+      h->alloc_bits[i] = h->free_bits + ((3 + i) * words);
+      h->mark_colors[i] = gc_color_red;
+      h->alloc_colors[i] = gc_color_red;
+    }
+    memset(h->mark_bits[0], 0, 4 * words * sizeof(uint64_t));
+  } else {
+    h->mark_bits[0] = h->mark_bits[1] = NULL;
+    h->alloc_bits[0] = h->alloc_bits[1] = NULL;
+  }
+  h->has_finalizers = 0;
+#else
+  gc_page_dir_set(h, h);
+#endif
+  if (thd->page_table) {
+    gc_page_attach(thd->page_table, h);
+  }
   return h;
 }
 
 /**
- * @brief   Initialize free lists within a single heap page.
- *          Assumes that there is no data currently on the heap page!
- * @param   h     Heap page to initialize
+ * @brief Mask of the bits in word `w` of a page's bitmap that map to blocks
+ * @param h Fixed-size heap page
+ * @param w Index of the bitmap word
  */
-void gc_init_fixed_size_free_list(gc_heap *h)
+static inline uint64_t gc_bitmap_word_mask(gc_heap *h, unsigned int w)
 {
-  // for this flavor, just layer a free list on top of unitialized memory
-  gc_free_list *next;
-  //int i = 0;
-  size_t remaining = h->size - (h->size % h->block_size) - h->block_size; // Starting at first one so skip it
-  next = h->free_list = (gc_free_list *)h->data;
-  //printf("data start = %p\n", h->data);
-  //printf("data end = %p\n", h->data + h->size);
-  while (remaining >= h->block_size) {
-    //printf("%d init remaining=%d next = %p\n", i++, remaining, next);
-    next->next = (gc_free_list *)(((char *) next) + h->block_size);
-    next = next->next;
-    remaining -= h->block_size;
-  }
-  next->next = NULL;
-  h->data_end = NULL; // Indicate we are using free lists
-} 
+  unsigned int n = h->num_blocks - (w * 64);
+  return (n >= 64) ? ~(uint64_t)0 : (((uint64_t)1 << n) - 1);
+}
 
 /**
- * @brief Diagnostic function to print all free lists on a fixed-size heap page
- * @param h Heap page to output
+ * @brief Population count of a bitmap word
  */
-void gc_print_fixed_size_free_list(gc_heap *h)
+static inline int gc_bitmap_count(uint64_t w)
 {
-  gc_free_list *f = h->free_list;
-  fprintf(stderr, "printing free list:\n");
-  while(f) {
-    fprintf(stderr, "%p\n", f);
-    f = f->next;
+#if defined(__GNUC__)
+  return __builtin_popcountll(w);
+#else
+  int n = 0;
+  while (w) {
+    w &= w - 1;
+    n++;
   }
-  fprintf(stderr, "done\n");
+  return n;
+#endif
 }
 
+#if GC_SIDE_MARK_BITS
+/////////////////////////////////////////////
+// Side mark bitmaps
+//
+// Objects on fixed-size pages are marked in bitmaps at the end of the page
+// rather than in their headers. Only the current mark color and the 
+// previous one are ever in use, so each page has one bitmap per color
+// parity. A bitmap also records the color it was last used for, and is only
+// cleared when it is first used for a new color. Objects allocated by the
+// owning mutator are recorded the same way, so an object is black if it has
+// either been marked or allocated in the current mark color.
+//
+// Any bits left behind by a freed object are cleared by the sweep, so a
+// bitmap never holds bits for a free block regardless of its color.
+
+/** Index of the bitmaps used for a given color */
+#define gc_side_index(c) (((c) >> 1) & 1)
+
+/** Index of an object's block on a fixed-size page */
+#define gc_side_block(h, obj) \
+  ((unsigned int)(((char *)(obj) - (h)->data) / (h)->block_size))
+
 /**
- * @brief Essentially this is half of the sweep code, for sweeping bump&pop
- * @param h Heap page to convert
+ * @brief Mask of the bits in bitmap word `w` that map to the first `n` blocks
  */
-static size_t gc_convert_heap_page_to_free_list(gc_heap *h, gc_thread_data *thd) 
+static inline uint64_t gc_bitmap_prefix_mask(unsigned int n, unsigned int w)
 {
-  size_t freed = 0;
-  object p;
-  gc_free_list *next;
-  int remaining = h->size - (h->size % h->block_size);
-  if (h->data_end == NULL) return 0; // Already converted
-
-  next = h->free_list = NULL;
-  while (remaining > h->remaining) {
-    p = h->data_end - remaining;
-    //int tag = type_of(p);
-    int color = mark(p);
-//    printf("found object %d color %d at %p with remaining=%lu\n", tag, color, p, remaining);
-    // free space, add it to the free list
-    if (color != thd->gc_alloc_color &&
-        color != thd->gc_trace_color) { //gc_color_clear) 
-      // Run any finalizers
-      if (type_of(p) == mutex_tag) {
-#if GC_DEBUG_VERBOSE
-      fprintf(stderr, "pthread_mutex_destroy from sweep\n");
-#endif
-        if (pthread_mutex_destroy(&(((mutex) p)->lock)) != 0) {
-          fprintf(stderr, "Error destroying mutex\n");
-          exit(1);
-        }
-      } else if (type_of(p) == cond_var_tag) {
-#if GC_DEBUG_VERBOSE
-      fprintf(stderr, "pthread_cond_destroy from sweep\n");
-#endif
-        if (pthread_cond_destroy(&(((cond_var) p)->cond)) != 0) {
-          fprintf(stderr, "Error destroying condition variable\n");
-          exit(1);
-        }
-      } else if (type_of(p) == bignum_tag) {
-        // TODO: this is no good if we abandon bignum's on the stack
-        // in that case the finalizer is never called
-#if GC_DEBUG_VERBOSE
-        fprintf(stderr, "mp_clear from sweep\n");
-#endif
-        mp_clear(&(((bignum_type *)p)->bn));
-      } else if (type_of(p) == c_opaque_tag && opaque_collect_ptr(p)) {
-#if GC_DEBUG_VERBOSE
-        fprintf(stderr, "free opaque pointer %p from sweep\n", opaque_ptr(p));
-#endif
-        free( opaque_ptr(p) );
-      }
+  if (n <= w * 64) return 0;
+  n -= w * 64;
+  return (n >= 64) ? ~(uint64_t)0 : (((uint64_t)1 << n) - 1);
+}
 
-      // Free block
-      freed += h->block_size;
-      if (next == NULL) {
-        next = h->free_list = p;
-      }
-      else {
-        next->next = p;
-        next = next->next;
-      }
-      h->free_size += h->block_size;
+/**
+ * @brief Get a page's mark bitmap for a color, clearing it first if it was
+ *        last used for another color
+ * @param h     Fixed-size heap page with side marks
+ * @param color Mark color
+ * @return The mark bitmap
+ *
+ * Any marking thread may call this function. The first thread to use the
+ * bitmap for a new color clears it while the others wait.
+ */
+static uint64_t *gc_side_mark_bits(gc_heap *h, unsigned char color)
+{
+  int i = gc_side_index(color);
+  unsigned int w, words;
+  for (;;) {
+    unsigned char c = ck_pr_load_8(&(h->mark_colors[i]));
+    if (c == color) {
+      ck_pr_fence_load();
+      return h->mark_bits[i];
     }
-    remaining -= h->block_size;
-  }
-
-  // Convert any empty space at the end
-  while (remaining) {
-    p = h->data_end - remaining;
-//    printf("no object at %p fill with free list\n", p);
-    if (next == NULL) {
-      next = h->free_list = p;
+    if (c == gc_color_blue) {
+      ck_pr_stall(); // Being cleared by another thread
+      continue;
     }
-    else {
-      next->next = p; //(gc_free_list *)(((char *) next) + h->block_size);
-      next = next->next;
+    if (ck_pr_cas_8(&(h->mark_colors[i]), c, gc_color_blue)) {
+      words = gc_bitmap_words(h->num_blocks);
+      for (w = 0; w < words; w++) {
+        ck_pr_store_64(&(h->mark_bits[i][w]), 0);
+      }
+      ck_pr_fence_store();
+      ck_pr_store_8(&(h->mark_colors[i]), color);
+      return h->mark_bits[i];
     }
-    remaining -= h->block_size;
   }
+}
 
-  if (next) {
-    next->next = NULL;
+/**
+ * @brief Record that the owning mutator allocated a block in its current
+ *        allocation color
+ * @param h   Fixed-size heap page with side marks
+ * @param obj Newly-allocated object
+ * @param thd Mutator's thread data
+ *
+ * Allocation bitmaps are only written by the thread that owns the page at
+ * the time, so no atomics are needed to update the bits.
+ */
+static void gc_side_set_alloc(gc_heap *h, object obj, gc_thread_data *thd)
+{
+  unsigned char color = thd->gc_alloc_color;
+  unsigned int b = gc_side_block(h, obj);
+  int i = gc_side_index(color);
+  if (h->alloc_colors[i] != color) {
+    memset(h->alloc_bits[i], 0, 
+           gc_bitmap_words(h->num_blocks) * sizeof(uint64_t));
+    ck_pr_fence_store();
+    ck_pr_store_8(&(h->alloc_colors[i]), color);
+  }
+  h->alloc_bits[i][b / 64] |= ((uint64_t)1 << (b % 64));
+  switch (type_of(obj)) {
+  case mutex_tag:
+  case cond_var_tag:
+  case bignum_tag:
+  case c_opaque_tag:
+    h->has_finalizers = 1;
+    break;
+  default:
+    break;
   }
-  // Let GC know this heap is not bump&pop
-  h->remaining = 0;
-  h->data_end = NULL;
-  return freed;
 }
 
 /**
- * @brief Sweep portion of the GC algorithm
- * @param h           Heap to sweep
- * @param thd           Thread data object for the mutator using this heap
- * @return Return the size of the largest object freed, in bytes
+ * @brief Test a block's bit in a side bitmap
+ * @param bits  Side bitmap
+ * @param epoch Color the bitmap was last used for
+ * @param color Color being tested
+ * @param b     Block index
+ */
+static inline int gc_side_test(uint64_t *bits, unsigned char *epoch, 
+                               unsigned char color, unsigned int b)
+{
+  if (ck_pr_load_8(epoch) != color) return 0;
+  ck_pr_fence_load();
+  return (ck_pr_load_64(&(bits[b / 64])) >> (b % 64)) & 1;
+}
+
+/**
+ * @brief Determine if an object has been marked or allocated in a color
  *
- * This portion of the major GC algorithm is responsible for returning unused
- * memory slots to the heap. It is only called by the collector thread after
- * the heap has been traced to identify live objects.
+ * Objects that are not on a page with side marks use the header mark.
  */
-static gc_heap *gc_sweep_fixed_size(gc_heap * h, gc_thread_data *thd)
+static int gc_side_is_black(object obj, unsigned char color)
 {
-  short heap_is_empty;
-  object p, end;
-  gc_free_list *q, *r, *s;
+  gc_heap *h = gc_page_lookup(obj);
+  if (h && h->mark_bits[0]) {
+    unsigned int b = gc_side_block(h, obj);
+    int i = gc_side_index(color);
+    return gc_side_test(h->mark_bits[i], &(h->mark_colors[i]), color, b) ||
+           gc_side_test(h->alloc_bits[i], &(h->alloc_colors[i]), color, b);
+  }
+  return mark(obj) == color;
+}
+
+/**
+ * @brief Determine if an object still needs to be marked in this cycle
+ */
+static int gc_side_is_white(object obj)
+{
+  gc_heap *h = gc_page_lookup(obj);
+  if (h && h->mark_bits[0]) {
+    return !gc_side_is_black(obj, ck_pr_load_8(&gc_color_mark));
+  }
+  return (mark(obj) == gc_color_clear || mark(obj) == gc_color_purple);
+}
+
+/**
+ * @brief Mark an object in the given color
+ */
+static void gc_side_blacken(object obj, unsigned char color)
+{
+  gc_heap *h = gc_page_lookup(obj);
+  if (h && h->mark_bits[0]) {
+    unsigned int b = gc_side_block(h, obj);
+    ck_pr_or_64(&(gc_side_mark_bits(h, color)[b / 64]), 
+                ((uint64_t)1 << (b % 64)));
+  } else if (ck_pr_load_8(&(mark(obj))) != gc_color_red) {
+    ck_pr_store_8(&(mark(obj)), color);
+  }
+}
+
+#define gc_is_white(obj) gc_side_is_white(obj)
+#define gc_is_black(obj, color) gc_side_is_black(obj, color)
+#define gc_blacken(obj, color) gc_side_blacken(obj, color)
+#else
+#define gc_is_white(obj) \
+  (mark(obj) == gc_color_clear || mark(obj) == gc_color_purple)
+#define gc_is_black(obj, color) (ck_pr_load_8(&(mark(obj))) == (color))
+// Only blacken objects on the heap
+#define gc_blacken(obj, color) do { \
+  if (ck_pr_load_8(&(mark(obj))) != gc_color_red) { \
+    ck_pr_store_8(&(mark(obj)), (color)); \
+  } \
+} while (0)
+#endif
+
+/**
+ * @brief Diagnostic function to print all free blocks on a fixed-size heap page
+ * @param h Heap page to output
+ */
+void gc_print_fixed_size_free_list(gc_heap *h)
+{
+  unsigned int i;
+  fprintf(stderr, "printing free blocks:\n");
+  if (h->data_end == NULL) {
+    for (i = 0; i < h->num_blocks; i++) {
+      if (h->free_bits[i / 64] & ((uint64_t)1 << (i % 64))) {
+        fprintf(stderr, "%p\n", h->data + (i * h->block_size));
+      }
+    }
+  }
+  fprintf(stderr, "done\n");
+}
+
+/**
+ * @brief Read the colors a sweep uses to decide which objects to keep
+ * @param thd         Thread data object for the mutator owning the heap
+ * @param alloc_color Receives the mutator's allocation color
+ * @param trace_color Receives the mutator's trace color
+ *
+ * The collector drops the trace color once it finishes tracing, which may
+ * happen part way through a sweep. If a sweep were to read the old mark of
+ * an object and then the new trace color, an object marked in between would
+ * be freed while still live. Taking both colors once up front, before any
+ * marks are read, means a sweep keeps everything the collector may still be
+ * marking; anything left over is reclaimed by the next sweep of the page.
+ */
+static void gc_sweep_colors(gc_thread_data *thd, unsigned char *alloc_color,
+                            unsigned char *trace_color)
+{
+  *alloc_color = ck_pr_load_8(&(thd->gc_alloc_color));
+  *trace_color = ck_pr_load_8(&(thd->gc_trace_color));
+  ck_pr_fence_load();
+}
+
+#if GC_SIDE_MARK_BITS
+/**
+ * @brief Run the finalizer of an object being freed, if it has one
+ */
+static void gc_side_finalize(object p)
+{
+  switch (type_of(p)) {
+  case mutex_tag:
+    if (pthread_mutex_destroy(&(((mutex) p)->lock)) != 0) {
+      fprintf(stderr, "Error destroying mutex\n");
+      exit(1);
+    }
+    break;
+  case cond_var_tag:
+    if (pthread_cond_destroy(&(((cond_var) p)->cond)) != 0) {
+      fprintf(stderr, "Error destroying condition variable\n");
+      exit(1);
+    }
+    break;
+  case bignum_tag:
+    mp_clear(&(((bignum_type *)p)->bn));
+    break;
+  case c_opaque_tag:
+    if (opaque_collect_ptr(p)) {
+      free( opaque_ptr(p) );
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+/**
+ * @brief Sweep a fixed-size page using its side mark bitmaps
+ * @param h           Heap page to sweep, which must have side marks
+ * @param used        If the page is bump&pop, the number of blocks handed 
+ *                    out so far. Otherwise the free block bitmap is used.
+ * @param alloc_color Allocation color of the mutator owning the page
+ * @param trace_color Trace color of the mutator owning the page
+ * @param heap_is_empty Cleared if any block on the page is still in use
+ * @return Number of bytes freed
+ *
+ * Live blocks are found a bitmap word at a time, so objects on the page
+ * are only read if they need to be finalized.
+ */
+static size_t gc_side_sweep(gc_heap *h, unsigned int used, 
+                            unsigned char alloc_color, 
+                            unsigned char trace_color,
+                            short *heap_is_empty)
+{
+  uint64_t *live[4];
+  unsigned char colors[2] = { alloc_color, trace_color };
+  unsigned int w, words = gc_bitmap_words(h->num_blocks);
+  int i, n = 0, any_kept = 0;
+  size_t freed = 0;
+
+  // Find the bitmaps that hold the colors being kept
+  for (i = 0; i < 2; i++) {
+    int s = gc_side_index(colors[i]);
+    if (i == 1 && colors[1] == colors[0]) break;
+    if (ck_pr_load_8(&(h->mark_colors[s])) == colors[i]) {
+      live[n++] = h->mark_bits[s];
+    }
+    if (h->alloc_colors[s] == colors[i]) {
+      live[n++] = h->alloc_bits[s];
+    }
+  }
+  ck_pr_fence_load();
+
+  for (w = 0; w < words; w++) {
+    uint64_t in_use, keep = 0, garbage;
+    if (h->data_end != NULL) {
+      in_use = gc_bitmap_prefix_mask(used, w);
+    } else {
+      in_use = ~(h->free_bits[w]) & gc_bitmap_word_mask(h, w);
+    }
+    for (i = 0; i < n; i++) {
+      keep |= ck_pr_load_64(&(live[i][w]));
+    }
+    garbage = in_use & ~keep;
+    if (in_use & keep) {
+      any_kept = 1;
+    }
+    if (garbage) {
+      if (h->has_finalizers) {
+        uint64_t g = garbage;
+        while (g) {
+          int bit = gc_bitmap_lowest_bit(g);
+          g &= g - 1;
+          gc_side_finalize(h->data + (((w * 64) + bit) * h->block_size));
+        }
+      }
+      // Free blocks never have side bits set
+      ck_pr_and_64(&(h->mark_bits[0][w]), ~garbage);
+      ck_pr_and_64(&(h->mark_bits[1][w]), ~garbage);
+      h->alloc_bits[0][w] &= ~garbage;
+      h->alloc_bits[1][w] &= ~garbage;
+      h->free_bits[w] |= garbage;
+      freed += gc_bitmap_count(garbage) * h->block_size;
+    }
+  }
+  if (any_kept) {
+    *heap_is_empty = 0;
+  } else {
+    h->has_finalizers = 0;
+  }
+  h->free_size += freed;
+  return freed;
+}
+#endif
+
+/**
+ * @brief Essentially this is half of the sweep code, for sweeping bump&pop
+ * @param h Heap page to convert
+ *
+ * Builds the page's free block bitmap from the blocks handed out so far,
+ * and marks every block past the bump pointer as free.
+ */
+static size_t gc_convert_heap_page_to_free_list(gc_heap *h, gc_thread_data *thd) 
+{
+  size_t freed = 0;
+  object p;
+  unsigned int i, words, used;
+  unsigned char alloc_color, trace_color;
+  if (h->data_end == NULL) return 0; // Already converted
+
+  gc_sweep_colors(thd, &alloc_color, &trace_color);
+
+  words = gc_bitmap_words(h->num_blocks);
+  memset(h->free_bits, 0, words * sizeof(uint64_t));
+  used = (h->num_blocks * h->block_size - h->remaining) / h->block_size;
+  i = 0;
+#if GC_SIDE_MARK_BITS
+  if (h->mark_bits[0]) {
+    short heap_is_empty = 1;
+    freed = gc_side_sweep(h, used, alloc_color, trace_color, &heap_is_empty);
+    i = used;
+  }
+#endif
+  for (; i < used; i++) {
+    p = h->data + (i * h->block_size);
+    //int tag = type_of(p);
+    int color = ck_pr_load_8(&(mark(p)));
+//    printf("found object %d color %d at %p\n", tag, color, p);
+    // free space, add it to the free list
+    if (color != alloc_color &&
+        color != trace_color) { //gc_color_clear) 
+      // Run any finalizers
+      if (type_of(p) == mutex_tag) {
+#if GC_DEBUG_VERBOSE
+      fprintf(stderr, "pthread_mutex_destroy from sweep\n");
+#endif
+        if (pthread_mutex_destroy(&(((mutex) p)->lock)) != 0) {
+          fprintf(stderr, "Error destroying mutex\n");
+          exit(1);
+        }
+      } else if (type_of(p) == cond_var_tag) {
+#if GC_DEBUG_VERBOSE
+      fprintf(stderr, "pthread_cond_destroy from sweep\n");
+#endif
+        if (pthread_cond_destroy(&(((cond_var) p)->cond)) != 0) {
+          fprintf(stderr, "Error destroying condition variable\n");
+          exit(1);
+        }
+      } else if (type_of(p) == bignum_tag) {
+        // TODO: this is no good if we abandon bignum's on the stack
+        // in that case the finalizer is never called
+#if GC_DEBUG_VERBOSE
+        fprintf(stderr, "mp_clear from sweep\n");
+#endif
+        mp_clear(&(((bignum_type *)p)->bn));
+      } else if (type_of(p) == c_opaque_tag && opaque_collect_ptr(p)) {
+#if GC_DEBUG_VERBOSE
+        fprintf(stderr, "free opaque pointer %p from sweep\n", opaque_ptr(p));
+#endif
+        free( opaque_ptr(p) );
+      }
+
+      // Free block
+      freed += h->block_size;
+      h->free_bits[i / 64] |= ((uint64_t)1 << (i % 64));
+      h->free_size += h->block_size;
+    }
+  }
+
+  // Convert any empty space at the end
+  for (; i < h->num_blocks; i++) {
+    h->free_bits[i / 64] |= ((uint64_t)1 << (i % 64));
+  }
+
+  // Let GC know this heap is not bump&pop
+  h->free_cursor = 0;
+  h->remaining = 0;
+  h->data_end = NULL;
+  return freed;
+}
+
+/**
+ * @brief Sweep portion of the GC algorithm
+ * @param h           Heap to sweep
+ * @param thd           Thread data object for the mutator using this heap
+ * @return Return the size of the largest object freed, in bytes
+ *
+ * This portion of the major GC algorithm is responsible for returning unused
+ * memory slots to the heap. It is only called by the collector thread after
+ * the heap has been traced to identify live objects.
+ *
+ * Only blocks that are in use need to be examined, and those are found 
+ * a bitmap word at a time.
+ */
+static gc_heap *gc_sweep_fixed_size(gc_heap * h, gc_thread_data *thd)
+{
+  short heap_is_empty;
+  object p;
+  unsigned char alloc_color, trace_color;
 #if GC_DEBUG_SHOW_SWEEP_DIAG
   gc_heap *orig_heap_ptr = h;
 #endif
@@ -600,6 +1498,7 @@ static gc_heap *gc_sweep_fixed_size(gc_heap * h, gc_thread_data *thd)
 
   h->next_free = h;
   h->is_unswept = 0;
+  gc_sweep_colors(thd, &alloc_color, &trace_color);
 
 #if GC_DEBUG_SHOW_SWEEP_DIAG
   fprintf(stderr, "\nBefore sweep -------------------------\n");
@@ -612,107 +1511,84 @@ static gc_heap *gc_sweep_fixed_size(gc_heap * h, gc_thread_data *thd)
     gc_convert_heap_page_to_free_list(h, thd);
     heap_is_empty = 0; // For now, don't try to free bump&pop
   } else {
-    //gc_free_list *next;
-    size_t remaining = h->size - (h->size % h->block_size); // - h->block_size; // Remove first one??
-    char *data_end = h->data + remaining;
+    unsigned int w, words = gc_bitmap_words(h->num_blocks);
     heap_is_empty = 1; // Base case is an empty heap
-    end = (object)data_end;
-    p = h->data;
-    q = h->free_list;
-    while (p < end) {
-      // find preceding/succeeding free list pointers for p
-      for (r = (q?q->next:NULL); r && ((char *)r < (char *)p); q = r, r = r->next) ;
-      if ((char *)q == (char *)p || (char *)r == (char *)p) {     // this is a free block, skip it
-        //printf("Sweep skip free block %p remaining=%lu\n", p, remaining);
-        p = (object) (((char *)p) + h->block_size);
-        continue;
-      }
+#if GC_SIDE_MARK_BITS
+    if (h->mark_bits[0]) {
+      gc_side_sweep(h, 0, alloc_color, trace_color, &heap_is_empty);
+      words = 0; // Already swept
+    }
+#endif
+    for (w = 0; w < words; w++) {
+      uint64_t used = ~(h->free_bits[w]) & gc_bitmap_word_mask(h, w);
+      while (used) {
+        int bit = gc_bitmap_lowest_bit(used);
+        used &= used - 1;
+        unsigned char color;
+        p = h->data + (((w * 64) + bit) * h->block_size);
 #if GC_SAFETY_CHECKS
-      if (!is_object_type(p)) {
-        fprintf(stderr, "sweep: invalid object at %p", p);
-        exit(1);
-      }
-      if (type_of(p) > 21) {
-        fprintf(stderr, "sweep: invalid object tag %d at %p", type_of(p), p);
-        exit(1);
-      }
+        if (!is_object_type(p)) {
+          fprintf(stderr, "sweep: invalid object at %p", p);
+          exit(1);
+        }
+        if (type_of(p) > 21) {
+          fprintf(stderr, "sweep: invalid object tag %d at %p", type_of(p), p);
+          exit(1);
+        }
 #endif
-      if (mark(p) != thd->gc_alloc_color && 
-          mark(p) != thd->gc_trace_color) { //gc_color_clear) 
+        color = ck_pr_load_8(&(mark(p)));
+        if (color != alloc_color && 
+            color != trace_color) { //gc_color_clear) 
 #if GC_DEBUG_VERBOSE
-        fprintf(stderr, "sweep is freeing unmarked obj: %p with tag %d\n", p,
-                type_of(p));
+          fprintf(stderr, "sweep is freeing unmarked obj: %p with tag %d\n", p,
+                  type_of(p));
 #endif
-        // Run finalizers
-        if (type_of(p) == mutex_tag) {
+          // Run finalizers
+          if (type_of(p) == mutex_tag) {
 #if GC_DEBUG_VERBOSE
-          fprintf(stderr, "pthread_mutex_destroy from sweep\n");
+            fprintf(stderr, "pthread_mutex_destroy from sweep\n");
 #endif
-          if (pthread_mutex_destroy(&(((mutex) p)->lock)) != 0) {
-            fprintf(stderr, "Error destroying mutex\n");
-            exit(1);
-          }
-        } else if (type_of(p) == cond_var_tag) {
+            if (pthread_mutex_destroy(&(((mutex) p)->lock)) != 0) {
+              fprintf(stderr, "Error destroying mutex\n");
+              exit(1);
+            }
+          } else if (type_of(p) == cond_var_tag) {
 #if GC_DEBUG_VERBOSE
-          fprintf(stderr, "pthread_cond_destroy from sweep\n");
+            fprintf(stderr, "pthread_cond_destroy from sweep\n");
 #endif
-          if (pthread_cond_destroy(&(((cond_var) p)->cond)) != 0) {
-            fprintf(stderr, "Error destroying condition variable\n");
-            exit(1);
-          }
-        } else if (type_of(p) == bignum_tag) {
-          // TODO: this is no good if we abandon bignum's on the stack
-          // in that case the finalizer is never called
+            if (pthread_cond_destroy(&(((cond_var) p)->cond)) != 0) {
+              fprintf(stderr, "Error destroying condition variable\n");
+              exit(1);
+            }
+          } else if (type_of(p) == bignum_tag) {
+            // TODO: this is no good if we abandon bignum's on the stack
+            // in that case the finalizer is never called
 #if GC_DEBUG_VERBOSE
-          fprintf(stderr, "mp_clear from sweep\n");
+            fprintf(stderr, "mp_clear from sweep\n");
 #endif
-          mp_clear(&(((bignum_type *)p)->bn));
-        }
+            mp_clear(&(((bignum_type *)p)->bn));
+          }
 
-        // free p
-        //heap_freed += h->block_size;
-        if (h->free_list == NULL) {
-          // No free list, start one at p
-          q = h->free_list = p;
-          h->free_list->next = NULL;
-          //printf("sweep reclaimed remaining=%d, %p, assign h->free_list\n", remaining, p);
-        } else if ((char *)p < (char *)h->free_list) {
-          // p is before the free list, prepend it as the start
-          // note if this is the case, either there is no free_list (see above case) or 
-          // the free list is after p, which is handled now. these are the only situations
-          // where there is no q
-          s = (gc_free_list *)p;
-          s->next = h->free_list;
-          q = h->free_list = p;
-          //printf("sweep reclaimed remaining=%d, %p, assign h->free_list which was %p\n", remaining, p, h->free_list);
+          // free p
+          h->free_bits[w] |= ((uint64_t)1 << bit);
+          h->free_size += h->block_size;
         } else {
-          s = (gc_free_list *)p;
-          s->next = r;
-          q->next = s;
-          //printf("sweep reclaimed remaining=%d, %p, q=%p, r=%p\n", remaining, p, q, r);
+          heap_is_empty = 0;
         }
-        h->free_size += h->block_size;
-      } else {
-        //printf("sweep block is still used remaining=%d p = %p\n", remaining, p);
-        heap_is_empty = 0;
       }
-      //next->next = (gc_free_list *)(((char *) next) + h->block_size);
-      //next = next->next;
-      p = (object) (((char *)p) + h->block_size);
     }
+    h->free_cursor = 0;
   }
   // Free the heap page if possible.
   if (heap_is_empty) {
-    if (h->type == HEAP_HUGE || (h->ttl--) <= 0) {
+    if (h->type == HEAP_HUGE || (h->ttl--) <= 0 || gc_over_soft_limit()) {
       rv = NULL; // Let caller know heap needs to be freed
     } else {
       // Convert back to bump&pop
-      h->remaining = h->size - (h->size % h->block_size);
+      h->remaining = h->num_blocks * h->block_size;
       h->data_end = h->data + h->remaining;
       h->free_list = NULL; // No free lists with bump&pop
     }
-  } else {
-    //(thd->heap->heap[h->type])->num_unswept_children--;
   }
 
 #if GC_DEBUG_SHOW_SWEEP_DIAG
@@ -724,11 +1600,40 @@ static gc_heap *gc_sweep_fixed_size(gc_heap * h, gc_thread_data *thd)
   return rv;
 }
 
+/**
+ * @brief Insert a page into a heap's list of pages
+ * @param prev Page to insert after
+ * @param h    Page to insert
+ */
+static void gc_page_link_after(gc_heap *prev, gc_heap *h)
+{
+  h->prev = prev;
+  h->next = prev->next;
+  if (h->next) {
+    h->next->prev = h;
+  }
+  prev->next = h;
+}
+
+/**
+ * @brief Remove a page other than the first from a heap's list of pages
+ */
+static void gc_page_unlink(gc_heap *h)
+{
+  h->prev->next = h->next;
+  if (h->next) {
+    h->next->prev = h->prev;
+  }
+}
+
 /**
  * @brief   Free a page of the heap
  * @param   page        Page to free
  * @param   prev_page   Previous page in the heap
  * @return  Previous page if successful, NULL otherwise
+ *
+ * The caller is responsible for removing the page from its owner's 
+ * page table first.
  */
 gc_heap *gc_heap_free(gc_heap *page, gc_heap *prev_page)
 {
@@ -740,8 +1645,8 @@ gc_heap *gc_heap_free(gc_heap *page, gc_heap *prev_page)
   fprintf(stderr, "DEBUG freeing heap type %d page at addr: %p\n", page->type, page);
 #endif
 
-  prev_page->next = page->next;
-  free(page);
+  gc_page_unlink(page);
+  gc_heap_release(page);
   return prev_page;
 }
 
@@ -756,7 +1661,16 @@ static int gc_is_heap_empty(gc_heap *h)
   if (!h) return 0;
 
   if (h->data_end) { // Fixed-size bump&pop
-    return (h->remaining == (h->size - (h->size % h->block_size)));
+    return (h->remaining == (h->num_blocks * h->block_size));
+  }
+
+  if (h->free_bits) { // Fixed-size, all blocks must be free
+    unsigned int w, words = gc_bitmap_words(h->num_blocks);
+    for (w = 0; w < words; w++) {
+      uint64_t mask = gc_bitmap_word_mask(h, w);
+      if ((h->free_bits[w] & mask) != mask) return 0;
+    }
+    return 1;
   }
 
   if (!h->free_list) return 0;
@@ -768,54 +1682,665 @@ static int gc_is_heap_empty(gc_heap *h)
   return (f->size + gc_heap_align(gc_free_chunk_size)) == h->size;
 }
 
+/////////////////////////////////////////////
+// Heap trimming
+
 /**
- * @brief Print heap usage information. Before calling this function the 
- *        current thread must have the heap lock
- * @param h Heap to analyze.
+ * @brief Return the memory of an empty page to the OS, but keep the page
+ * @param h Empty heap page
+ * @return Number of bytes decommitted
+ *
+ * The page is left in place, and its memory is faulted back in as zeroed
+ * pages once it is allocated from again. Only the parts of the page that 
+ * hold objects are decommitted, so its header, free list, and bitmaps are
+ * left intact.
  */
-void gc_print_stats(gc_heap * h)
+static size_t gc_heap_decommit(gc_heap *h)
 {
-  gc_free_list *f;
-  unsigned int free, free_chunks, free_min, free_max;
-  int heap_is_empty;
-  for (; h; h = h->next) {
-    free = 0;
-    free_chunks = 0;
-    free_min = h->size;
-    free_max = 0;
-    for (f = h->free_list; f; f = f->next) {
-      free += f->size;
-      free_chunks++;
-      if (f->size < free_min && f->size > 0)
-        free_min = f->size;
-      if (f->size > free_max)
-        free_max = f->size;
-    }
-    if (free == 0){ // No free chunks
-      free_min = 0;
-    }
-    heap_is_empty = gc_is_heap_empty(h);
-    fprintf(stderr,
-            "Heap type=%d, page size=%u, is empty=%d, used=%u, free=%u, free chunks=%u, min=%u, max=%u\n",
-            h->type, h->size, heap_is_empty, h->size - free, free, free_chunks, free_min, free_max);
+#ifdef MADV_DONTNEED
+  uintptr_t os_page = (uintptr_t)sysconf(_SC_PAGESIZE), start, end;
+  if (h->free_bits) {
+    start = (uintptr_t)h->data;
+    end = start + (h->num_blocks * h->block_size);
+  } else {
+    // Keep the header of the free chunk covering the page
+    start = (uintptr_t)h->free_list->next + sizeof(gc_free_list);
+    end = (uintptr_t)h->data + h->size;
   }
+  start = (start + os_page - 1) & ~(os_page - 1);
+  end &= ~(os_page - 1);
+  if (start < end && madvise((void *)start, end - start, MADV_DONTNEED) == 0) {
+    return end - start;
+  }
+#endif
+  return 0;
 }
 
 /**
- * @brief Copy given object into given heap object
- * @param dest  Pointer to destination heap memory slot
- * @param obj   Object to copy
- * @param thd   Thread data object for the applicable mutator
- * @return The appropriate pointer to use for `obj`
+ * @brief Return empty heap pages owned by a mutator to the OS
+ * @param thd         Mutator's thread data
+ * @param release_all Release every empty page if true. Otherwise pages are
+ *                    only released while at least `GC_TRIM_FREE_RATIO` of 
+ *                    the heap would remain free.
+ * @param decommit    Decommit any empty pages that are kept
+ * @return Number of bytes returned to the OS
  *
- * NOTE: There is no additional type checking because this function is
- * called from `gc_move` which already does that.
+ * Must be called by the mutator itself, or while it is blocked. Unless 
+ * `release_all` is set, pages that have not been swept since the last 
+ * collection are left alone. Huge pages are never trimmed since they are
+ * released as soon as they are swept.
  */
-char *gc_copy_obj(object dest, char *obj, gc_thread_data * thd)
+size_t gc_heap_trim(gc_thread_data *thd, int release_all, int decommit)
 {
-  #if GC_DEBUG_TRACE
-  allocated_obj_counts[type_of(obj)]++;
-  #endif
+  gc_page_table *pt = thd->page_table;
+  size_t trimmed = 0;
+  int heap_type;
+  // Pages must not be released from under an allocation buffer
+  gc_alloc_buffers_flush(thd);
+  for (heap_type = 0; heap_type < HEAP_HUGE; heap_type++) {
+    gc_heap *h_head = thd->heap->heap[heap_type], *h_prev, *h, *next;
+    uint64_t free_size = 0, total_size = 0;
+    if (!h_head) {
+      continue;
+    }
+    // Sweep any pages left over from the last collection so that pages 
+    // holding only garbage can be released as well
+    if (release_all) {
+      for (h = h_head; h; h = h->next) {
+        if (h->is_unswept == 1) {
+          uint64_t prev_free_size = gc_page_free_size(h);
+          if (gc_is_heap_empty(h)) {
+            h->is_unswept = 0;
+          } else {
+            if (heap_type <= LAST_FIXED_SIZE_HEAP_TYPE) {
+              gc_sweep_fixed_size(h, thd);
+            } else {
+              gc_sweep(h, thd);
+            }
+            h_head->num_unswept_children--;
+          }
+          pt->free_size[heap_type] += gc_page_free_size(h) - prev_free_size;
+        }
+      }
+    }
+    // Only count free space that is known, unswept pages may be full
+    for (h = h_head; h; h = h->next) {
+      total_size += h->size;
+      if (!h->is_unswept) {
+        free_size += h->free_size;
+      }
+    }
+    for (h_prev = h_head, h = h_head->next; h; h = next) {
+      next = h->next;
+      if (h->is_unswept || !gc_is_heap_empty(h)) {
+        h_prev = h;
+      } else if (release_all ||
+                 (free_size >= h->size &&
+                  (free_size - h->size) >= 
+                  (total_size - h->size) * GC_TRIM_FREE_RATIO)) {
+        free_size -= h->size;
+        total_size -= h->size;
+        thd->cached_heap_total_sizes[heap_type] -= h->size;
+        trimmed += h->size;
+        gc_page_detach(pt, h);
+        gc_heap_free(h, h_prev);
+      } else {
+        if (decommit) {
+          trimmed += gc_heap_decommit(h);
+        }
+        h_prev = h;
+      }
+    }
+    if (decommit && !h_head->is_unswept && gc_is_heap_empty(h_head)) {
+      trimmed += gc_heap_decommit(h_head);
+    }
+    // Do not leave the allocator pointing at a page that was released
+    h_head->next_free = h_head;
+  }
+  return trimmed;
+}
+
+/**
+ * @brief Set a soft limit on the total size of the heap
+ * @param limit Limit in bytes, or 0 for no limit
+ *
+ * As the heap nears the limit collections are started sooner, and once it
+ * is over the limit empty pages are released as soon as they are found.
+ */
+void gc_set_soft_limit(uint64_t limit)
+{
+  ck_pr_store_64(&gc_soft_limit, limit);
+}
+
+/**
+ * @brief Get the soft limit on the total size of the heap, or 0 for none
+ */
+uint64_t gc_get_soft_limit(void)
+{
+  return ck_pr_load_64(&gc_soft_limit);
+}
+
+/**
+ * @brief Free space threshold below which a mutator starts a collection
+ *
+ * This starts at the collection-threshold parameter, scaled up by the 
+ * adaptive mode to at most the free-threshold parameter. It then rises 
+ * towards `GC_TRIM_FREE_RATIO` as the heap grows from half of the soft 
+ * limit to the limit itself, so the collector runs more often the closer
+ * the heap is to the limit.
+ */
+static double gc_collection_threshold(void)
+{
+  uint64_t limit = ck_pr_load_64(&gc_soft_limit), used;
+  double base = gc_param(GC_PARAM_COLLECTION_THRESHOLD), r;
+  if (ck_pr_load_int(&gc_adaptive_scale) > 100) {
+    base = base * ck_pr_load_int(&gc_adaptive_scale) / 100;
+    if (base > gc_param(GC_PARAM_FREE_THRESHOLD)) {
+      base = gc_param(GC_PARAM_FREE_THRESHOLD);
+    }
+  }
+  if (limit == 0) {
+    return base;
+  }
+  used = ck_pr_load_64(&gc_heap_bytes);
+  if (used <= limit / 2 || base >= GC_TRIM_FREE_RATIO) {
+    return base;
+  }
+  r = (double)(used - limit / 2) / (double)(limit - limit / 2);
+  if (r > 1.0) {
+    r = 1.0;
+  }
+  return base + r * (GC_TRIM_FREE_RATIO - base);
+}
+
+/////////////////////////////////////////////
+// Runtime parameters
+
+/**
+ * @brief Find a runtime GC parameter by name
+ * @param name Name of the parameter, such as "heap-size"
+ * @return The parameter's `gc_param_id`, or -1 if there is no such parameter
+ */
+int gc_param_lookup(const char *name)
+{
+  int i;
+  for (i = 0; i < NUM_GC_PARAMS; i++) {
+    if (strcmp(name, gc_params[i].name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+/**
+ * @brief Name of a runtime GC parameter
+ */
+const char *gc_param_name(gc_param_id param)
+{
+  return gc_params[param].name;
+}
+
+/**
+ * @brief Get the current value of a runtime GC parameter
+ */
+double gc_get_param(gc_param_id param)
+{
+  return gc_params[param].value;
+}
+
+/**
+ * @brief Change a runtime GC parameter
+ * @param param Parameter to change
+ * @param value New value
+ * @return A true value if the parameter was changed, or 0 if `value` is out
+ *         of range for it
+ *
+ * Heap sizes only apply to pages created from now on, and the stack size
+ * only to threads started from now on.
+ */
+int gc_set_param(gc_param_id param, double value)
+{
+  if (!(value >= gc_params[param].min && value <= gc_params[param].max)) {
+    return 0;
+  }
+  gc_params[param].value = value;
+  if (param == GC_PARAM_ADAPTIVE && value == 0) {
+    ck_pr_store_int(&gc_adaptive_scale, 100);
+  }
+  if (param == GC_PARAM_COMPACT_THRESHOLD && value > 0) {
+    ck_pr_store_int(&gc_compact_pages, 1);
+  }
+  return 1;
+}
+
+/**
+ * @brief Parse the value of a runtime GC parameter
+ * @param param Parameter the value is for
+ * @param val   Value, sizes may have a K, M, or G suffix
+ * @param src   Where the value came from, for error messages
+ *
+ * Invalid values are reported and terminate the program.
+ */
+static void gc_parse_param(gc_param_id param, const char *val, const char *src)
+{
+  char *end;
+  double value = strtod(val, &end);
+  switch (*end) {
+  case 'g': case 'G': value *= 1024; // Fall through
+  case 'm': case 'M': value *= 1024; // Fall through
+  case 'k': case 'K': value *= 1024; end++;
+  default: break;
+  }
+  if (end == val || *end != '\0' || !gc_set_param(param, value)) {
+    fprintf(stderr, "Invalid value for %s: %s (must be between %g and %g)\n", 
+            src, val, gc_params[param].min, gc_params[param].max);
+    exit(1);
+  }
+}
+
+/**
+ * @brief Apply any runtime GC parameters given on the command line
+ * @param argc Pointer to the argument count
+ * @param argv Arguments
+ *
+ * Arguments of the form `--cyc-gc-NAME=VALUE` are consumed and removed 
+ * from `argv`, so the program never sees them. Parsing stops at `--`.
+ * These take precedence over the CYC_GC_* environment variables, which
+ * are read by `gc_initialize`.
+ */
+void gc_parse_args(int *argc, char **argv)
+{
+  const char *prefix = "--cyc-gc-";
+  size_t prefix_len = strlen(prefix);
+  int i, j;
+  for (i = j = 1; i < *argc; i++) {
+    char *arg = argv[i], *eq;
+    if (strcmp(arg, "--") == 0) {
+      while (i < *argc) {
+        argv[j++] = argv[i++];
+      }
+      break;
+    }
+    if (strncmp(arg, prefix, prefix_len) != 0) {
+      argv[j++] = arg;
+      continue;
+    }
+    eq = strchr(arg, '=');
+    if (eq != NULL) {
+      int param;
+      *eq = '\0';
+      param = gc_param_lookup(arg + prefix_len);
+      *eq = '=';
+      if (param >= 0) {
+        gc_parse_param(param, eq + 1, arg);
+        continue;
+      }
+    }
+    fprintf(stderr, "Unknown GC option: %s\n", arg);
+    exit(1);
+  }
+  argv[j] = NULL;
+  *argc = j;
+}
+
+/**
+ * @brief Adjust the adaptive scale after a collection cycle
+ * @param cycle_ns    How long the cycle took
+ * @param interval_ns Time since the start of the previous cycle
+ * @param grown       Bytes of pages mutators added because they ran out of
+ *                    free space since the previous cycle
+ *
+ * Called by the collector thread. If mutators had to grow their heaps, or
+ * the collector spent more than half of its time collecting, allocation is
+ * outpacing it. In that case larger pages are used and collections start 
+ * sooner. Once the collector is mostly idle again the scale decays back.
+ */
+static void gc_adapt_params(uint64_t cycle_ns, uint64_t interval_ns, 
+                            uint64_t grown)
+{
+  int scale = ck_pr_load_int(&gc_adaptive_scale);
+  if (!gc_param(GC_PARAM_ADAPTIVE)) {
+    return;
+  }
+  if (grown > 0 || cycle_ns * 2 > interval_ns) {
+    scale *= 2;
+    if (scale > GC_ADAPTIVE_MAX_SCALE * 100) {
+      scale = GC_ADAPTIVE_MAX_SCALE * 100;
+    }
+  } else if (cycle_ns * 8 < interval_ns) {
+    scale = scale * 3 / 4;
+    if (scale < 100) {
+      scale = 100;
+    }
+  }
+  ck_pr_store_int(&gc_adaptive_scale, scale);
+}
+
+/**
+ * @brief Reduce a stack buffer size to fit the process stack limit
+ * @param stack_size  Requested size of the stack buffer
+ * @return Size in bytes that leaves at least `STACK_MARGIN` bytes of the
+ *         process stack limit unused
+ */
+static long gc_stack_size_fit_rlimit(long stack_size)
+{
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_STACK, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY &&
+      (rlim_t)stack_size + STACK_MARGIN > rl.rlim_cur) {
+    if (rl.rlim_cur > 2 * STACK_MARGIN) {
+      return (long)rl.rlim_cur - STACK_MARGIN;
+    }
+    return (long)rl.rlim_cur / 2;
+  }
+  return stack_size;
+}
+
+/**
+ * @brief Size of the main thread's stack buffer
+ * @return The `stack-size` parameter, reduced if needed so the buffer fits
+ *         on the main thread's C stack
+ *
+ * Other threads are created with a C stack large enough for their stack
+ * buffer, but the main thread's C stack is bounded by `RLIMIT_STACK`.
+ * Letting the buffer run past it would crash the program instead of
+ * triggering a minor GC.
+ */
+long gc_main_stack_size(void)
+{
+  return gc_stack_size_fit_rlimit((long)gc_param(GC_PARAM_STACK_SIZE));
+}
+
+/**
+ * @brief Largest size a thread's stack buffer may grow to
+ * @param stack_size  Size the thread's stack buffer starts out with
+ * @return Size in bytes, the same as `stack_size` unless the adaptive
+ *         stack mode is enabled
+ *
+ * The result leaves at least `STACK_MARGIN` bytes of the process stack
+ * limit unused, so it is also safe for the main thread.
+ */
+long gc_stack_size_max(long stack_size)
+{
+  long max;
+  if (!gc_param(GC_PARAM_ADAPTIVE_STACK)) {
+    return stack_size;
+  }
+  max = gc_stack_size_fit_rlimit((long)gc_param(GC_PARAM_MAX_STACK_SIZE));
+  return max < stack_size ? stack_size : max;
+}
+
+/**
+ * @brief Resize a thread's stack buffer after a minor GC
+ * @param thd  The mutator's thread data object
+ *
+ * Threads that fill their stack buffer quickly while moving little of it 
+ * to the heap get a larger one, so they need fewer minor GC's. Threads
+ * that rarely need a minor GC go back to a smaller one, so they use less 
+ * cache. Must be called by the thread itself, before it longjmp's back 
+ * to the start of its stack.
+ */
+void gc_stack_size_adapt(gc_thread_data * thd)
+{
+  uint64_t now, interval, bytes = 0;
+  long size = thd->stack_size;
+  int heap_type;
+  if (thd->stack_size_min == thd->stack_size_max) {
+    return;
+  }
+  now = gc_time_ns();
+  interval = now - thd->stack_adapt_ns;
+  for (heap_type = 0; heap_type < NUM_HEAP_TYPES; heap_type++) {
+    bytes += thd->stats_bytes_allocated[heap_type];
+  }
+  if (interval < GC_STACK_GROW_INTERVAL_NS &&
+      (bytes - thd->stack_adapt_bytes) * GC_STACK_GROW_SURVIVAL < (uint64_t)size) {
+    size *= 2;
+    if (size > thd->stack_size_max) {
+      size = thd->stack_size_max;
+    }
+  } else if (interval > GC_STACK_SHRINK_INTERVAL_NS) {
+    size /= 2;
+    if (size < thd->stack_size_min) {
+      size = thd->stack_size_min;
+    }
+  }
+  thd->stack_adapt_ns = now;
+  thd->stack_adapt_bytes = bytes;
+  if (size != thd->stack_size) {
+    thd->stack_size = size;
+#if STACK_GROWTH_IS_DOWNWARD
+    thd->stack_limit = thd->stack_start - size;
+#else
+    thd->stack_limit = thd->stack_start + size;
+#endif
+  }
+}
+
+/////////////////////////////////////////////
+// Statistics and tracing
+
+/**
+ * @brief Current time in nanoseconds, from a monotonic clock
+ */
+uint64_t gc_time_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief Get garbage collector statistics
+ * @param thd   Thread to report thread statistics for
+ * @param stats Out parameter, receives the statistics
+ *
+ * Must be called by the thread itself, or while it is blocked.
+ */
+void gc_get_stats(gc_thread_data *thd, gc_stats *stats)
+{
+  int heap_type;
+  stats->major_cycles = ck_pr_load_64(&gc_collector_stats.major_cycles);
+  stats->clear_mark_ns = ck_pr_load_64(&gc_collector_stats.clear_mark_ns);
+  stats->trace_ns = ck_pr_load_64(&gc_collector_stats.trace_ns);
+  stats->sweep_ns = ck_pr_load_64(&gc_collector_stats.sweep_ns);
+  stats->last_clear_mark_ns = 
+    ck_pr_load_64(&gc_collector_stats.last_clear_mark_ns);
+  stats->last_trace_ns = ck_pr_load_64(&gc_collector_stats.last_trace_ns);
+  stats->last_sweep_ns = ck_pr_load_64(&gc_collector_stats.last_sweep_ns);
+  stats->handshake_wait_ns = 
+    ck_pr_load_64(&gc_collector_stats.handshake_wait_ns);
+  stats->heap_bytes = ck_pr_load_64(&gc_heap_bytes);
+  stats->minor_gcs = thd->stats_minor_gcs;
+  stats->minor_gc_ns = thd->stats_minor_gc_ns;
+  for (heap_type = 0; heap_type < NUM_HEAP_TYPES; heap_type++) {
+    stats->bytes_allocated[heap_type] = thd->stats_bytes_allocated[heap_type];
+    stats->pages[heap_type] = thd->page_table->num_pages[heap_type];
+  }
+  stats->young_collections = thd->stats_young_collections;
+  stats->young_survivor_bytes = thd->stats_young_survivor_bytes;
+  stats->compactions = ck_pr_load_64(&gc_collector_stats.compactions);
+  stats->compacted_bytes = ck_pr_load_64(&gc_collector_stats.compacted_bytes);
+}
+
+/**
+ * @brief Start or stop writing a GC event trace
+ * @param path File to write the trace to, "-" for stderr, or NULL to stop
+ * @return A true value on success, or 0 if the file could not be opened
+ *
+ * The trace is written in JSON lines format. At the end of each collection
+ * cycle the collector writes a "major" event with the duration of each 
+ * phase, and each mutator then writes a "mutator" event with its own
+ * statistics. The file is truncated when it is opened.
+ */
+int gc_set_trace_file(const char *path)
+{
+  FILE *out = NULL, *prev;
+  if (path != NULL) {
+    out = (strcmp(path, "-") == 0) ? stderr : fopen(path, "w");
+    if (out == NULL) {
+      return 0;
+    }
+  }
+  pthread_mutex_lock(&gc_trace_lock);
+  prev = gc_trace_out;
+  ck_pr_store_ptr(&gc_trace_out, out);
+  pthread_mutex_unlock(&gc_trace_lock);
+  if (prev != NULL && prev != stderr) {
+    fclose(prev);
+  }
+  return 1;
+}
+
+/**
+ * @brief Write a line to the GC trace, if one is being written
+ */
+static void gc_trace_write(const char *line)
+{
+  pthread_mutex_lock(&gc_trace_lock);
+  if (gc_trace_out != NULL) {
+    fputs(line, gc_trace_out);
+    fflush(gc_trace_out);
+  }
+  pthread_mutex_unlock(&gc_trace_lock);
+}
+
+/**
+ * @brief Record statistics for a completed collection cycle
+ *
+ * Called by the collector thread.
+ */
+static void gc_record_cycle(uint64_t clear_mark_ns, uint64_t trace_ns, 
+                            uint64_t sweep_ns)
+{
+  char line[512];
+  ck_pr_add_64(&gc_collector_stats.major_cycles, 1);
+  ck_pr_add_64(&gc_collector_stats.clear_mark_ns, clear_mark_ns);
+  ck_pr_add_64(&gc_collector_stats.trace_ns, trace_ns);
+  ck_pr_add_64(&gc_collector_stats.sweep_ns, sweep_ns);
+  ck_pr_store_64(&gc_collector_stats.last_clear_mark_ns, clear_mark_ns);
+  ck_pr_store_64(&gc_collector_stats.last_trace_ns, trace_ns);
+  ck_pr_store_64(&gc_collector_stats.last_sweep_ns, sweep_ns);
+  if (ck_pr_load_ptr(&gc_trace_out) == NULL) {
+    return;
+  }
+  snprintf(line, sizeof(line), 
+    "{\"event\":\"major\",\"time_ns\":%llu,\"cycle\":%llu,"
+    "\"clear_mark_ns\":%llu,\"trace_ns\":%llu,\"sweep_ns\":%llu,"
+    "\"handshake_wait_ns\":%llu,\"heap_bytes\":%llu}\n",
+    (unsigned long long)(gc_time_ns() - gc_start_ns),
+    (unsigned long long)ck_pr_load_64(&gc_collector_stats.major_cycles),
+    (unsigned long long)clear_mark_ns,
+    (unsigned long long)trace_ns,
+    (unsigned long long)sweep_ns,
+    (unsigned long long)ck_pr_load_64(&gc_collector_stats.handshake_wait_ns),
+    (unsigned long long)ck_pr_load_64(&gc_heap_bytes));
+  gc_trace_write(line);
+}
+
+/**
+ * @brief Write a mutator's statistics to the GC trace, if there is one
+ *
+ * Called by the mutator once it sees that a collection cycle is complete.
+ */
+static void gc_trace_mutator(gc_thread_data *thd)
+{
+  char line[2048];
+  size_t n;
+  int heap_type;
+  gc_stats stats;
+  if (ck_pr_load_ptr(&gc_trace_out) == NULL) {
+    return;
+  }
+  gc_get_stats(thd, &stats);
+  n = snprintf(line, sizeof(line),
+    "{\"event\":\"mutator\",\"time_ns\":%llu,\"cycle\":%llu,"
+    "\"thread\":\"%p\",\"minor_gcs\":%llu,\"minor_gc_ns\":%llu,"
+    "\"bytes_allocated\":[",
+    (unsigned long long)(gc_time_ns() - gc_start_ns),
+    (unsigned long long)stats.major_cycles,
+    (void *)thd,
+    (unsigned long long)stats.minor_gcs,
+    (unsigned long long)stats.minor_gc_ns);
+  for (heap_type = 0; heap_type < NUM_HEAP_TYPES; heap_type++) {
+    n += snprintf(line + n, sizeof(line) - n, "%s%llu", 
+                  heap_type ? "," : "",
+                  (unsigned long long)stats.bytes_allocated[heap_type]);
+  }
+  n += snprintf(line + n, sizeof(line) - n, "],\"pages\":[");
+  for (heap_type = 0; heap_type < NUM_HEAP_TYPES; heap_type++) {
+    n += snprintf(line + n, sizeof(line) - n, "%s%llu", 
+                  heap_type ? "," : "",
+                  (unsigned long long)stats.pages[heap_type]);
+  }
+  snprintf(line + n, sizeof(line) - n, "]}\n");
+  gc_trace_write(line);
+}
+
+/**
+ * @brief Print heap usage information. Before calling this function the 
+ *        current thread must have the heap lock
+ * @param h Heap to analyze.
+ */
+void gc_print_stats(gc_heap * h)
+{
+  gc_free_list *f;
+  unsigned int free, free_chunks, free_min, free_max;
+  int heap_is_empty;
+  for (; h; h = h->next) {
+    free = 0;
+    free_chunks = 0;
+    free_min = h->size;
+    free_max = 0;
+    if (h->free_bits) {
+      // Fixed-size page, every free block is a chunk
+      unsigned int i;
+      if (h->data_end) {
+        free_chunks = h->remaining / h->block_size;
+      } else {
+        for (i = 0; i < h->num_blocks; i++) {
+          if (h->free_bits[i / 64] & ((uint64_t)1 << (i % 64))) {
+            free_chunks++;
+          }
+        }
+      }
+      free = free_chunks * h->block_size;
+      if (free_chunks) {
+        free_min = free_max = h->block_size;
+      }
+    }
+    for (f = h->free_list; f; f = f->next) {
+      free += f->size;
+      free_chunks++;
+      if (f->size < free_min && f->size > 0)
+        free_min = f->size;
+      if (f->size > free_max)
+        free_max = f->size;
+    }
+    if (free == 0){ // No free chunks
+      free_min = 0;
+    }
+    heap_is_empty = gc_is_heap_empty(h);
+    fprintf(stderr,
+            "Heap type=%d, page size=%u, is empty=%d, used=%u, free=%u, free chunks=%u, min=%u, max=%u\n",
+            h->type, h->size, heap_is_empty, h->size - free, free, free_chunks, free_min, free_max);
+  }
+}
+
+/**
+ * @brief Copy given object into given heap object
+ * @param dest  Pointer to destination heap memory slot
+ * @param obj   Object to copy
+ * @param thd   Thread data object for the applicable mutator
+ * @return The appropriate pointer to use for `obj`
+ *
+ * NOTE: There is no additional type checking because this function is
+ * called from `gc_move` which already does that.
+ */
+char *gc_copy_obj(object dest, char *obj, gc_thread_data * thd)
+{
+  #if GC_DEBUG_TRACE
+  allocated_obj_counts[type_of(obj)]++;
+  #endif
 
   switch (type_of(obj)) {
   case closureN_tag:{
@@ -848,6 +2373,7 @@ char *gc_copy_obj(object dest, char *obj, gc_thread_data * thd)
       type_of(hp) = string_tag;
       string_num_cp(hp) = string_num_cp(obj);
       string_len(hp) = string_len(obj);
+      string_cursor(hp) = string_cursor(obj);
       string_str(hp) = s;
       return (char *)hp;
     }
@@ -858,11 +2384,12 @@ char *gc_copy_obj(object dest, char *obj, gc_thread_data * thd)
       hp->value = ((double_type *) obj)->value;
       return (char *)hp;
     }
-  case vector_tag:{
+  case vector_tag:
+  case record_tag:{
       vector_type *hp = dest;
       mark(hp) = thd->gc_alloc_color;
       immutable(hp) = immutable(obj);
-      type_of(hp) = vector_tag;
+      type_of(hp) = type_of(obj);
       hp->num_elements = ((vector) obj)->num_elements;
       hp->elements = (object *) (((char *)hp) + sizeof(vector_type));
       memcpy(hp->elements, ((vector)obj)->elements, sizeof(object *) * hp->num_elements);
@@ -1020,41 +2547,46 @@ gc_heap *gc_grow_heap(gc_heap * h, size_t size, gc_thread_data *thd)
     }
   } else {
     // Grow heap gradually using fibonnaci sequence.
-    size_t prev_size = GROW_HEAP_BY_SIZE;
+    size_t prev_size = gc_scaled_page_size(GC_PARAM_GROW_HEAP_BY_SIZE),
+           max_size = gc_scaled_page_size(GC_PARAM_HEAP_SIZE);
     new_size = 0;
     while (h_last->next) {
-      if (new_size < HEAP_SIZE) {
+      if (new_size < max_size) {
         new_size = prev_size + h_last->size;
         prev_size = h_last->size;
-        if (new_size > HEAP_SIZE) {
-            new_size = HEAP_SIZE;
+        if (new_size > max_size) {
+            new_size = max_size;
             break;
         }
       } else {
-        new_size = HEAP_SIZE;
+        new_size = max_size;
         break;
       }
       h_last = h_last->next;
     }
     if (new_size == 0) {
       new_size = prev_size + h_last->size;
-      if (new_size > HEAP_SIZE) {
-        new_size = HEAP_SIZE;
+      if (new_size > max_size) {
+        new_size = max_size;
       }
     }
     // Fast-track heap page size if allocating a large block
-    if (new_size < size && size < HEAP_SIZE) {
-      new_size = HEAP_SIZE;
+    if (new_size < size && size < max_size) {
+      new_size = max_size;
     }
+    ck_pr_add_64(&gc_heap_grown_bytes, new_size);
 #if GC_DEBUG_TRACE
     fprintf(stderr, "Growing heap %d new page size = %zu\n", h->type,
             new_size);
 #endif
   }
   h_last = gc_heap_last(h_last); // Ensure we don't unlink any heaps
+  if (h == thd->heap->heap[HEAP_REST]) {
+    gc_compact_check(thd, new_size);
+  }
   // Done with computing new page size
   h_new = gc_heap_create(h->type, new_size, thd);
-  h_last->next = h_new;
+  gc_page_link_after(h_last, h_new);
 #if GC_DEBUG_TRACE
   fprintf(stderr, "DEBUG - grew heap\n");
 #endif
@@ -1099,8 +2631,10 @@ void *gc_try_alloc(gc_heap * h, size_t size, char *obj,
         gc_copy_obj(f2, obj, thd);
         // Done after sweep now instead of with each allocation
         h->free_size -= size;
+        thd->page_table->free_size[h->type] -= size;
       } else {
         thd->heap_num_huge_allocations++;
+        thd->heap_huge_allocation_bytes += size;
       }
       return f2;
     }
@@ -1131,58 +2665,302 @@ void gc_start_major_collection(gc_thread_data *thd){
 #if GC_DEBUG_TRACE
     gc_log(stderr, "gc_start_major_collection - initiating collector");
 #endif
-    ck_pr_cas_int(&gc_stage, STAGE_RESTING, STAGE_CLEAR_OR_MARKING);
+    if (ck_pr_cas_int(&gc_stage, STAGE_RESTING, STAGE_CLEAR_OR_MARKING)) {
+      // Wake up the collector thread
+      pthread_mutex_lock(&gc_wake_lock);
+      pthread_cond_signal(&gc_wake_cond);
+      pthread_mutex_unlock(&gc_wake_lock);
+    }
   }
 }
 
-void *gc_try_alloc_slow(gc_heap *h_passed, gc_heap *h, size_t size, char *obj, gc_thread_data *thd)
+/////////////////////////////////////////////
+// Background sweeping
+
+/**
+ * @brief Set the number of background threads used to sweep heap pages
+ * @param n Number of sweeper threads, 0 to only sweep lazily from the allocator
+ *
+ * Sweeper threads are spawned lazily the next time a mutator hands off
+ * pages to be swept.
+ */
+void gc_set_sweep_threads(int n)
+{
+  if (n < 0) {
+    n = 0;
+  } else if (n > GC_MAX_SWEEP_THREADS) {
+    n = GC_MAX_SWEEP_THREADS;
+  }
+  ck_pr_store_int(&gc_sweep_threads, n);
+}
+
+/**
+ * @brief Get the number of background threads used to sweep heap pages
+ * @return Number of sweeper threads
+ */
+int gc_get_sweep_threads(void)
+{
+  return ck_pr_load_int(&gc_sweep_threads);
+}
+
+/**
+ * @brief Push a page onto one of a mutator's lock-free page stacks
+ * @param stack Stack to receive the page
+ * @param h     Page, which must not be linked into any heap
+ *
+ * Any number of sweepers may push concurrently, but only the owning 
+ * mutator ever removes pages, and it always takes the whole stack at
+ * once. So there is no ABA problem to worry about here.
+ */
+static void gc_page_stack_push(gc_heap **stack, gc_heap *h)
+{
+  gc_heap *top;
+  do {
+    top = ck_pr_load_ptr(stack);
+    h->next = top;
+  } while (!ck_pr_cas_ptr(stack, top, h));
+}
+
+/**
+ * @brief Sweep a single page on behalf of its owner
+ * @param thd Thread data for the mutator owning the page
+ * @param h   Page to sweep
+ *
+ * Sweeping uses the owner's mark colors, which are only stable outside of
+ * the collector's clear, mark, and trace stages. The in-flight count lets
+ * the collector wait for us before it changes any colors, and if a
+ * collection is already under way the page is returned unswept and the 
+ * owner will sweep it lazily instead.
+ */
+static void gc_sweep_page_in_background(gc_thread_data *thd, gc_heap *h)
+{
+  gc_heap *keep = h;
+  int stage, swept = 0;
+  ck_pr_inc_int(&sweep_in_flight);
+  // Pairs with the fence in gc_wait_for_sweepers, either the collector 
+  // sees this sweep in flight or we see its new stage
+  ck_pr_fence_memory();
+  stage = ck_pr_load_int(&gc_stage);
+  if ((stage == STAGE_RESTING || stage == STAGE_SWEEPING) &&
+      !gc_is_heap_empty(h)) {
+    if (h->type <= LAST_FIXED_SIZE_HEAP_TYPE) {
+      keep = gc_sweep_fixed_size(h, thd);
+    } else {
+      keep = gc_sweep(h, thd);
+    }
+    swept = 1;
+  }
+  ck_pr_dec_int(&sweep_in_flight);
+
+  if (!keep) {
+    gc_page_stack_push(&(thd->released_pages), h);
+  } else {
+    if (swept) {
+      h->is_unswept = 2;
+    }
+    gc_page_stack_push(&(thd->swept_pages[h->type]), h);
+  }
+}
+
+/**
+ * @brief Main loop for a background sweeper thread
+ */
+static void *gc_sweeper_main(void *arg)
+{
+  gc_sweep_job *job;
+  gc_heap *h, *next;
+  while (1) {
+    pthread_mutex_lock(&sweep_pool_lock);
+    while (sweep_jobs == NULL) {
+      pthread_cond_wait(&sweep_pool_cond, &sweep_pool_lock);
+    }
+    job = sweep_jobs;
+    sweep_jobs = job->next;
+    pthread_mutex_unlock(&sweep_pool_lock);
+
+    for (h = job->pages; h; h = next) {
+      next = h->next;
+      gc_sweep_page_in_background(job->thd, h);
+    }
+    // Must be last, the owner may be waiting on this to free its data
+    ck_pr_dec_int(&(job->thd->sweep_jobs_pending));
+    free(job);
+  }
+  return NULL;
+}
+
+/**
+ * @brief Queue a list of pages to be swept in the background
+ * @param thd   Thread data for the mutator owning the pages
+ * @param pages Pages to sweep, linked via their `next` field
+ */
+static void gc_sweep_pool_submit(gc_thread_data *thd, gc_heap *pages)
+{
+  gc_sweep_job *job = malloc(sizeof(gc_sweep_job));
+  pthread_t thread;
+  job->thd = thd;
+  job->pages = pages;
+  ck_pr_inc_int(&(thd->sweep_jobs_pending));
+
+  pthread_mutex_lock(&sweep_pool_lock);
+  while (sweep_helpers_started < ck_pr_load_int(&gc_sweep_threads)) {
+    if (pthread_create(&thread, NULL, gc_sweeper_main, NULL)) {
+      fprintf(stderr, "Error creating sweeper thread\n");
+      exit(1);
+    }
+    pthread_detach(thread);
+    sweep_helpers_started++;
+  }
+  job->next = sweep_jobs;
+  sweep_jobs = job;
+  pthread_cond_signal(&sweep_pool_cond);
+  pthread_mutex_unlock(&sweep_pool_lock);
+}
+
+/**
+ * @brief Hand off a mutator's unswept pages to the background sweepers
+ * @param thd  Mutator's thread data
+ * @param type Heap type
+ * @return Number of unswept pages still left in the heap
+ *
+ * Called by the mutator once the collector is done tracing. The first 
+ * page of each heap always stays with the mutator, every other page that 
+ * needs a sweep is unlinked and sent off in batches of `GC_SWEEP_JOB_PAGES`.
+ */
+static int gc_sweep_pool_handoff(gc_thread_data *thd, int type)
+{
+  gc_heap *h_head = thd->heap->heap[type], *h_prev, *h, *batch = NULL;
+  int unswept = 0, batch_len = 0;
+  if (!h_head) {
+    return 0;
+  }
+  if (h_head->is_full == 1) {
+    h_head->is_full = 0;
+    h_head->is_unswept = 1;
+  }
+  if (h_head->is_unswept) {
+    unswept++;
+  }
+  h_prev = h_head;
+  for (h = h_head->next; h; h = h_prev->next) {
+    if (h->is_full == 1 || h->is_unswept) {
+      gc_page_unlink(h);
+      gc_page_avail_remove(thd->page_table, h);
+      h->is_full = 0;
+      h->is_unswept = 1;
+      h->next = batch;
+      batch = h;
+      thd->cached_heap_sweep_sizes[type] += h->size;
+      unswept++;
+      if (++batch_len == GC_SWEEP_JOB_PAGES) {
+        gc_sweep_pool_submit(thd, batch);
+        batch = NULL;
+        batch_len = 0;
+      }
+    } else {
+      h_prev = h;
+    }
+  }
+  if (batch) {
+    gc_sweep_pool_submit(thd, batch);
+  }
+  // Do not leave the allocator pointing at a page we no longer own
+  h_head->next_free = h_head;
+  return unswept;
+}
+
+/**
+ * @brief Take back any pages the background sweepers are done with
+ * @param thd Mutator's thread data
+ * @return Number of pages added back to the mutator's heaps
+ *
+ * Only the owning mutator may call this function. Swept pages are linked 
+ * in right after the first page of the heap so the allocator finds them
+ * quickly, and empty pages are freed.
+ */
+static int gc_collect_swept_pages(gc_thread_data *thd)
+{
+  gc_heap *h, *next, *h_head;
+  int type, count = 0;
+  for (type = 0; type < NUM_HEAP_TYPES; type++) {
+    if (ck_pr_load_ptr(&(thd->swept_pages[type])) == NULL) {
+      continue;
+    }
+    h_head = thd->heap->heap[type];
+    for (h = ck_pr_fas_ptr(&(thd->swept_pages[type]), NULL); h; h = next) {
+      next = h->next;
+      gc_page_link_after(h_head, h);
+      thd->cached_heap_sweep_sizes[type] -= h->size;
+      gc_page_attach(thd->page_table, h);
+      count++;
+    }
+  }
+  if (ck_pr_load_ptr(&(thd->released_pages)) != NULL) {
+    for (h = ck_pr_fas_ptr(&(thd->released_pages), NULL); h; h = next) {
+      next = h->next;
+#if GC_DEBUG_TRACE
+      fprintf(stderr, "DEBUG freeing heap type %d page at addr: %p\n", h->type, h);
+#endif
+      thd->heap->heap[h->type]->num_unswept_children--;
+      thd->cached_heap_sweep_sizes[h->type] -= h->size;
+      thd->cached_heap_total_sizes[h->type] -= h->size;
+      gc_heap_release(h);
+    }
+  }
+  return count;
+}
+
+/**
+ * @brief Wait for background sweepers to finish any page they are working on
+ *
+ * Called by the collector after the start of a new cycle, before any mark 
+ * colors are changed.
+ */
+static void gc_wait_for_sweepers(void)
+{
+  // Order the stage change before reading the in-flight count, see 
+  // gc_sweep_page_in_background
+  ck_pr_fence_memory();
+  while (ck_pr_load_int(&sweep_in_flight) > 0) {
+    sched_yield();
+  }
+}
+
+void *gc_try_alloc_slow(gc_heap *h_passed, gc_heap *h, size_t size, char *obj, gc_thread_data *thd)
 {
 #ifdef CYC_HIGH_RES_TIMERS
 long long tstamp = hrt_get_current();
 #endif
-  gc_heap *h_start = h, *h_prev;
+  gc_page_table *pt = thd->page_table;
+  int type = h_passed->type;
   void *result = NULL;
-  // Find next heap
-  while (result == NULL) {
-    h_prev = h;
-    h = h->next;
-    if (h == NULL) {
-      // Wrap around to the first heap block
-      h_prev = NULL;
-      h = h_passed;
-    }
-    if (h == h_start) {
-      // Tried all and no heap exists with free space
-      break;
-    }
+  // Take pages with free space from the page table until one works
+  while (result == NULL && pt->avail_len[type] > 0) {
+    h = pt->avail[type][pt->avail_len[type] - 1];
     // check allocation status to make sure we can use it
-    if (h->is_full) {
-      continue; // Cannot sweep until next GC cycle
-    } else if (h->is_unswept == 1 && !gc_is_heap_empty(h)) { // TODO: empty function does not support fixed-size heaps yet
-      unsigned int h_size = h->size;
-      //unsigned int prev_free_size = h->free_size;
-      //if (h->is_unswept == 1) {
-      //  prev_free_size = h_size; // Full size was cached
-      //}
-      gc_heap *keep = gc_sweep(h, thd); // Clean up garbage objects
+    if (h->is_unswept == 1) {
+      uint64_t prev_free_size = gc_page_free_size(h);
+      if (gc_is_heap_empty(h)) {
+        // Nothing to sweep
+        h->is_unswept = 0;
+        pt->free_size[type] += gc_page_free_size(h) - prev_free_size;
+      } else {
+        unsigned int h_size = h->size;
+        gc_heap *keep = gc_sweep(h, thd); // Clean up garbage objects
 #ifdef CYC_HIGH_RES_TIMERS
 fprintf(stderr, "sweep heap %p \n", h);
 hrt_log_delta("gc sweep", tstamp);
 #endif
-      h_passed->num_unswept_children--;
-      if (!keep) {
+        h_passed->num_unswept_children--;
+        pt->free_size[type] += gc_page_free_size(h) - prev_free_size;
+        if (!keep && h != h_passed) {
 #if GC_DEBUG_TRACE
   fprintf(stderr, "heap %p marked for deletion\n", h);
 #endif
-        // Heap marked for deletion, remove it and keep searching
-        gc_heap *freed = gc_heap_free(h, h_prev);
-        if (freed) {
-          if (h_prev) {
-            h = h_prev;
-          } else {
-            h = h_passed;
-          }
-          thd->cached_heap_total_sizes[h->type] -= h_size;
+          // Heap marked for deletion, remove it and keep searching
+          gc_page_detach(pt, h);
+          gc_heap_free(h, h->prev);
+          thd->cached_heap_total_sizes[type] -= h_size;
           continue;
         }
       }
@@ -1193,7 +2971,7 @@ hrt_log_delta("gc sweep", tstamp);
       h_passed->last_alloc_size = size;
     } else {
       // TODO: else, assign heap full? YES for fixed-size, for REST maybe not??
-      h->is_full = 1;
+      gc_page_set_full(pt, h);
 #if GC_DEBUG_TRACE
   fprintf(stderr, "heap %p is full\n", h);
 #endif
@@ -1215,11 +2993,20 @@ hrt_log_delta("gc sweep", tstamp);
  */
 static void *gc_try_alloc_fixed_size(gc_heap * h, size_t size, char *obj, gc_thread_data * thd)
 {
-    void *result;
-
-    if (h->free_list) {
-      result = h->free_list;
-      h->free_list = h->free_list->next;
+    void *result = NULL;
+
+    if (h->data_end == NULL) {
+      // Swept page, take the first free block from the bitmap
+      unsigned int w, words = gc_bitmap_words(h->num_blocks);
+      for (w = h->free_cursor; w < words; w++) {
+        uint64_t bits = h->free_bits[w];
+        if (bits) {
+          h->free_bits[w] = bits & (bits - 1);
+          result = h->data + (((w * 64) + gc_bitmap_lowest_bit(bits)) * h->block_size);
+          break;
+        }
+      }
+      h->free_cursor = w;
     } else if (h->remaining) {
       h->remaining -= h->block_size;
       result = h->data_end - h->remaining - h->block_size;
@@ -1236,8 +3023,14 @@ static void *gc_try_alloc_fixed_size(gc_heap * h, size_t size, char *obj, gc_thr
       }
       #endif
       gc_copy_obj(result, obj, thd);
+#if GC_SIDE_MARK_BITS
+      if (h->alloc_bits[0]) {
+        gc_side_set_alloc(h, result, thd);
+      }
+#endif
 
-      h->free_size -= size;
+      h->free_size -= h->block_size;
+      thd->page_table->free_size[h->type] -= h->block_size;
       return result;
     }
     return NULL;
@@ -1248,45 +3041,36 @@ void *gc_try_alloc_slow_fixed_size(gc_heap *h_passed, gc_heap *h, size_t size, c
 #ifdef CYC_HIGH_RES_TIMERS
 long long tstamp = hrt_get_current();
 #endif
-  gc_heap *h_start = h, *h_prev;
+  gc_page_table *pt = thd->page_table;
+  int type = h_passed->type;
   void *result = NULL;
-  // Find next heap
-  while (result == NULL) {
-    h_prev = h;
-    h = h->next;
-    if (h == NULL) {
-      // Wrap around to the first heap block
-      h_prev = NULL;
-      h = h_passed;
-    }
-    if (h == h_start) {
-      // Tried all and no heap exists with free space
-      break;
-    }
+  // Take pages with free space from the page table until one works
+  while (result == NULL && pt->avail_len[type] > 0) {
+    h = pt->avail[type][pt->avail_len[type] - 1];
     // check allocation status to make sure we can use it
-    if (h->is_full) {
-      continue; // Cannot sweep until next GC cycle
-    } else if (h->is_unswept == 1 && !gc_is_heap_empty(h)) {
-      unsigned int h_size = h->size;
-      gc_heap *keep = gc_sweep_fixed_size(h, thd); // Clean up garbage objects
+    if (h->is_unswept == 1) {
+      uint64_t prev_free_size = gc_page_free_size(h);
+      if (gc_is_heap_empty(h)) {
+        // Nothing to sweep
+        h->is_unswept = 0;
+        pt->free_size[type] += gc_page_free_size(h) - prev_free_size;
+      } else {
+        unsigned int h_size = h->size;
+        gc_heap *keep = gc_sweep_fixed_size(h, thd); // Clean up garbage objects
 #ifdef CYC_HIGH_RES_TIMERS
 fprintf(stderr, "sweep fixed size heap %p size %lu \n", h, size);
-hrt_log_delta("gc sweep fixed size", tstamp);
+hrt_log_delta("gc sweep", tstamp);
 #endif
-      h_passed->num_unswept_children--;
-      if (!keep) {
+        h_passed->num_unswept_children--;
+        pt->free_size[type] += gc_page_free_size(h) - prev_free_size;
+        if (!keep && h != h_passed) {
 #if GC_DEBUG_TRACE
   fprintf(stderr, "heap %p marked for deletion\n", h);
 #endif
-        // Heap marked for deletion, remove it and keep searching
-        gc_heap *freed = gc_heap_free(h, h_prev);
-        if (freed) {
-          if (h_prev) {
-            h = h_prev;
-          } else {
-            h = h_passed;
-          }
-          thd->cached_heap_total_sizes[h->type] -= h_size;
+          // Heap marked for deletion, remove it and keep searching
+          gc_page_detach(pt, h);
+          gc_heap_free(h, h->prev);
+          thd->cached_heap_total_sizes[type] -= h_size;
           continue;
         }
       }
@@ -1297,7 +3081,7 @@ hrt_log_delta("gc sweep fixed size", tstamp);
       h_passed->last_alloc_size = size;
     } else {
       // TODO: else, assign heap full? YES for fixed-size, for REST maybe not??
-      h->is_full = 1;
+      gc_page_set_full(pt, h);
 #if GC_DEBUG_TRACE
   fprintf(stderr, "heap %p is full\n", h);
 #endif
@@ -1316,11 +3100,19 @@ void *gc_alloc_bignum(gc_thread_data *data)
   int heap_grown, result;
   bignum_type *bn;
   bignum_type tmp;
-  // No need to do this since tmp is always local
-  //tmp.hdr.mark = gc_color_red;
-  //tmp.hdr.grayed = 0;
-  tmp.tag = bignum_tag;
-  bn = gc_alloc(((gc_thread_data *)data)->heap, sizeof(bignum_type), (char *)(&tmp), (gc_thread_data *)data, &heap_grown);
+  bn = gc_alloc_buffered(data, sizeof(bignum_type));
+  if (bn) {
+    bn->hdr.mark = data->gc_alloc_color;
+    bn->hdr.grayed = 0;
+    bn->hdr.immutable = 0;
+    bn->tag = bignum_tag;
+  } else {
+    // No need to do this since tmp is always local
+    //tmp.hdr.mark = gc_color_red;
+    //tmp.hdr.grayed = 0;
+    tmp.tag = bignum_tag;
+    bn = gc_alloc(((gc_thread_data *)data)->heap, sizeof(bignum_type), (char *)(&tmp), (gc_thread_data *)data, &heap_grown);
+  }
 
   if ((result = mp_init(&bignum_value(bn))) != MP_OKAY) {
      fprintf(stderr, "Error initializing number %s",
@@ -1343,6 +3135,284 @@ void *gc_alloc_from_bignum(gc_thread_data *data, bignum_type *src)
 }
 
 
+/**
+ * @brief Hand any unused part of an allocation buffer back to its page
+ * @param thd       The mutator's thread data object
+ * @param heap_type Fixed-size heap type of the buffer
+ *
+ * The space used by the buffer is only accounted for here, once per
+ * buffer instead of once per object.
+ */
+static void gc_alloc_buffer_release(gc_thread_data *thd, int heap_type)
+{
+  gc_alloc_buffer *b = &(thd->alloc_buffers[heap_type]);
+  gc_heap *h = b->page;
+  uint64_t used;
+  if (h) {
+#if GC_SIDE_MARK_BITS
+    // Record the new objects now that they have been filled in
+    if (h->alloc_bits[0]) {
+      char *p;
+      uint64_t bits;
+      for (p = b->start; p && p < b->cur; p += b->block_size) {
+        gc_side_set_alloc(h, p, thd);
+      }
+      for (bits = b->taken & ~(b->free); bits; bits &= (bits - 1)) {
+        p = b->base + (gc_bitmap_lowest_bit(bits) * b->block_size);
+        gc_side_set_alloc(h, p, thd);
+      }
+    }
+#endif
+    if (b->start) {
+      used = b->cur - b->start;
+      h->remaining = b->end - b->cur;
+    } else {
+      used = (uint64_t)gc_bitmap_count(b->taken & ~(b->free)) * b->block_size;
+      h->free_bits[b->word] |= b->free;
+      if (b->word < h->free_cursor) {
+        h->free_cursor = b->word;
+      }
+    }
+    h->free_size -= used;
+    thd->page_table->free_size[heap_type] -= used;
+    b->page = NULL;
+    b->start = b->cur = b->end = b->base = NULL;
+    b->free = b->taken = 0;
+  }
+}
+
+/**
+ * @brief Refill an allocation buffer from the page the heap is allocating from
+ * @param thd       The mutator's thread data object
+ * @param heap_type Fixed-size heap type of the buffer
+ * @return `1` if the buffer now has free blocks, `0` otherwise
+ *
+ * On a fresh (bump&pop) page the buffer takes the rest of the page's bump
+ * region, and on a swept page it takes the next word of the free bitmap
+ * that has any free blocks. Either way that space is not available to 
+ * `gc_alloc` until the buffer is released.
+ */
+static int gc_alloc_buffer_refill(gc_thread_data *thd, int heap_type)
+{
+  gc_alloc_buffer *b = &(thd->alloc_buffers[heap_type]);
+  gc_heap *h = thd->heap->heap[heap_type]->next_free;
+  gc_alloc_buffer_release(thd, heap_type);
+  if (h->is_unswept || h->is_full) {
+    return 0;
+  }
+  if (h->data_end) {
+    if (h->remaining == 0) {
+      return 0;
+    }
+    b->start = b->cur = h->data_end - h->remaining;
+    b->end = h->data_end;
+    h->remaining = 0;
+  } else {
+    unsigned int w, words = gc_bitmap_words(h->num_blocks);
+    for (w = h->free_cursor; w < words && !h->free_bits[w]; w++) ;
+    h->free_cursor = w;
+    if (w == words) {
+      return 0;
+    }
+    b->free = b->taken = h->free_bits[w];
+    b->base = h->data + (w * 64 * h->block_size);
+    b->word = w;
+    h->free_bits[w] = 0;
+  }
+  b->page = h;
+  b->block_size = h->block_size;
+  return 1;
+}
+
+/**
+ * @brief Release all of a mutator's allocation buffers
+ * @param thd  The mutator's thread data object
+ *
+ * Called at the end of every minor GC, and before anything else that
+ * needs up to date free space counts for the thread's pages.
+ */
+void gc_alloc_buffers_flush(gc_thread_data * thd)
+{
+  int heap_type;
+  for (heap_type = 0; heap_type <= LAST_FIXED_SIZE_HEAP_TYPE; heap_type++) {
+    gc_alloc_buffer_release(thd, heap_type);
+  }
+}
+
+/**
+ * @brief Determine if an object may be allocated in an arena
+ *
+ * Arena pages are freed without being swept, so objects that have to be
+ * finalized when they are freed always go on the thread's heap.
+ */
+static int gc_arena_accepts(object obj)
+{
+  switch (type_of(obj)) {
+  case mutex_tag:
+  case cond_var_tag:
+  case bignum_tag:
+    return 0;
+  case c_opaque_tag:
+    return !opaque_collect_ptr(obj);
+  default:
+    return 1;
+  }
+}
+
+/**
+ * @brief Determine if an object may be allocated in the young heap
+ * @param obj  Object to allocate
+ * @param size Aligned size of the object
+ *
+ * Besides the objects an arena does not take, atoms are always shared
+ * with other threads and huge objects are too large to copy.
+ */
+static int gc_young_accepts(object obj, size_t size)
+{
+  return size < MAX_STACK_OBJ && 
+         type_of(obj) != atomic_tag && 
+         gc_arena_accepts(obj);
+}
+
+/**
+ * @brief Add a page to an arena
+ * @param thd       The mutator's thread data object
+ * @param a         Arena to grow
+ * @param heap_type Heap type of the page
+ * @param size      Size of the object the page is needed for
+ * @return The new page, which is the one the arena now allocates from
+ *
+ * Each page of a heap type is twice the size of the previous one, up to
+ * the size of a full heap page, or `GC_YOUNG_PAGE_SIZE` for the young 
+ * heap. Huge objects get a page of their own. Spare pages of the young
+ * heap are used first.
+ */
+static gc_heap *gc_arena_grow(gc_thread_data *thd, gc_arena *a, int heap_type, size_t size)
+{
+  gc_heap *h = a->pages[heap_type];
+  size_t new_size;
+  if (a->spare[heap_type] && 
+      (heap_type <= LAST_FIXED_SIZE_HEAP_TYPE || 
+       a->spare[heap_type]->size >= size * 2)) {
+    h = a->spare[heap_type];
+    a->spare[heap_type] = h->next;
+    h->next = a->pages[heap_type];
+    a->pages[heap_type] = h;
+    return h;
+  }
+  if (heap_type == HEAP_HUGE) {
+    new_size = size + 128;
+  } else {
+    size_t max_size = (a->depth == 0) ? GC_YOUNG_PAGE_SIZE :
+                        gc_scaled_page_size(GC_PARAM_HEAP_SIZE);
+    new_size = h ? h->size * 2 : GC_ARENA_PAGE_SIZE;
+    if (new_size > max_size) {
+      new_size = max_size;
+    }
+    if (new_size < size * 2) {
+      new_size = size * 2;
+    }
+  }
+  h = gc_heap_create(heap_type, new_size, thd);
+  if (!h) {
+    fprintf(stderr, "out of memory error allocating %zu bytes\n", size);
+    exit(1);
+  }
+  // The page is not part of the thread's heap unless the arena escapes
+  if (thd->page_table) {
+    gc_page_detach(thd->page_table, h);
+  }
+  thd->cached_heap_total_sizes[heap_type] -= h->size;
+  thd->cached_heap_free_sizes[heap_type] -= h->size;
+  h->arena = a;
+  h->next = a->pages[heap_type];
+  a->pages[heap_type] = h;
+  return h;
+}
+
+/**
+ * @brief Take a block from the unused end of an arena page
+ * @param h    Arena page
+ * @param size Aligned size of the object
+ * @return The block, or `NULL` if the page is full
+ *
+ * Arena pages are only ever allocated from this way, so a fixed-size page
+ * is always bump&pop and any other page has a single free chunk.
+ */
+static void *gc_arena_try_alloc(gc_heap *h, size_t size)
+{
+  gc_free_list *f1, *f2, *f3;
+  if (h->data_end) {
+    if (h->remaining == 0) {
+      return NULL;
+    }
+    h->remaining -= h->block_size;
+    h->free_size -= h->block_size;
+    return h->data_end - h->remaining - h->block_size;
+  }
+  f1 = h->free_list;
+  f2 = f1->next;
+  if (!f2 || f2->size < size) {
+    return NULL;
+  }
+  if (f2->size >= (size + gc_heap_align(1))) {
+    f3 = (gc_free_list *) (((char *)f2) + size);
+    f3->size = f2->size - size;
+    f3->next = f2->next;
+    f1->next = f3;
+  } else {
+    f1->next = f2->next;
+  }
+  if (h->type != HEAP_HUGE) {
+    h->free_size -= size;
+  }
+  return f2;
+}
+
+/**
+ * @brief Allocate memory in an arena for an object
+ * @param thd   The requesting mutator's thread data object
+ * @param a     The thread's active arena
+ * @param size  Aligned size of the object
+ * @param obj   Object containing data to copy to the arena
+ * @return Pointer to the new object
+ *
+ * As with `gc_alloc`, huge objects are not copied and must be filled in
+ * by the caller.
+ */
+static void *gc_arena_alloc(gc_thread_data *thd, gc_arena *a, size_t size, char *obj)
+{
+  int heap_type;
+  gc_heap *h;
+  void *result = NULL;
+  if (size <= GC_MAX_SIZE_CLASS) {
+    heap_type = gc_heap_type_by_blocks[size >> GC_BLOCK_BITS];
+  } else if (size >= MAX_STACK_OBJ) {
+    heap_type = HEAP_HUGE;
+  } else {
+    heap_type = HEAP_REST;
+  }
+  h = a->pages[heap_type];
+  if (h && heap_type != HEAP_HUGE) {
+    result = gc_arena_try_alloc(h, size);
+  }
+  if (!result) {
+    h = gc_arena_grow(thd, a, heap_type, size);
+    result = gc_arena_try_alloc(h, size);
+  }
+  if (heap_type != HEAP_HUGE) {
+    gc_copy_obj(result, obj, thd);
+#if GC_SIDE_MARK_BITS
+    if (h->alloc_bits[0]) {
+      gc_side_set_alloc(h, result, thd);
+    }
+#endif
+  }
+  thd->stats_bytes_allocated[heap_type] += size;
+  return result;
+}
+
+
 /**
  * @brief Allocate memory on the heap for an object
  * @param hrt   The root of the heap to allocate from
@@ -1354,7 +3424,9 @@ void *gc_alloc_from_bignum(gc_thread_data *data, bignum_type *src)
  * @return Pointer to the heap object
  *
  * This function will attempt to grow the heap if it is full, and will
- * terminate the program if the OS is out of memory.
+ * terminate the program if the OS is out of memory. Small objects are 
+ * bump allocated from the thread's allocation buffer for their size 
+ * class whenever possible, see `gc_alloc_buffered`.
  */
 void *gc_alloc(gc_heap_root * hrt, size_t size, char *obj, gc_thread_data * thd,
                int *heap_grown)
@@ -1365,31 +3437,29 @@ void *gc_alloc(gc_heap_root * hrt, size_t size, char *obj, gc_thread_data * thd,
   void *(*try_alloc)(gc_heap * h, size_t size, char *obj, gc_thread_data * thd);
   void *(*try_alloc_slow)(gc_heap *h_passed, gc_heap *h, size_t size, char *obj, gc_thread_data *thd);
   size = gc_heap_align(size);
-  if (size <= 32) {
-    heap_type = HEAP_SM;
-    //try_alloc = &gc_try_alloc;
-    //try_alloc_slow = &gc_try_alloc_slow;
-    // TODO:
-    try_alloc = &gc_try_alloc_fixed_size;
-    try_alloc_slow = &gc_try_alloc_slow_fixed_size;
-  } else if (size <= 64) {
-    heap_type = HEAP_64;
-    //try_alloc = &gc_try_alloc;
-    //try_alloc_slow = &gc_try_alloc_slow;
-    // TODO:
-    try_alloc = &gc_try_alloc_fixed_size;
-    try_alloc_slow = &gc_try_alloc_slow_fixed_size;
-// Only use this heap on 64-bit platforms, where larger objs are used more often
-// Code from http://stackoverflow.com/a/32717129/101258
-#if INTPTR_MAX == INT64_MAX
-  } else if (size <= 96) {
-    heap_type = HEAP_96;
-    //try_alloc = &gc_try_alloc;
-    //try_alloc_slow = &gc_try_alloc_slow;
-    // TODO:
+  if (thd->arena && gc_arena_accepts(obj)) {
+    return gc_arena_alloc(thd, thd->arena, size, obj);
+  } else if (thd->young && gc_young_accepts(obj, size)) {
+    result = gc_arena_alloc(thd, &(thd->young->region), size, obj);
+    pinned(result) = 0;
+    thd->young->allocated += size;
+    return result;
+  }
+  if (size <= GC_MAX_SIZE_CLASS) {
+    heap_type = gc_heap_type_by_blocks[size >> GC_BLOCK_BITS];
+    // Fast path, take a block from the thread's allocation buffer
+    if (!thd->arena) {
+      result = gc_alloc_buffered(thd, size);
+      if (!result && gc_alloc_buffer_refill(thd, heap_type)) {
+        result = gc_alloc_buffered(thd, size);
+      }
+      if (result) {
+        gc_copy_obj(result, obj, thd);
+        return result;
+      }
+    }
     try_alloc = &gc_try_alloc_fixed_size;
     try_alloc_slow = &gc_try_alloc_slow_fixed_size;
-#endif
   } else if (size >= MAX_STACK_OBJ) {
     heap_type = HEAP_HUGE;
     try_alloc = &gc_try_alloc;
@@ -1415,7 +3485,7 @@ void *gc_alloc(gc_heap_root * hrt, size_t size, char *obj, gc_thread_data * thd,
     h_passed->last_alloc_size = size;
   } else {
     // Slow path, find another heap block
-    h->is_full = 1;
+    gc_page_set_full(thd->page_table, h);
     result = try_alloc_slow(h_passed, h, size, obj, thd);
 #if GC_DEBUG_VERBOSE
 fprintf(stderr, "slow alloc of %p\n", result);
@@ -1425,7 +3495,8 @@ fprintf(stderr, "slow alloc of %p\n", result);
       if (heap_type != HEAP_HUGE && 
         (//(try_alloc == &gc_try_alloc_fixed_size && // Fixed-size object heap
          // h_passed->num_unswept_children < (GC_COLLECT_UNDER_UNSWEPT_HEAP_COUNT * 128)) ||
-         h_passed->num_unswept_children < GC_COLLECT_UNDER_UNSWEPT_HEAP_COUNT)) {
+         h_passed->num_unswept_children < 
+           gc_param(GC_PARAM_COLLECT_UNDER_UNSWEPT_HEAP_COUNT))) {
 //           gc_num_unswept_heaps(h_passed) < GC_COLLECT_UNDER_UNSWEPT_HEAP_COUNT)){
 //        printf("major collection heap_type = %d h->num_unswept = %d, computed = %d\n", heap_type,  h_passed->num_unswept_children, gc_num_unswept_heaps(h_passed));
         //if (h_passed->num_unswept_children != gc_num_unswept_heaps(h_passed)) {
@@ -1458,6 +3529,15 @@ fprintf(stderr, "slowest alloc of %p\n", result);
     }
   }
 
+  thd->stats_bytes_allocated[heap_type] += size;
+
+  // Huge pages are only released by a collection, so start one as soon
+  // as a lot of memory has gone into them
+  if (heap_type == HEAP_HUGE &&
+      thd->heap_huge_allocation_bytes > GC_COLLECT_HUGE_BYTES) {
+    gc_start_major_collection(thd);
+  }
+
 #if GC_DEBUG_TRACE
   allocated_heap_counts[heap_type]++;
 #endif
@@ -1475,1039 +3555,3161 @@ fprintf(stderr, "slowest alloc of %p\n", result);
 }
 
 /**
- * @brief Get the number of bytes that will be allocated for `obj`.
- * @param obj Object to inspect
- * @param q   Previous free list pointer, set to `NULL` if not applicable
- * @param r   Next free list pointer, set to `NULL` if not applicable
- * @return Number of bytes, including any needed for alignment
+ * @brief Start allocating objects in a new arena
+ * @param thd  The mutator's thread data object
+ * @return Nesting depth of the new arena, to pass to `gc_arena_end`
+ *
+ * Until the arena ends, every object the thread moves to the heap is 
+ * allocated in the arena instead. The thread's stack should be empty of
+ * objects from before the arena began, for example by running a minor 
+ * GC first, or they will be moved into the arena along with new objects.
  */
-size_t gc_allocated_bytes(object obj, gc_free_list * q, gc_free_list * r)
+static void gc_young_promote(gc_thread_data *thd);
+
+int gc_arena_begin(gc_thread_data * thd)
 {
-  tag_type t;
-#if GC_SAFETY_CHECKS
-  if (is_value_type(obj)) {
-    fprintf(stderr,
-            "gc_allocated_bytes - passed value type %p q=[%p, %d] r=[%p, %d]\n",
-            obj, q, q->size, r, r->size);
+  gc_arena *a = calloc(1, sizeof(gc_arena));
+  if (!a) {
+    fprintf(stderr, "Unable to allocate arena\n");
     exit(1);
   }
-#endif
-  t = type_of(obj);
-  if (t == pair_tag)
-    return gc_heap_align(sizeof(pair_type));
-  if (t == closureN_tag) {
-    return gc_heap_align(sizeof(closureN_type) +
-                         sizeof(object) * 
-                         ((closureN_type *) obj)->num_elements);
-  }
-  if (t == double_tag)
-    return gc_heap_align(sizeof(double_type));
-  if (t == closure1_tag)
-    return gc_heap_align(sizeof(closure1_type));
-  if (t == string_tag) {
-    return gc_heap_align(sizeof(string_type) + string_len(obj) + 1);
-  }
-  if (t == vector_tag) {
-    return gc_heap_align(sizeof(vector_type) +
-                         sizeof(object) * ((vector_type *) obj)->num_elements);
+  if (thd->young) {
+    gc_young_promote(thd);
   }
-  if (t == bytevector_tag) {
-    return gc_heap_align(sizeof(bytevector_type) +
-                         sizeof(char) * ((bytevector) obj)->len);
-  }
-  if (t == macro_tag)
-    return gc_heap_align(sizeof(macro_type));
-  if (t == bignum_tag)
-    return gc_heap_align(sizeof(bignum_type));
-  if (t == port_tag)
-    return gc_heap_align(sizeof(port_type));
-  if (t == cvar_tag)
-    return gc_heap_align(sizeof(cvar_type));
-  if (t == c_opaque_tag)
-    return gc_heap_align(sizeof(c_opaque_type));
-  if (t == mutex_tag)
-    return gc_heap_align(sizeof(mutex_type));
-  if (t == cond_var_tag)
-    return gc_heap_align(sizeof(cond_var_type));
-  if (t == atomic_tag)
-    return gc_heap_align(sizeof(atomic_type));
-  if (t == integer_tag)
-    return gc_heap_align(sizeof(integer_type));
-  if (t == complex_num_tag)
-    return gc_heap_align(sizeof(complex_num_type));
+  a->parent = thd->arena;
+  a->depth = a->parent ? a->parent->depth + 1 : 1;
+  thd->arena = a;
+  return a->depth;
+}
 
-  fprintf(stderr, "gc_allocated_bytes: unexpected object %p of type %d\n", obj,
-          t);
-  exit(1);
+/**
+ * @brief Find the arena an object was allocated in
+ * @return The arena, or `NULL` if the object is not in one
+ */
+static gc_arena *gc_arena_of(object obj)
+{
+  gc_heap *h = gc_page_lookup(obj);
+  return h ? h->arena : NULL;
+}
+
+/**
+ * @brief Determine if arena `a` is `b` or encloses it
+ */
+static int gc_arena_encloses(gc_arena *a, gc_arena *b)
+{
+  for (; b; b = b->parent) {
+    if (a == b) {
+      return 1;
+    }
+  }
   return 0;
 }
 
 /**
- * @brief Get the heap's last page
- * @param h Heap to inspect
- * @return Pointer to the heap's last page
+ * @brief Write barrier for arenas
+ * @param thd   The mutator's thread data object
+ * @param var   Object being mutated, or `NULL` if `value` is being stored
+ *              outside of the heap, for example in a global
+ * @param value New value being associated to `var`
  *
- * This function does not do any locking, it is the responsibility of
- * the caller to hold the appropriate locks prior to calling.
+ * Flags the arena that `value` is in, or will be moved to if it is on the
+ * stack, as escaped unless `var` is in the same arena or one nested in
+ * it. The arenas enclosing that one are flagged as well if `var` is not 
+ * in any of them. Only needs to be called while the thread has an arena.
  */
-gc_heap *gc_heap_last(gc_heap * h)
+void gc_arena_check_escape(gc_thread_data * thd, object var, object value)
 {
-  while (h->next)
-    h = h->next;
-  return h;
+  char tmp;
+  gc_arena *a, *var_arena = NULL;
+  if (!is_object_type(value)) {
+    return;
+  }
+  if (var) {
+    if (gc_is_stack_obj(&tmp, thd, var)) {
+      return; // Will be moved to the same arena as value
+    }
+    var_arena = gc_arena_of(var);
+  }
+  a = gc_is_stack_obj(&tmp, thd, value) ? thd->arena : gc_arena_of(value);
+  for (; a && !gc_arena_encloses(a, var_arena); a = a->parent) {
+    a->escaped = 1;
+  }
 }
 
 /**
- * @brief A convenient front-end to the actual gc_sweep function.
+ * @brief Free the pages of an arena
  */
-void gc_collector_sweep()
+static void gc_arena_free(gc_arena *a)
 {
-  ck_array_iterator_t iterator;
-  gc_thread_data *m;
-  CK_ARRAY_FOREACH(&Cyc_mutators, &iterator, &m) {
-    // Tracing is done, remove the trace color
-    m->gc_trace_color = m->gc_alloc_color;
-    // Let mutator know we are done tracing
-    ck_pr_cas_8(&(m->gc_done_tracing), 0, 1);
+  gc_heap *h, *next;
+  int heap_type;
+  for (heap_type = 0; heap_type < NUM_HEAP_TYPES; heap_type++) {
+    for (h = a->pages[heap_type]; h; h = next) {
+      next = h->next;
+      gc_heap_release(h);
+    }
   }
-#if GC_DEBUG_TRACE
-  fprintf(stderr, "all thread heap sweeps done\n");
-#endif
+  free(a);
 }
 
 /**
- * @brief Sweep portion of the GC algorithm
- * @param h           Heap to sweep
- * @param thd         Thread data object for the mutator using this heap
- * @return Pointer to the heap, or NULL if heap is to be freed
+ * @brief Add a page of an arena or of the young heap to the thread's heap
  *
- * This portion of the major GC algorithm is responsible for returning unused
- * memory slots to the heap. It is only called by the allocator to free up space
- * after the heap has been traced to identify live objects.
+ * The page is flagged as full, so it is swept once the next collection is
+ * done tracing and anything that did not escape is freed then, see 
+ * `gc_arena_sweep_adopted`.
  */
-gc_heap *gc_sweep(gc_heap * h, gc_thread_data *thd)
+static void gc_arena_adopt_page(gc_thread_data *thd, gc_heap *h)
 {
-  size_t freed, size;
-  object p, end;
-  gc_free_list *q, *r, *s;
-#if GC_DEBUG_SHOW_SWEEP_DIAG
-  gc_heap *orig_heap_ptr = h;
-#endif
-  gc_heap *rv = h;
-  //int markColor = ck_pr_load_8(&gc_color_mark);
+  int heap_type = h->type;
+  gc_heap *h_last = gc_heap_last(thd->heap->heap[heap_type]);
+  h->arena = NULL;
+  h->is_full = 1;
+  h->from_arena = 2;
+  h->next = NULL;
+  gc_page_link_after(h_last, h);
+  thd->cached_heap_total_sizes[heap_type] += h->size;
+  thd->cached_heap_free_sizes[heap_type] += h->free_size;
+  thd->heap_arena_adopted_bytes += h->size;
+  gc_page_attach(thd->page_table, h);
+}
 
-  //h->next_free = h;
-  h->last_alloc_size = 0;
-  //h->free_size = 0;
-  h->is_unswept = 0;
+/**
+ * @brief Hand the pages of an arena that escaped to its parent, or to the
+ *        thread's heap if it has no parent
+ */
+static void gc_arena_adopt(gc_thread_data *thd, gc_arena *a)
+{
+  gc_arena *p = a->parent;
+  gc_heap *h;
+  int heap_type;
+  for (heap_type = 0; heap_type < NUM_HEAP_TYPES; heap_type++) {
+    while ((h = a->pages[heap_type])) {
+      a->pages[heap_type] = h->next;
+      if (p && p->pages[heap_type]) {
+        // Keep allocating from the parent's current page
+        h->arena = p;
+        h->next = p->pages[heap_type]->next;
+        p->pages[heap_type]->next = h;
+      } else if (p) {
+        h->arena = p;
+        h->next = NULL;
+        p->pages[heap_type] = h;
+      } else {
+        gc_arena_adopt_page(thd, h);
+      }
+    }
+  }
+  free(a);
+  // Like huge pages, these are only swept after a collection
+  if (thd->heap_arena_adopted_bytes > GC_COLLECT_ARENA_BYTES) {
+    gc_start_major_collection(thd);
+  }
+}
 
-#if GC_DEBUG_SHOW_SWEEP_DIAG
-  fprintf(stderr, "\nBefore sweep -------------------------\n");
-  fprintf(stderr, "Heap %d diagnostics:\n", h->type);
-  gc_print_stats(orig_heap_ptr);
-#endif
+/**
+ * @brief Determine if the collector is done with any object that 
+ *        became garbage before now
+ *
+ * Objects can only be marked while the collector is marking or tracing,
+ * and an object can only be found that way if it was still reachable 
+ * when the collection started.
+ */
+static int gc_arena_can_free(gc_thread_data *thd)
+{
+  int stage = ck_pr_load_int(&gc_stage);
+  return (stage == STAGE_RESTING || stage == STAGE_SWEEPING) &&
+         ck_pr_load_int(&(thd->gc_status)) == STATUS_ASYNC;
+}
 
-  //for (; h; prev_h = h, h = h->next)       // All heaps
-#if GC_DEBUG_TRACE
-    fprintf(stderr, "sweep heap %p, size = %zu\n", h, (size_t) h->size);
-#endif
-#if GC_DEBUG_VERBOSE
-    {
-      gc_free_list *tmp = h->free_list;
-      while (tmp) {
-        fprintf(stderr, "free list %p\n", tmp);
-        tmp = tmp->next;
-      }
+/**
+ * @brief Free any retired arenas the collector is done with
+ * @param thd  The mutator's thread data object
+ */
+static void gc_arena_free_retired(gc_thread_data *thd)
+{
+  gc_arena *a, *next;
+  if (thd->retired_arenas && gc_arena_can_free(thd)) {
+    for (a = thd->retired_arenas; a; a = next) {
+      next = a->next_retired;
+      gc_arena_free(a);
     }
-#endif
-    p = gc_heap_first_block(h);
-    q = h->free_list;
-    end = gc_heap_end(h);
-    while (p < end) {
-      // find preceding/succeeding free list pointers for p
-      for (r = q->next; r && ((char *)r < (char *)p); q = r, r = r->next) ;
+    thd->retired_arenas = NULL;
+  }
+}
 
-      if ((char *)r == (char *)p) {     // this is a free block, skip it
-        p = (object) (((char *)p) + r->size);
-        //h->free_size += r->size;
-#if GC_DEBUG_VERBOSE
-        fprintf(stderr, "skip free block %p size = %zu\n", p, r->size);
-#endif
+/**
+ * @brief Sweep the pages that escaped arenas added to a heap
+ * @param thd  The mutator's thread data object
+ * @param type Heap type
+ * @return Number of those pages that were waiting to be swept
+ *
+ * Called once the collector is done tracing. Those pages were filled 
+ * without the allocator sweeping anything to make room, so if they were 
+ * left for the allocator the heap would keep growing as long as the 
+ * thread does most of its allocation in arenas. Each page is only handed
+ * to the allocator after it has been swept twice, since objects allocated
+ * while the first collection was in progress are not freed until the
+ * second. The pages keep being swept at the end of every collection, and
+ * freed once empty, since the objects that kept them around are usually
+ * few and the allocator may not need to sweep them for a long time.
+ */
+static int gc_arena_sweep_adopted(gc_thread_data *thd, int type)
+{
+  gc_page_table *pt = thd->page_table;
+  gc_heap *h_prev = thd->heap->heap[type], *h, *keep;
+  uint64_t prev_free_size;
+  unsigned int h_size;
+  int swept = 0, full;
+  for (h = h_prev->next; h; h = h_prev->next) {
+    if (h->from_arena) {
+      full = (h->from_arena > 1);
+      if (full) {
+        h->from_arena--;
+      }
+      if (h->is_unswept == 1) {
+        swept++;
+      }
+      prev_free_size = gc_page_free_size(h);
+      h_size = h->size;
+      keep = (type <= LAST_FIXED_SIZE_HEAP_TYPE) ? 
+               gc_sweep_fixed_size(h, thd) : gc_sweep(h, thd);
+      pt->free_size[type] += gc_page_free_size(h) - prev_free_size;
+      // Nothing escaped from the page after all, the next arena will map
+      // pages of its own instead of reusing it
+      if (!keep || gc_is_heap_empty(h)) {
+        gc_page_detach(pt, h);
+        gc_heap_free(h, h_prev);
+        thd->cached_heap_total_sizes[type] -= h_size;
         continue;
       }
-      size = gc_allocated_bytes(p, q, r);
+      if (full) {
+        // Do not allocate on the page until its second sweep
+        gc_page_set_full(pt, h);
+      }
+    }
+    h_prev = h;
+  }
+  return swept;
+}
 
-#if GC_SAFETY_CHECKS
-      if (!is_object_type(p)) {
-        fprintf(stderr, "sweep: invalid object at %p", p);
-        exit(1);
+/**
+ * @brief Retire an arena that ended without escaping
+ *
+ * The pages are freed after the next minor GC, which is done with any
+ * objects in the arena that were logged by the write barrier. If a
+ * collection is in progress they are kept until the collector is done,
+ * since it may still be tracing objects in the arena that were reachable
+ * when the collection started.
+ */
+static void gc_arena_retire(gc_thread_data *thd, gc_arena *a)
+{
+  a->next_retired = thd->retired_arenas;
+  thd->retired_arenas = a;
+}
+
+/**
+ * @brief End the thread's arena of the given depth
+ * @param thd    The mutator's thread data object
+ * @param depth  Depth returned by `gc_arena_begin`
+ * @param result Value returned from the arena's extent
+ *
+ * If nothing in the arena escaped, including `result`, all of its pages 
+ * are freed at once, see `gc_arena_retire`. Otherwise they are handed to the enclosing arena or
+ * the thread's heap. Nested arenas that were never ended, for example 
+ * because a continuation escaped from them, are treated as escaped. Does
+ * nothing if the arena has already ended.
+ */
+void gc_arena_end(gc_thread_data * thd, int depth, object result)
+{
+  gc_arena *a;
+  char tmp;
+  gc_arena_abandon(thd, depth + 1);
+  a = thd->arena;
+  if (!a || a->depth != depth) {
+    return;
+  }
+  // The result escapes to the enclosing extent
+  if (is_object_type(result) &&
+      (gc_is_stack_obj(&tmp, thd, result) || gc_arena_of(result) == a)) {
+    a->escaped = 1;
+  }
+  thd->arena = a->parent;
+  if (a->escaped) {
+    gc_arena_adopt(thd, a);
+  } else {
+    gc_arena_retire(thd, a);
+  }
+}
+
+/**
+ * @brief End the thread's arenas of the given depth or deeper, as if they
+ *        had escaped
+ * @param thd    The mutator's thread data object
+ * @param depth  Depth returned by `gc_arena_begin`
+ *
+ * Used when control leaves an arena's extent some other way than by 
+ * returning, such as when an exception is raised.
+ */
+void gc_arena_abandon(gc_thread_data * thd, int depth)
+{
+  gc_arena *a;
+  while ((a = thd->arena) && a->depth >= depth) {
+    thd->arena = a->parent;
+    gc_arena_adopt(thd, a);
+  }
+}
+
+/**
+ * @brief End the thread's arenas that a continuation is outside of
+ * @param thd  The mutator's thread data object
+ * @param k    Continuation about to be called
+ *
+ * Used when a continuation captured by `call/cc` is called, which may
+ * leave the extents of any number of arenas. Objects from before an arena
+ * began are never on the stack, see `gc_arena_begin`, so a continuation 
+ * on the stack belongs to the current arena's extent. Otherwise it 
+ * belongs to the extent of the arena it was allocated in, if any, and the
+ * arenas nested in that one are ended as if they had escaped.
+ */
+void gc_arena_unwind(gc_thread_data * thd, object k)
+{
+  gc_arena *a;
+  char tmp;
+  if (!thd->arena || !is_object_type(k) || gc_is_stack_obj(&tmp, thd, k)) {
+    return;
+  }
+  a = gc_arena_of(k);
+  if (a && !gc_arena_encloses(a, thd->arena)) {
+    return;
+  }
+  gc_arena_abandon(thd, a ? a->depth + 1 : 1);
+}
+
+/**
+ * @brief Add an object to one of the young heap's buffers
+ */
+static void gc_young_push(object **buf, int *count, int *len, object obj)
+{
+  if (*count == *len) {
+    *len = (*len > 0) ? *len * 2 : 128;
+    *buf = realloc(*buf, *len * sizeof(object));
+    if (!*buf) {
+      fprintf(stderr, "Unable to grow young heap buffer\n");
+      exit(1);
+    }
+  }
+  (*buf)[(*count)++] = obj;
+}
+
+/**
+ * @brief Find the young heap page an object is on
+ * @return The page, or `NULL` if the object is not in the young heap
+ */
+static gc_heap *gc_young_page(gc_young *y, object obj)
+{
+  gc_heap *h = gc_page_lookup(obj);
+  return (h && h->arena == &(y->region)) ? h : NULL;
+}
+
+/**
+ * @brief Pin a young object and every young object reachable from it
+ * @param thd       The mutator's thread data object
+ * @param low_limit Top of the mutator's stack
+ * @param obj       Object that may now be referenced from outside the 
+ *                  young heap
+ *
+ * Objects on the stack that are found along the way are pinned once the 
+ * next minor GC has moved them, see `gc_young_pin_escaped`.
+ */
+static void gc_young_pin(gc_thread_data *thd, object low_limit, object obj)
+{
+  gc_young *y = thd->young;
+  gc_heap *h;
+  int i;
+  y->work_count = 0;
+  gc_young_push(&(y->work), &(y->work_count), &(y->work_len), obj);
+  while (y->work_count > 0) {
+    obj = y->work[--(y->work_count)];
+    if (!is_object_type(obj)) {
+      continue;
+    }
+    h = gc_young_page(y, obj);
+    if (!h) {
+      if (gc_is_stack_obj(low_limit, thd, obj)) {
+        gc_young_push(&(y->pending), &(y->pending_count), 
+                      &(y->pending_len), obj);
       }
-      if ((char *)q + q->size > (char *)p) {
-        fprintf(stderr, "bad size at %p < %p + %u", p, q, q->size);
-        exit(1);
+      continue;
+    }
+    if (pinned(obj)) {
+      continue;
+    }
+    pinned(obj) = 1;
+    h->has_pinned = 1;
+    switch (type_of(obj)) {
+    case pair_tag:
+      gc_young_push(&(y->work), &(y->work_count), &(y->work_len), car(obj));
+      gc_young_push(&(y->work), &(y->work_count), &(y->work_len), cdr(obj));
+      break;
+    case closure1_tag:
+      gc_young_push(&(y->work), &(y->work_count), &(y->work_len), 
+                    ((closure1) obj)->element);
+      break;
+    case closureN_tag:
+      for (i = 0; i < ((closureN) obj)->num_elements; i++) {
+        gc_young_push(&(y->work), &(y->work_count), &(y->work_len), 
+                      ((closureN) obj)->elements[i]);
       }
-      if (r && ((char *)p) + size > (char *)r) {
-        fprintf(stderr, "sweep: bad size at %p + %zu > %p", p, size, r);
-        exit(1);
+      break;
+    case vector_tag:
+    case record_tag:
+      for (i = 0; i < ((vector) obj)->num_elements; i++) {
+        gc_young_push(&(y->work), &(y->work_count), &(y->work_len), 
+                      ((vector) obj)->elements[i]);
       }
-#endif
+      break;
+    default:
+      break;
+    }
+  }
+}
 
-      // Use the object's mark to determine if we keep it. 
-      // Need to check for both colors because:
-      // - Objects that are either newly-allocated or recently traced are given 
-      //   the alloc color, and we need to keep them.
-      // - If the collector is currently tracing, objects not traced yet will 
-      //   have the trace/clear color. We need to keep any of those to make sure
-      //   the collector has a chance to trace the entire heap.
-      if (//mark(p) != markColor &&
-          mark(p) != thd->gc_alloc_color && 
-          mark(p) != thd->gc_trace_color) { //gc_color_clear) 
-#if GC_DEBUG_VERBOSE
-        fprintf(stderr, "sweep is freeing unmarked obj: %p with tag %d mark %d - alloc color %d trace color %d\n", p,
-                type_of(p),
-                mark(p),
-                thd->gc_alloc_color, thd->gc_trace_color);
-#endif
-        //mark(p) = gc_color_blue;        // Needed?
-        if (type_of(p) == mutex_tag) {
-#if GC_DEBUG_VERBOSE
-          fprintf(stderr, "pthread_mutex_destroy from sweep\n");
-#endif
-          if (pthread_mutex_destroy(&(((mutex) p)->lock)) != 0) {
-            fprintf(stderr, "Error destroying mutex\n");
-            exit(1);
-          }
-        } else if (type_of(p) == cond_var_tag) {
-#if GC_DEBUG_VERBOSE
-          fprintf(stderr, "pthread_cond_destroy from sweep\n");
-#endif
-          if (pthread_cond_destroy(&(((cond_var) p)->cond)) != 0) {
-            fprintf(stderr, "Error destroying condition variable\n");
-            exit(1);
-          }
-        } else if (type_of(p) == bignum_tag) {
-          // TODO: this is no good if we abandon bignum's on the stack
-          // in that case the finalizer is never called
-#if GC_DEBUG_VERBOSE
-          fprintf(stderr, "mp_clear from sweep\n");
-#endif
-          mp_clear(&(((bignum_type *)p)->bn));
-        }
-        // free p
-        if (((((char *)q) + q->size) == (char *)p) && (q != h->free_list)) {
-          /* merge q with p */
-          if (r && r->size && ((((char *)p) + size) == (char *)r)) {
-            // ... and with r
-            q->next = r->next;
-            freed = q->size + size + r->size;
-            p = (object) (((char *)p) + size + r->size);
-          } else {
-            freed = q->size + size;
-            p = (object) (((char *)p) + size);
-          }
-          q->size = freed;
-        } else {
-          s = (gc_free_list *) p;
-          if (r && r->size && ((((char *)p) + size) == (char *)r)) {
-            // merge p with r
-            s->size = size + r->size;
-            s->next = r->next;
-            q->next = s;
-            freed = size + r->size;
-          } else {
-            s->size = size;
-            s->next = r;
-            q->next = s;
-            freed = size;
-          }
-          p = (object) (((char *)p) + freed);
-        }
-        h->free_size += size;
-      } else {
-//#if GC_DEBUG_VERBOSE
-//        fprintf(stderr, "sweep: object is marked %p\n", p);
-//#endif
-        p = (object) (((char *)p) + size);
-      }
+/**
+ * @brief Write barrier for the young heap
+ * @param thd   The mutator's thread data object
+ * @param var   Object being mutated, or `NULL` if `value` is being stored
+ *              outside of the heap, for example in a global
+ * @param value New value being associated to `var`
+ *
+ * Pins `value` unless `var` is on the stack or is a young object that is 
+ * not pinned itself. Only needs to be called while the thread has a young
+ * heap and no arena.
+ */
+void gc_young_check_escape(gc_thread_data * thd, object var, object value)
+{
+  gc_young *y = thd->young;
+  char tmp;
+  if (!is_object_type(value)) {
+    return;
+  }
+  if (var) {
+    if (gc_is_stack_obj(&tmp, thd, var)) {
+      return; // Will be moved to the young heap along with value
     }
-    // Free the heap page if possible.
-    //
-    // With huge heaps, this becomes more important. one of the huge
-    // pages only has one object, so it is likely that the page
-    // will become free at some point and could be reclaimed.
-    //
-    // The newly created flag is used to attempt to avoid situtaions
-    // where a page is allocated because there is not enough free space,
-    // but then we do a sweep and see it is empty so we free it, and
-    // so forth. A better solution might be to keep empty heap pages
-    // off to the side and only free them if there is enough free space
-    // remaining without them.
-    //
-    // Experimenting with only freeing huge heaps
-    if (gc_is_heap_empty(h)) {
-      if (h->type == HEAP_HUGE || (h->ttl--) <= 0) {
-        rv = NULL; // Let caller know heap needs to be freed
-      }
-    } else {
-      //(thd->heap->heap[h->type])->num_unswept_children--;
+    if (gc_young_page(y, var) && !pinned(var)) {
+      return;
     }
+  }
+  if (gc_is_stack_obj(&tmp, thd, value)) {
+    gc_young_push(&(y->pending), &(y->pending_count), &(y->pending_len), 
+                  value);
+  } else {
+    gc_young_pin(thd, &tmp, value);
+  }
+}
 
-#if GC_DEBUG_SHOW_SWEEP_DIAG
-  fprintf(stderr, "\nAfter sweep -------------------------\n");
-  fprintf(stderr, "Heap %d diagnostics:\n", h->type);
-  gc_print_stats(orig_heap_ptr);
-#endif
-
-  return rv;
+/**
+ * @brief Pin the objects the write barrier found on the stack
+ * @param thd       The mutator's thread data object
+ * @param low_limit Top of the mutator's stack
+ * @param globals   Internal global used by the runtime, or `NULL`
+ * @param table     Table of globals to pin as well, or `NULL`
+ *
+ * Called at the end of each minor GC, once those objects that are still
+ * live have been moved to the young heap. Globals are passed after a 
+ * library is loaded, since it sets them without the write barrier.
+ */
+void gc_young_pin_escaped(gc_thread_data * thd, object low_limit, 
+                          object globals, gc_global_table *table)
+{
+  gc_young *y = thd->young;
+  int i, n = y->pending_count;
+  for (i = 0; i < n; i++) {
+    object obj = y->pending[i];
+    if (type_of(obj) == forward_tag) {
+      gc_young_pin(thd, low_limit, forward(obj));
+    }
+  }
+  y->pending_count = 0;
+  if (table && !thd->arena) {
+    gc_young_pin(thd, low_limit, globals);
+    n = ck_pr_load_int(&(table->len));
+    ck_pr_fence_load();
+    for (i = 0; i < n; i++) {
+      gc_young_pin(thd, low_limit, *(gc_global_entry(table, i)->pvar));
+    }
+  }
 }
 
 /**
- * @brief Increase the size of the mutator's move buffer
- * @param d Mutator's thread data object
+ * @brief Copy a young object that is not pinned to the thread's heap
+ * @return The heap copy, or `obj` if it does not need to be moved
  */
-void gc_thr_grow_move_buffer(gc_thread_data * d)
+static object gc_young_copy(gc_thread_data *thd, gc_young *y, object obj)
 {
-  if (!d)
-    return;
+  object hp;
+  size_t size;
+  int heap_grown;
+  if (!is_object_type(obj) || !gc_young_page(y, obj)) {
+    return obj;
+  }
+  if (type_of(obj) == forward_tag) {
+    return forward(obj);
+  }
+  if (pinned(obj)) {
+    return obj;
+  }
+  size = gc_allocated_bytes(obj, NULL, NULL);
+  hp = gc_alloc(thd->heap, size, obj, thd, &heap_grown);
+  thd->stats_young_survivor_bytes += size;
+  forward(obj) = hp;
+  type_of(obj) = forward_tag;
+  gc_young_push(&(y->work), &(y->work_count), &(y->work_len), hp);
+  return hp;
+}
 
-  if (d->moveBufLen == 0) {     // Special case
-    d->moveBufLen = 128;
-    d->moveBuf = NULL;
+/**
+ * @brief Flag the objects on a young page that are not pinned as free
+ *
+ * Objects on other size-class pages are found a block at a time. Those on 
+ * other pages are walked by size, so objects that were copied to the heap
+ * get their contents back first.
+ */
+static void gc_young_free_unpinned(gc_heap *h)
+{
+  object p;
+  char *end;
+  unsigned int i, used;
+  if (h->type <= LAST_FIXED_SIZE_HEAP_TYPE) {
+    used = (h->num_blocks * h->block_size - h->remaining) / h->block_size;
+    for (i = 0; i < used; i++) {
+      p = h->data + (i * h->block_size);
+      if (pinned(p)) {
+        continue;
+      }
+      mark(p) = gc_color_blue;
+#if GC_SIDE_MARK_BITS
+      if (h->mark_bits[0]) {
+        uint64_t bit = ~((uint64_t)1 << (i % 64));
+        ck_pr_and_64(&(h->mark_bits[0][i / 64]), bit);
+        ck_pr_and_64(&(h->mark_bits[1][i / 64]), bit);
+        h->alloc_bits[0][i / 64] &= bit;
+        h->alloc_bits[1][i / 64] &= bit;
+      }
+#endif
+    }
   } else {
-    d->moveBufLen *= 2;
+    p = gc_heap_first_block(h);
+    end = h->free_list->next ? (char *)h->free_list->next : 
+                               (char *)gc_heap_end(h);
+    while ((char *)p < end) {
+      if (type_of(p) == forward_tag) {
+        object hp = forward(p);
+        memcpy(p, hp, gc_allocated_bytes(hp, NULL, NULL));
+      }
+      if (!pinned(p)) {
+        mark(p) = gc_color_blue;
+      }
+      p = (object)(((char *)p) + gc_allocated_bytes(p, NULL, NULL));
+    }
   }
+}
 
-  d->moveBuf = realloc(d->moveBuf, d->moveBufLen * sizeof(void *));
-#if GC_DEBUG_TRACE
-  fprintf(stderr, "grew moveBuffer, len = %d\n", d->moveBufLen);
+/**
+ * @brief Make a young page that has no pinned objects empty again
+ */
+static void gc_young_reset_page(gc_heap *h)
+{
+  gc_free_list *next;
+  if (h->type <= LAST_FIXED_SIZE_HEAP_TYPE) {
+    h->remaining = h->num_blocks * h->block_size;
+#if GC_SIDE_MARK_BITS
+    if (h->mark_bits[0]) {
+      memset(h->mark_bits[0], 0, 
+             4 * gc_bitmap_words(h->num_blocks) * sizeof(uint64_t));
+    }
+    h->has_finalizers = 0;
 #endif
+  } else {
+    next = (gc_free_list *)gc_heap_first_block(h);
+    next->size = h->size - gc_heap_align(gc_free_chunk_size);
+    next->next = NULL;
+    h->free_list->next = next;
+  }
+  h->free_size = h->size;
 }
 
-// END heap definitions
+/**
+ * @brief Copy the young objects that are still live to the heap
+ * @param thd  The mutator's thread data object
+ *
+ * Only the thread's roots need to be checked, since a young object that
+ * may be referenced from anywhere else is pinned. Pages that hold pinned
+ * objects are added to the heap, and the rest are kept for reuse.
+ */
+static void gc_young_evacuate(gc_thread_data *thd)
+{
+  gc_young *y = thd->young;
+  gc_heap *h, *next;
+  object obj;
+  int heap_type, i;
+
+  // Copies go to the heap
+  thd->young = NULL;
+  y->work_count = 0;
+  thd->gc_cont = gc_young_copy(thd, y, thd->gc_cont);
+  for (i = 0; i < thd->gc_num_args; i++) {
+    thd->gc_args[i] = gc_young_copy(thd, y, thd->gc_args[i]);
+  }
+  thd->exception_handler_stack = 
+    gc_young_copy(thd, y, thd->exception_handler_stack);
+  thd->param_objs = gc_young_copy(thd, y, thd->param_objs);
+  thd->scm_thread_obj = gc_young_copy(thd, y, thd->scm_thread_obj);
+  while (y->work_count > 0) {
+    obj = y->work[--(y->work_count)];
+    switch (type_of(obj)) {
+    case pair_tag:
+      car(obj) = gc_young_copy(thd, y, car(obj));
+      cdr(obj) = gc_young_copy(thd, y, cdr(obj));
+      break;
+    case closure1_tag:
+      ((closure1) obj)->element = 
+        gc_young_copy(thd, y, ((closure1) obj)->element);
+      break;
+    case closureN_tag:
+      for (i = 0; i < ((closureN) obj)->num_elements; i++) {
+        ((closureN) obj)->elements[i] = 
+          gc_young_copy(thd, y, ((closureN) obj)->elements[i]);
+      }
+      break;
+    case vector_tag:
+    case record_tag:
+      for (i = 0; i < ((vector) obj)->num_elements; i++) {
+        ((vector) obj)->elements[i] = 
+          gc_young_copy(thd, y, ((vector) obj)->elements[i]);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+  thd->young = y;
+  gc_alloc_buffers_flush(thd);
 
-// Tri-color GC section
+  for (heap_type = 0; heap_type < NUM_HEAP_TYPES; heap_type++) {
+    h = y->region.pages[heap_type];
+    y->region.pages[heap_type] = NULL;
+    for (; h; h = next) {
+      next = h->next;
+      if (h->has_pinned) {
+        gc_young_free_unpinned(h);
+        h->has_pinned = 0;
+        gc_arena_adopt_page(thd, h);
+      } else {
+        gc_young_reset_page(h);
+        h->next = y->region.spare[heap_type];
+        y->region.spare[heap_type] = h;
+      }
+    }
+  }
+  y->allocated = 0;
+  thd->stats_young_collections++;
+  gc_note_moved(thd);
+}
 
-/////////////////////////////////////////////
-// GC functions called by the Mutator threads
+/**
+ * @brief Add all of the young heap's pages to the thread's heap
+ * @param thd  The mutator's thread data object
+ *
+ * Used when the young heap cannot be collected, and before an arena 
+ * begins since the arena's write barrier does not pin young objects.
+ */
+static void gc_young_promote(gc_thread_data *thd)
+{
+  gc_young *y = thd->young;
+  gc_heap *h;
+  int heap_type;
+  for (heap_type = 0; heap_type < NUM_HEAP_TYPES; heap_type++) {
+    while ((h = y->region.pages[heap_type])) {
+      y->region.pages[heap_type] = h->next;
+      h->has_pinned = 0;
+      gc_arena_adopt_page(thd, h);
+    }
+    while ((h = y->region.spare[heap_type])) {
+      y->region.spare[heap_type] = h->next;
+      gc_heap_release(h);
+    }
+  }
+  y->allocated = 0;
+}
 
 /**
- * @brief Clear thread data read/write fields
- * @param thd Mutator's thread data object
+ * @brief Move the thread's young objects to its heap and stop using the 
+ *        young heap
  */
-void gc_zero_read_write_counts(gc_thread_data * thd)
+static void gc_young_free(gc_thread_data *thd)
 {
-  pthread_mutex_lock(&(thd->lock));
+  gc_young *y = thd->young;
+  if (y) {
+    gc_young_promote(thd);
+    free(y->pending);
+    free(y->work);
+    free(y);
+    thd->young = NULL;
+  }
+}
+
+/**
+ * @brief Collect the thread's young heap if it is full
+ * @param thd  The mutator's thread data object
+ *
+ * Called after each minor GC, before the thread cooperates with the 
+ * collector. The young heap is only collected while the collector cannot
+ * be tracing any of its objects, see `gc_arena_can_free`. If it fills up 
+ * twice over before then, all of it is added to the heap instead. Also 
+ * starts or stops using a young heap when the `young-heap-size` parameter
+ * has changed.
+ */
+void gc_young_collect(gc_thread_data * thd)
+{
+  size_t limit = (size_t)gc_param(GC_PARAM_YOUNG_HEAP_SIZE);
+  gc_young *y = thd->young;
+  if (thd->arena) {
+    return;
+  }
+  if (!y) {
+    if (limit > 0) {
+      thd->young = calloc(1, sizeof(gc_young));
+      if (!thd->young) {
+        fprintf(stderr, "Unable to allocate young heap\n");
+        exit(1);
+      }
+    }
+    return;
+  }
+  if (limit == 0) {
+    gc_young_free(thd);
+  } else if (y->allocated >= limit) {
+    if (gc_arena_can_free(thd)) {
+      gc_young_evacuate(thd);
+    } else if (y->allocated >= limit * 2) {
+      gc_young_promote(thd);
+    }
+  }
+}
+
+/**
+ * @brief Get the number of bytes that will be allocated for `obj`.
+ * @param obj Object to inspect
+ * @param q   Previous free list pointer, set to `NULL` if not applicable
+ * @param r   Next free list pointer, set to `NULL` if not applicable
+ * @return Number of bytes, including any needed for alignment
+ */
+size_t gc_allocated_bytes(object obj, gc_free_list * q, gc_free_list * r)
+{
+  tag_type t;
 #if GC_SAFETY_CHECKS
-  if (thd->last_read < thd->last_write) {
-    fprintf(stderr,
-            "gc_zero_read_write_counts - last_read (%d) < last_write (%d)\n",
-            thd->last_read, thd->last_write);
-  } else if (thd->pending_writes) {
+  if (is_value_type(obj)) {
     fprintf(stderr,
-            "gc_zero_read_write_counts - pending_writes (%d) is not zero\n",
-            thd->pending_writes);
+            "gc_allocated_bytes - passed value type %p q=[%p, %d] r=[%p, %d]\n",
+            obj, q, q->size, r, r->size);
+    exit(1);
   }
 #endif
-  thd->last_write = 0;
-  thd->last_read = 0;
-  thd->pending_writes = 0;
-  pthread_mutex_unlock(&(thd->lock));
+  t = type_of(obj);
+  if (t == pair_tag)
+    return gc_heap_align(sizeof(pair_type));
+  if (t == closureN_tag) {
+    return gc_heap_align(sizeof(closureN_type) +
+                         sizeof(object) * 
+                         ((closureN_type *) obj)->num_elements);
+  }
+  if (t == double_tag)
+    return gc_heap_align(sizeof(double_type));
+  if (t == closure1_tag)
+    return gc_heap_align(sizeof(closure1_type));
+  if (t == string_tag) {
+    return gc_heap_align(sizeof(string_type) + string_len(obj) + 1);
+  }
+  if (t == vector_tag || t == record_tag) {
+    return gc_heap_align(sizeof(vector_type) +
+                         sizeof(object) * ((vector_type *) obj)->num_elements);
+  }
+  if (t == bytevector_tag) {
+    return gc_heap_align(sizeof(bytevector_type) +
+                         sizeof(char) * ((bytevector) obj)->len);
+  }
+  if (t == macro_tag)
+    return gc_heap_align(sizeof(macro_type));
+  if (t == bignum_tag)
+    return gc_heap_align(sizeof(bignum_type));
+  if (t == port_tag)
+    return gc_heap_align(sizeof(port_type));
+  if (t == cvar_tag)
+    return gc_heap_align(sizeof(cvar_type));
+  if (t == c_opaque_tag)
+    return gc_heap_align(sizeof(c_opaque_type));
+  if (t == mutex_tag)
+    return gc_heap_align(sizeof(mutex_type));
+  if (t == cond_var_tag)
+    return gc_heap_align(sizeof(cond_var_type));
+  if (t == atomic_tag)
+    return gc_heap_align(sizeof(atomic_type));
+  if (t == integer_tag)
+    return gc_heap_align(sizeof(integer_type));
+  if (t == complex_num_tag)
+    return gc_heap_align(sizeof(complex_num_type));
+
+  fprintf(stderr, "gc_allocated_bytes: unexpected object %p of type %d\n", obj,
+          t);
+  exit(1);
+  return 0;
+}
+
+/**
+ * @brief Get the heap's last page
+ * @param h Heap to inspect
+ * @return Pointer to the heap's last page
+ *
+ * This function does not do any locking, it is the responsibility of
+ * the caller to hold the appropriate locks prior to calling.
+ */
+gc_heap *gc_heap_last(gc_heap * h)
+{
+  while (h->next)
+    h = h->next;
+  return h;
+}
+
+/**
+ * @brief A convenient front-end to the actual gc_sweep function.
+ */
+void gc_collector_sweep()
+{
+  ck_array_iterator_t iterator;
+  gc_thread_data *m;
+  CK_ARRAY_FOREACH(&Cyc_mutators, &iterator, &m) {
+    // Tracing is done, remove the trace color
+    m->gc_trace_color = m->gc_alloc_color;
+    // Let mutator know we are done tracing
+    ck_pr_cas_8(&(m->gc_done_tracing), 0, 1);
+  }
+#if GC_DEBUG_TRACE
+  fprintf(stderr, "all thread heap sweeps done\n");
+#endif
+}
+
+/**
+ * @brief Sweep portion of the GC algorithm
+ * @param h           Heap to sweep
+ * @param thd         Thread data object for the mutator using this heap
+ * @return Pointer to the heap, or NULL if heap is to be freed
+ *
+ * This portion of the major GC algorithm is responsible for returning unused
+ * memory slots to the heap. It is only called by the allocator to free up space
+ * after the heap has been traced to identify live objects.
+ */
+gc_heap *gc_sweep(gc_heap * h, gc_thread_data *thd)
+{
+  size_t freed, size;
+  object p, end;
+  gc_free_list *q, *r, *s;
+  unsigned char alloc_color, trace_color, color;
+#if GC_DEBUG_SHOW_SWEEP_DIAG
+  gc_heap *orig_heap_ptr = h;
+#endif
+  gc_heap *rv = h;
+  //int markColor = ck_pr_load_8(&gc_color_mark);
+
+  //h->next_free = h;
+  h->last_alloc_size = 0;
+  //h->free_size = 0;
+  h->is_unswept = 0;
+  gc_sweep_colors(thd, &alloc_color, &trace_color);
+
+#if GC_DEBUG_SHOW_SWEEP_DIAG
+  fprintf(stderr, "\nBefore sweep -------------------------\n");
+  fprintf(stderr, "Heap %d diagnostics:\n", h->type);
+  gc_print_stats(orig_heap_ptr);
+#endif
+
+  //for (; h; prev_h = h, h = h->next)       // All heaps
+#if GC_DEBUG_TRACE
+    fprintf(stderr, "sweep heap %p, size = %zu\n", h, (size_t) h->size);
+#endif
+#if GC_DEBUG_VERBOSE
+    {
+      gc_free_list *tmp = h->free_list;
+      while (tmp) {
+        fprintf(stderr, "free list %p\n", tmp);
+        tmp = tmp->next;
+      }
+    }
+#endif
+    p = gc_heap_first_block(h);
+    q = h->free_list;
+    end = gc_heap_end(h);
+    while (p < end) {
+      // find preceding/succeeding free list pointers for p
+      for (r = q->next; r && ((char *)r < (char *)p); q = r, r = r->next) ;
+
+      if ((char *)r == (char *)p) {     // this is a free block, skip it
+        p = (object) (((char *)p) + r->size);
+        //h->free_size += r->size;
+#if GC_DEBUG_VERBOSE
+        fprintf(stderr, "skip free block %p size = %zu\n", p, r->size);
+#endif
+        continue;
+      }
+      size = gc_allocated_bytes(p, q, r);
+
+#if GC_SAFETY_CHECKS
+      if (!is_object_type(p)) {
+        fprintf(stderr, "sweep: invalid object at %p", p);
+        exit(1);
+      }
+      if ((char *)q + q->size > (char *)p) {
+        fprintf(stderr, "bad size at %p < %p + %u", p, q, q->size);
+        exit(1);
+      }
+      if (r && ((char *)p) + size > (char *)r) {
+        fprintf(stderr, "sweep: bad size at %p + %zu > %p", p, size, r);
+        exit(1);
+      }
+#endif
+
+      // Use the object's mark to determine if we keep it. 
+      // Need to check for both colors because:
+      // - Objects that are either newly-allocated or recently traced are given 
+      //   the alloc color, and we need to keep them.
+      // - If the collector is currently tracing, objects not traced yet will 
+      //   have the trace/clear color. We need to keep any of those to make sure
+      //   the collector has a chance to trace the entire heap.
+      color = ck_pr_load_8(&(mark(p)));
+      if (//mark(p) != markColor &&
+          color != alloc_color && 
+          color != trace_color) { //gc_color_clear) 
+#if GC_DEBUG_VERBOSE
+        fprintf(stderr, "sweep is freeing unmarked obj: %p with tag %d mark %d - alloc color %d trace color %d\n", p,
+                type_of(p),
+                mark(p),
+                thd->gc_alloc_color, thd->gc_trace_color);
+#endif
+        //mark(p) = gc_color_blue;        // Needed?
+        if (type_of(p) == mutex_tag) {
+#if GC_DEBUG_VERBOSE
+          fprintf(stderr, "pthread_mutex_destroy from sweep\n");
+#endif
+          if (pthread_mutex_destroy(&(((mutex) p)->lock)) != 0) {
+            fprintf(stderr, "Error destroying mutex\n");
+            exit(1);
+          }
+        } else if (type_of(p) == cond_var_tag) {
+#if GC_DEBUG_VERBOSE
+          fprintf(stderr, "pthread_cond_destroy from sweep\n");
+#endif
+          if (pthread_cond_destroy(&(((cond_var) p)->cond)) != 0) {
+            fprintf(stderr, "Error destroying condition variable\n");
+            exit(1);
+          }
+        } else if (type_of(p) == bignum_tag) {
+          // TODO: this is no good if we abandon bignum's on the stack
+          // in that case the finalizer is never called
+#if GC_DEBUG_VERBOSE
+          fprintf(stderr, "mp_clear from sweep\n");
+#endif
+          mp_clear(&(((bignum_type *)p)->bn));
+        }
+        // free p
+        if (((((char *)q) + q->size) == (char *)p) && (q != h->free_list)) {
+          /* merge q with p */
+          if (r && r->size && ((((char *)p) + size) == (char *)r)) {
+            // ... and with r
+            q->next = r->next;
+            freed = q->size + size + r->size;
+            p = (object) (((char *)p) + size + r->size);
+          } else {
+            freed = q->size + size;
+            p = (object) (((char *)p) + size);
+          }
+          q->size = freed;
+        } else {
+          s = (gc_free_list *) p;
+          if (r && r->size && ((((char *)p) + size) == (char *)r)) {
+            // merge p with r
+            s->size = size + r->size;
+            s->next = r->next;
+            q->next = s;
+            freed = size + r->size;
+          } else {
+            s->size = size;
+            s->next = r;
+            q->next = s;
+            freed = size;
+          }
+          p = (object) (((char *)p) + freed);
+        }
+        h->free_size += size;
+      } else {
+//#if GC_DEBUG_VERBOSE
+//        fprintf(stderr, "sweep: object is marked %p\n", p);
+//#endif
+        p = (object) (((char *)p) + size);
+      }
+    }
+    // Free the heap page if possible.
+    //
+    // With huge heaps, this becomes more important. one of the huge
+    // pages only has one object, so it is likely that the page
+    // will become free at some point and could be reclaimed.
+    //
+    // The newly created flag is used to attempt to avoid situtaions
+    // where a page is allocated because there is not enough free space,
+    // but then we do a sweep and see it is empty so we free it, and
+    // so forth. A better solution might be to keep empty heap pages
+    // off to the side and only free them if there is enough free space
+    // remaining without them.
+    //
+    // Experimenting with only freeing huge heaps
+    if (gc_is_heap_empty(h)) {
+      if (h->type == HEAP_HUGE || (h->ttl--) <= 0 || gc_over_soft_limit()) {
+        rv = NULL; // Let caller know heap needs to be freed
+      }
+    } else {
+      //(thd->heap->heap[h->type])->num_unswept_children--;
+    }
+
+#if GC_DEBUG_SHOW_SWEEP_DIAG
+  fprintf(stderr, "\nAfter sweep -------------------------\n");
+  fprintf(stderr, "Heap %d diagnostics:\n", h->type);
+  gc_print_stats(orig_heap_ptr);
+#endif
+
+  return rv;
+}
+
+/**
+ * @brief Increase the size of the mutator's move buffer
+ * @param d Mutator's thread data object
+ */
+void gc_thr_grow_move_buffer(gc_thread_data * d)
+{
+  if (!d)
+    return;
+
+  if (d->moveBufLen == 0) {     // Special case
+    d->moveBufLen = 128;
+    d->moveBuf = NULL;
+  } else {
+    d->moveBufLen *= 2;
+  }
+
+  d->moveBuf = realloc(d->moveBuf, d->moveBufLen * sizeof(void *));
+#if GC_DEBUG_TRACE
+  fprintf(stderr, "grew moveBuffer, len = %d\n", d->moveBufLen);
+#endif
+}
+
+// END heap definitions
+
+// Tri-color GC section
+
+/////////////////////////////////////////////
+// GC functions called by the Mutator threads
+
+/**
+ * @brief Clear thread data read/write fields
+ * @param thd Mutator's thread data object
+ */
+void gc_zero_read_write_counts(gc_thread_data * thd)
+{
+  pthread_mutex_lock(&(thd->lock));
+#if GC_SAFETY_CHECKS
+  if (thd->last_read < thd->last_write) {
+    fprintf(stderr,
+            "gc_zero_read_write_counts - last_read (%d) < last_write (%d)\n",
+            thd->last_read, thd->last_write);
+  } else if (thd->pending_writes) {
+    fprintf(stderr,
+            "gc_zero_read_write_counts - pending_writes (%d) is not zero\n",
+            thd->pending_writes);
+  }
+#endif
+  thd->last_write = 0;
+  thd->last_read = 0;
+  thd->pending_writes = 0;
+  pthread_mutex_unlock(&(thd->lock));
+}
+
+/**
+ * @brief Move pending writes to 'last_write'
+ * @param thd Mutator's thread data object
+ * @param locked  Does the caller hold the mutator lock?
+ */
+void gc_sum_pending_writes(gc_thread_data * thd, int locked)
+{
+  if (!locked) {
+    pthread_mutex_lock(&(thd->lock));
+  }
+  thd->last_write += thd->pending_writes;
+  thd->pending_writes = 0;
+  if (!locked) {
+    pthread_mutex_unlock(&(thd->lock));
+  }
+}
+
+// /**
+//  * @brief Determine if object lives on the thread's stack
+//  * @param thd Mutator's thread data
+//  * @param obj Object to inspect
+//  * @return True if `obj` is on the mutator's stack, false otherwise
+//  */
+// int gc_is_stack_obj(gc_thread_data * thd, object obj)
+// {
+//   char tmp;
+//   object low_limit = &tmp;
+//   object high_limit = thd->stack_start;
+//   return (stack_overflow(low_limit, obj) && stack_overflow(obj, high_limit));
+// }
+
+/**
+ * @brief Helper function for `gc_mut_update`
+ */
+static void mark_stack_or_heap_obj(gc_thread_data * thd, object obj, int locked)
+{
+  char tmp;
+  if (!is_object_type(obj) || type_of(obj) == boolean_tag) {
+    return;
+  } else if (gc_is_stack_obj(&tmp, thd, obj)) {
+    // Set object to be marked after moved to heap by next GC.
+    // This avoids having to recursively examine the stack now, 
+    // which we have to do anyway during minor GC.
+    grayed(obj) = 1;
+  } else {
+    // Value is on the heap, mark gray right now
+    if (!locked) { pthread_mutex_lock(&(thd->lock)); }
+    gc_mark_gray(thd, obj);
+    if (!locked) { pthread_mutex_unlock(&(thd->lock)); }
+  }
+}
+
+/**
+ * @brief Write barrier for updates to heap-allocated objects
+ * @param thd     Mutator's thread data
+ * @param old_obj Old object value prior to the mutation
+ * @param value   New object value
+ *
+ * The key for this barrier is to identify stack objects that contain
+ * heap references, so they can be marked to avoid collection.
+*/
+void gc_mut_update(gc_thread_data * thd, object old_obj, object value)
+{
+  int //status = ck_pr_load_int(&gc_status_col),
+      stage = ck_pr_load_int(&gc_stage);
+  if (ck_pr_load_int(&(thd->gc_status)) != STATUS_ASYNC) {
+    pthread_mutex_lock(&(thd->lock));
+    mark_stack_or_heap_obj(thd, old_obj, 1);
+    mark_stack_or_heap_obj(thd, value, 1);
+    pthread_mutex_unlock(&(thd->lock));
+  } else if (stage == STAGE_TRACING) {
+//fprintf(stderr, "DEBUG - GC async tracing marking heap obj %p ", old_obj);
+//Cyc_display(thd, old_obj, stderr);
+//fprintf(stderr, "\n");
+    mark_stack_or_heap_obj(thd, old_obj, 0);
+#if GC_DEBUG_VERBOSE
+    if (is_object_type(old_obj) && gc_is_white(old_obj)) {
+      fprintf(stderr,
+              "added to mark buffer (trace) from write barrier %p:mark %d:",
+              old_obj, mark(old_obj));
+      Cyc_display(thd, old_obj, stderr);
+      fprintf(stderr, "\n");
+    }
+#endif
+  }
+}
+
+/**
+ * @brief Read barrier for objects the collector does not trace through
+ * @param thd Mutator's thread data
+ * @param obj Key or value read from a weak table
+ *
+ * The collector may not have marked an object that is only referenced 
+ * from weak tables, so one that a mutator reads while the collector is 
+ * marking is grayed, the same as an old value in `gc_mut_update`.
+ */
+void gc_mut_read(gc_thread_data * thd, object obj)
+{
+  if (ck_pr_load_int(&(thd->gc_status)) != STATUS_ASYNC ||
+      ck_pr_load_int(&gc_stage) == STAGE_TRACING) {
+    mark_stack_or_heap_obj(thd, obj, 0);
+  }
+}
+
+static void gc_handshake_done(void);
+
+/**
+ * @brief Called by a mutator to cooperate with the collector thread
+ * @param thd Mutator's thread data
+ * @param buf_len Number of objects moved to the heap by the mutator during minor GC
+ *
+ * This function must be called periodically by each mutator to coordinate
+ * with the collector. In our implementation it is called after minor GC.
+ */
+void gc_mut_cooperate(gc_thread_data * thd, int buf_len)
+{
+  int i, status_c, status_m;
+#if GC_DEBUG_VERBOSE
+  int debug_print = 0;
+#endif
+
+  // Handle any pending marks from write barrier
+  gc_sum_pending_writes(thd, 0);
+
+  // Pick up any pages that were swept in the background
+  gc_collect_swept_pages(thd);
+
+  // I think below is thread safe, but this code is tricky.
+  // Worst case should be that some work is done twice if there is
+  // a race condition
+  //
+  // TODO: should use an atomic comparison here
+  status_c = ck_pr_load_int(&gc_status_col);
+  status_m = ck_pr_load_int(&(thd->gc_status));
+  if (status_m != status_c) {
+    // Do the work for this handshake before publishing the new status;
+    // once the collector sees it, the collector may begin tracing at once.
+    if (status_m == STATUS_ASYNC) {
+      // Async is done, so clean up old mark data from the last collection
+      gc_zero_read_write_counts(thd);
+    } else if (status_m == STATUS_SYNC2) {
+#if GC_DEBUG_VERBOSE
+      debug_print = 1;
+#endif
+//printf("DEBUG - mutator is cooperating\n");            
+      // Mark thread "roots":
+      // Begin by marking current continuation, which may have already
+      // been on the heap prior to latest minor GC
+      pthread_mutex_lock(&(thd->lock));
+      gc_mark_gray(thd, thd->gc_cont);
+      for (i = 0; i < thd->gc_num_args; i++) {
+        gc_mark_gray(thd, thd->gc_args[i]);
+      }
+      // Mark thread object, if applicable. Very likely this is its only ref
+      if (thd->scm_thread_obj) {
+        gc_mark_gray(thd, thd->scm_thread_obj);
+      }
+      if (thd->exception_handler_stack) {
+        gc_mark_gray(thd, thd->exception_handler_stack);
+      }
+      if (thd->param_objs) {
+        gc_mark_gray(thd, thd->param_objs);
+      }
+      // Also, mark everything the collector moved to the heap
+      for (i = 0; i < buf_len; i++) {
+        gc_mark_gray(thd, thd->moveBuf[i]);
+      }
+      pthread_mutex_unlock(&(thd->lock));
+      thd->gc_alloc_color = ck_pr_load_8(&gc_color_mark);
+    }
+    if (ck_pr_cas_int(&(thd->gc_status), status_m, status_c)) {
+      gc_handshake_done();
+    } else {
+      gc_notify_handshake();
+    }
+  }
+#if GC_DEBUG_VERBOSE
+  if (debug_print) {
+    fprintf(stderr, "coop mark gc_cont %p\n", thd->gc_cont);
+    for (i = 0; i < thd->gc_num_args; i++) {
+      fprintf(stderr, "coop mark gc_args[%d] %p\n", i, thd->gc_args[i]);
+    }
+    for (i = 0; i < buf_len; i++) {
+      fprintf(stderr, "coop mark from move buf %i %p\n", i, thd->moveBuf[i]);
+    }
+  }
+#endif
+
+  // If we have finished tracing, clear any "full" bits on the heap
+  if(ck_pr_cas_8(&(thd->gc_done_tracing), 1, 0)) {
+    int heap_type, unswept;
+    gc_heap *h_tmp, *h_head;
+#if GC_DEBUG_VERBOSE
+fprintf(stdout, "done tracing, cooperator is clearing full bits\n");
+#endif
+    for (heap_type = 0; heap_type < NUM_HEAP_TYPES; heap_type++) {
+      h_head = h_tmp = thd->heap->heap[heap_type];
+      unswept = 0;
+      if (ck_pr_load_int(&gc_sweep_threads) > 0) {
+        unswept = gc_sweep_pool_handoff(thd, heap_type);
+        h_tmp = NULL;
+      }
+      for (; h_tmp; h_tmp = h_tmp->next) {
+        if (h_tmp && h_tmp->is_full == 1) {
+          h_tmp->is_full = 0;
+          h_tmp->is_unswept = 1;
+          unswept++;
+        } else if (h_tmp->is_unswept) {
+          unswept++;
+        }
+      }
+      if (h_head) {
+        unswept -= gc_arena_sweep_adopted(thd, heap_type);
+      }
+      if (h_head) {
+        h_head->num_unswept_children = unswept;
+        //printf("set num_unswept_children = %d computed = %d\n", h_head->num_unswept_children, gc_num_unswept_heaps(h_head));
+        gc_page_table_resync(thd, heap_type);
+      }
+    }
+
+    // At least for now, let the main thread help clean up any terminated threads
+    if (thd == primordial_thread) {
+#if GC_DEBUG_TRACE
+      fprintf(stderr, "main thread is cleaning up any old thread data\n");
+#endif
+      gc_free_old_thread_data();
+    }
+
+    // Release empty pages if there is plenty of free space without them
+    gc_heap_trim(thd, gc_over_soft_limit(), 0);
+
+    gc_trace_mutator(thd);
+
+    // Clear allocation counts to delay next GC trigger
+    thd->heap_num_huge_allocations = 0;
+    thd->heap_huge_allocation_bytes = 0;
+    thd->heap_arena_adopted_bytes = 0;
+    thd->num_minor_gcs = 0;
+// TODO: can't do this now because we don't know how much of the heap is free, as none if it has
+// been swept and we are sweeping incrementally
+//
+//    for (heap_type = 0; heap_type < 2; heap_type++) {
+//      uint64_t free_size = gc_heap_free_size(thd->heap->heap[heap_type]),
+//               threshold = (thd->cached_heap_total_sizes[heap_type]) * GC_FREE_THRESHOLD;
+//      if (free_size < threshold) {
+//        int i, new_heaps = (int)((threshold - free_size) / HEAP_SIZE);
+//        if (new_heaps < 1) {
+//          new_heaps = 1;
+//        }
+////#if GC_DEBUG_TRACE
+//        fprintf(stderr, "Less than %f%% of the heap %d is free (%llu / %llu), growing it %d times\n",
+//                100.0 * GC_FREE_THRESHOLD, heap_type, free_size, threshold, new_heaps);
+////#endif
+//if (new_heaps > 100){ exit(1);} // Something is wrong!
+//        for(i = 0; i < new_heaps; i++){
+//          gc_grow_heap(thd->heap->heap[heap_type], heap_type, 0, 0, thd);
+//        }
+//    //  while ( gc_heap_free_size(thd->heap->heap[heap_type]) < //thd->cached_heap_free_sizes[heap_type] <
+//    //    if (heap_type == HEAP_SM) {
+//    //      gc_grow_heap(thd->heap->heap[heap_type], heap_type, 0, 0, thd);
+//    //    } else if (heap_type == HEAP_64) {
+//    //      gc_grow_heap(thd->heap->heap[heap_type], heap_type, 0, 0, thd);
+//    //    } else if (heap_type == HEAP_REST) {
+//    //      gc_grow_heap(thd->heap->heap[heap_type], heap_type, 0, 0, thd);
+//    //    }
+//      }
+//    }
+
+
+    // DEBUG diagnostics
+#if GC_DEBUG_SHOW_SWEEP_DIAG
+    for (heap_type = 0; heap_type < NUM_HEAP_TYPES; heap_type++) {
+      h_tmp = thd->heap->heap[heap_type];
+      if (h_tmp) {
+        fprintf(stderr, "From collector - Heap %d diagnostics:\n", heap_type);
+        gc_print_stats(h_tmp);
+      }
+    }
+#endif
+  }
+
+  // Return memory to the OS if the collector has been idle for a while
+  if (thd->trim_epoch != ck_pr_load_int(&gc_trim_epoch)) {
+    thd->trim_epoch = ck_pr_load_int(&gc_trim_epoch);
+    gc_heap_trim(thd, 0, 1);
+  }
+
+  // Free arenas that ended since the last minor GC
+  gc_arena_free_retired(thd);
+
+  thd->num_minor_gcs++;
+  if (thd->num_minor_gcs % 10 == 9 || // Throttle a bit since usually we do not need major GC
+      gc_over_soft_limit()) {
+    int heap_type, collect = 0;
+    double threshold = gc_collection_threshold();
+    for (heap_type = 0; heap_type < HEAP_HUGE; heap_type++) {
+      thd->cached_heap_free_sizes[heap_type] = 
+        thd->page_table->free_size[heap_type] + 
+        thd->cached_heap_sweep_sizes[heap_type];
+#if GC_DEBUG_VERBOSE
+      fprintf(stderr, "heap %d free %zu total %zu\n", heap_type, thd->cached_heap_free_sizes[heap_type], thd->cached_heap_total_sizes[heap_type]);
+      if (thd->cached_heap_free_sizes[heap_type] > thd->cached_heap_total_sizes[heap_type]) {
+        fprintf(stderr, "gc_mut_cooperate - Invalid cached heap sizes, free=%zu total=%zu\n", 
+          thd->cached_heap_free_sizes[heap_type], thd->cached_heap_total_sizes[heap_type]);
+        exit(1);
+      }
+#endif
+      if (thd->cached_heap_free_sizes[heap_type] <
+          thd->cached_heap_total_sizes[heap_type] * threshold) {
+        collect = 1;
+      }
+    }
+
+    // Initiate collection cycle if free space is too low.
+    // Threshold is intentially low because we have to go through an
+    // entire handshake/trace/sweep cycle, ideally without growing heap.
+    if (ck_pr_load_int(&gc_stage) == STAGE_RESTING &&
+        (collect ||
+         // Separate huge heap threshold since these are typically allocated as whole pages
+         (thd->heap_num_huge_allocations > 100)
+          )) {
+  #if GC_DEBUG_TRACE
+      fprintf(stderr,
+              "Less than %f%% of the heap is free, initiating collector\n",
+              100.0 * gc_param(GC_PARAM_COLLECTION_THRESHOLD));
+  #endif
+      gc_start_major_collection(thd);
+    }
+  }
+}
+
+/////////////////////////////////////////////
+// Collector functions
+
+/**
+ * @brief Mark the given object gray if it is on the heap.
+ * @param thd Mutator's thread data
+ * @param obj Object to gray
+ *
+ * Note marking is done implicitly by placing it in a buffer,
+ * to avoid repeated re-scanning.
+ *
+ * This function must be executed once the thread lock has been acquired.
+ */
+void gc_mark_gray(gc_thread_data * thd, object obj)
+{
+  // From what I can tell, no other thread would be modifying
+  // either object type or mark. Both should be stable once the object is placed
+  // into the heap, with the collector being the only thread that changes marks.
+  //
+  // Note when marking we check for both clear and purple to prevent against 
+  // timing issues when incrementing colors and since if we ever reach a
+  // purple object during tracing we would want to mark it.
+  // TODO: revisit if checking for gc_color_purple is truly necessary here and elsewhere.
+  if (is_object_type(obj) && gc_is_white(obj)) {     // TODO: sync??
+    // Place marked object in a buffer to avoid repeated scans of the heap.
+// TODO:
+// Note that ideally this should be a lock-free data structure to make the
+// algorithm more efficient. So this code (and the corresponding collector
+// trace code) should be converted at some point.
+    mark_buffer_set(thd->mark_buffer, thd->last_write, obj);
+    (thd->last_write)++;        // Already locked, just do it...
+  }
+}
+
+/**
+ * @brief Add a pending write to the mark buffer.
+ * @param thd Mutator's thread data
+ * @param obj Object to gray
+ *
+ * These are pended because they are written in a batch during minor GC.
+ * To prevent race conditions we wait until all of the writes are made before
+ * updating last write.
+ *
+ * TODO: figure out a new name for this function.
+ */
+void gc_mark_gray2(gc_thread_data * thd, object obj)
+{
+  if (is_object_type(obj) && gc_is_white(obj)) {
+    mark_buffer_set(thd->mark_buffer, thd->last_write + thd->pending_writes, obj);
+    thd->pending_writes++;
+  }
+}
+
+/**
+ * @brief "Color" objects gray by adding them to the mark stack for further processing.
+ * @param parent Parent of object, used for debugging only
+ * @param obj Object to mark
+ *
+ * Note that stack objects are always colored red during creation, so
+ * they should never be added to the mark stack. Which would be bad because it
+ * could lead to stack corruption.
+ */
+#if GC_DEBUG_VERBOSE
+static void gc_collector_mark_gray(object parent, object obj)
+{
+  if (is_object_type(obj) && gc_is_white(obj)) {
+    mark_stack = vpbuffer_add(mark_stack, &mark_stack_len, mark_stack_i++, obj);
+    fprintf(stderr, "mark gray parent = %p (%d) obj = %p\n", parent,
+            type_of(parent), obj);
+  } else if (is_object_type(obj)) {
+    fprintf(stderr, "not marking gray, parent = %p (%d) obj = %p mark(obj) = %d, gc_color_clear = %d\n", parent,
+            type_of(parent), obj, mark(obj), gc_color_clear);
+  }
+}
+#else
+//
+// Attempt to speed this up by forcing an inline
+//
+#define gc_collector_mark_gray(parent, gobj) \
+  if (is_object_type(gobj) && gc_is_white(gobj)) { \
+    mark_stack = vpbuffer_add(mark_stack, &mark_stack_len, mark_stack_i++, gobj); \
+  }
+#endif
+
+/** Is the vector `v` a weak table? See types.h */
+#define gc_is_weak_table(v) \
+  (type_of(v) == vector_tag && \
+   ((vector) (v))->num_elements >= GC_WEAK_FIRST && \
+   (((vector) (v))->elements[GC_WEAK_MARKER] == gc_weak_keys || \
+    ((vector) (v))->elements[GC_WEAK_MARKER] == gc_ephemerons))
+
+/**
+ * @brief Determine if a key of a weak table is still alive
+ *
+ * Only objects the major GC may free can die, so objects that are not on
+ * the heap or are in a young heap are always alive.
+ */
+static int gc_weak_key_is_live(object key)
+{
+  gc_heap *h;
+  if (!is_object_type(key) || !gc_is_white(key)) {
+    return 1;
+  }
+  h = gc_page_lookup(key);
+  return h == NULL || h->arena != NULL;
+}
+
+#if GC_DEBUG_VERBOSE
+void gc_mark_black(object obj)
+{
+  // TODO: is sync required to get colors? probably not on the collector
+  // thread (at least) since colors are only changed once during the clear
+  // phase and before the first handshake.
+  int markColor = ck_pr_load_8(&gc_color_mark);
+  if (is_object_type(obj) && !gc_is_black(obj, markColor)) {
+    // Gray any child objects
+    // Note we probably should use some form of atomics/synchronization
+    // for cons and vector types, as these pointers could change.
+    switch (type_of(obj)) {
+    case pair_tag:{
+        gc_collector_mark_gray(obj, car(obj));
+        gc_collector_mark_gray(obj, cdr(obj));
+        break;
+      }
+    case closure1_tag:
+      gc_collector_mark_gray(obj, ((closure1) obj)->element);
+      break;
+    case closureN_tag:{
+        int i, n = ((closureN) obj)->num_elements;
+        for (i = 0; i < n; i++) {
+          gc_collector_mark_gray(obj, ((closureN) obj)->elements[i]);
+        }
+        break;
+      }
+    case vector_tag:
+    case record_tag:{
+        int i, n = ((vector) obj)->num_elements;
+        if (gc_is_weak_table(obj)) {
+          gc_mark_weak_table(NULL, obj);
+          break;
+        }
+        for (i = 0; i < n; i++) {
+          gc_collector_mark_gray(obj, ((vector) obj)->elements[i]);
+        }
+        break;
+      }
+    case cvar_tag:{
+        cvar_type *c = (cvar_type *) obj;
+        object pvar = *(c->pvar);
+        if (pvar) {
+          gc_collector_mark_gray(obj, pvar);
+        }
+        break;
+      }
+    case atomic_tag: {
+        atomic_type *a = (atomic_type *)obj;
+        object o = ck_pr_load_ptr(&(a->obj));
+        if (obj) {
+          gc_collector_mark_gray(obj, o);
+        }
+      }
+    default:
+      break;
+    }
+    gc_blacken(obj, markColor);
+    if (mark(obj) != gc_color_red) {
+      fprintf(stderr, "marked %p %d\n", obj, markColor);
+    } else {
+      fprintf(stderr, "not marking stack obj %p %d\n", obj, markColor);
+    }
+  }
+}
+#else
+// See full version above for debugging purposes.
+// Also sync any changes to this macro with the function version
+#define gc_mark_black(obj) \
+{ \
+  int markColor = ck_pr_load_8(&gc_color_mark); \
+  if (is_object_type(obj) && !gc_is_black(obj, markColor)) { \
+    switch (type_of(obj)) { \
+    case pair_tag:{ \
+        gc_collector_mark_gray(obj, car(obj)); \
+        gc_collector_mark_gray(obj, cdr(obj)); \
+        break; \
+      } \
+    case closure1_tag: \
+      gc_collector_mark_gray(obj, ((closure1) obj)->element); \
+      break; \
+    case closureN_tag:{ \
+        int i, n = ((closureN) obj)->num_elements; \
+        for (i = 0; i < n; i++) { \
+          gc_collector_mark_gray(obj, ((closureN) obj)->elements[i]); \
+        } \
+        break; \
+      } \
+    case vector_tag: \
+    case record_tag:{ \
+        int i, n = ((vector) obj)->num_elements; \
+        if (gc_is_weak_table(obj)) { \
+          gc_mark_weak_table(NULL, obj); \
+          break; \
+        } \
+        for (i = 0; i < n; i++) { \
+          gc_collector_mark_gray(obj, ((vector) obj)->elements[i]); \
+        } \
+        break; \
+      } \
+    case cvar_tag:{ \
+        cvar_type *c = (cvar_type *) obj; \
+        object pvar = *(c->pvar); \
+        if (pvar) { \
+          gc_collector_mark_gray(obj, pvar); \
+        } \
+        break; \
+      } \
+    default: \
+      break; \
+    } \
+    gc_blacken(obj, markColor); \
+  } \
+}
+#endif
+
+/////////////////////////////////////////////
+// Parallel marking
+
+/**
+ * @brief Set the number of helper threads used to trace the heap
+ * @param n Number of helper threads, 0 to trace on the collector thread only
+ *
+ * Helper threads are spawned lazily by the collector the next time it 
+ * traces, so this may be called at any time. If the count is reduced
+ * any extra helpers that were already started simply sit out of each
+ * tracing round.
+ */
+void gc_set_mark_threads(int n)
+{
+  if (n < 0) {
+    n = 0;
+  } else if (n > GC_MAX_MARK_THREADS) {
+    n = GC_MAX_MARK_THREADS;
+  }
+  ck_pr_store_int(&gc_mark_threads, n);
+}
+
+/**
+ * @brief Get the number of helper threads used to trace the heap
+ * @return Number of helper threads
+ */
+int gc_get_mark_threads(void)
+{
+  return ck_pr_load_int(&gc_mark_threads);
+}
+
+/**
+ * @brief Move the oldest half of a worker's private stack to its shared deque
+ * @param w Tracer to publish work for
+ *
+ * Objects near the bottom of the stack were found first and generally 
+ * have the most work remaining underneath them, so those are offered up 
+ * to thieves while the owner continues with the most recent objects.
+ */
+static void gc_mark_worker_share(gc_mark_worker *w)
+{
+  int i, n = w->stack_i / 2;
+  pthread_mutex_lock(&(w->lock));
+  if (w->shared_head == w->shared_tail) {
+    w->shared_head = w->shared_tail = 0;
+  }
+  for (i = 0; i < n; i++) {
+    w->shared = vpbuffer_add(w->shared, &(w->shared_len), w->shared_tail++, w->stack[i]);
+  }
+  pthread_mutex_unlock(&(w->lock));
+  memmove(w->stack, w->stack + n, (w->stack_i - n) * sizeof(void *));
+  w->stack_i -= n;
+}
+
+/**
+ * @brief Take the next object to trace from a worker's own queues
+ * @param w Tracer
+ * @return Object to trace, or NULL if the worker is out of work
+ */
+static object gc_mark_worker_pop(gc_mark_worker *w)
+{
+  if (w->stack_i > 0) {
+    return w->stack[--(w->stack_i)];
+  }
+  if (ck_pr_load_int(&(w->shared_tail)) != ck_pr_load_int(&(w->shared_head))) {
+    object obj = NULL;
+    pthread_mutex_lock(&(w->lock));
+    if (w->shared_tail > w->shared_head) {
+      obj = w->shared[--(w->shared_tail)];
+    }
+    pthread_mutex_unlock(&(w->lock));
+    return obj;
+  }
+  return NULL;
+}
+
+/**
+ * @brief Steal half of the shared work from another tracer
+ * @param w Tracer doing the stealing
+ * @return True if work was stolen, false otherwise
+ */
+static int gc_mark_worker_steal(gc_mark_worker *w)
+{
+  int i, n, num_workers = ck_pr_load_int(&mark_round_workers);
+  for (i = 1; i < num_workers; i++) {
+    gc_mark_worker *victim = &mark_workers[(w->id + i) % num_workers];
+    if (ck_pr_load_int(&(victim->shared_tail)) == 
+        ck_pr_load_int(&(victim->shared_head))) {
+      continue;
+    }
+    pthread_mutex_lock(&(victim->lock));
+    n = (victim->shared_tail - victim->shared_head + 1) / 2;
+    while (n-- > 0) {
+      w->stack = vpbuffer_add(w->stack, &(w->stack_len), w->stack_i++, 
+                              victim->shared[victim->shared_head++]);
+    }
+    pthread_mutex_unlock(&(victim->lock));
+    if (w->stack_i > 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Determine if any tracer has work available to steal
+ */
+static int gc_mark_work_available(void)
+{
+  int i, num_workers = ck_pr_load_int(&mark_round_workers);
+  for (i = 0; i < num_workers; i++) {
+    if (ck_pr_load_int(&(mark_workers[i].shared_tail)) != 
+        ck_pr_load_int(&(mark_workers[i].shared_head))) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+#define gc_par_mark_gray(w, gobj) \
+  if (is_object_type(gobj) && gc_is_white(gobj)) { \
+    (w)->stack = vpbuffer_add((w)->stack, &((w)->stack_len), (w)->stack_i++, gobj); \
+  }
+
+/**
+ * @brief Parallel version of `gc_mark_black`
+ * @param w Tracer
+ * @param obj Object to mark
+ *
+ * Several tracers may reach the same object at the same time. We do not 
+ * bother with a CAS to claim it since marking is idempotent - in the 
+ * rare case of a race both tracers gray the object's children, which 
+ * costs a little duplicate work but is otherwise harmless and much 
+ * cheaper than an atomic operation on every object.
+ */
+static void gc_par_mark_black(gc_mark_worker *w, object obj, unsigned char markColor)
+{
+  if (!is_object_type(obj) || gc_is_black(obj, markColor)) {
+    return;
+  }
+  gc_blacken(obj, markColor);
+  switch (type_of(obj)) {
+  case pair_tag:{
+      gc_par_mark_gray(w, car(obj));
+      gc_par_mark_gray(w, cdr(obj));
+      break;
+    }
+  case closure1_tag:
+    gc_par_mark_gray(w, ((closure1) obj)->element);
+    break;
+  case closureN_tag:{
+      int i, n = ((closureN) obj)->num_elements;
+      for (i = 0; i < n; i++) {
+        gc_par_mark_gray(w, ((closureN) obj)->elements[i]);
+      }
+      break;
+    }
+  case vector_tag:
+  case record_tag:{
+      int i, n = ((vector) obj)->num_elements;
+      if (gc_is_weak_table(obj)) {
+        gc_mark_weak_table(w, obj);
+        break;
+      }
+      for (i = 0; i < n; i++) {
+        gc_par_mark_gray(w, ((vector) obj)->elements[i]);
+      }
+      break;
+    }
+  case cvar_tag:{
+      cvar_type *c = (cvar_type *) obj;
+      object pvar = *(c->pvar);
+      if (pvar) {
+        gc_par_mark_gray(w, pvar);
+      }
+      break;
+    }
+  default:
+    break;
+  }
+}
+
+/**
+ * @brief Gray the elements of a weak table that it keeps alive
+ * @param w   Tracer, or NULL if tracing on the collector thread only
+ * @param obj Weak table, see types.h
+ *
+ * Keys are never grayed. Values are, except for those of an ephemeron
+ * table whose key has not been marked yet, which are left to 
+ * `gc_weak_finish`. The table is recorded so that function can delete
+ * the entries whose keys are not marked by the end of tracing.
+ */
+static void gc_mark_weak_table(gc_mark_worker *w, object obj)
+{
+  object *e = ((vector) obj)->elements;
+  int i, n = ((vector) obj)->num_elements,
+      ephemerons = (e[GC_WEAK_MARKER] == gc_ephemerons);
+  for (i = GC_WEAK_FIRST; i + 2 < n; i += 3) {
+    if (!obj_is_int(e[i]) || (ephemerons && !gc_weak_key_is_live(e[i + 1]))) {
+      continue;
+    }
+    if (w) {
+      gc_par_mark_gray(w, e[i + 2]);
+    } else {
+      gc_collector_mark_gray(obj, e[i + 2]);
+    }
+  }
+  pthread_mutex_lock(&gc_weak_lock);
+  gc_weak_tables = vpbuffer_add(gc_weak_tables, &gc_weak_tables_len, 
+                                gc_weak_tables_i++, obj);
+  pthread_mutex_unlock(&gc_weak_lock);
+}
+
+/**
+ * @brief Trace until every tracer in the current round runs out of work
+ * @param w Tracer
+ *
+ * A tracer that cannot find work announces that it is idle and then waits
+ * for either more work to be shared or for all other tracers to go idle,
+ * at which point tracing is complete.
+ */
+static void gc_mark_worker_run(gc_mark_worker *w)
+{
+  unsigned char markColor = ck_pr_load_8(&gc_color_mark);
+  object obj;
+  int spins;
+  while (1) {
+    while ((obj = gc_mark_worker_pop(w)) != NULL) {
+      gc_par_mark_black(w, obj, markColor);
+      if (w->stack_i > 1 &&
+          ck_pr_load_int(&(w->shared_tail)) == ck_pr_load_int(&(w->shared_head)) &&
+          (w->stack_i > 256 || ck_pr_load_int(&mark_idle) > 0)) {
+        gc_mark_worker_share(w);
+      }
+    }
+    if (gc_mark_worker_steal(w)) {
+      continue;
+    }
+    ck_pr_inc_int(&mark_idle);
+    for (spins = 0; ; spins++) {
+      if (ck_pr_load_int(&mark_idle) == ck_pr_load_int(&mark_round_workers)) {
+        return;
+      }
+      if (gc_mark_work_available()) {
+        ck_pr_dec_int(&mark_idle);
+        break;
+      }
+      // Back off so idle tracers do not starve the ones with work
+      if (spins < 64) {
+        ck_pr_stall();
+      } else {
+        sched_yield();
+      }
+    }
+  }
+}
+
+/**
+ * @brief Main loop for a helper tracer thread
+ * @param arg Tracer data for this thread
+ */
+static void *gc_mark_helper_main(void *arg)
+{
+  gc_mark_worker *w = (gc_mark_worker *)arg;
+  int round = w->round;
+  while (1) {
+    pthread_mutex_lock(&mark_pool_lock);
+    while (mark_round == round) {
+      pthread_cond_wait(&mark_pool_cond, &mark_pool_lock);
+    }
+    round = mark_round;
+    pthread_mutex_unlock(&mark_pool_lock);
+
+    if (w->id < ck_pr_load_int(&mark_round_workers)) {
+      gc_mark_worker_run(w);
+    }
+
+    pthread_mutex_lock(&mark_pool_lock);
+    // Only count this helper towards the round it took part in
+    if (round == mark_round) {
+      mark_helpers_done++;
+      pthread_cond_signal(&mark_pool_done_cond);
+    }
+    pthread_mutex_unlock(&mark_pool_lock);
+  }
+  return NULL;
+}
+
+/**
+ * @brief Initialize data for a single tracer
+ */
+static void gc_mark_worker_init(gc_mark_worker *w, int id)
+{
+  w->id = id;
+  w->stack_len = 128;
+  w->stack = vpbuffer_realloc(NULL, &(w->stack_len));
+  w->stack_i = 0;
+  w->shared_len = 128;
+  w->shared = vpbuffer_realloc(NULL, &(w->shared_len));
+  w->shared_head = 0;
+  w->shared_tail = 0;
+  if (pthread_mutex_init(&(w->lock), NULL) != 0) {
+    fprintf(stderr, "Unable to initialize mark worker mutex\n");
+    exit(1);
+  }
+}
+
+/**
+ * @brief Spawn helper tracer threads, up to the requested count
+ *
+ * Only called by the collector thread.
+ */
+static void gc_start_mark_helpers(int n)
+{
+  if (mark_workers == NULL) {
+    mark_workers = calloc(GC_MAX_MARK_THREADS + 1, sizeof(gc_mark_worker));
+    gc_mark_worker_init(&mark_workers[0], 0);
+  }
+  while (mark_helpers_started < n) {
+    gc_mark_worker *w = &mark_workers[mark_helpers_started + 1];
+    gc_mark_worker_init(w, mark_helpers_started + 1);
+    // Rounds that already ran are not this helper's to finish
+    pthread_mutex_lock(&mark_pool_lock);
+    w->round = mark_round;
+    pthread_mutex_unlock(&mark_pool_lock);
+    if (pthread_create(&(w->thread), NULL, gc_mark_helper_main, w)) {
+      fprintf(stderr, "Error creating mark helper thread\n");
+      exit(1);
+    }
+    mark_helpers_started++;
+  }
+}
+
+/**
+ * @brief Push an object onto the collector's parallel mark stack
+ */
+static void gc_parallel_mark_push(object obj)
+{
+  gc_mark_worker *w = &mark_workers[0];
+  w->stack = vpbuffer_add(w->stack, &(w->stack_len), w->stack_i++, obj);
+}
+
+/**
+ * @brief Trace everything reachable from the collector's mark stack using 
+ *        the collector thread along with all of the helper threads.
+ *
+ * Returns once the transitive closure has been marked and all helpers have
+ * gone back to sleep.
+ */
+static void gc_parallel_mark(void)
+{
+  // Pick up anything grayed by the serial code, EG: marking of globals
+  while (mark_stack_i > 0) {
+    gc_parallel_mark_push(mark_stack[--mark_stack_i]);
+  }
+  ck_pr_store_int(&mark_round_workers, 
+    1 + (gc_mark_threads < mark_helpers_started ? 
+         gc_mark_threads : mark_helpers_started));
+  ck_pr_store_int(&mark_idle, 0);
+
+  pthread_mutex_lock(&mark_pool_lock);
+  mark_helpers_done = 0;
+  mark_round++;
+  pthread_cond_broadcast(&mark_pool_cond);
+  pthread_mutex_unlock(&mark_pool_lock);
+
+  gc_mark_worker_run(&mark_workers[0]);
+
+  pthread_mutex_lock(&mark_pool_lock);
+  while (mark_helpers_done < mark_helpers_started) {
+    pthread_cond_wait(&mark_pool_done_cond, &mark_pool_lock);
+  }
+  pthread_mutex_unlock(&mark_pool_lock);
+}
+
+/**
+ * @brief The collector's tracing algorithm
+ *
+ * This function ensures all live objects are marked prior to transitioning
+ * to the collector's sweep phase.
+ */
+void gc_collector_trace()
+{
+  ck_array_iterator_t iterator;
+  gc_thread_data *m;
+  int clean = 0, last_write;
+  int parallel = ck_pr_load_int(&gc_mark_threads) > 0;
+  if (parallel) {
+    gc_start_mark_helpers(gc_mark_threads);
+#if GC_DEBUG_TRACE
+    fprintf(stderr, "DEBUG - tracing with %d helper threads\n", gc_mark_threads);
+#endif
+  }
+  while (!clean) {
+    clean = 1;
+
+    CK_ARRAY_FOREACH(&Cyc_mutators, &iterator, &m) {
+      pthread_mutex_lock(&(m->lock));
+      // Try doing this loop (majority of tracing) without the lock. We
+      // shouldn't need to be locked to do it anyway and we still lock
+      // below as a fail-safe. One potential issue here is this would be 
+      // broken if the mark buffer needs to be grown. But this is not a
+      // problem because we will only go as far as the mutator already 
+      // went with the version of last write we are holding here... so
+      // we avoid that race condition.
+      last_write = m->last_write;
+      pthread_mutex_unlock(&(m->lock)); 
+      if (parallel) {
+        // Hand the mark buffer off to the tracers in bulk
+        while (m->last_read < last_write) {
+          clean = 0;
+          gc_parallel_mark_push(mark_buffer_get(m->mark_buffer, m->last_read));
+          (m->last_read)++;
+        }
+      }
+      while (m->last_read < last_write) {
+        clean = 0;
+#if GC_DEBUG_VERBOSE
+        fprintf(stderr,
+                "gc_mark_black mark buffer %p, last_read = %d last_write = %d\n",
+                mark_buffer_get(m->mark_buffer, m->last_read), m->last_read, last_write);
+#endif
+        gc_mark_black(mark_buffer_get(m->mark_buffer, m->last_read));
+        gc_empty_collector_stack();
+        (m->last_read)++;       // Inc here to prevent off-by-one error
+      }
+      //pthread_mutex_unlock(&(m->lock));
+
+      // Try checking the condition once more after giving the
+      // mutator a chance to respond, to prevent exiting early.
+      // This is experimental, not sure if it is necessary
+      if (clean) {
+        pthread_mutex_lock(&(m->lock));
+        if (m->last_read < m->last_write) {
+#if GC_SAFETY_CHECKS
+          fprintf(stderr,
+                  "gc_collector_trace - might have exited trace early\n");
+#endif
+          clean = 0;
+        } else if (m->pending_writes) {
+          clean = 0;
+        }
+        pthread_mutex_unlock(&(m->lock));
+      }
+    }
+    if (parallel && !clean) {
+      gc_parallel_mark();
+    }
+  }
+}
+
+/**
+ * @brief Empty the collector's mark stack
+ *
+ * Objects on the stack are removed one at a time and marked
+ */
+void gc_empty_collector_stack()
+{
+  object obj;
+  // Mark stack is only used by the collector thread, so no sync needed
+  while (mark_stack_i > 0) {    // not empty
+    mark_stack_i--;
+//#if GC_DEBUG_VERBOSE
+//    fprintf(stderr, "gc_mark_black mark stack %p \n",
+//      mark_stack[mark_stack_i]);
+//#endif
+    obj = mark_stack[mark_stack_i];
+    gc_mark_black(obj);
+  }
 }
 
 /**
- * @brief Move pending writes to 'last_write'
- * @param thd Mutator's thread data object
- * @param locked  Does the caller hold the mutator lock?
+ * @brief Called by the collector thread to perform a handshake with 
+ *        all of the mutators
+ * @param s Transition to this GC status
  */
-void gc_sum_pending_writes(gc_thread_data * thd, int locked)
+void gc_handshake(gc_status_type s)
 {
-  if (!locked) {
-    pthread_mutex_lock(&(thd->lock));
-  }
-  thd->last_write += thd->pending_writes;
-  thd->pending_writes = 0;
-  if (!locked) {
-    pthread_mutex_unlock(&(thd->lock));
-  }
+  gc_post_handshake(s);
+  gc_wait_handshake();
 }
 
-// /**
-//  * @brief Determine if object lives on the thread's stack
-//  * @param thd Mutator's thread data
-//  * @param obj Object to inspect
-//  * @return True if `obj` is on the mutator's stack, false otherwise
-//  */
-// int gc_is_stack_obj(gc_thread_data * thd, object obj)
-// {
-//   char tmp;
-//   object low_limit = &tmp;
-//   object high_limit = thd->stack_start;
-//   return (stack_overflow(low_limit, obj) && stack_overflow(obj, high_limit));
-// }
+/**
+ * @brief Change GC status to the given type
+ * @param s Transition to this GC status
+ */
+void gc_post_handshake(gc_status_type s)
+{
+  int status = ck_pr_load_int(&gc_status_col);
+  while (!ck_pr_cas_int(&gc_status_col, status, s)) {
+  }
+}
 
 /**
- * @brief Helper function for `gc_mut_update`
+ * @brief Let the collector know a mutator has handshaked or changed its
+ *        thread state, in case it is waiting on that mutator.
+ *
+ * This is cheap unless the collector is actually waiting.
  */
-static void mark_stack_or_heap_obj(gc_thread_data * thd, object obj, int locked)
+void gc_notify_handshake(void)
 {
-  char tmp;
-  if (!is_object_type(obj) || type_of(obj) == boolean_tag) {
-    return;
-  } else if (gc_is_stack_obj(&tmp, thd, obj)) {
-    // Set object to be marked after moved to heap by next GC.
-    // This avoids having to recursively examine the stack now, 
-    // which we have to do anyway during minor GC.
-    grayed(obj) = 1;
-  } else {
-    // Value is on the heap, mark gray right now
-    if (!locked) { pthread_mutex_lock(&(thd->lock)); }
-    gc_mark_gray(thd, obj);
-    if (!locked) { pthread_mutex_unlock(&(thd->lock)); }
+  ck_pr_fence_memory();
+  if (ck_pr_load_int(&gc_handshake_waiting)) {
+    pthread_mutex_lock(&gc_handshake_lock);
+    pthread_cond_broadcast(&gc_handshake_cond);
+    pthread_mutex_unlock(&gc_handshake_lock);
   }
 }
 
 /**
- * @brief Write barrier for updates to heap-allocated objects
- * @param thd     Mutator's thread data
- * @param old_obj Old object value prior to the mutation
- * @param value   New object value
+ * @brief Let the collector know the calling mutator has handshaked
  *
- * The key for this barrier is to identify stack objects that contain
- * heap references, so they can be marked to avoid collection.
-*/
-void gc_mut_update(gc_thread_data * thd, object old_obj, object value)
+ * Only wakes the collector once the last mutator it is waiting on is 
+ * done. The fence pairs with the one in `gc_wait_for_mutators`, so either
+ * the collector sees our new status when counting the mutators it waits
+ * on, or we see that it is waiting and count ourselves off. In the worst
+ * case the collector is woken early and counts again.
+ */
+static void gc_handshake_done(void)
 {
-  int //status = ck_pr_load_int(&gc_status_col),
-      stage = ck_pr_load_int(&gc_stage);
-  if (ck_pr_load_int(&(thd->gc_status)) != STATUS_ASYNC) {
-    pthread_mutex_lock(&(thd->lock));
-    mark_stack_or_heap_obj(thd, old_obj, 1);
-    mark_stack_or_heap_obj(thd, value, 1);
-    pthread_mutex_unlock(&(thd->lock));
-  } else if (stage == STAGE_TRACING) {
-//fprintf(stderr, "DEBUG - GC async tracing marking heap obj %p ", old_obj);
-//Cyc_display(thd, old_obj, stderr);
-//fprintf(stderr, "\n");
-    mark_stack_or_heap_obj(thd, old_obj, 0);
-#if GC_DEBUG_VERBOSE
-    if (is_object_type(old_obj) && (mark(old_obj) == gc_color_clear ||
-                                    mark(old_obj) == gc_color_purple)) {
-      fprintf(stderr,
-              "added to mark buffer (trace) from write barrier %p:mark %d:",
-              old_obj, mark(old_obj));
-      Cyc_display(thd, old_obj, stderr);
-      fprintf(stderr, "\n");
+  ck_pr_fence_memory();
+  if (ck_pr_load_int(&gc_handshake_waiting)) {
+    pthread_mutex_lock(&gc_handshake_lock);
+    if (--gc_handshake_pending <= 0) {
+      pthread_cond_broadcast(&gc_handshake_cond);
     }
-#endif
+    pthread_mutex_unlock(&gc_handshake_lock);
   }
 }
 
 /**
- * @brief Called by a mutator to cooperate with the collector thread
- * @param thd Mutator's thread data
- * @param buf_len Number of objects moved to the heap by the mutator during minor GC
+ * @brief Handshake with a mutator if it cannot do so itself
+ * @param m       Mutator to handshake with
+ * @param statusc Status the collector is waiting for the mutator to reach
+ * @return `1` if the mutator is done with the handshake, `0` if it is 
+ *         running and the collector has to wait for it
  *
- * This function must be called periodically by each mutator to coordinate
- * with the collector. In our implementation it is called after minor GC.
+ * If the mutator is blocked the collector cooperates on its behalf,
+ * including invoking a minor GC of the mutator's stack. That is only 
+ * needed the first time, a mutator that is still blocked since the 
+ * collector last cooperated for it has nothing left on its stack, so
+ * only its roots are marked.
  */
-void gc_mut_cooperate(gc_thread_data * thd, int buf_len)
+static int gc_handshake_mutator(gc_thread_data *m, int statusc)
 {
-  int i, status_c, status_m;
-#if GC_DEBUG_VERBOSE
-  int debug_print = 0;
-#endif
-
-  // Handle any pending marks from write barrier
-  gc_sum_pending_writes(thd, 0);
-
-  // I think below is thread safe, but this code is tricky.
-  // Worst case should be that some work is done twice if there is
-  // a race condition
-  //
-  // TODO: should use an atomic comparison here
-  status_c = ck_pr_load_int(&gc_status_col);
-  status_m = ck_pr_load_int(&(thd->gc_status));
-  if (status_m != status_c) {
-    ck_pr_cas_int(&(thd->gc_status), status_m, status_c);
-    if (status_m == STATUS_ASYNC) {
-      // Async is done, so clean up old mark data from the last collection
-      gc_zero_read_write_counts(thd);
-    } else if (status_m == STATUS_SYNC2) {
-#if GC_DEBUG_VERBOSE
-      debug_print = 1;
-#endif
-//printf("DEBUG - mutator is cooperating\n");            
-      // Mark thread "roots":
-      // Begin by marking current continuation, which may have already
-      // been on the heap prior to latest minor GC
-      pthread_mutex_lock(&(thd->lock));
-      gc_mark_gray(thd, thd->gc_cont);
-      for (i = 0; i < thd->gc_num_args; i++) {
-        gc_mark_gray(thd, thd->gc_args[i]);
-      }
-      // Mark thread object, if applicable. Very likely this is its only ref
-      if (thd->scm_thread_obj) {
-        gc_mark_gray(thd, thd->scm_thread_obj);
-      }
-      if (thd->exception_handler_stack) {
-        gc_mark_gray(thd, thd->exception_handler_stack);
-      }
-      if (thd->param_objs) {
-        gc_mark_gray(thd, thd->param_objs);
-      }
-      // Also, mark everything the collector moved to the heap
-      for (i = 0; i < buf_len; i++) {
-        gc_mark_gray(thd, thd->moveBuf[i]);
-      }
-      pthread_mutex_unlock(&(thd->lock));
-      thd->gc_alloc_color = ck_pr_load_8(&gc_color_mark);
+  int statusm, thread_status, i, buf_len;
+  while (1) {
+    statusm = ck_pr_load_int(&(m->gc_status));
+    if (statusc == statusm) {
+      return 1;
     }
-  }
-#if GC_DEBUG_VERBOSE
-  if (debug_print) {
-    fprintf(stderr, "coop mark gc_cont %p\n", thd->gc_cont);
-    for (i = 0; i < thd->gc_num_args; i++) {
-      fprintf(stderr, "coop mark gc_args[%d] %p\n", i, thd->gc_args[i]);
+    thread_status = ck_pr_load_int((int *)&(m->thread_state));
+    if (thread_status == CYC_THREAD_STATE_TERMINATED) {
+      // Thread is no longer running
+      return 1;
     }
-    for (i = 0; i < buf_len; i++) {
-      fprintf(stderr, "coop mark from move buf %i %p\n", i, thd->moveBuf[i]);
+    if (thread_status != CYC_THREAD_STATE_BLOCKED &&
+        thread_status != CYC_THREAD_STATE_BLOCKED_COOPERATING) {
+      return 0;
     }
-  }
-#endif
-
-  // If we have finished tracing, clear any "full" bits on the heap
-  if(ck_pr_cas_8(&(thd->gc_done_tracing), 1, 0)) {
-    int heap_type, unswept;
-    gc_heap *h_tmp, *h_head;
-#if GC_DEBUG_VERBOSE
-fprintf(stdout, "done tracing, cooperator is clearing full bits\n");
-#endif
-    for (heap_type = 0; heap_type < NUM_HEAP_TYPES; heap_type++) {
-      h_head = h_tmp = thd->heap->heap[heap_type];
-      unswept = 0;
-      for (; h_tmp; h_tmp = h_tmp->next) {
-        if (h_tmp && h_tmp->is_full == 1) {
-          h_tmp->is_full = 0;
-          h_tmp->is_unswept = 1;
-          unswept++;
-        } else if (h_tmp->is_unswept == 1) {
-          unswept++;
-        }
+    if (statusm == STATUS_ASYNC) {  // Prev state
+      ck_pr_cas_int(&(m->gc_status), statusm, statusc);
+      // Async is done, so clean up old mark data from the last collection
+      gc_zero_read_write_counts(m);
+    } else if (statusm == STATUS_SYNC1) {
+      ck_pr_cas_int(&(m->gc_status), statusm, statusc);
+    } else if (statusm == STATUS_SYNC2) {
+      pthread_mutex_lock(&(m->lock));
+      // Check again, if thread is still blocked we need to cooperate
+      buf_len = -1;
+      if (ck_pr_cas_int((int *)&(m->thread_state),
+                        CYC_THREAD_STATE_BLOCKED,
+                        CYC_THREAD_STATE_BLOCKED_COOPERATING)) {
+        #if GC_DEBUG_TRACE
+        fprintf(stderr, "DEBUG - collector is cooperating for blocked mutator\n");            
+        #endif
+        buf_len =
+            gc_minor(m, m->stack_limit, m->stack_start, m->gc_cont, NULL,
+                     0);
+      } else if (ck_pr_load_int((int *)&(m->thread_state)) ==
+                 CYC_THREAD_STATE_BLOCKED_COOPERATING) {
+        // Already moved everything to the heap last time
+        buf_len = 0;
       }
-      if (h_head) {
-        h_head->num_unswept_children = unswept;
-        //printf("set num_unswept_children = %d computed = %d\n", h_head->num_unswept_children, gc_num_unswept_heaps(h_head));
+      if (buf_len >= 0) {
+        ck_pr_cas_int(&(m->gc_status), statusm, statusc);
+        // Handle any pending marks from write barrier
+        gc_sum_pending_writes(m, 1);
+        // Mark thread "roots", based on code from mutator's cooperator
+        gc_mark_gray(m, m->gc_cont);
+        if (m->scm_thread_obj) {
+          gc_mark_gray(m, m->scm_thread_obj);
+        }
+        if (m->exception_handler_stack) {
+          gc_mark_gray(m, m->exception_handler_stack);
+        }
+        if (m->param_objs) {
+          gc_mark_gray(m, m->param_objs);
+        }
+        // Also, mark everything the collector moved to the heap
+        for (i = 0; i < buf_len; i++) {
+          gc_mark_gray(m, m->moveBuf[i]);
+        }
+        m->gc_alloc_color = ck_pr_load_8(&gc_color_mark);
       }
+      pthread_mutex_unlock(&(m->lock));
     }
+  }
+}
 
-    // At least for now, let the main thread help clean up any terminated threads
-    if (thd == primordial_thread) {
-#if GC_DEBUG_TRACE
-      fprintf(stderr, "main thread is cleaning up any old thread data\n");
-#endif
-      gc_free_old_thread_data();
+/**
+ * @brief Block the collector until one of the running mutators it is
+ *        waiting on does something that might let the handshake proceed.
+ * @param n       Number of mutators in `gc_handshake_running`
+ * @param statusc Status the collector is waiting for the mutators to reach
+ *
+ * Mutators signal us via `gc_notify_handshake`, after a handshake only 
+ * once the last of them is done. A timeout is used as a fail-safe in case
+ * any state change is missed.
+ */
+static void gc_wait_for_mutators(int n, int statusc)
+{
+  gc_thread_data *m;
+  int i, thread_status, pending, done = 0;
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_nsec += 10 * NANOSECONDS_PER_MILLISECOND;
+  if (deadline.tv_nsec >= 1000 * NANOSECONDS_PER_MILLISECOND) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000 * NANOSECONDS_PER_MILLISECOND;
+  }
+  pthread_mutex_lock(&gc_handshake_lock);
+  ck_pr_store_int(&gc_handshake_waiting, 1);
+  ck_pr_fence_memory();
+  // Check again now that mutators know to signal us, and count the ones
+  // that still have to handshake. Any of them that has not handshaked
+  // yet will count itself off once it does.
+  pending = 0;
+  for (i = 0; i < n && !done; i++) {
+    m = gc_handshake_running[i];
+    thread_status = ck_pr_load_int((int *)&(m->thread_state));
+    if (thread_status != CYC_THREAD_STATE_RUNNABLE &&
+        thread_status != CYC_THREAD_STATE_NEW) {
+      done = 1;
+    } else if (ck_pr_load_int(&(m->gc_status)) != statusc) {
+      pending++;
     }
+  }
+  gc_handshake_pending = pending;
+  if (!done && pending > 0) {
+    pthread_cond_timedwait(&gc_handshake_cond, &gc_handshake_lock, &deadline);
+  }
+  ck_pr_store_int(&gc_handshake_waiting, 0);
+  pthread_mutex_unlock(&gc_handshake_lock);
+}
 
-    // Clear allocation counts to delay next GC trigger
-    thd->heap_num_huge_allocations = 0;
-    thd->num_minor_gcs = 0;
-// TODO: can't do this now because we don't know how much of the heap is free, as none if it has
-// been swept and we are sweeping incrementally
-//
-//    for (heap_type = 0; heap_type < 2; heap_type++) {
-//      uint64_t free_size = gc_heap_free_size(thd->heap->heap[heap_type]),
-//               threshold = (thd->cached_heap_total_sizes[heap_type]) * GC_FREE_THRESHOLD;
-//      if (free_size < threshold) {
-//        int i, new_heaps = (int)((threshold - free_size) / HEAP_SIZE);
-//        if (new_heaps < 1) {
-//          new_heaps = 1;
-//        }
-////#if GC_DEBUG_TRACE
-//        fprintf(stderr, "Less than %f%% of the heap %d is free (%llu / %llu), growing it %d times\n",
-//                100.0 * GC_FREE_THRESHOLD, heap_type, free_size, threshold, new_heaps);
-////#endif
-//if (new_heaps > 100){ exit(1);} // Something is wrong!
-//        for(i = 0; i < new_heaps; i++){
-//          gc_grow_heap(thd->heap->heap[heap_type], heap_type, 0, 0, thd);
-//        }
-//    //  while ( gc_heap_free_size(thd->heap->heap[heap_type]) < //thd->cached_heap_free_sizes[heap_type] <
-//    //    if (heap_type == HEAP_SM) {
-//    //      gc_grow_heap(thd->heap->heap[heap_type], heap_type, 0, 0, thd);
-//    //    } else if (heap_type == HEAP_64) {
-//    //      gc_grow_heap(thd->heap->heap[heap_type], heap_type, 0, 0, thd);
-//    //    } else if (heap_type == HEAP_REST) {
-//    //      gc_grow_heap(thd->heap->heap[heap_type], heap_type, 0, 0, thd);
-//    //    }
-//      }
-//    }
-
+/**
+ * @brief Wait for all mutators to handshake
+ *
+ * This function is always called by the collector. If a mutator
+ * is blocked and cannot handshake, the collector will cooperate
+ * on its behalf, see `gc_handshake_mutator`, so major GC can proceed.
+ *
+ * All mutators are visited once, and after that the collector only 
+ * looks at the ones that are running and have yet to handshake. So a
+ * handshake with many blocked threads costs little more than one pass
+ * over them.
+ */
+void gc_wait_handshake()
+{
+  ck_array_iterator_t iterator;
+  gc_thread_data *m;
+  int statusc, i, n = 0;
+  uint64_t start = gc_time_ns();
 
-    // DEBUG diagnostics
-#if GC_DEBUG_SHOW_SWEEP_DIAG
-    for (heap_type = 0; heap_type < NUM_HEAP_TYPES; heap_type++) {
-      h_tmp = thd->heap->heap[heap_type];
-      if (h_tmp) {
-        fprintf(stderr, "From collector - Heap %d diagnostics:\n", heap_type);
-        gc_print_stats(h_tmp);
+  statusc = ck_pr_load_int(&gc_status_col);
+  CK_ARRAY_FOREACH(&Cyc_mutators, &iterator, &m) {
+    if (!gc_handshake_mutator(m, statusc)) {
+      if (n == gc_handshake_running_len) {
+        gc_handshake_running_len = n ? n * 2 : 64;
+        gc_handshake_running = realloc(gc_handshake_running, 
+          sizeof(gc_thread_data *) * gc_handshake_running_len);
+        if (!gc_handshake_running) {
+          fprintf(stderr, "Unable to grow handshake list\n");
+          exit(1);
+        }
+      }
+      gc_handshake_running[n++] = m;
+    }
+  }
+  while (n > 0) {
+    gc_wait_for_mutators(n, statusc);
+    // Drop the mutators that are done, including any that blocked
+    for (i = 0; n > 0 && i < n; ) {
+      if (gc_handshake_mutator(gc_handshake_running[i], statusc)) {
+        gc_handshake_running[i] = gc_handshake_running[--n];
+      } else {
+        i++;
       }
     }
-#endif
   }
+  ck_pr_add_64(&gc_collector_stats.handshake_wait_ns, gc_time_ns() - start);
+}
 
-  thd->num_minor_gcs++;
-  if (thd->num_minor_gcs % 10 == 9) { // Throttle a bit since usually we do not need major GC
-    thd->cached_heap_free_sizes[HEAP_SM]   = gc_heap_free_size(thd->heap->heap[HEAP_SM]) ;
-    thd->cached_heap_free_sizes[HEAP_64]   = gc_heap_free_size(thd->heap->heap[HEAP_64]) ;
-    thd->cached_heap_free_sizes[HEAP_96]   = gc_heap_free_size(thd->heap->heap[HEAP_96]) ;
-    thd->cached_heap_free_sizes[HEAP_REST] = gc_heap_free_size(thd->heap->heap[HEAP_REST]);
+/////////////////////////////////////////////
+// Heap compaction
+//
+// Objects too large for a size class are allocated first fit on HEAP_REST
+// pages, and mark-sweep never moves them. Over a long run those pages may 
+// have plenty of free space in total but no chunk large enough for a new 
+// object, so the heap keeps growing. Compaction fixes that by stopping the
+// world at the end of a collection cycle, moving every object off of the
+// sparsely used and fragmented pages, updating all references to them,
+// and releasing the pages.
+//
+// Mutators stop at the end of their next minor GC, when every object they
+// use is on the heap and referenced from their roots. The collector stops
+// blocked mutators itself, moving their stack to the heap as it does for 
+// a handshake, and holds their lock so they cannot resume until it is done.
 
-#if GC_DEBUG_VERBOSE
-    fprintf(stderr, "heap %d free %zu total %zu\n", HEAP_SM, thd->cached_heap_free_sizes[HEAP_SM], thd->cached_heap_total_sizes[HEAP_SM]);
-    if (thd->cached_heap_free_sizes[HEAP_SM] > thd->cached_heap_total_sizes[HEAP_SM]) {
-      fprintf(stderr, "gc_mut_cooperate - Invalid cached heap sizes, free=%zu total=%zu\n", 
-        thd->cached_heap_free_sizes[HEAP_SM], thd->cached_heap_total_sizes[HEAP_SM]);
-      exit(1);
-    }
-    fprintf(stderr, "heap %d free %zu total %zu\n", HEAP_64, thd->cached_heap_free_sizes[HEAP_64], thd->cached_heap_total_sizes[HEAP_64]);
-    if (thd->cached_heap_free_sizes[HEAP_64] > thd->cached_heap_total_sizes[HEAP_64]) {
-      fprintf(stderr, "gc_mut_cooperate - Invalid cached heap sizes, free=%zu total=%zu\n", 
-        thd->cached_heap_free_sizes[HEAP_64], thd->cached_heap_total_sizes[HEAP_64]);
-      exit(1);
+/**
+ * @brief Get the size of the largest free chunk on a page with a free list
+ */
+static size_t gc_largest_free_chunk(gc_heap *h)
+{
+  gc_free_list *f;
+  size_t largest = 0;
+  for (f = h->free_list->next; f; f = f->next) {
+    if (f->size > largest) {
+      largest = f->size;
     }
-    fprintf(stderr, "heap %d free %zu total %zu\n", HEAP_96, thd->cached_heap_free_sizes[HEAP_96], thd->cached_heap_total_sizes[HEAP_96]);
-    if (thd->cached_heap_free_sizes[HEAP_96] > thd->cached_heap_total_sizes[HEAP_96]) {
-      fprintf(stderr, "gc_mut_cooperate - Invalid cached heap sizes, free=%zu total=%zu\n", 
-        thd->cached_heap_free_sizes[HEAP_96], thd->cached_heap_total_sizes[HEAP_96]);
-      exit(1);
+  }
+  return largest;
+}
+
+/**
+ * @brief Determine if compaction is able to move an object
+ *
+ * Only the types that may be too large for a size class are moved. Any 
+ * other object, for example a mutex that may be in use by C code, keeps
+ * its whole page in place.
+ */
+static int gc_compact_movable(object obj)
+{
+  switch (type_of(obj)) {
+  case closureN_tag:
+  case string_tag:
+  case vector_tag:
+  case record_tag:
+  case bytevector_tag:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+/**
+ * @brief Determine if the objects on a page should be moved off of it
+ * @param h         HEAP_REST page, other than the first page of its heap
+ * @param threshold Fragmentation at or above which a page is compacted
+ * @return A true value if the page should be compacted, 0 otherwise
+ *
+ * A page is compacted if no more than half of it is in use and its free
+ * space is fragmented, that is the largest free chunk is only a small part
+ * of it. Fragmentation is measured as one minus the ratio of the two.
+ */
+static int gc_compact_candidate(gc_heap *h, double threshold)
+{
+  object p, end;
+  gc_free_list *r;
+  if (!h->compactable || h->arena || h->from_arena || h->is_unswept == 1 ||
+      (uint64_t)h->free_size * 2 < h->size ||
+      gc_page_lookup(h->data) != h) { // References to it could not be found
+    return 0;
+  }
+  if (1.0 - ((double)gc_largest_free_chunk(h) / h->free_size) < threshold) {
+    return 0;
+  }
+  p = gc_heap_first_block(h);
+  end = gc_heap_end(h);
+  r = h->free_list->next;
+  while (p < end) {
+    if ((char *)r == (char *)p) {
+      p = (object) (((char *)p) + r->size);
+      r = r->next;
+      continue;
     }
-    fprintf(stderr, "heap %d free %zu total %zu\n", HEAP_REST, thd->cached_heap_free_sizes[HEAP_REST], thd->cached_heap_total_sizes[HEAP_REST]);
-    if (thd->cached_heap_free_sizes[HEAP_REST] > thd->cached_heap_total_sizes[HEAP_REST]) {
-      fprintf(stderr, "gc_mut_cooperate - Invalid cached heap sizes, free=%zu total=%zu\n", 
-        thd->cached_heap_free_sizes[HEAP_REST], thd->cached_heap_total_sizes[HEAP_REST]);
-      exit(1);
+    if (!gc_compact_movable(p)) {
+      return 0;
     }
-#endif
+    p = (object) (((char *)p) + gc_allocated_bytes(p, NULL, NULL));
+  }
+  return 1;
+}
 
-    // Initiate collection cycle if free space is too low.
-    // Threshold is intentially low because we have to go through an
-    // entire handshake/trace/sweep cycle, ideally without growing heap.
-    if (ck_pr_load_int(&gc_stage) == STAGE_RESTING &&
-        (
-         //(gc_heap_free_size(thd->heap->heap[HEAP_SM]) < //thd->cached_heap_free_sizes[HEAP_SM] <
-         (thd->cached_heap_free_sizes[HEAP_SM] <
-          thd->cached_heap_total_sizes[HEAP_SM] * GC_COLLECTION_THRESHOLD) ||
-         //(gc_heap_free_size(thd->heap->heap[HEAP_64]) < //thd->cached_heap_free_sizes[HEAP_64] <
-         (thd->cached_heap_free_sizes[HEAP_64] <
-          thd->cached_heap_total_sizes[HEAP_64] * GC_COLLECTION_THRESHOLD) ||
-  #if INTPTR_MAX == INT64_MAX
-         //(gc_heap_free_size(thd->heap->heap[HEAP_96]) < //thd->cached_heap_free_sizes[HEAP_96] <
-         (thd->cached_heap_free_sizes[HEAP_96] <
-          thd->cached_heap_total_sizes[HEAP_96] * GC_COLLECTION_THRESHOLD) ||
-  #endif
-         //(gc_heap_free_size(thd->heap->heap[HEAP_REST]) < //thd->cached_heap_free_sizes[HEAP_REST] <
-         (thd->cached_heap_free_sizes[HEAP_REST] <
-          thd->cached_heap_total_sizes[HEAP_REST] * GC_COLLECTION_THRESHOLD) ||
-         // Separate huge heap threshold since these are typically allocated as whole pages
-         (thd->heap_num_huge_allocations > 100)
-          )) {
-  #if GC_DEBUG_TRACE
-      fprintf(stderr,
-              "Less than %f%% of the heap is free, initiating collector\n",
-              100.0 * GC_COLLECTION_THRESHOLD);
-  #endif
-      ck_pr_cas_int(&gc_stage, STAGE_RESTING, STAGE_CLEAR_OR_MARKING);
+/**
+ * @brief Request a compaction if a mutator has to grow its HEAP_REST heap
+ *        while its fragmented pages have enough free space for a new page
+ * @param thd      Mutator's thread data
+ * @param new_size Size of the page being added
+ */
+static void gc_compact_check(gc_thread_data *thd, size_t new_size)
+{
+  double threshold = gc_param(GC_PARAM_COMPACT_THRESHOLD);
+  uint64_t free_size = 0;
+  gc_heap *h;
+  if (threshold <= 0 || ck_pr_load_int(&gc_compact_requested) ||
+      ck_pr_load_int(&gc_compact_stopping)) {
+    return;
+  }
+  for (h = thd->heap->heap[HEAP_REST]->next; h; h = h->next) {
+    if (gc_compact_candidate(h, threshold)) {
+      free_size += h->free_size;
     }
   }
+  if (free_size >= new_size) {
+    ck_pr_store_int(&gc_compact_requested, 1);
+  }
 }
 
-/////////////////////////////////////////////
-// Collector functions
+/**
+ * @brief Wait with `gc_compact_lock` held until compaction is done
+ * @param thd Thread data of the calling mutator, its roots must be on the heap
+ */
+static void gc_compact_wait(gc_thread_data *thd)
+{
+  ck_pr_store_int(&(thd->compact_stopped), 1);
+  gc_notify_handshake();
+  while (gc_compact_stopping) {
+    pthread_cond_wait(&gc_compact_cond, &gc_compact_lock);
+  }
+  ck_pr_store_int(&(thd->compact_stopped), 0);
+}
 
 /**
- * @brief Mark the given object gray if it is on the heap.
+ * @brief Stop the calling mutator for as long as the collector is compacting
  * @param thd Mutator's thread data
- * @param obj Object to gray
- *
- * Note marking is done implicitly by placing it in a buffer,
- * to avoid repeated re-scanning.
  *
- * This function must be executed once the thread lock has been acquired.
+ * Called at the end of each minor GC. This is cheap unless the collector
+ * is actually stopping the world.
  */
-void gc_mark_gray(gc_thread_data * thd, object obj)
+void gc_compact_park(gc_thread_data *thd)
 {
-  // From what I can tell, no other thread would be modifying
-  // either object type or mark. Both should be stable once the object is placed
-  // into the heap, with the collector being the only thread that changes marks.
-  //
-  // Note when marking we check for both clear and purple to prevent against 
-  // timing issues when incrementing colors and since if we ever reach a
-  // purple object during tracing we would want to mark it.
-  // TODO: revisit if checking for gc_color_purple is truly necessary here and elsewhere.
-  if (is_object_type(obj) && (mark(obj) == gc_color_clear ||
-                              mark(obj) == gc_color_purple)) {     // TODO: sync??
-    // Place marked object in a buffer to avoid repeated scans of the heap.
-// TODO:
-// Note that ideally this should be a lock-free data structure to make the
-// algorithm more efficient. So this code (and the corresponding collector
-// trace code) should be converted at some point.
-    mark_buffer_set(thd->mark_buffer, thd->last_write, obj);
-    (thd->last_write)++;        // Already locked, just do it...
+  if (!ck_pr_load_int(&gc_compact_stopping)) {
+    return;
   }
+  gc_alloc_buffers_flush(thd);
+  pthread_mutex_lock(&gc_compact_lock);
+  gc_compact_wait(thd);
+  pthread_mutex_unlock(&gc_compact_lock);
 }
 
 /**
- * @brief Add a pending write to the mark buffer.
- * @param thd Mutator's thread data
- * @param obj Object to gray
+ * @brief Called before a new thread first uses the heap
  *
- * These are pended because they are written in a batch during minor GC.
- * To prevent race conditions we wait until all of the writes are made before
- * updating last write.
+ * Waits for any compaction that is under way, and holds off the next one
+ * until the new thread calls `gc_thread_started`. This is called by the
+ * thread spawning the new one, or by the new thread itself if it is not
+ * started from Scheme.
+ */
+void gc_thread_starting(void)
+{
+  pthread_mutex_lock(&gc_compact_lock);
+  while (gc_compact_stopping) {
+    pthread_cond_wait(&gc_compact_cond, &gc_compact_lock);
+  }
+  gc_threads_starting++;
+  pthread_mutex_unlock(&gc_compact_lock);
+}
+
+/**
+ * @brief Called by a new thread once it has been added to the mutators
+ * @param thd New mutator's thread data
  *
- * TODO: figure out a new name for this function.
+ * From here on the thread stops at its minor GCs like any other mutator.
+ * Its roots are all on the heap at this point, so if the collector is 
+ * already waiting to compact the thread stops right away.
  */
-void gc_mark_gray2(gc_thread_data * thd, object obj)
+void gc_thread_started(gc_thread_data *thd)
 {
-  if (is_object_type(obj) && (mark(obj) == gc_color_clear ||
-                              mark(obj) == gc_color_purple)) {
-    mark_buffer_set(thd->mark_buffer, thd->last_write + thd->pending_writes, obj);
-    thd->pending_writes++;
+  gc_alloc_buffers_flush(thd);
+  pthread_mutex_lock(&gc_compact_lock);
+  gc_threads_starting--;
+  if (gc_compact_stopping) {
+    gc_compact_wait(thd);
   }
+  pthread_mutex_unlock(&gc_compact_lock);
+  gc_notify_handshake();
 }
 
 /**
- * @brief "Color" objects gray by adding them to the mark stack for further processing.
- * @param parent Parent of object, used for debugging only
- * @param obj Object to mark
+ * @brief Stop a mutator for compaction, if possible
+ * @param m Mutator to stop
+ * @return `1` if the mutator is stopped, `0` if it is still running
  *
- * Note that stack objects are always colored red during creation, so
- * they should never be added to the mark stack. Which would be bad because it
- * could lead to stack corruption.
+ * A blocked mutator is stopped by the collector. The mutator's lock is
+ * kept until compaction is done, so the mutator cannot leave the blocked 
+ * state before then, see `gc_mutator_thread_runnable`.
  */
-#if GC_DEBUG_VERBOSE
-static void gc_collector_mark_gray(object parent, object obj)
+static int gc_compact_stop_mutator(gc_thread_data *m)
 {
-  if (is_object_type(obj) && (mark(obj) == gc_color_clear ||
-                              mark(obj) == gc_color_purple)) {
-    mark_stack = vpbuffer_add(mark_stack, &mark_stack_len, mark_stack_i++, obj);
-    fprintf(stderr, "mark gray parent = %p (%d) obj = %p\n", parent,
-            type_of(parent), obj);
-  } else if (is_object_type(obj)) {
-    fprintf(stderr, "not marking gray, parent = %p (%d) obj = %p mark(obj) = %d, gc_color_clear = %d\n", parent,
-            type_of(parent), obj, mark(obj), gc_color_clear);
+  int thread_status;
+  if (ck_pr_load_int(&(m->compact_stopped))) {
+    return 1;
+  }
+  thread_status = ck_pr_load_int((int *)&(m->thread_state));
+  if (thread_status == CYC_THREAD_STATE_TERMINATED) {
+    return 1;
+  }
+  if (thread_status != CYC_THREAD_STATE_BLOCKED &&
+      thread_status != CYC_THREAD_STATE_BLOCKED_COOPERATING) {
+    return 0;
   }
+  pthread_mutex_lock(&(m->lock));
+  if (ck_pr_cas_int((int *)&(m->thread_state),
+                    CYC_THREAD_STATE_BLOCKED,
+                    CYC_THREAD_STATE_BLOCKED_COOPERATING)) {
+    gc_minor(m, m->stack_limit, m->stack_start, m->gc_cont, NULL, 0);
+  } else if (ck_pr_load_int((int *)&(m->thread_state)) !=
+             CYC_THREAD_STATE_BLOCKED_COOPERATING) {
+    pthread_mutex_unlock(&(m->lock)); // No longer blocked
+    return 0;
+  }
+  gc_alloc_buffers_flush(m);
+  ck_pr_store_int(&(m->compact_stopped), 2);
+  return 1;
 }
-#else
-//
-// Attempt to speed this up by forcing an inline
-//
-#define gc_collector_mark_gray(parent, gobj) \
-  if (is_object_type(gobj) && (mark(gobj) == gc_color_clear || mark(gobj) == gc_color_purple)) { \
-    mark_stack = vpbuffer_add(mark_stack, &mark_stack_len, mark_stack_i++, gobj); \
+
+/**
+ * @brief Let every mutator stopped for compaction continue
+ */
+static void gc_compact_resume(void)
+{
+  ck_array_iterator_t iterator;
+  gc_thread_data *m;
+  CK_ARRAY_FOREACH(&Cyc_mutators, &iterator, &m) {
+    if (ck_pr_load_int(&(m->compact_stopped)) == 2) {
+      ck_pr_store_int(&(m->compact_stopped), 0);
+      pthread_mutex_unlock(&(m->lock));
+    }
   }
-#endif
+  pthread_mutex_lock(&gc_compact_lock);
+  ck_pr_store_int(&gc_compact_stopping, 0);
+  pthread_cond_broadcast(&gc_compact_cond);
+  pthread_mutex_unlock(&gc_compact_lock);
+}
 
-#if GC_DEBUG_VERBOSE
-void gc_mark_black(object obj)
+/**
+ * @brief Stop all mutators for compaction
+ * @param limit_ms Milliseconds to wait for the mutators to stop, or 0 to
+ *                 wait for as long as it takes
+ * @return `1` if they are all stopped, or `0` if any of them did not stop
+ *         within `limit_ms`
+ *
+ * Either way the caller must call `gc_compact_resume` afterwards.
+ */
+static int gc_compact_stop_world(uint64_t limit_ms)
 {
-  // TODO: is sync required to get colors? probably not on the collector
-  // thread (at least) since colors are only changed once during the clear
-  // phase and before the first handshake.
-  int markColor = ck_pr_load_8(&gc_color_mark);
-  if (is_object_type(obj) && mark(obj) != markColor) {
-    // Gray any child objects
-    // Note we probably should use some form of atomics/synchronization
-    // for cons and vector types, as these pointers could change.
-    switch (type_of(obj)) {
-    case pair_tag:{
-        gc_collector_mark_gray(obj, car(obj));
-        gc_collector_mark_gray(obj, cdr(obj));
-        break;
-      }
-    case closure1_tag:
-      gc_collector_mark_gray(obj, ((closure1) obj)->element);
-      break;
-    case closureN_tag:{
-        int i, n = ((closureN) obj)->num_elements;
-        for (i = 0; i < n; i++) {
-          gc_collector_mark_gray(obj, ((closureN) obj)->elements[i]);
-        }
-        break;
+  ck_array_iterator_t iterator;
+  gc_thread_data *m;
+  struct timespec deadline;
+  uint64_t stop_by = gc_time_ns() + limit_ms * NANOSECONDS_PER_MILLISECOND;
+  int running;
+  pthread_mutex_lock(&gc_compact_lock);
+  ck_pr_store_int(&gc_compact_stopping, 1);
+  pthread_mutex_unlock(&gc_compact_lock);
+  while (1) {
+    // New threads register under the lock, so each one is either counted
+    // as starting or is on the mutator list
+    pthread_mutex_lock(&gc_compact_lock);
+    running = (gc_threads_starting > 0);
+    CK_ARRAY_FOREACH(&Cyc_mutators, &iterator, &m) {
+      if (!gc_compact_stop_mutator(m)) {
+        running = 1;
       }
-    case vector_tag:{
-        int i, n = ((vector) obj)->num_elements;
-        for (i = 0; i < n; i++) {
-          gc_collector_mark_gray(obj, ((vector) obj)->elements[i]);
+    }
+    pthread_mutex_unlock(&gc_compact_lock);
+    if (!running) {
+      return 1;
+    }
+    if (limit_ms > 0 && gc_time_ns() > stop_by) {
+      return 0;
+    }
+    // Mutators signal us as they stop, poll as well in case one is missed
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += NANOSECONDS_PER_MILLISECOND;
+    if (deadline.tv_nsec >= 1000 * NANOSECONDS_PER_MILLISECOND) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000 * NANOSECONDS_PER_MILLISECOND;
+    }
+    pthread_mutex_lock(&gc_handshake_lock);
+    ck_pr_store_int(&gc_handshake_waiting, 1);
+    ck_pr_fence_memory();
+    pthread_cond_timedwait(&gc_handshake_cond, &gc_handshake_lock, &deadline);
+    ck_pr_store_int(&gc_handshake_waiting, 0);
+    pthread_mutex_unlock(&gc_handshake_lock);
+  }
+}
+
+/**
+ * @brief Take back all of a stopped thread's pages that are out for sweeping
+ */
+static void gc_compact_collect_pages(gc_thread_data *thd)
+{
+  while (ck_pr_load_int(&(thd->sweep_jobs_pending)) > 0) {
+    sched_yield();
+  }
+  gc_collect_swept_pages(thd);
+  gc_alloc_buffers_flush(thd);
+}
+
+/**
+ * @brief Sweep every page of a thread's HEAP_REST heap that may have 
+ *        garbage on it, so its free space is known
+ */
+static void gc_compact_sweep(gc_thread_data *thd)
+{
+  gc_page_table *pt = thd->page_table;
+  gc_heap *h_head = thd->heap->heap[HEAP_REST], *h_prev = NULL, *h, *keep;
+  uint64_t prev_free_size;
+  unsigned int h_size;
+  for (h = h_head; h; h_prev = h, h = h->next) {
+    if (h->from_arena || (h->is_unswept != 1 && !h->is_full)) {
+      continue;
+    }
+    prev_free_size = gc_page_free_size(h);
+    if (h->is_unswept == 1) {
+      h_head->num_unswept_children--;
+    }
+    h_size = h->size;
+    keep = gc_sweep(h, thd);
+    h->is_full = 0;
+    pt->free_size[HEAP_REST] += gc_page_free_size(h) - prev_free_size;
+    if (!keep && h_prev) {
+      gc_page_detach(pt, h);
+      h = gc_heap_free(h, h_prev);
+      thd->cached_heap_total_sizes[HEAP_REST] -= h_size;
+    } else {
+      gc_page_avail_add(pt, h);
+    }
+  }
+}
+
+/**
+ * @brief Move an object to one of a thread's HEAP_REST pages
+ * @param thd  Thread data for the mutator owning the heap
+ * @param obj  Object to move
+ * @param size Size of the object, in bytes
+ * @return The new copy of the object
+ *
+ * The object goes on the first page it fits on, or on a new page if none.
+ */
+static object gc_compact_alloc(gc_thread_data *thd, object obj, size_t size)
+{
+  gc_heap *h_head = thd->heap->heap[HEAP_REST], *h;
+  object hp = NULL;
+  for (h = h_head; h && !hp; h = h->next) {
+    if (!h->from_arena && h->free_size >= size) {
+      hp = gc_try_alloc(h, size, obj, thd);
+    }
+  }
+  if (!hp) {
+    h = gc_grow_heap(h_head, size, thd)->next;
+    if (!h || !(hp = gc_try_alloc(h, size, obj, thd))) {
+      fprintf(stderr, "out of memory error compacting %zu bytes\n", size);
+      exit(1);
+    }
+  }
+  return hp;
+}
+
+/**
+ * @brief Move every object off of a page, leaving forwarding pointers
+ * @param thd Thread data for the mutator owning the page
+ * @param h   Page, which has already been unlinked from the heap
+ * @return Number of bytes moved
+ */
+static uint64_t gc_compact_page(gc_thread_data *thd, gc_heap *h)
+{
+  object p = gc_heap_first_block(h), end = gc_heap_end(h);
+  gc_free_list *r = h->free_list->next;
+  uint64_t moved = 0;
+  size_t size;
+  while (p < end) {
+    if ((char *)r == (char *)p) {
+      p = (object) (((char *)p) + r->size);
+      r = r->next;
+      continue;
+    }
+    size = gc_allocated_bytes(p, NULL, NULL);
+    forward(p) = gc_compact_alloc(thd, p, size);
+    type_of(p) = forward_tag;
+    moved += size;
+    p = (object) (((char *)p) + size);
+  }
+  return moved;
+}
+
+/**
+ * @brief Move the objects off of a thread's fragmented HEAP_REST pages
+ * @param thd       Mutator's thread data
+ * @param threshold Fragmentation at or above which a page is compacted
+ * @param evacuated Receives the pages that were emptied, to be released
+ *                  once all references to their objects have been updated
+ * @return Number of bytes moved
+ */
+static uint64_t gc_compact_evacuate(gc_thread_data *thd, double threshold,
+                                    gc_heap **evacuated)
+{
+  gc_page_table *pt = thd->page_table;
+  gc_heap *h_head = thd->heap->heap[HEAP_REST], *h_prev, *h, *next,
+          *pages = NULL;
+  uint64_t moved = 0;
+  if (!h_head) {
+    return 0;
+  }
+  gc_compact_sweep(thd);
+  // Unlink the pages first so nothing is moved onto them
+  h_prev = h_head;
+  for (h = h_head->next; h; h = h_prev->next) {
+    if (gc_compact_candidate(h, threshold)) {
+      gc_page_unlink(h);
+      gc_page_detach(pt, h);
+      thd->cached_heap_total_sizes[HEAP_REST] -= h->size;
+      h->compacting = 1;
+      h->next = pages;
+      pages = h;
+    } else {
+      h_prev = h;
+    }
+  }
+  for (h = pages; h; h = next) {
+    next = h->next;
+    moved += gc_compact_page(thd, h);
+    h->next = *evacuated;
+    *evacuated = h;
+  }
+  h_head->next_free = h_head;
+  return moved;
+}
+
+/**
+ * @brief Update a reference to an object that compaction moved
+ * @param slot Location of the reference
+ */
+static void gc_compact_fix(object *slot)
+{
+  object obj = *slot;
+  gc_heap *h;
+  if (is_object_type(obj) && (h = gc_page_lookup(obj)) != NULL &&
+      h->compacting && type_of(obj) == forward_tag) {
+    *slot = forward(obj);
+  }
+}
+
+/**
+ * @brief Update the references held by an object
+ */
+static void gc_compact_fix_object(object obj)
+{
+  int i, n;
+  switch (type_of(obj)) {
+  case pair_tag:
+    gc_compact_fix(&(car(obj)));
+    gc_compact_fix(&(cdr(obj)));
+    break;
+  case closure1_tag:
+    gc_compact_fix(&(((closure1) obj)->element));
+    break;
+  case closureN_tag:
+    n = ((closureN) obj)->num_elements;
+    for (i = 0; i < n; i++) {
+      gc_compact_fix(&(((closureN) obj)->elements[i]));
+    }
+    break;
+  case vector_tag:
+  case record_tag:
+    n = ((vector) obj)->num_elements;
+    for (i = 0; i < n; i++) {
+      gc_compact_fix(&(((vector) obj)->elements[i]));
+    }
+    break;
+  case cvar_tag:
+    gc_compact_fix(((cvar_type *) obj)->pvar);
+    break;
+  case atomic_tag:
+    gc_compact_fix(&(((atomic_type *) obj)->obj));
+    break;
+  default:
+    break;
+  }
+}
+
+/**
+ * @brief Update the references held by every object on a list of pages
+ *
+ * Objects that are garbage but have yet to be swept are updated as well,
+ * which is harmless since nothing reads them.
+ */
+static void gc_compact_fix_pages(gc_heap *h)
+{
+  object p, end;
+  gc_free_list *r;
+  unsigned int i, w, words;
+  uint64_t used;
+  for (; h; h = h->next) {
+    if (h->type <= LAST_FIXED_SIZE_HEAP_TYPE) {
+      if (h->data_end) { // Bump&pop, objects are all before the free space
+        end = h->data_end - h->remaining;
+        for (p = h->data; p < end; p = ((char *)p) + h->block_size) {
+          gc_compact_fix_object(p);
         }
-        break;
-      }
-    case cvar_tag:{
-        cvar_type *c = (cvar_type *) obj;
-        object pvar = *(c->pvar);
-        if (pvar) {
-          gc_collector_mark_gray(obj, pvar);
+      } else {
+        words = gc_bitmap_words(h->num_blocks);
+        for (w = 0; w < words; w++) {
+          used = ~(h->free_bits[w]) & gc_bitmap_word_mask(h, w);
+          for (; used; used &= (used - 1)) {
+            i = (w * 64) + gc_bitmap_lowest_bit(used);
+            gc_compact_fix_object(h->data + (i * h->block_size));
+          }
         }
-        break;
       }
-    case atomic_tag: {
-        atomic_type *a = (atomic_type *)obj;
-        object o = ck_pr_load_ptr(&(a->obj));
-        if (obj) {
-          gc_collector_mark_gray(obj, o);
+    } else if (h->type == HEAP_HUGE) {
+      if (!gc_is_heap_empty(h)) {
+        gc_compact_fix_object(gc_heap_first_block(h));
+      }
+    } else {
+      p = gc_heap_first_block(h);
+      end = gc_heap_end(h);
+      r = h->free_list->next;
+      while (p < end) {
+        if ((char *)r == (char *)p) {
+          p = (object) (((char *)p) + r->size);
+          r = r->next;
+          continue;
         }
+        gc_compact_fix_object(p);
+        p = (object) (((char *)p) + gc_allocated_bytes(p, NULL, NULL));
       }
-    default:
-      break;
     }
-    if (mark(obj) != gc_color_red) {
-      // Only blacken objects on the heap
-      mark(obj) = markColor;
+  }
+}
+
+/**
+ * @brief Update the references held by every object a thread allocated,
+ *        on its heap, in its arenas, and in its young heap
+ */
+static void gc_compact_fix_thread(gc_thread_data *thd)
+{
+  gc_arena *a;
+  int heap_type;
+  for (heap_type = 0; heap_type < NUM_HEAP_TYPES; heap_type++) {
+    gc_compact_fix_pages(thd->heap->heap[heap_type]);
+    for (a = thd->arena; a; a = a->parent) {
+      gc_compact_fix_pages(a->pages[heap_type]);
     }
-    if (mark(obj) != gc_color_red) {
-      fprintf(stderr, "marked %p %d\n", obj, markColor);
-    } else {
-      fprintf(stderr, "not marking stack obj %p %d\n", obj, markColor);
+    if (thd->young) {
+      gc_compact_fix_pages(thd->young->region.pages[heap_type]);
     }
   }
 }
-#else
-// See full version above for debugging purposes.
-// Also sync any changes to this macro with the function version
-#define gc_mark_black(obj) \
-{ \
-  int markColor = ck_pr_load_8(&gc_color_mark); \
-  if (is_object_type(obj) && mark(obj) != markColor) { \
-    switch (type_of(obj)) { \
-    case pair_tag:{ \
-        gc_collector_mark_gray(obj, car(obj)); \
-        gc_collector_mark_gray(obj, cdr(obj)); \
-        break; \
-      } \
-    case closure1_tag: \
-      gc_collector_mark_gray(obj, ((closure1) obj)->element); \
-      break; \
-    case closureN_tag:{ \
-        int i, n = ((closureN) obj)->num_elements; \
-        for (i = 0; i < n; i++) { \
-          gc_collector_mark_gray(obj, ((closureN) obj)->elements[i]); \
-        } \
-        break; \
-      } \
-    case vector_tag:{ \
-        int i, n = ((vector) obj)->num_elements; \
-        for (i = 0; i < n; i++) { \
-          gc_collector_mark_gray(obj, ((vector) obj)->elements[i]); \
-        } \
-        break; \
-      } \
-    case cvar_tag:{ \
-        cvar_type *c = (cvar_type *) obj; \
-        object pvar = *(c->pvar); \
-        if (pvar) { \
-          gc_collector_mark_gray(obj, pvar); \
-        } \
-        break; \
-      } \
-    default: \
-      break; \
-    } \
-    if (mark(obj) != gc_color_red) { \
-      mark(obj) = markColor; \
-    } \
-  } \
-}
-#endif
 
 /**
- * @brief The collector's tracing algorithm
- *
- * This function ensures all live objects are marked prior to transitioning
- * to the collector's sweep phase.
+ * @brief Update the references held by a stopped mutator's roots
  */
-void gc_collector_trace()
+static void gc_compact_fix_roots(gc_thread_data *thd)
 {
-  ck_array_iterator_t iterator;
-  gc_thread_data *m;
-  int clean = 0, last_write;
-  while (!clean) {
-    clean = 1;
-
-    CK_ARRAY_FOREACH(&Cyc_mutators, &iterator, &m) {
-      pthread_mutex_lock(&(m->lock));
-      // Try doing this loop (majority of tracing) without the lock. We
-      // shouldn't need to be locked to do it anyway and we still lock
-      // below as a fail-safe. One potential issue here is this would be 
-      // broken if the mark buffer needs to be grown. But this is not a
-      // problem because we will only go as far as the mutator already 
-      // went with the version of last write we are holding here... so
-      // we avoid that race condition.
-      last_write = m->last_write;
-      pthread_mutex_unlock(&(m->lock)); 
-      while (m->last_read < last_write) {
-        clean = 0;
-#if GC_DEBUG_VERBOSE
-        fprintf(stderr,
-                "gc_mark_black mark buffer %p, last_read = %d last_write = %d\n",
-                mark_buffer_get(m->mark_buffer, m->last_read), m->last_read, last_write);
-#endif
-        gc_mark_black(mark_buffer_get(m->mark_buffer, m->last_read));
-        gc_empty_collector_stack();
-        (m->last_read)++;       // Inc here to prevent off-by-one error
-      }
-      //pthread_mutex_unlock(&(m->lock));
-
-      // Try checking the condition once more after giving the
-      // mutator a chance to respond, to prevent exiting early.
-      // This is experimental, not sure if it is necessary
-      if (clean) {
-        pthread_mutex_lock(&(m->lock));
-        if (m->last_read < m->last_write) {
-#if GC_SAFETY_CHECKS
-          fprintf(stderr,
-                  "gc_collector_trace - might have exited trace early\n");
-#endif
-          clean = 0;
-        } else if (m->pending_writes) {
-          clean = 0;
-        }
-        pthread_mutex_unlock(&(m->lock));
-      }
-    }
+  int i;
+  gc_compact_fix(&(thd->gc_cont));
+  for (i = 0; i < thd->gc_num_args; i++) {
+    gc_compact_fix(&(thd->gc_args[i]));
   }
+  gc_compact_fix(&(thd->scm_thread_obj));
+  gc_compact_fix(&(thd->exception_handler_stack));
+  gc_compact_fix(&(thd->param_objs));
 }
 
 /**
- * @brief Empty the collector's mark stack
+ * @brief Update global variables that refer to objects compaction moved
+ * @param globals  Internal global list used by the runtime
+ * @param table    Table of all global variables
  *
- * Objects on the stack are removed one at a time and marked
+ * This is called by the collector thread while the world is stopped.
  */
-void gc_empty_collector_stack()
+void gc_compact_globals(object *globals, gc_global_table *table)
 {
-  object obj;
-  // Mark stack is only used by the collector thread, so no sync needed
-  while (mark_stack_i > 0) {    // not empty
-    mark_stack_i--;
-//#if GC_DEBUG_VERBOSE
-//    fprintf(stderr, "gc_mark_black mark stack %p \n",
-//      mark_stack[mark_stack_i]);
-//#endif
-    obj = mark_stack[mark_stack_i];
-    gc_mark_black(obj);
+  int i, len = ck_pr_load_int(&(table->len));
+  ck_pr_fence_load();
+  gc_compact_fix(globals);
+  for (i = 0; i < len; i++) {
+    gc_compact_fix(gc_global_entry(table, i)->pvar);
   }
 }
 
 /**
- * @brief Called by the collector thread to perform a handshake with 
- *        all of the mutators
- * @param s Transition to this GC status
+ * @brief Record statistics for a compaction
+ *
+ * Called by the collector thread.
  */
-void gc_handshake(gc_status_type s)
+static void gc_record_compaction(int pages, uint64_t moved, uint64_t pause_ns)
 {
-  gc_post_handshake(s);
-  gc_wait_handshake();
+  char line[256];
+  ck_pr_add_64(&gc_collector_stats.compactions, 1);
+  ck_pr_add_64(&gc_collector_stats.compacted_bytes, moved);
+  if (ck_pr_load_ptr(&gc_trace_out) == NULL) {
+    return;
+  }
+  snprintf(line, sizeof(line), 
+    "{\"event\":\"compact\",\"time_ns\":%llu,\"pages\":%d,"
+    "\"bytes\":%llu,\"pause_ns\":%llu}\n",
+    (unsigned long long)(gc_time_ns() - gc_start_ns),
+    pages,
+    (unsigned long long)moved,
+    (unsigned long long)pause_ns);
+  gc_trace_write(line);
 }
 
 /**
- * @brief Change GC status to the given type
- * @param s Transition to this GC status
+ * @brief Compact the fragmented HEAP_REST pages of every mutator
+ *
+ * Called by the collector once it is done tracing, while no new cycle can
+ * start. If any mutator does not stop in time compaction is skipped, and 
+ * is tried again the next time a mutator requests it.
  */
-void gc_post_handshake(gc_status_type s)
+static void gc_compact(void)
 {
-  int status = ck_pr_load_int(&gc_status_col);
-  while (!ck_pr_cas_int(&gc_status_col, status, s)) {
+  ck_array_iterator_t iterator;
+  gc_thread_data *m;
+  gc_heap *evacuated = NULL, *h, *next;
+  uint64_t moved = 0, start = gc_time_ns();
+  double threshold = gc_param(GC_PARAM_COMPACT_THRESHOLD);
+  int pages = 0;
+  if (threshold <= 0) {
+    return;
+  }
+  if (!gc_compact_stop_world(GC_COMPACT_STOP_MS)) {
+    gc_compact_resume();
+    return;
+  }
+  pthread_mutex_lock(&mutators_lock);
+  CK_ARRAY_FOREACH(&Cyc_mutators, &iterator, &m) {
+    gc_compact_collect_pages(m);
+  }
+  CK_ARRAY_FOREACH(&old_mutators, &iterator, &m) {
+    gc_compact_collect_pages(m);
+  }
+  CK_ARRAY_FOREACH(&Cyc_mutators, &iterator, &m) {
+    moved += gc_compact_evacuate(m, threshold, &evacuated);
+  }
+  if (evacuated) {
+    // Point every reference to a moved object at its new copy
+    CK_ARRAY_FOREACH(&Cyc_mutators, &iterator, &m) {
+      gc_compact_fix_roots(m);
+      gc_compact_fix_thread(m);
+    }
+    CK_ARRAY_FOREACH(&old_mutators, &iterator, &m) {
+      gc_compact_fix_thread(m);
+    }
+    gc_request_compact_globals();
+    gc_note_moved(NULL);
+    for (h = evacuated; h; h = next) {
+      next = h->next;
+      gc_heap_release(h);
+      pages++;
+    }
+  }
+  pthread_mutex_unlock(&mutators_lock);
+  gc_compact_resume();
+  if (pages > 0) {
+    gc_record_compaction(pages, moved, gc_time_ns() - start);
   }
 }
 
+/////////////////////////////////////////////
+// Weak tables
+
 /**
- * @brief Wait for all mutators to handshake
+ * @brief Delete the entries of weak tables whose keys were not marked
  *
- * This function is always called by the collector. If a mutator
- * is blocked and cannot handshake, the collector will cooperate
- * on its behalf, including invoking a minor GC of the mutator's
- * stack, so major GC can proceed.
+ * Called by the collector once it is done tracing, and before anything 
+ * is swept. The world is stopped so that no mutator can read a key while 
+ * its entry is deleted. Objects grayed by the read barrier since the 
+ * mutators last cooperated are marked first, then the values of ephemeron
+ * tables whose keys are marked, until no more objects are marked.
  */
-void gc_wait_handshake()
+static void gc_weak_finish(void)
 {
   ck_array_iterator_t iterator;
   gc_thread_data *m;
-  int statusm, statusc, thread_status, i, buf_len;
-  struct timespec tim;
-  tim.tv_sec = 0;
-  tim.tv_nsec = 1000000;        // 1 millisecond
-
+  object *e, value;
+  int i, j, n, marked;
+  if (gc_weak_tables_i == 0) {
+    return;
+  }
+  // Does not time out, the collector cannot sweep until this is done
+  gc_compact_stop_world(0);
   CK_ARRAY_FOREACH(&Cyc_mutators, &iterator, &m) {
-    while (1) {
-      // TODO: use an atomic comparison
-      statusc = ck_pr_load_int(&gc_status_col);
-      statusm = ck_pr_load_int(&(m->gc_status));
-      if (statusc == statusm) {
-        // Handshake succeeded, check next mutator
-        break;
+    if (ck_pr_load_int(&(m->compact_stopped)) == 2) {
+      gc_sum_pending_writes(m, 1);
+    } else if (ck_pr_load_int(&(m->compact_stopped)) == 1) {
+      gc_sum_pending_writes(m, 0);
+    }
+    while (m->last_read < m->last_write) {
+      gc_mark_black(mark_buffer_get(m->mark_buffer, m->last_read));
+      gc_empty_collector_stack();
+      (m->last_read)++;
+    }
+  }
+  // More weak tables may be found while marking values
+  do {
+    marked = 0;
+    for (i = 0; i < gc_weak_tables_i; i++) {
+      e = ((vector) gc_weak_tables[i])->elements;
+      n = ((vector) gc_weak_tables[i])->num_elements;
+      if (e[GC_WEAK_MARKER] != gc_ephemerons) {
+        continue;
       }
-
-      thread_status = ck_pr_load_int((int *)&(m->thread_state));
-      if (thread_status == CYC_THREAD_STATE_BLOCKED ||
-          thread_status == CYC_THREAD_STATE_BLOCKED_COOPERATING) {
-        if (statusm == STATUS_ASYNC) {  // Prev state
-          ck_pr_cas_int(&(m->gc_status), statusm, statusc);
-          // Async is done, so clean up old mark data from the last collection
-          gc_zero_read_write_counts(m);
-        } else if (statusm == STATUS_SYNC1) {
-          ck_pr_cas_int(&(m->gc_status), statusm, statusc);
-        } else if (statusm == STATUS_SYNC2) {
-//printf("DEBUG - is mutator still blocked?\n");
-          pthread_mutex_lock(&(m->lock));
-          // Check again, if thread is still blocked we need to cooperate
-          if (ck_pr_cas_int((int *)&(m->thread_state),
-                            CYC_THREAD_STATE_BLOCKED,
-                            CYC_THREAD_STATE_BLOCKED_COOPERATING)
-              ||
-              ck_pr_cas_int((int *)&(m->thread_state),
-                            CYC_THREAD_STATE_BLOCKED_COOPERATING,
-                            CYC_THREAD_STATE_BLOCKED_COOPERATING)
-              ) {
-//printf("DEBUG - update mutator GC status\n");            
-            ck_pr_cas_int(&(m->gc_status), statusm, statusc);
-            #if GC_DEBUG_TRACE
-            fprintf(stderr, "DEBUG - collector is cooperating for blocked mutator\n");            
-            #endif
-            buf_len =
-                gc_minor(m, m->stack_limit, m->stack_start, m->gc_cont, NULL,
-                         0);
-            // Handle any pending marks from write barrier
-            gc_sum_pending_writes(m, 1);
-            // Mark thread "roots", based on code from mutator's cooperator
-            gc_mark_gray(m, m->gc_cont);
-            //for (i = 0; i < m->gc_num_args; i++) {
-            //  gc_mark_gray(m, m->gc_args[i]);
-            //}
-            if (m->scm_thread_obj) {
-              gc_mark_gray(m, m->scm_thread_obj);
-            }
-            if (m->exception_handler_stack) {
-              gc_mark_gray(m, m->exception_handler_stack);
-            }
-            if (m->param_objs) {
-              gc_mark_gray(m, m->param_objs);
-            }
-            // Also, mark everything the collector moved to the heap
-            for (i = 0; i < buf_len; i++) {
-              gc_mark_gray(m, m->moveBuf[i]);
-            }
-            m->gc_alloc_color = ck_pr_load_8(&gc_color_mark);
-          }
-          pthread_mutex_unlock(&(m->lock));
+      for (j = GC_WEAK_FIRST; j + 2 < n; j += 3) {
+        value = e[j + 2];
+        if (obj_is_int(e[j]) && is_object_type(value) && gc_is_white(value) &&
+            gc_weak_key_is_live(e[j + 1])) {
+          gc_mark_black(value);
+          gc_empty_collector_stack();
+          marked = 1;
         }
-      } else if (thread_status == CYC_THREAD_STATE_TERMINATED) {
-        // Thread is no longer running
-        break;
       }
-      // At least for now, just give up quantum and come back to
-      // this quickly to test again. This probably could be more
-      // efficient.
-      nanosleep(&tim, NULL);
     }
+  } while (marked);
+  // A table may have been marked more than once, deleting is idempotent
+  for (i = 0; i < gc_weak_tables_i; i++) {
+    e = ((vector) gc_weak_tables[i])->elements;
+    n = ((vector) gc_weak_tables[i])->num_elements;
+    for (j = GC_WEAK_FIRST; j + 2 < n; j += 3) {
+      if (obj_is_int(e[j]) && !gc_weak_key_is_live(e[j + 1])) {
+        e[j] = boolean_t;
+        e[j + 1] = boolean_f;
+        e[j + 2] = boolean_f;
+        e[0] = obj_int2obj(obj_obj2int(e[0]) - 1);
+      }
+    }
+  }
+  gc_weak_tables_i = 0;
+  gc_compact_resume();
+}
+
+/////////////////////////////////////////////
+// Object movement
+
+/**
+ * @brief Record that objects may have moved
+ * @param thd Mutator whose objects moved, or `NULL` if objects of any 
+ *            mutator may have moved
+ *
+ * Called once a minor GC, young heap collection or compaction is done
+ * moving objects, and before the thread that moved them runs Scheme code
+ * again.
+ */
+void gc_note_moved(gc_thread_data *thd)
+{
+  int i;
+  if (thd) {
+    ck_pr_inc_int(&(gc_moves[thd->move_slot]));
+  } else {
+    for (i = 0; i < GC_MOVE_SLOTS; i++) {
+      ck_pr_inc_int(&(gc_moves[i]));
+    }
+  }
+  ck_pr_inc_int(&(gc_moves[GC_MOVE_SLOTS]));
+}
+
+/**
+ * @brief Get a number that changes whenever objects may have moved
+ * @param slot The `move_slot` of the mutator that found an object may
+ *             move, or `GC_MOVE_SLOTS` for objects of any mutator
+ *
+ * Code that depends on the address of an object that `gc_may_move` says
+ * may move saves this number along with it, and must not rely on the
+ * address once the number has changed.
+ */
+int gc_move_epoch(int slot)
+{
+  return ck_pr_load_int(&(gc_moves[slot]));
+}
+
+/**
+ * @brief Determine if an object may still be moved to another address
+ * @param thd Mutator's thread data
+ * @param obj Object to inspect
+ * @return A true value if a minor GC, young heap collection or compaction
+ *         may move the object, 0 if its address never changes
+ *
+ * Objects on the mutator's stack and unpinned objects in its young heap
+ * may move. So may objects on HEAP_REST pages that compaction is able to
+ * move, which are only created once compaction has been enabled.
+ */
+int gc_may_move(gc_thread_data *thd, object obj)
+{
+  char tmp;
+  gc_heap *h;
+  if (is_value_type(obj) || obj == NULL) {
+    return 0;
   }
+  if (gc_is_stack_obj(&tmp, thd, obj)) {
+    return 1;
+  }
+  h = gc_page_lookup(obj);
+  if (!h) {
+    return 0;
+  }
+  if (thd->young && h->arena == &(thd->young->region)) {
+    return !pinned(obj);
+  }
+  return h->type == HEAP_REST && h->compactable && gc_compact_movable(obj);
 }
 
 /////////////////////////////////////////////
@@ -2526,8 +6728,11 @@ void gc_collector()
   gc_log(stderr, "Starting gc_collector");
 #endif
 //fprintf(stderr, " - Starting gc_collector\n"); // TODO: DEBUGGING!!!
+  uint64_t start = gc_time_ns(), marked, traced, end, grown;
   //clear : 
   ck_pr_cas_int(&gc_stage, STAGE_RESTING, STAGE_CLEAR_OR_MARKING);
+  // Background sweepers use the current colors, let them finish up first
+  gc_wait_for_sweepers();
   // exchange values of markColor and clearColor
   //
   // We now increment both so that clear becomes the old mark color and a
@@ -2556,11 +6761,14 @@ void gc_collector()
 #endif
   gc_wait_handshake();
   gc_request_mark_globals(); // Wait until mutators have new mark color
+  marked = gc_time_ns();
 #if GC_DEBUG_TRACE
   fprintf(stderr, "DEBUG - after wait_handshake async\n");
 #endif
   //trace : 
   gc_collector_trace();
+  gc_weak_finish();
+  traced = gc_time_ns();
 #if GC_DEBUG_TRACE
   fprintf(stderr, "DEBUG - after trace\n");
   //debug_dump_globals();
@@ -2569,29 +6777,57 @@ void gc_collector()
   //
   //sweep : 
   gc_collector_sweep();
+  // Compact while still sweeping, so no new cycle can start
+  if (ck_pr_cas_int(&gc_compact_requested, 1, 0)) {
+    gc_compact();
+  }
 
   // Idle the GC thread
   ck_pr_cas_int(&gc_stage, STAGE_SWEEPING, STAGE_RESTING);
+
+  end = gc_time_ns();
+  gc_record_cycle(marked - start, traced - marked, end - traced);
+  grown = ck_pr_load_64(&gc_heap_grown_bytes);
+  ck_pr_sub_64(&gc_heap_grown_bytes, grown);
+  gc_adapt_params(end - start, end - gc_last_cycle_start, grown);
+  gc_last_cycle_start = start;
 }
 
 void *collector_main(void *arg)
 {
-  int stage;
-  struct timespec tim;
 #ifdef DEBUG_THREADS
   pthread_t tid = pthread_self();
   int sid = syscall(SYS_gettid);
   printf("GC thread LWP id is %d\n", sid);
   //printf("GC thread POSIX thread id is %d\n", tid);
 #endif
-  tim.tv_sec = 0;
-  tim.tv_nsec = 100 * NANOSECONDS_PER_MILLISECOND;
   while (1) {
-    stage = ck_pr_load_int(&gc_stage);
-    if (stage != STAGE_RESTING) {
-      gc_collector();
+    // Sleep until a mutator starts a collection. If that takes a while,
+    // let the mutators know they may return memory to the OS, but only
+    // once per idle period.
+    int trimmed = 0;
+    pthread_mutex_lock(&gc_wake_lock);
+    while (ck_pr_load_int(&gc_stage) == STAGE_RESTING) {
+      if (trimmed) {
+        pthread_cond_wait(&gc_wake_cond, &gc_wake_lock);
+      } else {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += GC_TRIM_IDLE_MS / 1000;
+        ts.tv_nsec += (GC_TRIM_IDLE_MS % 1000) * NANOSECONDS_PER_MILLISECOND;
+        if (ts.tv_nsec >= 1000 * NANOSECONDS_PER_MILLISECOND) {
+          ts.tv_sec++;
+          ts.tv_nsec -= 1000 * NANOSECONDS_PER_MILLISECOND;
+        }
+        if (pthread_cond_timedwait(&gc_wake_cond, &gc_wake_lock, &ts) == ETIMEDOUT &&
+            ck_pr_load_int(&gc_stage) == STAGE_RESTING) {
+          ck_pr_inc_int(&gc_trim_epoch);
+          trimmed = 1;
+        }
+      }
     }
-    nanosleep(&tim, NULL);
+    pthread_mutex_unlock(&gc_wake_lock);
+    gc_collector();
   }
   return NULL;
 }
@@ -2625,13 +6861,14 @@ void gc_start_collector()
 
 /**
  * @brief Mark globals as part of the tracing collector
- * @param globals
- * @param global_table
+ * @param globals  Internal global list used by the runtime
+ * @param table    Table of all global variables
  *
  * This is called by the collector thread
  */
-void gc_mark_globals(object globals, object global_table)
+void gc_mark_globals(object globals, gc_global_table *table)
 {
+  int i, len;
 #if GC_DEBUG_TRACE
   //fprintf(stderr, "(gc_mark_globals heap: %p size: %d)\n", h, (unsigned int)gc_heap_total_size(h));
   fprintf(stderr, "Cyc_global_variables %p\n", globals);
@@ -2639,17 +6876,15 @@ void gc_mark_globals(object globals, object global_table)
   // Mark global variables
   gc_mark_black(globals);  // Internal global used by the runtime
   // Marking it ensures all glos are marked
-  {
-    list l = global_table;
-    for (; l != NULL; l = cdr(l)) {
-      cvar_type *c = (cvar_type *) car(l);
-      object glo = *(c->pvar);
-      if (glo != NULL) {
+  len = ck_pr_load_int(&(table->len));
+  ck_pr_fence_load();
+  for (i = 0; i < len; i++) {
+    object glo = *(gc_global_entry(table, i)->pvar);
+    if (glo != NULL) {
 #if GC_DEBUG_VERBOSE
-        fprintf(stderr, "global pvar %p\n", glo);
+      fprintf(stderr, "global pvar %p\n", glo);
 #endif
-        gc_mark_black(glo);     // Mark actual object the global points to
-      }
+      gc_mark_black(glo);     // Mark actual object the global points to
     }
   }
 }
@@ -2673,12 +6908,19 @@ void gc_thread_data_init(gc_thread_data * thd, int mut_num, char *stack_base,
                          long stack_size)
 {
   char stack_ref;
+  size_t initial_size;
+  int i;
   thd->stack_start = stack_base;
 #if STACK_GROWTH_IS_DOWNWARD
   thd->stack_limit = stack_base - stack_size;
 #else
   thd->stack_limit = stack_base + stack_size;
 #endif
+  thd->stack_size = stack_size;
+  thd->stack_size_min = stack_size;
+  thd->stack_size_max = gc_stack_size_max(stack_size);
+  thd->stack_adapt_ns = gc_time_ns();
+  thd->stack_adapt_bytes = 0;
   if (stack_overflow(stack_base, &stack_ref)) {
     fprintf(stderr,
             "Error: Stack is growing in the wrong direction! Rebuild with STACK_GROWTH_IS_DOWNWARD changed to %d\n",
@@ -2693,7 +6935,13 @@ void gc_thread_data_init(gc_thread_data * thd, int mut_num, char *stack_base,
   thd->mutation_count = 0;
   thd->mutations = 
       vpbuffer_realloc(thd->mutations, &(thd->mutation_buflen));
+  thd->mutation_set_len = GC_MUTATION_SET_SIZE;
+  thd->mutation_set = calloc(thd->mutation_set_len, sizeof(int));
+  thd->symbol_cache = calloc(SYMBOL_CACHE_SIZE, sizeof(void *));
   thd->globals_changed = 1;
+  thd->globals_dirty_any = 0;
+  thd->globals_dirty = NULL;
+  thd->globals_dirty_len = 0;
   thd->param_objs = NULL;
   thd->exception_handler_stack = NULL;
   thd->scm_thread_obj = NULL;
@@ -2704,10 +6952,15 @@ void gc_thread_data_init(gc_thread_data * thd, int mut_num, char *stack_base,
   thd->gc_num_args = 0;
   thd->moveBufLen = 0;
   gc_thr_grow_move_buffer(thd);
+  thd->alloc_buffers = calloc(LAST_FIXED_SIZE_HEAP_TYPE + 1, sizeof(gc_alloc_buffer));
+  thd->arena = NULL;
+  thd->retired_arenas = NULL;
+  thd->young = NULL;
   thd->gc_alloc_color = ck_pr_load_8(&gc_color_clear);
   thd->gc_trace_color = thd->gc_alloc_color;
   thd->gc_done_tracing = 0;
   thd->gc_status = ck_pr_load_int(&gc_status_col);
+  thd->compact_stopped = 0;
   thd->pending_writes = 0;
   thd->last_write = 0;
   thd->last_read = 0;
@@ -2717,16 +6970,30 @@ void gc_thread_data_init(gc_thread_data * thd, int mut_num, char *stack_base,
     exit(1);
   }
   thd->heap_num_huge_allocations = 0;
+  thd->heap_huge_allocation_bytes = 0;
+  thd->heap_arena_adopted_bytes = 0;
+  thd->trim_epoch = ck_pr_load_int(&gc_trim_epoch);
   thd->num_minor_gcs = 0;
-  thd->cached_heap_free_sizes = calloc(5, sizeof(uintptr_t));
-  thd->cached_heap_total_sizes = calloc(5, sizeof(uintptr_t));
+  thd->stats_minor_gcs = 0;
+  thd->stats_minor_gc_ns = 0;
+  thd->stats_bytes_allocated = calloc(NUM_HEAP_TYPES, sizeof(uint64_t));
+  thd->stats_young_collections = 0;
+  thd->stats_young_survivor_bytes = 0;
+  thd->move_slot = ck_pr_faa_int(&gc_move_slots_used, 1) % GC_MOVE_SLOTS;
+  thd->cached_heap_free_sizes = calloc(NUM_HEAP_TYPES, sizeof(uintptr_t));
+  thd->cached_heap_total_sizes = calloc(NUM_HEAP_TYPES, sizeof(uintptr_t));
+  thd->cached_heap_sweep_sizes = calloc(NUM_HEAP_TYPES, sizeof(uintptr_t));
+  thd->swept_pages = calloc(NUM_HEAP_TYPES, sizeof(gc_heap *));
+  thd->released_pages = NULL;
+  thd->sweep_jobs_pending = 0;
+  thd->page_table = calloc(1, sizeof(gc_page_table));
   thd->heap = calloc(1, sizeof(gc_heap_root));
   thd->heap->heap = calloc(1, sizeof(gc_heap *) * NUM_HEAP_TYPES);
-  thd->heap->heap[HEAP_REST] = gc_heap_create(HEAP_REST, INITIAL_HEAP_SIZE, thd);
-  thd->heap->heap[HEAP_SM] = gc_heap_create(HEAP_SM, INITIAL_HEAP_SIZE, thd);
-  thd->heap->heap[HEAP_64] = gc_heap_create(HEAP_64, INITIAL_HEAP_SIZE, thd);
-  if (sizeof(void *) == 8) { // Only use this heap on 64-bit platforms
-    thd->heap->heap[HEAP_96] = gc_heap_create(HEAP_96, INITIAL_HEAP_SIZE, thd);
+  initial_size = gc_scaled_page_size(GC_PARAM_INITIAL_HEAP_SIZE);
+  thd->heap->heap[HEAP_REST] = gc_heap_create(HEAP_REST, initial_size, thd);
+  for (i = HEAP_SM; i <= LAST_FIXED_SIZE_HEAP_TYPE; i++) {
+    thd->heap->heap[i] = gc_heap_create(i, 
+      (i <= HEAP_96) ? initial_size : INITIAL_SIZE_CLASS_HEAP_SIZE, thd);
   }
   thd->heap->heap[HEAP_HUGE] = gc_heap_create(HEAP_HUGE, 1024, thd);
 }
@@ -2737,6 +7004,7 @@ void gc_thread_data_init(gc_thread_data * thd, int mut_num, char *stack_base,
  */
 void gc_thread_data_free(gc_thread_data * thd)
 {
+  int i;
   if (thd) {
     if (pthread_mutex_destroy(&thd->lock) != 0) {
       // TODO: can only destroy the lock if it is unlocked. need to make sure we
@@ -2754,6 +7022,24 @@ void gc_thread_data_free(gc_thread_data * thd)
 
 // TODO: need to figure out a new solution since we no longer have the heap lock!!!!
 
+    // Take back all pages from the background sweepers before merging
+    while (ck_pr_load_int(&(thd->sweep_jobs_pending)) > 0) {
+      gc_sleep_ms(1);
+    }
+    gc_collect_swept_pages(thd);
+    gc_alloc_buffers_flush(thd);
+
+    // Any arena left is merged along with the rest of the heap, retired
+    // ones are swept like any other garbage, and so is the young heap
+    gc_arena_abandon(thd, 1);
+    gc_young_free(thd);
+    while (thd->retired_arenas) {
+      gc_arena *a = thd->retired_arenas;
+      thd->retired_arenas = a->next_retired;
+      a->parent = NULL;
+      gc_arena_adopt(thd, a);
+    }
+
 //    pthread_mutex_lock(&(primordial_thread->heap_lock));
     gc_merge_all_heaps(primordial_thread, thd);
 //    pthread_mutex_unlock(&(primordial_thread->heap_lock));
@@ -2761,12 +7047,26 @@ void gc_thread_data_free(gc_thread_data * thd)
       free(thd->cached_heap_free_sizes);
     if (thd->cached_heap_total_sizes)
       free(thd->cached_heap_total_sizes);
+    if (thd->cached_heap_sweep_sizes)
+      free(thd->cached_heap_sweep_sizes);
+    if (thd->stats_bytes_allocated)
+      free(thd->stats_bytes_allocated);
+    if (thd->swept_pages)
+      free(thd->swept_pages);
+    if (thd->page_table) {
+      for (i = 0; i < NUM_HEAP_TYPES; i++) {
+        free(thd->page_table->avail[i]);
+      }
+      free(thd->page_table);
+    }
     if (thd->jmp_start)
       free(thd->jmp_start);
     if (thd->gc_args)
       free(thd->gc_args);
     if (thd->moveBuf)
       free(thd->moveBuf);
+    if (thd->alloc_buffers)
+      free(thd->alloc_buffers);
     if (thd->mark_buffer)
       mark_buffer_free(thd->mark_buffer);
     if (thd->stack_traces)
@@ -2774,6 +7074,15 @@ void gc_thread_data_free(gc_thread_data * thd)
     if (thd->mutations) {
       free(thd->mutations);
     }
+    if (thd->mutation_set) {
+      free(thd->mutation_set);
+    }
+    if (thd->globals_dirty) {
+      free(thd->globals_dirty);
+    }
+    if (thd->symbol_cache) {
+      free(thd->symbol_cache);
+    }
     free(thd);
   }
 }
@@ -2789,6 +7098,7 @@ void gc_heap_merge(gc_heap *hdest, gc_heap *hsrc)
 {
   gc_heap *last = gc_heap_last(hdest);
   last->next = hsrc;
+  hsrc->prev = last;
 }
 
 /**
@@ -2800,7 +7110,7 @@ void gc_heap_merge(gc_heap *hdest, gc_heap *hsrc)
  */
 void gc_merge_all_heaps(gc_thread_data *dest, gc_thread_data *src)
 {
-  gc_heap *hdest, *hsrc;
+  gc_heap *hdest, *hsrc, *h;
   int heap_type;
 
   for (heap_type = 0; heap_type < NUM_HEAP_TYPES; heap_type++) {
@@ -2808,6 +7118,10 @@ void gc_merge_all_heaps(gc_thread_data *dest, gc_thread_data *src)
     hsrc = src->heap->heap[heap_type];
     if (hdest && hsrc) {
       gc_heap_merge(hdest, hsrc);
+      for (h = hsrc; h; h = h->next) {
+        h->avail_index = -1;
+        gc_page_attach(dest->page_table, h);
+      }
       ck_pr_add_ptr(&(dest->cached_heap_total_sizes[heap_type]), 
            ck_pr_load_ptr(&(src->cached_heap_total_sizes[heap_type])));
       ck_pr_add_ptr(&(dest->cached_heap_free_sizes[heap_type]), 
@@ -2816,6 +7130,8 @@ void gc_merge_all_heaps(gc_thread_data *dest, gc_thread_data *src)
   }
   ck_pr_add_int(&(dest->heap_num_huge_allocations), 
        ck_pr_load_int(&(src->heap_num_huge_allocations)));
+  ck_pr_add_64(&(dest->heap_huge_allocation_bytes), 
+       ck_pr_load_64(&(src->heap_huge_allocation_bytes)));
 #if GC_DEBUG_TRACE
   fprintf(stderr, "Finished merging old heap data\n");
 #endif
@@ -2838,6 +7154,7 @@ void gc_mutator_thread_blocked(gc_thread_data * thd, object cont)
             thd->thread_state);
     exit(1);
   }
+  gc_notify_handshake();
 }
 
 void Cyc_apply_from_buf(void *data, int argc, object prim, object * buf);
@@ -509,6 +509,53 @@ object Cyc_vector_set_unsafe_cps(void *d, object cont, object v, object k, objec
 object Cyc_make_vector(void *data, object cont, int argc, object len, ...);
 /**@}*/
 
+/**
+ * \defgroup prim_rec Records
+ * @brief Record functions
+ *
+ * Field indices passed to these functions count from 0 and do not
+ * include the type descriptor, see `record_type`.
+ */
+/**@{*/
+#define Cyc_is_record(o)     (make_boolean(is_object_type(o) && ((list) o)->tag == record_tag))
+#define Cyc_is_record_of(o, t) \
+  (make_boolean(is_object_type(o) && ((list) o)->tag == record_tag && \
+                record_type_of(o) == (t)))
+void Cyc_invalid_record_error(void *data, object r, object type, object k);
+object Cyc_record(void *data, object cont, int argc, object type, ...);
+static inline object Cyc_record_ref(void *data, object r, object type, object k)
+{
+  if (!obj_is_int(k) || Cyc_is_record_of(r, type) == boolean_f ||
+      (unsigned) obj_obj2int(k) >= (unsigned) (((vector) r)->num_elements - 1)) {
+    Cyc_invalid_record_error(data, r, type, k);
+  }
+  return record_field(r, obj_obj2int(k));
+}
+#define Cyc_record_ref_unsafe(d, r, t, k) record_field(r, obj_obj2int(k))
+object Cyc_record_set_cps(void *d, object cont, object r, object type, object k, object obj);
+object Cyc_record_set_unsafe_cps(void *d, object cont, object r, object type, object k, object obj);
+/**@}*/
+
+/**
+ * \defgroup prim_ht Hash tables
+ * @brief Hash tables stored in vectors, used by `(srfi 69)`
+ */
+/**@{*/
+object Cyc_hash(void *data, object obj, object kind);
+object Cyc_hash_table_find(void *data, object entries, object kind, object h,
+                           object key);
+object Cyc_hash_table_scan(void *data, object entries, object h, object prev);
+object Cyc_hash_table_claim(void *data, object entries, object kind, 
+                            object h, object key);
+object Cyc_hash_table_full(object entries);
+object Cyc_hash_table_remove(void *data, object entries, object idx);
+object Cyc_hash_table_rehash(void *data, object from, object to);
+void Cyc_hash_table_refresh(void *data, object entries);
+object Cyc_hash_table_entry(void *data, object entries, object idx);
+object Cyc_hash_table_weaken(object entries, object weakness);
+object Cyc_hash_table_weakness(object entries);
+/**@}*/
+
 /**
  * \defgroup prim_bv Bytevectors
  * @brief Bytevector functions
@@ -558,6 +605,7 @@ time_t Cyc_file_last_modified_time(char *path);
 object Cyc_spawn_thread(object thunk);
 void Cyc_start_trampoline(gc_thread_data * thd);
 void Cyc_end_thread(gc_thread_data * thd);
+object Cyc_arena_unwind(void *data, object k, object result);
 void Cyc_exit_thread(gc_thread_data * thd);
 object Cyc_thread_sleep(void *data, object timeout);
 /**@}*/
@@ -614,6 +662,7 @@ extern const object primitive_Cyc_91opaque_127;
 extern const object primitive_Cyc_91has_91cycle_127;
 extern const object primitive_Cyc_91spawn_91thread_67;
 extern const object primitive_Cyc_91end_91thread_67;
+extern const object primitive_Cyc_91arena_91unwind;
 extern const object primitive__87;
 extern const object primitive__91;
 extern const object primitive__85;
@@ -691,6 +740,10 @@ extern const object primitive_make_91vector;
 extern const object primitive_list_91_125vector;
 extern const object primitive_vector_91ref;
 extern const object primitive_vector_91set_67;
+extern const object primitive_Cyc_91record;
+extern const object primitive_Cyc_91record_91of_127;
+extern const object primitive_Cyc_91record_91ref;
+extern const object primitive_Cyc_91record_91set_67;
 extern const object primitive_bytevector;
 extern const object primitive_bytevector_91append;
 extern const object primitive_Cyc_91bytevector_91copy;
@@ -780,6 +833,7 @@ void Cyc_rt_raise_msg(void *data, const char *err);
 /**@{*/
 object add_symbol(symbol_type * psym);
 object find_or_add_symbol(const char *name);
+object Cyc_intern_symbol(void *data, const char *name, size_t len);
 /**@}*/
 
 /**
@@ -798,7 +852,7 @@ object register_library(const char *name);
  * @brief A table of global variables.
  */
 /**@{*/
-extern list global_table;
+extern gc_global_table global_table;
 void add_global(const char *identifier, object * glo);
 void Cyc_set_globals_changed(gc_thread_data *thd);
 /**@}*/
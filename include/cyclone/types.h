@@ -70,6 +70,7 @@ enum object_tag {
       , complex_num_tag = 21
       , atomic_tag      = 22
       , void_tag        = 23
+      , record_tag      = 24
 };
 
 /**
@@ -110,14 +111,16 @@ typedef unsigned char tag_type;
 
 ////////////////////////////////
 // Parameters for size of a "page" on the heap (the second generation GC), in bytes.
+// These and the major GC tuning parameters marked below are defaults, 
+// each may be changed at runtime, see `gc_param_id`.
 
-/** Grow first page by adding this amount to it */
+/** Grow first page by adding this amount to it (tunable) */
 #define GROW_HEAP_BY_SIZE (2 * 1024 * 1024)    
 
-/** Size of the first page */
+/** Size of the first page (tunable) */
 #define INITIAL_HEAP_SIZE (3 * 1024 * 1024)     
 
-/** Normal size of a heap page */
+/** Normal size of a heap page (tunable) */
 #define HEAP_SIZE (8 * 1024 * 1024)    
 
 // End heap page size parameters
@@ -126,17 +129,142 @@ typedef unsigned char tag_type;
 /////////////////////////////
 // Major GC tuning parameters
 
-/** Start GC cycle if % heap space free below this percentage */
+/** Start GC cycle if % heap space free below this percentage (tunable) */
 #define GC_COLLECTION_THRESHOLD 0.0125 //0.05
 
-/** Start GC cycle if fewer than this many heap pages are unswept */
+/** Start GC cycle if fewer than this many heap pages are unswept (tunable) */
 #define GC_COLLECT_UNDER_UNSWEPT_HEAP_COUNT 3
 
-/** After major GC, grow the heap so at least this percentage is free */
+/** 
+ * After major GC, grow the heap so at least this percentage is free. 
+ * Also the most the adaptive mode will raise the collection threshold to
+ * (tunable).
+ */
 #define GC_FREE_THRESHOLD 0.40
+
+/** 
+ * Largest factor by which the adaptive mode scales up the heap page sizes
+ * and the collection threshold
+ */
+#define GC_ADAPTIVE_MAX_SCALE 8
+
+/** Start GC cycle once this many bytes of huge objects have been allocated */
+#define GC_COLLECT_HUGE_BYTES (64 * 1024 * 1024)
+
+/** Start GC cycle once this many bytes of arena pages have escaped to the heap */
+#define GC_COLLECT_ARENA_BYTES (64 * 1024 * 1024)
+
+/** 
+ * Release empty heap pages after a GC cycle as long as at least this 
+ * fraction of the heap remains free without them
+ */
+#define GC_TRIM_FREE_RATIO 0.50
+
+/** 
+ * Decommit empty heap pages once the collector has been idle for this 
+ * many milliseconds
+ */
+#define GC_TRIM_IDLE_MS 5000
+
+/** 
+ * Default number of helper threads used to trace the heap in parallel
+ * with the collector thread. Zero disables parallel marking. May be 
+ * overridden at runtime via the CYC_GC_MARK_THREADS environment variable
+ * or `gc_set_mark_threads`.
+ */
+#define GC_MARK_THREADS 0
+
+/** Upper bound on the number of parallel marking helper threads */
+#define GC_MAX_MARK_THREADS 64
+
+/** 
+ * Default number of background threads used to sweep heap pages after
+ * tracing. Zero disables background sweeping, in which case all pages
+ * are swept lazily by the allocating mutator. May be overridden at runtime 
+ * via the CYC_GC_SWEEP_THREADS environment variable or `gc_set_sweep_threads`.
+ */
+#define GC_SWEEP_THREADS 0
+
+/** Upper bound on the number of background sweeper threads */
+#define GC_MAX_SWEEP_THREADS 64
+
+/** Number of heap pages handed to a background sweeper at a time */
+#define GC_SWEEP_JOB_PAGES 8
+
+/** Size of the first page of each heap type in an arena, see `gc_arena` */
+#define GC_ARENA_PAGE_SIZE (64 * 1024)
+
+/** 
+ * Default size of each thread's young heap, see `gc_young`. Zero disables
+ * the young heap. May be overridden at runtime via the 
+ * CYC_GC_YOUNG_HEAP_SIZE environment variable or `gc_set_param`.
+ */
+#define YOUNG_HEAP_SIZE 0
+
+/** 
+ * Default fragmentation at which the collector compacts sparsely used 
+ * pages of the heap for objects too large for a size class, see 
+ * `gc_compact`. Zero disables compaction. May be overridden at runtime 
+ * via the CYC_GC_COMPACT_THRESHOLD environment variable or `gc_set_param`.
+ */
+#define COMPACT_THRESHOLD 0
+
+/** Longest time the collector waits for mutators to stop for compaction */
+#define GC_COMPACT_STOP_MS 100
+
+/** Largest page of each heap type in a young heap */
+#define GC_YOUNG_PAGE_SIZE (256 * 1024)
+
+/**
+ * Set to 1 to keep the marks of objects on size-class heap pages in side 
+ * bitmaps at the end of each page instead of in the object headers. The
+ * collector then never writes to an object when marking it, and pages are
+ * swept a bitmap word at a time without reading the objects on them.
+ * Objects on other pages are still marked in their headers.
+ */
+#define GC_SIDE_MARK_BITS 0
 // END GC tuning
 /////////////////////////////
 
+/**
+ * GC parameters that may be changed at runtime. Each starts out with the
+ * default from the macro of the same name and may be overridden by an 
+ * environment variable such as CYC_GC_HEAP_SIZE, by a command line flag 
+ * such as `--cyc-gc-heap-size=16M`, or via `gc_set_param`.
+ */
+typedef enum { 
+  GC_PARAM_INITIAL_HEAP_SIZE = 0
+, GC_PARAM_HEAP_SIZE
+, GC_PARAM_GROW_HEAP_BY_SIZE
+, GC_PARAM_COLLECTION_THRESHOLD
+, GC_PARAM_FREE_THRESHOLD
+, GC_PARAM_COLLECT_UNDER_UNSWEPT_HEAP_COUNT
+, GC_PARAM_STACK_SIZE
+  /** 
+   * Nonzero to let the collector scale up page sizes and the collection
+   * threshold when mutators allocate faster than it can keep up with
+   */
+, GC_PARAM_ADAPTIVE
+  /** Largest size the adaptive mode may grow a thread's stack buffer to */
+, GC_PARAM_MAX_STACK_SIZE
+  /** 
+   * Nonzero to resize each thread's stack buffer based on how often it
+   * needs a minor GC and how much it moves to the heap
+   */
+, GC_PARAM_ADAPTIVE_STACK
+  /** 
+   * Bytes a thread allocates in its young heap before collecting it, 
+   * zero to move objects straight to the heap
+   */
+, GC_PARAM_YOUNG_HEAP_SIZE
+  /** 
+   * Fragmentation, from 0 to 1, at which a sparsely used page is 
+   * compacted, zero to never move objects
+   */
+, GC_PARAM_COMPACT_THRESHOLD
+, NUM_GC_PARAMS
+} gc_param_id;
+
 /** Number of functions to save for printing call history */
 #define MAX_STACK_TRACES 10
 
@@ -167,35 +295,58 @@ typedef unsigned char tag_type;
 /**
  * Group heap pages by type, to attempt to limit fragmentation
  * and improve performance.
-
- TODO: starting to run into problems when adding additional "sizes" of heap page,
- possibly due to increasing amounts of page faults due to non-locality???
- 
- Basically for X86_64 everything works great when a 96 byte heap is added, but slows way down when additional
- heaps (128, 160) are also added.
-
- 32 bit x86 is starting to have trouble with just a 96 byte heap added.
-
- In the future, a better solution might be to allocate arrays (closureN's, vectors, bytevectors, and strings)
- as fixed-size chunks to prevent heap fragmentation. The advantage is then we have no fragmentation directly.
- But, an array will no longer be contiguous so they may cause other problems, and the runtime has to change
- to work with non-contiguous arrays. This would also cause a lot of problems for strings since the built-in
- functions would no longer work (EG: strlen, etc).
+ *
+ * Objects up to `GC_MAX_SIZE_CLASS` bytes are allocated from size-class
+ * heaps. Each page of such a heap is divided into fixed-size blocks and
+ * tracks its free blocks using a bitmap kept at the end of the page itself,
+ * so allocation and sweeping never need to touch any other page. Classes
+ * are spaced geometrically to bound the amount of space wasted by rounding
+ * an object up to its block size.
+ *
+ * Pages for the larger classes start out small, since many programs never
+ * allocate objects of those sizes. Earlier versions of the allocator slowed 
+ * down when heaps past 96 bytes were added, probably because every page 
+ * was a full-size page and free lists were threaded through the blocks.
+ *
+ * Larger objects are still allocated from the first-fit `HEAP_REST` heap,
+ * and huge objects get a page of their own.
  */
 typedef enum { 
     HEAP_SM = 0  // 32 byte objects (min gc_heap_align)
   , HEAP_64
   , HEAP_96
+  , HEAP_128
+  , HEAP_160
+  , HEAP_192
+  , HEAP_256
+  , HEAP_320
+  , HEAP_384
+  , HEAP_512
+  , HEAP_640
+  , HEAP_768
+  , HEAP_1024
+  , HEAP_1280
+  , HEAP_1536
+  , HEAP_2048
+  , HEAP_2560
+  , HEAP_3072
+  , HEAP_4096
   , HEAP_REST    // Everything else
   , HEAP_HUGE    // Huge objects, 1 per page
 } gc_heap_type;
 
-/** The first heap type that is not fixed-size */
-#if INTPTR_MAX == INT64_MAX
-#define LAST_FIXED_SIZE_HEAP_TYPE HEAP_96
-#else
-#define LAST_FIXED_SIZE_HEAP_TYPE HEAP_64
-#endif
+/** The last heap type that is fixed-size */
+#define LAST_FIXED_SIZE_HEAP_TYPE HEAP_4096
+
+/** Largest object, in bytes, that is allocated from a size-class heap */
+#define GC_MAX_SIZE_CLASS 4096
+
+/** Heap objects are aligned to blocks of `1 << GC_BLOCK_BITS` bytes */
+#define GC_BLOCK_BITS 5
+#define GC_BLOCK_SIZE (1 << GC_BLOCK_BITS)
+
+/** Size of the first page of each heap for size classes above 96 bytes */
+#define INITIAL_SIZE_CLASS_HEAP_SIZE (256 * 1024)
 
 /** The number of `gc_heap_type`'s */
 #define NUM_HEAP_TYPES (HEAP_HUGE + 1)
@@ -219,10 +370,13 @@ struct gc_free_list_t {
  * - Lazy sweep
  */
 typedef struct gc_heap_t gc_heap;
+typedef struct gc_arena_t gc_arena;
 struct gc_heap_t {
   gc_heap_type type;
   /** Size of the heap page in bytes */
   unsigned int size;
+  /** Size of the memory mapping holding the page, in bytes */
+  size_t map_size;
   /** Keep empty page alive this many times before freeing */
   unsigned int ttl; 
   /** Bump: Track remaining space; this is useful for bump&pop style allocation */
@@ -233,8 +387,24 @@ struct gc_heap_t {
   unsigned int free_size; 
   /** Lazy-sweep: Determine if the heap is full */
   unsigned char is_full; 
-  /** Lazy-sweep: Determine if the heap has been swept */
+  /** 
+   * Lazy-sweep: Determine if the heap has been swept. A value of 2 indicates
+   * the page was swept in the background but has not been allocated from yet,
+   * so it is still counted as unswept for the purposes of triggering a GC.
+   */
   unsigned char is_unswept;
+  /** 
+   * Lazy-sweep: Nonzero if the page came from an arena that escaped, and
+   * is swept at the end of each collection instead of waiting for the
+   * allocator to need it. Above one the page is not allocated from yet.
+   */
+  unsigned char from_arena;
+  /** Young heap: set if any object on the page is pinned */
+  unsigned char has_pinned;
+  /** Compaction: set while the objects on the page are being moved off it */
+  unsigned char compacting;
+  /** Compaction: set if the page was created once compaction was enabled */
+  unsigned char compactable;
   /** Lazy-sweep: Start GC cycle if fewer than this many heap pages are unswept */
   int num_unswept_children;
   /** Last size of object that was allocated, allows for optimizations */
@@ -243,14 +413,309 @@ struct gc_heap_t {
   gc_heap *next_free;
   /** Linked list of free memory blocks in this page */
   gc_free_list *free_list;
-  /** Next page in this heap */
-  gc_heap *next;                // TBD, linked list is not very efficient, but easy to work with as a start
+  /** For fixed-size heaps, number of blocks on this page */
+  unsigned int num_blocks;
+  /** For fixed-size heaps, word of `free_bits` to resume searching from */
+  unsigned int free_cursor;
+  /** 
+   * For fixed-size heaps, one bit per block that is set if the block is 
+   * free. Stored at the end of the page and only used once the page has
+   * been swept, bump&pop allocation is used before that.
+   */
+  uint64_t *free_bits;
+#if GC_SIDE_MARK_BITS
+  /** 
+   * Side marks: one bit per block that is set when the collector marks the
+   * block's object. There is one bitmap per mark color parity, since only 
+   * the current and previous colors are in use at any time. These are NULL
+   * if objects on the page are marked in their headers instead.
+   */
+  uint64_t *mark_bits[2];
+  /** Side marks: blocks allocated by the owning mutator, by color parity */
+  uint64_t *alloc_bits[2];
+  /** Side marks: color recorded by each of the `mark_bits` */
+  unsigned char mark_colors[2];
+  /** Side marks: color recorded by each of the `alloc_bits` */
+  unsigned char alloc_colors[2];
+  /** Side marks: set if any object on the page may need a finalizer */
+  unsigned char has_finalizers;
+#endif
+  /** Page table: index in the owner's list of pages with free space, or -1 */
+  int avail_index;
+  /** Arena the page belongs to, or `NULL` for a page of a thread's heap */
+  gc_arena *arena;
+  /** 
+   * Next page in this heap. The allocator finds pages using the owning
+   * thread's page table, see `gc_page_table`.
+   */
+  gc_heap *next;
+  /** 
+   * Previous page in this heap, so a page found using the page table can
+   * be unlinked without walking the list. Only kept up to date while the 
+   * page is part of a thread's heap.
+   */
+  gc_heap *prev;
   /** Actual data in this page */
   char *data;
   /** End of the data when using bump alllocation or NULL when using free lists */
   char *data_end;
 };
 
+/**
+ * Page directory: size of the address range covered by each entry, in bits.
+ * Heap pages are aligned to this size so no two pages share an entry.
+ */
+#define GC_PAGE_GRANULE_BITS 16
+
+/** Size of the address range covered by each entry of the page directory */
+#define GC_PAGE_GRANULE (1 << GC_PAGE_GRANULE_BITS)
+
+/** 
+ * Page directory: number of address bits covered by the directory. Pages
+ * above this range are not registered and cannot be looked up.
+ */
+#define GC_PAGE_DIR_ADDR_BITS 48
+
+/**
+ * @brief Per-thread index of heap pages
+ *
+ * Each mutator keeps a page table with the pages of each heap type that 
+ * have free space, so the allocator can find one without walking the 
+ * heap. Page counts and free space are also kept up to date here so they
+ * can be read in constant time. 
+ *
+ * The table only includes pages linked into the mutator's heaps, not 
+ * those out for sweeping in the background.
+ */
+typedef struct gc_page_table_t gc_page_table;
+struct gc_page_table_t {
+  /** Pages that are not full, per heap type */
+  gc_heap **avail[NUM_HEAP_TYPES];
+  /** Number of entries in each `avail` list */
+  unsigned int avail_len[NUM_HEAP_TYPES];
+  /** Allocated size of each `avail` list */
+  unsigned int avail_cap[NUM_HEAP_TYPES];
+  /** Number of pages, per heap type */
+  unsigned int num_pages[NUM_HEAP_TYPES];
+  /** Free space in bytes, counting unswept pages as entirely free */
+  uint64_t free_size[NUM_HEAP_TYPES];
+};
+
+/**
+ * Page statistics for a single heap type, see `gc_get_page_stats`
+ */
+typedef struct gc_page_stats_t gc_page_stats;
+struct gc_page_stats_t {
+  /** Number of pages */
+  unsigned int num_pages;
+  /** Number of pages that are not full */
+  unsigned int num_available;
+  /** Total size of all pages in bytes */
+  uint64_t total_size;
+  /** Free space in bytes, counting unswept pages as entirely free */
+  uint64_t free_size;
+};
+
+/**
+ * Garbage collector statistics, see `gc_get_stats`. Every field is a
+ * 64-bit counter and all times are in nanoseconds. Collector fields cover
+ * the whole program while the rest are for the calling thread.
+ */
+typedef struct gc_stats_t gc_stats;
+struct gc_stats_t {
+  /** Collector: Number of major collection cycles completed */
+  uint64_t major_cycles;
+  /** Collector: Total time spent in the clear and mark phases */
+  uint64_t clear_mark_ns;
+  /** Collector: Total time spent tracing */
+  uint64_t trace_ns;
+  /** Collector: Total time spent sweeping */
+  uint64_t sweep_ns;
+  /** Collector: Time spent in the clear and mark phases of the last cycle */
+  uint64_t last_clear_mark_ns;
+  /** Collector: Time spent tracing in the last cycle */
+  uint64_t last_trace_ns;
+  /** Collector: Time spent sweeping in the last cycle */
+  uint64_t last_sweep_ns;
+  /** Collector: Total time spent waiting for mutators to handshake */
+  uint64_t handshake_wait_ns;
+  /** Collector: Total size of all heap pages, in bytes */
+  uint64_t heap_bytes;
+  /** Thread: Number of minor collections */
+  uint64_t minor_gcs;
+  /** Thread: Total time spent in minor collections */
+  uint64_t minor_gc_ns;
+  /** Thread: Bytes allocated on the heap, per heap type */
+  uint64_t bytes_allocated[NUM_HEAP_TYPES];
+  /** Thread: Number of heap pages, per heap type */
+  uint64_t pages[NUM_HEAP_TYPES];
+  /** Thread: Number of young heap collections */
+  uint64_t young_collections;
+  /** Thread: Bytes copied to the heap by young heap collections */
+  uint64_t young_survivor_bytes;
+  /** Collector: Number of times the heap was compacted */
+  uint64_t compactions;
+  /** Collector: Total size of the objects moved by compaction, in bytes */
+  uint64_t compacted_bytes;
+};
+
+/**
+ * A thread's allocation buffer for one of the fixed-size heaps. Small 
+ * objects, whether moved to the heap by the minor GC or allocated there
+ * directly, are taken from the buffer without going through `gc_alloc`.
+ *
+ * A buffer holds either the rest of a fresh page's bump&pop region, or 
+ * one word of a swept page's free bitmap. Space used from the buffer is
+ * only accounted for once it is released, which happens at the end of 
+ * every minor GC, so a page is never swept while a buffer holds part of 
+ * it.
+ */
+typedef struct gc_alloc_buffer_t gc_alloc_buffer;
+struct gc_alloc_buffer_t {
+  /** Page the buffer belongs to, or `NULL` if the buffer is empty */
+  gc_heap *page;
+  /** Bump&pop: Start of the run, or `NULL` if the buffer holds a bitmap word */
+  char *start;
+  /** Bump&pop: Next free block in the run */
+  char *cur;
+  /** Bump&pop: End of the run, always the page's `data_end` */
+  char *end;
+  /** Bitmap: Address of the first block covered by the word */
+  char *base;
+  /** Bitmap: Blocks of the word that are still free */
+  uint64_t free;
+  /** Bitmap: Blocks that were free when the word was taken */
+  uint64_t taken;
+  /** Bitmap: Index of the word in the page's free bitmap */
+  unsigned int word;
+  /** Block size of the heap type */
+  unsigned int block_size;
+};
+
+/**
+ * @brief A region that a thread allocates objects from for a dynamic extent
+ *
+ * While an arena is active every object the thread moves to the heap, 
+ * whether by minor GC or directly, is allocated on the arena's own pages
+ * instead of the thread's heap. Arena pages are never swept. When the
+ * extent ends all of the pages are freed at once, unless the write
+ * barrier found that an object in the arena may be referenced from 
+ * outside of it. In that case the pages are handed to the enclosing
+ * arena, or to the thread's heap if there is none, and the objects on 
+ * them are collected as usual.
+ *
+ * A thread's young heap keeps its pages in an arena of depth 0 that is
+ * never ended, see `gc_young`.
+ */
+struct gc_arena_t {
+  /** Pages of each heap type, the first page is the one allocated from */
+  gc_heap *pages[NUM_HEAP_TYPES];
+  /** Empty pages kept for reuse, only used by the young heap */
+  gc_heap *spare[NUM_HEAP_TYPES];
+  /** Arena that was active when this one began, or `NULL` */
+  gc_arena *parent;
+  /** Nesting depth, 1 for an arena that has no parent */
+  int depth;
+  /** Set once an object in the arena may be referenced from outside it */
+  unsigned char escaped;
+  /** Next ended arena waiting for the collector to be done with it */
+  gc_arena *next_retired;
+};
+
+/**
+ * @brief A thread's young heap
+ *
+ * While a thread has a young heap every object it moves off of its stack,
+ * whether by minor GC or directly, is allocated there instead of on the
+ * thread's heap. Once enough has been allocated the thread copies the 
+ * young objects that are still reachable from its roots to the heap, and
+ * reuses the young pages. Neither the collector nor other threads take
+ * part, and objects that die young are never marked or swept.
+ *
+ * Young objects may only be moved while they are private to the thread. 
+ * The write barrier pins a young object, along with every young object it
+ * refers to, as soon as it may be referenced from the heap, a global, or
+ * another thread. Pinned objects are never moved, and the pages holding
+ * them are added to the thread's heap when the young heap is collected.
+ */
+typedef struct gc_young_t gc_young;
+struct gc_young_t {
+  /** Pages of the young heap */
+  gc_arena region;
+  /** Bytes allocated since the last young collection */
+  size_t allocated;
+  /** Stack objects to pin once the minor GC has moved them */
+  object *pending;
+  int pending_count;
+  int pending_len;
+  /** Work list used to pin and to copy objects */
+  object *work;
+  int work_count;
+  int work_len;
+};
+
+/**
+ * @brief Index of the lowest set bit in a non-zero bitmap word
+ */
+static inline int gc_bitmap_lowest_bit(uint64_t w)
+{
+#if defined(__GNUC__)
+  return __builtin_ctzll(w);
+#else
+  int i = 0;
+  while (!(w & 1)) {
+    w >>= 1;
+    i++;
+  }
+  return i;
+#endif
+}
+
+/** Number of entries in each thread's symbol cache, a power of two */
+#define SYMBOL_CACHE_SIZE 256
+
+/** Number of globals in each chunk of the global table, as a power of two */
+#define GLOBAL_TABLE_CHUNK_BITS 10
+
+/** Max number of chunks in the global table */
+#define GLOBAL_TABLE_CHUNKS 1024
+
+/** Number of hash buckets used to find a global's slot, a power of two */
+#define GLOBAL_TABLE_BUCKETS 4096
+
+/**
+ * Entry in the global table
+ */
+typedef struct gc_global_t gc_global;
+struct gc_global_t {
+  /** Address of the global variable */
+  object *pvar;
+  /** Slot of the next global in the same hash bucket plus one, or zero */
+  int next;
+};
+
+/**
+ * Table of every global variable in the program, in the order they were
+ * added. Globals are stored in fixed-size chunks that never move, so 
+ * other threads may read the table while a global is being added. Each 
+ * global's position in the table is its slot, which indexes the per-thread
+ * bitmaps of globals changed since the last minor GC.
+ */
+typedef struct gc_global_table_t gc_global_table;
+struct gc_global_table_t {
+  /** Chunks of `1 << GLOBAL_TABLE_CHUNK_BITS` entries each */
+  gc_global *chunks[GLOBAL_TABLE_CHUNKS];
+  /** First slot in each hash bucket plus one, or zero if empty */
+  int buckets[GLOBAL_TABLE_BUCKETS];
+  /** Number of globals in the table */
+  int len;
+};
+
+/** Get the table entry for the global in `slot` */
+#define gc_global_entry(table, slot) \
+  (&((table)->chunks[(slot) >> GLOBAL_TABLE_CHUNK_BITS] \
+                    [(slot) & ((1 << GLOBAL_TABLE_CHUNK_BITS) - 1)]))
+
 /**
  * A heap root is the heap's first page
  */
@@ -267,6 +732,7 @@ struct gc_header_type_t {
   unsigned char mark;      // mark bits 
   unsigned char grayed:1;    // stack object to be grayed when moved to heap
   unsigned char immutable:1; // Flag normally mutable obj (EG: pair) as read-only
+  unsigned char pinned:1;    // Young heap object that may be referenced from outside of it
 };
 
 /** Get an object's `mark` value */
@@ -278,6 +744,9 @@ struct gc_header_type_t {
 //** Access an object's "immutable" field */
 #define immutable(x) (((list) x)->hdr.immutable)
 
+/** Access an object's `pinned` field */
+#define pinned(x) (((list) x)->hdr.pinned)
+
 /** Enums for tri-color marking */
 typedef enum { STATUS_ASYNC, STATUS_SYNC1, STATUS_SYNC2
 } gc_status_type;
@@ -298,6 +767,23 @@ typedef enum { STAGE_CLEAR_OR_MARKING, STAGE_TRACING
 /** Unallocated memory */
 #define gc_color_blue 2         
 
+/**
+ * A vector is a weak table if its element `GC_WEAK_MARKER` is either
+ * `gc_weak_keys` or `gc_ephemerons`. Its elements from `GC_WEAK_FIRST` on
+ * are entries of three elements each: a hash, which is a fixnum for an
+ * entry in use, followed by a key and a value. Element 0 is the number of
+ * entries in use. See the "Hash tables" section of runtime.c.
+ *
+ * The major GC does not trace the keys of a weak table. The values of a
+ * `gc_weak_keys` table are always traced, and those of a `gc_ephemerons`
+ * table only once their key is marked. Once tracing is done, an entry 
+ * whose key was not marked is deleted: its hash is set to #t, its key and
+ * value to #f, and element 0 is decremented.
+ */
+#define GC_WEAK_MARKER 3
+/** Index of the first entry of a weak table */
+#define GC_WEAK_FIRST 4
+
 /** Mark buffers */
 typedef struct mark_buffer_t mark_buffer;
 struct mark_buffer_t {
@@ -331,18 +817,58 @@ struct gc_thread_data_t {
   char *stack_start;
   /** Minor GC: Data needed to initiate stack-based minor GC, defines the end of the memory range */
   char *stack_limit;
+  /** Minor GC: Current size of the stack buffer, in bytes */
+  long stack_size;
+  /** Minor GC: Smallest size the stack buffer may be resized to */
+  long stack_size_min;
+  /** Minor GC: Largest size the stack buffer may be resized to */
+  long stack_size_max;
+  /** Minor GC: Time of the last minor GC, in nanoseconds */
+  uint64_t stack_adapt_ns;
+  /** Minor GC: Total bytes allocated on the heap as of the last minor GC */
+  uint64_t stack_adapt_bytes;
   /** Minor GC: write barrier */
   void **mutations;
   /** Minor GC: Size of the minor GC write barrier */
   int mutation_buflen;
   /** Minor GC: Number of entries in the minor GC write barrier */
   int mutation_count;
-  /** Minor GC: Is minor collection of globals necessary? */
+  /** 
+   * Minor GC: Hash set of the entries in `mutations`, so each object, or 
+   * card of a vector, is only logged once. Slots hold an entry's index in
+   * `mutations` plus one, or zero if empty.
+   */
+  int *mutation_set;
+  /** Minor GC: Number of slots in `mutation_set`, a power of two */
+  int mutation_set_len;
+  /** 
+   * Cache of symbols recently interned by this thread, indexed by the
+   * low bits of their hash. See `SYMBOL_CACHE_SIZE`.
+   */
+  void **symbol_cache;
+  /** Minor GC: Must all globals be collected by the next minor GC? */
   unsigned char globals_changed;
+  /** Minor GC: Were any bits set in `globals_dirty` since the last minor GC? */
+  unsigned char globals_dirty_any;
+  /** 
+   * Minor GC: Bitmap of the globals, by slot in the global table, that 
+   * were set to objects on this thread's stack since the last minor GC
+   */
+  uint64_t *globals_dirty;
+  /** Minor GC: Number of words in `globals_dirty` */
+  int globals_dirty_len;
   /** Minor GC: List of objects moved to heap during minor GC */
   void **moveBuf;
   /** Minor GC: Length of `moveBuf` */
   int moveBufLen;
+  /** Heap GC: Allocation buffers, one per fixed-size heap type */
+  gc_alloc_buffer *alloc_buffers;
+  /** Arena objects are currently allocated from, or `NULL` */
+  gc_arena *arena;
+  /** Arenas that ended while the collector may still have been tracing them */
+  gc_arena *retired_arenas;
+  /** Young heap objects are allocated from, or `NULL` */
+  gc_young *young;
   /** Heap GC: mark color used for new allocations */
   unsigned char gc_alloc_color;
   /** Heap GC: mark color the major GC is currently using tracing. This can be different than the alloc color due to lazy sweeping */
@@ -351,6 +877,11 @@ struct gc_thread_data_t {
   uint8_t gc_done_tracing;
   /** Heap GC: current state of the collector */
   int gc_status;
+  /** 
+   * Heap GC: nonzero while the thread is stopped for compaction, 1 if it
+   * stopped itself and 2 if the collector stopped it while it was blocked
+   */
+  int compact_stopped;
   /** Heap GC: index of last write to the mark buffer */
   int last_write;
   /** Heap GC: index of last read from the mark buffer */
@@ -376,10 +907,38 @@ struct gc_thread_data_t {
   uintptr_t *cached_heap_free_sizes;
   /** Heap GC: Cached total amount of heap space */
   uintptr_t *cached_heap_total_sizes;
+  /** Heap GC: Background sweep: swept pages handed back by the sweeper threads, one lock-free stack per heap type */
+  gc_heap **swept_pages;
+  /** Heap GC: Background sweep: empty pages found by the sweeper threads that are ready to be freed */
+  gc_heap *released_pages;
+  /** Heap GC: Background sweep: total size of pages currently out for sweeping, per heap type */
+  uintptr_t *cached_heap_sweep_sizes;
+  /** Heap GC: Background sweep: number of outstanding sweep jobs */
+  int sweep_jobs_pending;
+  /** Heap GC: Index of this thread's heap pages */
+  gc_page_table *page_table;
   /** Heap GC: Number of "huge" allocations by this thread */
   int heap_num_huge_allocations;
+  /** Heap GC: Number of bytes allocated for "huge" objects by this thread */
+  uint64_t heap_huge_allocation_bytes;
+  /** Heap GC: Size of the arena pages added to this thread's heap since the last collection */
+  uint64_t heap_arena_adopted_bytes;
+  /** Heap GC: Last idle period for which this thread trimmed its heap */
+  int trim_epoch;
   /** Heap GC: Keep track of number of minor GC's for use by the major GC */
   int num_minor_gcs;
+  /** Stats: Total number of minor GC's by this thread */
+  uint64_t stats_minor_gcs;
+  /** Stats: Total time spent in minor GC's by this thread, in nanoseconds */
+  uint64_t stats_minor_gc_ns;
+  /** Stats: Bytes allocated on the heap by this thread, per heap type */
+  uint64_t *stats_bytes_allocated;
+  /** Stats: Total number of young heap collections by this thread */
+  uint64_t stats_young_collections;
+  /** Stats: Bytes copied to the heap by this thread's young heap collections */
+  uint64_t stats_young_survivor_bytes;
+  /** Count of `gc_move_epoch` incremented when this thread moves objects */
+  int move_slot;
   /** Exception handler stack */
   object exception_handler_stack;
   /** Parameter object data */
@@ -416,26 +975,107 @@ void *gc_try_alloc(gc_heap * h, size_t size, char *obj,
 void *gc_try_alloc_slow(gc_heap *h_passed, gc_heap *h, size_t size, char *obj, gc_thread_data *thd);
 void *gc_alloc(gc_heap_root * h, size_t size, char *obj, gc_thread_data * thd,
                int *heap_grown);
+void gc_alloc_buffers_flush(gc_thread_data * thd);
+
+/** Fixed-size heap type for each aligned object size, in blocks */
+extern unsigned char gc_heap_type_by_blocks[];
+
+/**
+ * @brief Bump allocate a small object from the thread's allocation buffer
+ * @param thd  The mutator's thread data object
+ * @param size Size of the object to allocate
+ * @return Pointer to the uninitialized object, or `NULL` if the object
+ *         must be allocated using `gc_alloc` instead
+ *
+ * This is the inline fast path of `gc_alloc`, for C code that fills in
+ * new objects itself. The caller must set the object's mark to the 
+ * thread's `gc_alloc_color` before the next minor GC.
+ */
+static inline void *gc_alloc_buffered(gc_thread_data * thd, size_t size)
+{
+  size_t blocks = (size + GC_BLOCK_SIZE - 1) >> GC_BLOCK_BITS;
+  int heap_type;
+  gc_alloc_buffer *b;
+  char *result;
+  if (size > GC_MAX_SIZE_CLASS || thd->arena) {
+    return NULL;
+  }
+  heap_type = gc_heap_type_by_blocks[blocks];
+  b = &(thd->alloc_buffers[heap_type]);
+  if (b->cur < b->end) {
+    result = b->cur;
+    b->cur += b->block_size;
+  } else if (b->free) {
+    result = b->base + (gc_bitmap_lowest_bit(b->free) * b->block_size);
+    b->free &= (b->free - 1);
+  } else {
+    return NULL;
+  }
+  thd->stats_bytes_allocated[heap_type] += (blocks << GC_BLOCK_BITS);
+  return result;
+}
+int gc_arena_begin(gc_thread_data * thd);
+void gc_arena_end(gc_thread_data * thd, int depth, object result);
+void gc_arena_abandon(gc_thread_data * thd, int depth);
+void gc_arena_unwind(gc_thread_data * thd, object k);
+void gc_arena_check_escape(gc_thread_data * thd, object var, object value);
+void gc_young_check_escape(gc_thread_data * thd, object var, object value);
+void gc_young_pin_escaped(gc_thread_data * thd, object low_limit, 
+                          object globals, gc_global_table *table);
+void gc_young_collect(gc_thread_data * thd);
+
+/**
+ * @brief Write barrier for arenas and the young heap
+ * @param thd   The mutator's thread data object
+ * @param var   Object being mutated, or `NULL` if `value` is being stored
+ *              outside of the heap, for example in a global
+ * @param value New value being associated to `var`
+ */
+static inline void gc_check_escape(gc_thread_data * thd, object var, object value)
+{
+  if (thd->arena) {
+    gc_arena_check_escape(thd, var, value);
+  } else if (thd->young) {
+    gc_young_check_escape(thd, var, value);
+  }
+}
 void *gc_alloc_bignum(gc_thread_data *data);
 size_t gc_allocated_bytes(object obj, gc_free_list * q, gc_free_list * r);
 gc_heap *gc_heap_last(gc_heap * h);
+gc_heap *gc_page_lookup(void *p);
+void gc_get_page_stats(gc_thread_data *thd, int heap_type, gc_page_stats *stats);
+size_t gc_heap_trim(gc_thread_data *thd, int release_all, int decommit);
+void gc_set_soft_limit(uint64_t limit);
+uint64_t gc_get_soft_limit(void);
+int gc_param_lookup(const char *name);
+const char *gc_param_name(gc_param_id param);
+double gc_get_param(gc_param_id param);
+int gc_set_param(gc_param_id param, double value);
+void gc_parse_args(int *argc, char **argv);
+void gc_get_stats(gc_thread_data *thd, gc_stats *stats);
+int gc_set_trace_file(const char *path);
+uint64_t gc_time_ns(void);
 
 void gc_heap_create_rest(gc_heap *h, gc_thread_data *thd);
 void *gc_try_alloc_rest(gc_heap * h, size_t size, char *obj, gc_thread_data * thd);
 void *gc_alloc_rest(gc_heap_root * hrt, size_t size, char *obj, gc_thread_data * thd, int *heap_grown);
-void gc_init_fixed_size_free_list(gc_heap *h);
 
 //size_t gc_heap_total_size(gc_heap * h);
 //size_t gc_heap_total_free_size(gc_heap *h);
 //size_t gc_collect(gc_heap *h, size_t *sum_freed);
 //void gc_mark(gc_heap *h, object obj);
 void gc_request_mark_globals(void);
-void gc_mark_globals(object globals, object global_table);
+void gc_mark_globals(object globals, gc_global_table *table);
+void gc_request_compact_globals(void);
+void gc_compact_globals(object *globals, gc_global_table *table);
 //size_t gc_sweep(gc_heap * h, size_t * sum_freed_ptr, gc_thread_data *thd);
 gc_heap *gc_sweep(gc_heap * h, gc_thread_data *thd);
 void gc_thr_grow_move_buffer(gc_thread_data * d);
 void gc_thread_data_init(gc_thread_data * thd, int mut_num, char *stack_base,
                          long stack_size);
+long gc_main_stack_size(void);
+long gc_stack_size_max(long stack_size);
+void gc_stack_size_adapt(gc_thread_data * thd);
 void gc_thread_data_free(gc_thread_data * thd);
 // Prototypes for mutator/collector:
 /**
@@ -449,14 +1089,30 @@ void gc_thread_data_free(gc_thread_data * thd);
  (stack_overflow(((object)low_limit), ((object)obj)) && \
   stack_overflow(((object)obj), ((object)((gc_thread_data *)thd)->stack_start)))
 void gc_mut_update(gc_thread_data * thd, object old_obj, object value);
+void gc_mut_read(gc_thread_data * thd, object obj);
 void gc_mut_cooperate(gc_thread_data * thd, int buf_len);
 void gc_mark_gray(gc_thread_data * thd, object obj);
 void gc_mark_gray2(gc_thread_data * thd, object obj);
 void gc_collector_trace();
 void gc_empty_collector_stack();
+void gc_set_mark_threads(int n);
+int gc_get_mark_threads(void);
+void gc_set_sweep_threads(int n);
+int gc_get_sweep_threads(void);
 void gc_handshake(gc_status_type s);
 void gc_post_handshake(gc_status_type s);
 void gc_wait_handshake();
+void gc_notify_handshake(void);
+void gc_compact_park(gc_thread_data *thd);
+void gc_thread_starting(void);
+void gc_thread_started(gc_thread_data *thd);
+/** Number of separate counts `gc_move_epoch` keeps for mutators */
+#define GC_MOVE_SLOTS 64
+void gc_note_moved(gc_thread_data *thd);
+int gc_move_epoch(int slot);
+int gc_may_move(gc_thread_data *thd, object obj);
+extern const object gc_weak_keys;
+extern const object gc_ephemerons;
 void gc_start_collector();
 void gc_mutator_thread_blocked(gc_thread_data * thd, object cont);
 void gc_mutator_thread_runnable(gc_thread_data * thd, object result, object maybe_copied);
@@ -502,15 +1158,54 @@ void Cyc_make_shared_object(void *data, object k, object obj);
 
 /** 
  * Size of the stack buffer, in bytes.
- * This is used as the first generation of the GC.
+ * This is used as the first generation of the GC. This is the default,
+ * the size may be changed at startup, see `GC_PARAM_STACK_SIZE`.
  */
 #define STACK_SIZE 500000
 
 /** 
  * Do not allocate objects larger than this on the stack.
+ * This is fixed at compile time since generated code depends on it.
  */
 #define MAX_STACK_OBJ (STACK_SIZE * 2)
 
+/**
+ * Room to leave on a thread's C stack past the end of its stack buffer,
+ * for objects allocated after the last stack overflow check and for the
+ * minor GC itself.
+ */
+#define STACK_MARGIN (MAX_STACK_OBJ * 2)
+
+/**
+ * Adaptive stack size: a thread's stack buffer is doubled when minor GC's
+ * happen more often than this, in nanoseconds, unless much of the buffer
+ * ends up on the heap. See `GC_PARAM_ADAPTIVE_STACK`.
+ */
+#define GC_STACK_GROW_INTERVAL_NS (1000 * 1000)
+
+/**
+ * Adaptive stack size: the buffer is only grown if less than this 
+ * fraction of it, as a divisor, was moved to the heap since the last 
+ * minor GC
+ */
+#define GC_STACK_GROW_SURVIVAL 4
+
+/**
+ * Adaptive stack size: a thread's stack buffer is halved, down to the
+ * size it started with, when minor GC's are further apart than this
+ */
+#define GC_STACK_SHRINK_INTERVAL_NS (100 * 1000 * 1000)
+
+/** 
+ * The minor GC write barrier remembers stores to a vector in cards of
+ * 2^GC_MUTATION_CARD_BITS elements, and scans a whole card when moving
+ * its elements to the heap.
+ */
+#define GC_MUTATION_CARD_BITS 5
+
+/** Initial number of slots in a thread's mutation set */
+#define GC_MUTATION_SET_SIZE 256
+
 /** Determine if stack has overflowed */
 #if STACK_GROWTH_IS_DOWNWARD
 #define stack_overflow(x,y) ((x) < (y))
@@ -788,6 +1483,10 @@ typedef struct {
   gc_header_type hdr;
   const tag_type tag;
   const char *desc;
+  /** Hash of `desc` used by the symbol table, never zero once computed */
+  unsigned long hash;
+  /** Length of `desc` in bytes */
+  size_t len;
 } symbol_type;
 typedef symbol_type *symbol;
 
@@ -927,12 +1626,20 @@ typedef enum {
 
 /** 
  * @brief The string type 
+ *
+ * `cursor` remembers the last code point located by `string-ref` or
+ * `string-set!` along with its byte offset, packed as
+ * `(code point << 32) | byte offset`, so that indexing a UTF-8 string
+ * near that position does not have to scan from the start. It is a
+ * single word so that threads sharing a string never see half of an
+ * update. A cursor of zero always refers to the first code point.
  */
 typedef struct {
   gc_header_type hdr;
   tag_type tag;
   int num_cp;
   int len;
+  uint64_t cursor;
   char *str;
 } string_type;
 
@@ -947,6 +1654,7 @@ typedef struct {
   cs.hdr.immutable = 0; \
   cs.tag = string_tag; \
   cs.num_cp = len; \
+  cs.cursor = 0; \
   cs.len = len; \
   cs.str = alloca(sizeof(char) * (len + 1)); \
   memcpy(cs.str, s, len + 1);}
@@ -962,6 +1670,7 @@ typedef struct {
   cs.hdr.immutable = 0; \
   cs.tag = string_tag; cs.len = len; \
   cs.num_cp = len; \
+  cs.cursor = 0; \
   cs.str = alloca(sizeof(char) * (len + 1)); \
   memcpy(cs.str, s, len); \
   cs.str[len] = '\0';}
@@ -974,6 +1683,7 @@ typedef struct {
 { cs.hdr.mark = gc_color_red; cs.hdr.grayed = 0; cs.hdr.immutable = 0; \
   cs.tag = string_tag; cs.len = length; \
   cs.num_cp = length; \
+  cs.cursor = 0; \
   cs.str = s; }
 
 /** Create a new string in the nursery */
@@ -984,6 +1694,7 @@ typedef struct {
   cs.hdr.immutable = 0; \
   cs.tag = string_tag; \
   cs.num_cp = Cyc_utf8_count_code_points((uint8_t *)s); \
+  cs.cursor = 0; \
   if (cs.num_cp < 0) { \
     Cyc_rt_raise_msg(data, "Invalid UTF-8 characters in string"); \
   } \
@@ -1002,6 +1713,7 @@ typedef struct {
   cs.hdr.immutable = 0; \
   cs.tag = string_tag; cs.len = len; \
   cs.num_cp = num_code_points; \
+  cs.cursor = 0; \
   cs.str = alloca(sizeof(char) * (len + 1)); \
   memcpy(cs.str, s, len); \
   cs.str[len] = '\0';}
@@ -1014,6 +1726,7 @@ typedef struct {
 { cs.hdr.mark = gc_color_red; cs.hdr.grayed = 0; cs.hdr.immutable = 0; \
   cs.tag = string_tag; cs.len = length; \
   cs.num_cp = length; \
+  cs.cursor = 0; \
   cs.str = s; }
 
 /**
@@ -1033,6 +1746,7 @@ typedef struct {
     ((string_type *) _s)->tag = string_tag; \
     ((string_type *) _s)->len = _len; \
     ((string_type *) _s)->num_cp = _num_cp; \
+    ((string_type *) _s)->cursor = 0; \
     ((string_type *) _s)->str = (((char *)_s) + sizeof(string_type)); \
   } else { \
     _s = alloca(sizeof(string_type)); \
@@ -1042,6 +1756,7 @@ typedef struct {
     ((string_type *)_s)->tag = string_tag;  \
     ((string_type *)_s)->len = _len; \
     ((string_type *)_s)->num_cp = _num_cp; \
+    ((string_type *)_s)->cursor = 0; \
     ((string_type *)_s)->str = alloca(sizeof(char) * (_len + 1)); \
   }
 
@@ -1078,6 +1793,9 @@ typedef struct {
 /** Get a string object's C string */
 #define string_str(x) (((string_type *) x)->str)
 
+/** Get a string's packed indexing cursor, see `string_type` */
+#define string_cursor(x) (((string_type *) x)->cursor)
+
 /* I/O types */
 
 // TODO: FILE* may not be good enough
@@ -1193,6 +1911,24 @@ typedef struct { vector_type v; object arr[5]; } vector_5_type;
   v->num_elements = 0; \
   v->elements = NULL;
 
+/**
+ * @brief Record type
+ *
+ * Records share the layout of vectors so the collector can trace, copy,
+ * and move them the same way. The first element is the record type
+ * descriptor and the rest are the record's fields, stored inline in the
+ * same object. Checking the type of a record is a single pointer compare
+ * against its first element.
+ */
+typedef vector_type record_type;
+typedef record_type *record;
+
+/** Type descriptor of record `r` */
+#define record_type_of(r) (((vector) (r))->elements[0])
+
+/** Field `i` of record `r`, counting from 0 */
+#define record_field(r, i) (((vector) (r))->elements[(i) + 1])
+
 /**
  * @brief Bytevector type 
  *
@@ -50,6 +50,7 @@ const char *tag_names[] = {
       /*complex_num_tag*/ , "complex number"
       /*atomic_tag*/     , "atomic"
       /*void_tag*/       , "void"
+      /*record_tag*/     , "record"
   , "Reserved for future use"
 };
 
@@ -65,6 +66,28 @@ void Cyc_invalid_type_error(void *data, int tag, object found)
   Cyc_rt_raise2(data, buf, found);
 }
 
+/**
+ * @brief Raise an error for an invalid record access
+ * @param data Thread data object
+ * @param r    Object that was accessed as a record
+ * @param type Type descriptor the record was expected to have
+ * @param k    Index of the field that was accessed
+ */
+void Cyc_invalid_record_error(void *data, object r, object type, object k)
+{
+  char buf[256];
+  object name = type;
+  if (Cyc_is_record_of(r, type) == boolean_t) {
+    Cyc_rt_raise2(data, "record field - invalid index", k);
+  }
+  if (Cyc_is_vector(type) == boolean_t && ((vector) type)->num_elements > 1) {
+    name = ((vector) type)->elements[1];
+  }
+  snprintf(buf, 255, "Invalid type: expected record of type %s, found ",
+           Cyc_is_symbol(name) == boolean_t ? symbol_desc(name) : "record");
+  Cyc_rt_raise2(data, buf, r);
+}
+
 void Cyc_immutable_obj_error(void *data, object obj)
 {
   Cyc_rt_raise2(data, "Unable to modify immutable object ", obj);
@@ -196,9 +219,21 @@ static symbol_type __VOID = { {0}, void_tag, ""};  // symbol_type in lieu of cus
 const object Cyc_EOF = &__EOF;
 const object Cyc_VOID = &__VOID;
 static ck_hs_t lib_table;
-static ck_hs_t symbol_table;
-static int symbol_table_initial_size = 4096;
-static pthread_mutex_t symbol_table_lock;
+static pthread_mutex_t lib_table_lock;
+
+/** 
+ * The symbol table is split into shards, each with its own lock, so 
+ * threads adding different symbols rarely wait on each other. Lookups
+ * do not take a lock.
+ */
+#define SYMBOL_TABLE_SHARDS 16
+/** Seed for symbol hashes, the same for every table so hashes can be cached */
+#define SYMBOL_TABLE_SEED 43423
+/** Shard of the symbol table that holds symbols with hash `h` */
+#define symbol_shard(h) (((h) >> 24) & (SYMBOL_TABLE_SHARDS - 1))
+static ck_hs_t symbol_table[SYMBOL_TABLE_SHARDS];
+static int symbol_table_initial_size = 4096 / SYMBOL_TABLE_SHARDS;
+static pthread_mutex_t symbol_table_lock[SYMBOL_TABLE_SHARDS];
 
 char **env_variables = NULL;
 char **get_env_variables()
@@ -229,6 +264,7 @@ void pack_env_variables(void *data, object k)
     strncpy(svar->str, e, svar->len);
     (svar->str)[svar->len] = '\0';
     svar->num_cp = Cyc_utf8_count_code_points((uint8_t *)svar->str);
+    svar->cursor = 0;
 
     if (eqpos) {
       eqpos++;
@@ -238,7 +274,8 @@ void pack_env_variables(void *data, object k)
     sval->hdr.immutable = 0;
     sval->tag = string_tag; 
     sval->len = strlen(eqpos);
-    svar->num_cp = Cyc_utf8_count_code_points((uint8_t *)eqpos);
+    sval->num_cp = Cyc_utf8_count_code_points((uint8_t *)eqpos);
+    sval->cursor = 0;
     sval->str = eqpos;
     set_pair(tmp, svar, sval);
     set_pair(p, tmp, NULL);
@@ -274,18 +311,29 @@ static struct ck_malloc my_allocator = {
   .free = hs_free
 };
 
+/**
+ * Hash the first `len` bytes of `name`. Never returns zero, so a zero 
+ * hash can mean it has not been computed yet.
+ */
+static unsigned long symbol_hash(const char *name, size_t len, unsigned long seed)
+{
+  unsigned long h = (unsigned long)MurmurHash64A(name, len, seed);
+  return h ? h : 1;
+}
+
 static unsigned long hs_hash(const void *object, unsigned long seed)
 {
   const symbol_type *c = object;
-  unsigned long h;
-
-  h = (unsigned long)MurmurHash64A(c->desc, strlen(c->desc), seed);
-  return h;
+  if (c->hash) {
+    return c->hash;
+  }
+  return symbol_hash(c->desc, c->len, seed);
 }
 
 static bool hs_compare(const void *previous, const void *compare)
 {
-  return strcmp(symbol_desc(previous), symbol_desc(compare)) == 0;
+  const symbol_type *a = previous, *b = compare;
+  return a->len == b->len && memcmp(a->desc, b->desc, a->len) == 0;
 }
 
 static void *set_get(ck_hs_t * hs, const void *value)
@@ -313,23 +361,30 @@ static bool set_insert(ck_hs_t * hs, const void *value)
  */
 void gc_init_heap(long heap_size)
 {
+  int i;
   if (!ck_hs_init(&lib_table,
                   CK_HS_MODE_OBJECT | CK_HS_MODE_SPMC,
                   hs_hash, hs_compare,
-                  &my_allocator, 32, 43423)) {
+                  &my_allocator, 32, SYMBOL_TABLE_SEED)) {
     fprintf(stderr, "Unable to initialize library table\n");
     exit(1);
   }
-  if (!ck_hs_init(&symbol_table,
-                  CK_HS_MODE_OBJECT | CK_HS_MODE_SPMC,
-                  hs_hash, hs_compare,
-                  &my_allocator, symbol_table_initial_size, 43423)) {
-    fprintf(stderr, "Unable to initialize symbol table\n");
+  if (pthread_mutex_init(&(lib_table_lock), NULL) != 0) {
+    fprintf(stderr, "Unable to initialize lib_table_lock mutex\n");
     exit(1);
   }
-  if (pthread_mutex_init(&(symbol_table_lock), NULL) != 0) {
-    fprintf(stderr, "Unable to initialize symbol_table_lock mutex\n");
-    exit(1);
+  for (i = 0; i < SYMBOL_TABLE_SHARDS; i++) {
+    if (!ck_hs_init(&(symbol_table[i]),
+                    CK_HS_MODE_OBJECT | CK_HS_MODE_SPMC,
+                    hs_hash, hs_compare,
+                    &my_allocator, symbol_table_initial_size, SYMBOL_TABLE_SEED)) {
+      fprintf(stderr, "Unable to initialize symbol table\n");
+      exit(1);
+    }
+    if (pthread_mutex_init(&(symbol_table_lock[i]), NULL) != 0) {
+      fprintf(stderr, "Unable to initialize symbol_table_lock mutex\n");
+      exit(1);
+    }
   }
   
   //ht_test(); // JAE - DEBUGGING!!
@@ -341,11 +396,19 @@ object cell_get(object cell)
   return car(cell);
 }
 
+static void Cyc_global_set_dirty(gc_thread_data *thd, object *glo);
+
 object Cyc_global_set(void *thd, object identifier, object * glo, object value)
 {
-  gc_mut_update((gc_thread_data *) thd, *glo, value);
+  gc_thread_data *data = (gc_thread_data *) thd;
+  char tmp;
+  gc_mut_update(data, *glo, value);
   *(glo) = value;
-  ((gc_thread_data *) thd)->globals_changed = 1;
+  gc_check_escape(data, NULL, value);
+  // Minor GC only needs to know about globals that point to the stack
+  if (!data->globals_changed && gc_is_stack_obj(&tmp, data, value)) {
+    Cyc_global_set_dirty(data, glo);
+  }
   return value;
 }
 
@@ -383,7 +446,7 @@ object Cyc_global_set_cps(void *thd, object cont, object identifier, object * gl
 
 static boolean_type t_boolean = { {0}, boolean_tag, "t" };
 static boolean_type f_boolean = { {0}, boolean_tag, "f" };
-static symbol_type Cyc_void_symbol = { {0}, symbol_tag, ""};
+static symbol_type Cyc_void_symbol = { .hdr = {0}, .tag = symbol_tag, .desc = "", .hash = 0, .len = 0 };
 
 const object boolean_t = &t_boolean;
 const object boolean_f = &f_boolean;
@@ -441,37 +504,92 @@ static char *_strdup(const char *s)
   return d;
 }
 
-static object find_symbol_by_name(const char *name)
+/**
+ * Find a symbol in the symbol table without taking a lock
+ */
+static symbol_type *symbol_table_get(const char *name, size_t len, unsigned long hash)
 {
-  symbol_type tmp = { {0}, symbol_tag, name};
-  object result = set_get(&symbol_table, &tmp);
-  return result;
+  symbol_type tmp = { {0}, symbol_tag, name, hash, len};
+  return set_get(&(symbol_table[symbol_shard(hash)]), &tmp);
+}
+
+/**
+ * Add a new symbol to the symbol table, unless another thread added it first
+ */
+static symbol_type *symbol_table_add(const char *name, size_t len, unsigned long hash)
+{
+  int shard = symbol_shard(hash);
+  symbol_type *psym;
+  pthread_mutex_lock(&(symbol_table_lock[shard]));  // Only 1 "writer" per shard
+  psym = symbol_table_get(name, len, hash);
+  if (!psym) {
+    char *desc = malloc(len + 1);
+    memcpy(desc, name, len);
+    desc[len] = '\0';
+    {
+      symbol_type sym = { {0}, symbol_tag, desc, hash, len};
+      psym = malloc(sizeof(symbol_type));
+      memcpy(psym, &sym, sizeof(symbol_type));
+    }
+    set_insert(&(symbol_table[shard]), psym);
+  }
+  pthread_mutex_unlock(&(symbol_table_lock[shard]));
+  return psym;
 }
 
 object add_symbol(symbol_type * psym)
 {
-  pthread_mutex_lock(&symbol_table_lock);       // Only 1 "writer" allowed
-  set_insert(&symbol_table, psym);
-  pthread_mutex_unlock(&symbol_table_lock);
-  return psym;
+  symbol_type *existing;
+  int shard;
+  if (!psym->hash) {
+    psym->len = strlen(psym->desc);
+    psym->hash = symbol_hash(psym->desc, psym->len, SYMBOL_TABLE_SEED);
+  }
+  shard = symbol_shard(psym->hash);
+  pthread_mutex_lock(&(symbol_table_lock[shard]));  // Only 1 "writer" per shard
+  existing = set_get(&(symbol_table[shard]), psym);
+  if (!existing) {
+    set_insert(&(symbol_table[shard]), psym);
+    existing = psym;
+  }
+  pthread_mutex_unlock(&(symbol_table_lock[shard]));
+  return existing;
 }
 
-static object add_symbol_by_name(const char *name)
+/**
+ * @brief Find the symbol named by the first `len` bytes of `name`, adding
+ *        it to the symbol table if necessary
+ * @param data  Thread data object, or `NULL` to bypass the thread's cache
+ * @param name  Symbol name, does not need to be null-terminated
+ * @param len   Length of the name in bytes
+ * @return The symbol
+ */
+object Cyc_intern_symbol(void *data, const char *name, size_t len)
 {
-  symbol_type sym = { {0}, symbol_tag, _strdup(name)};
-  symbol_type *psym = malloc(sizeof(symbol_type));
-  memcpy(psym, &sym, sizeof(symbol_type));
-  return add_symbol(psym);
+  gc_thread_data *thd = (gc_thread_data *) data;
+  unsigned long hash = symbol_hash(name, len, SYMBOL_TABLE_SEED);
+  symbol_type *sym, **slot = NULL;
+  if (thd && thd->symbol_cache) {
+    slot = (symbol_type **) &(thd->symbol_cache[hash & (SYMBOL_CACHE_SIZE - 1)]);
+    sym = *slot;
+    if (sym && sym->hash == hash && sym->len == len &&
+        memcmp(sym->desc, name, len) == 0) {
+      return sym;
+    }
+  }
+  sym = symbol_table_get(name, len, hash);
+  if (!sym) {
+    sym = symbol_table_add(name, len, hash);
+  }
+  if (slot) {
+    *slot = sym;
+  }
+  return sym;
 }
 
 object find_or_add_symbol(const char *name)
 {
-  object sym = find_symbol_by_name(name);
-  if (sym) {
-    return sym;
-  } else {
-    return add_symbol_by_name(name);
-  }
+  return Cyc_intern_symbol(NULL, name, strlen(name));
 }
 
 /* END symbol table */
@@ -479,7 +597,7 @@ object find_or_add_symbol(const char *name)
 /* Library table */
 object is_library_loaded(const char *name)
 {
-  symbol_type tmp = { {0}, symbol_tag, name};
+  symbol_type tmp = { {0}, symbol_tag, name, 0, strlen(name)};
   object result = set_get(&lib_table, &tmp);
   if (result)
     return boolean_t;
@@ -488,40 +606,104 @@ object is_library_loaded(const char *name)
 
 object register_library(const char *name)
 {
-  symbol_type sym = { {0}, symbol_tag, _strdup(name)};
+  symbol_type sym = { {0}, symbol_tag, _strdup(name), 0, strlen(name)};
   symbol_type *psym = malloc(sizeof(symbol_type));
   memcpy(psym, &sym, sizeof(symbol_type));
-  // Reuse mutex since lib inserts will be rare
-  pthread_mutex_lock(&symbol_table_lock);       // Only 1 "writer" allowed
+  pthread_mutex_lock(&lib_table_lock);       // Only 1 "writer" allowed
   set_insert(&lib_table, psym);
-  pthread_mutex_unlock(&symbol_table_lock);
+  pthread_mutex_unlock(&lib_table_lock);
   return boolean_t;
 }
 /* END Library table */
 
 
 /* Global table */
-list global_table = NULL;
+gc_global_table global_table;
+static pthread_mutex_t global_table_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Hash bucket of the global at address `glo` */
+#define global_bucket(glo) \
+  ((((uintptr_t)(glo)) / sizeof(object)) & (GLOBAL_TABLE_BUCKETS - 1))
 
 void add_global(const char *identifier, object * glo)
 {
-  // Tried using a vpbuffer for this and the benchmark
-  // results were the same or worse.
-  global_table = malloc_make_pair(mcvar(glo), global_table);
+  int slot, chunk, bucket = global_bucket(glo);
+  gc_global *g;
+  pthread_mutex_lock(&global_table_lock);       // Only 1 "writer" allowed
+  slot = global_table.len;
+  chunk = slot >> GLOBAL_TABLE_CHUNK_BITS;
+  if (chunk >= GLOBAL_TABLE_CHUNKS) {
+    fprintf(stderr, "Unable to add global %s, the limit is %d globals\n",
+            identifier, GLOBAL_TABLE_CHUNKS << GLOBAL_TABLE_CHUNK_BITS);
+    exit(1);
+  }
+  if (global_table.chunks[chunk] == NULL) {
+    global_table.chunks[chunk] = malloc(sizeof(gc_global) << GLOBAL_TABLE_CHUNK_BITS);
+  }
+  g = gc_global_entry(&global_table, slot);
+  g->pvar = glo;
+  g->next = global_table.buckets[bucket];
+  // Readers may use the entry as soon as they see the new bucket or length
+  ck_pr_fence_store();
+  ck_pr_store_int(&(global_table.buckets[bucket]), slot + 1);
+  ck_pr_store_int(&(global_table.len), slot + 1);
+  pthread_mutex_unlock(&global_table_lock);
+}
+
+/**
+ * Find the slot of the global at address `glo` in the global table,
+ * or -1 if it is not in the table.
+ */
+static int global_slot(object * glo)
+{
+  int i = ck_pr_load_int(&(global_table.buckets[global_bucket(glo)]));
+  ck_pr_fence_load();
+  while (i) {
+    gc_global *g = gc_global_entry(&global_table, i - 1);
+    if (g->pvar == glo) {
+      return i - 1;
+    }
+    i = g->next;
+  }
+  return -1;
+}
+
+/**
+ * Remember that the global at address `glo` must be collected by the
+ * next minor GC on this thread.
+ */
+static void Cyc_global_set_dirty(gc_thread_data *thd, object *glo)
+{
+  int slot = global_slot(glo), w;
+  if (slot < 0) {
+    // Not in the table, fall back to collecting all globals
+    thd->globals_changed = 1;
+    return;
+  }
+  w = slot / 64;
+  if (w >= thd->globals_dirty_len) {
+    int len = (ck_pr_load_int(&(global_table.len)) + 63) / 64;
+    thd->globals_dirty = realloc(thd->globals_dirty, sizeof(uint64_t) * len);
+    memset(thd->globals_dirty + thd->globals_dirty_len, 0, 
+           sizeof(uint64_t) * (len - thd->globals_dirty_len));
+    thd->globals_dirty_len = len;
+  }
+  thd->globals_dirty[w] |= ((uint64_t)1 << (slot % 64));
+  thd->globals_dirty_any = 1;
 }
 
 void debug_dump_globals()
 {
-  list l = global_table;
-  for (; l != NULL; l = cdr(l)) {
-    cvar_type *c = (cvar_type *) car(l);
-    //gc_mark(h, *(c->pvar)); // Mark actual object the global points to
-    printf("DEBUG %p ", c->pvar);
-    if (*c->pvar) {
-      printf("mark = %d ", mark(*c->pvar));
-      if (mark(*c->pvar) == gc_color_red) {
+  int i, len = ck_pr_load_int(&(global_table.len));
+  for (i = 0; i < len; i++) {
+    object *pvar = gc_global_entry(&global_table, i)->pvar;
+    //gc_mark(h, *pvar); // Mark actual object the global points to
+    printf("DEBUG %p ", pvar);
+    if (*pvar) {
+      printf("mark = %d ", mark(*pvar));
+      if (mark(*pvar) == gc_color_red) {
         printf("obj = ");
-        // TODO: no data param: Cyc_display(*c->pvar, stdout);
+        // TODO: no data param: Cyc_display(*pvar, stdout);
       }
       printf("\n");
     } else {
@@ -541,6 +723,8 @@ void Cyc_set_globals_changed(gc_thread_data *thd)
  * This function determines if a mutation introduces a pointer to a stack
  * object from a heap object, and if so, either copies the object to the
  * heap or lets the caller know a minor GC must be performed.
+ * While the thread has an arena this also checks whether the mutation
+ * lets an object escape from it, see `gc_arena_check_escape`.
  *
  * @param data   Current thread's data object
  * @param var    Object being mutated
@@ -554,6 +738,8 @@ object transport_stack_value(gc_thread_data *data, object var, object value, int
   int inttmp, *heap_grown = &inttmp;
   gc_heap_root *heap = data->heap;
 
+  gc_check_escape(data, var, value);
+
   // Nothing needs to be done unless we are mutating
   // a heap variable to point to a stack var.
   if (!gc_is_stack_obj(&tmp, data, var) && gc_is_stack_obj(&tmp, data, value)) {
@@ -564,6 +750,7 @@ object transport_stack_value(gc_thread_data *data, object var, object value, int
         if (immutable(value)) {
           // Safe to transport now
           object hp = gc_alloc(heap, gc_allocated_bytes(value, NULL, NULL), value, data, heap_grown);
+          gc_check_escape(data, var, hp);
           return hp;
         }
         // Need to GC if obj is mutable, EG: a string could be mutated so we can't
@@ -576,6 +763,7 @@ object transport_stack_value(gc_thread_data *data, object var, object value, int
       case complex_num_tag: {
         // These objects are immutable, transport now
         object hp = gc_alloc(heap, gc_allocated_bytes(value, NULL, NULL), value, data, heap_grown);
+        gc_check_escape(data, var, hp);
         return hp;
       }
       // Objs w/children force minor GC to guarantee everything is relocated:
@@ -585,6 +773,7 @@ object transport_stack_value(gc_thread_data *data, object var, object value, int
       case closureN_tag:
       case pair_tag:
       case vector_tag:
+      case record_tag:
         *run_gc = 1;
         return value;
       default:
@@ -604,32 +793,101 @@ object transport_stack_value(gc_thread_data *data, object var, object value, int
  * objects that point to old stack objects. We need to transport any
  * such stack objects to the heap during minor GC.
  *
+ * Each mutated object is only logged once between minor GC's, and for 
+ * vectors only the card of elements containing the mutated index is
+ * logged. A hash set over the log finds entries that are already there,
+ * so the work done by minor GC depends on the number of mutated objects
+ * rather than the number of stores.
+ *
  * Note these functions and underlying data structure are only used by
  * the calling thread, so locking is not required.
  */
+
+/** Hash a mutation log entry, `card` is -1 for objects other than vectors */
+static unsigned int mutation_hash(object var, int card)
+{
+  uint64_t h = ((uintptr_t)var >> 3) ^ ((uint64_t)(card + 1) << 40);
+  h *= 0x9E3779B97F4A7C15ULL;
+  return (unsigned int)(h >> 32);
+}
+
+/**
+ * Find the slot of the mutation set for the given entry. The slot is 
+ * either empty or holds the matching entry.
+ */
+static int *mutation_set_slot(gc_thread_data *thd, object var, int card)
+{
+  unsigned int mask = thd->mutation_set_len - 1,
+               i = mutation_hash(var, card) & mask;
+  while (thd->mutation_set[i]) {
+    int pos = thd->mutation_set[i] - 1;
+    if (thd->mutations[pos] == var &&
+        (card < 0 || obj_obj2int(thd->mutations[pos + 1]) == card)) {
+      break;
+    }
+    i = (i + 1) & mask;
+  }
+  return &(thd->mutation_set[i]);
+}
+
+/** Card logged with a mutation log entry, or -1 if it does not have one */
+#define mutation_card(o, next) \
+  ((is_object_type(o) && \
+    (type_of(o) == vector_tag || type_of(o) == record_tag)) ? \
+   obj_obj2int(next) : -1)
+
+/**
+ * Double the size of the mutation set, re-adding every entry in the log
+ */
+static void mutation_set_grow(gc_thread_data *thd)
+{
+  int l = 0;
+  free(thd->mutation_set);
+  thd->mutation_set_len *= 2;
+  thd->mutation_set = calloc(thd->mutation_set_len, sizeof(int));
+  while (l < thd->mutation_count) {
+    object o = thd->mutations[l];
+    int card = mutation_card(o, thd->mutations[l + 1]);
+    *mutation_set_slot(thd, o, card) = l + 1;
+    l += (card < 0) ? 1 : 2;
+  }
+}
+
 void add_mutation(void *data, object var, int index, object value)
 {
   gc_thread_data *thd = (gc_thread_data *) data;
   char tmp;
 
+  gc_check_escape(thd, var, value);
+
   // No need to track for minor GC purposes unless we are mutating
   // a heap variable to point to a stack var.
   //
   // If var is on stack we'll get it anyway in minor GC,
   // and if value is on heap we don't care (no chance of heap pointing to nursery)
   if (!gc_is_stack_obj(&tmp, data, var) && gc_is_stack_obj(&tmp, data, value)) {
+    int card = (index >= 0) ? (index >> GC_MUTATION_CARD_BITS) : -1, *slot;
+    // Keep the set at most half full
+    if ((thd->mutation_count + 2) * 2 > thd->mutation_set_len) {
+      mutation_set_grow(thd);
+    }
+    slot = mutation_set_slot(thd, var, card);
+    if (*slot) {
+      return; // Already logged
+    }
+    *slot = thd->mutation_count + 1;
     thd->mutations = vpbuffer_add(thd->mutations, 
                                   &(thd->mutation_buflen), 
                                   thd->mutation_count, 
                                   var);
     thd->mutation_count++;
-    if (index >= 0) {
-      // For vectors only, add index as another var. That way
-      // the write barrier only needs to inspect the mutated index.
+    if (card >= 0) {
+      // For vectors only, add card as another var. That way
+      // the write barrier only needs to inspect the mutated card.
       thd->mutations = vpbuffer_add(thd->mutations, 
                                      &(thd->mutation_buflen), 
                                      thd->mutation_count, 
-                                     obj_int2obj(index));
+                                     obj_int2obj(card));
       thd->mutation_count++;
     }
   }
@@ -639,6 +897,16 @@ void clear_mutations(void *data)
 {
   // Not clearing memory, just resetting count
   gc_thread_data *thd = (gc_thread_data *) data;
+  // Shrink the set back down if it is much larger than needed, otherwise
+  // clearing it costs more than the mutations that were logged
+  if (thd->mutation_set_len > GC_MUTATION_SET_SIZE &&
+      thd->mutation_count * 8 < thd->mutation_set_len) {
+    free(thd->mutation_set);
+    thd->mutation_set_len = GC_MUTATION_SET_SIZE;
+    thd->mutation_set = calloc(thd->mutation_set_len, sizeof(int));
+  } else {
+    memset(thd->mutation_set, 0, sizeof(int) * thd->mutation_set_len);
+  }
   thd->mutation_count = 0;
 }
 
@@ -780,8 +1048,9 @@ int equal(object x, object y)
             type_of(y) == double_tag &&
             ((double_type *) x)->value == ((double_type *) y)->value);
   case vector_tag:
+  case record_tag:
     if (is_object_type(y) &&
-        type_of(y) == vector_tag &&
+        type_of(y) == type_of(x) &&
         ((vector) x)->num_elements == ((vector) y)->num_elements) {
       int i;
       if (x == y) return 1;
@@ -886,7 +1155,8 @@ object Cyc_has_cycle(object lst)
   object slow_lst, fast_lst;
   if ((lst == NULL) || is_value_type(lst)) {
     return boolean_f;
-  } else if (is_object_type(lst) && type_of(lst) == vector_tag) {
+  } else if (is_object_type(lst) && 
+             (type_of(lst) == vector_tag || type_of(lst) == record_tag)) {
     return Cyc_has_vector_cycle(lst);
   } else if (is_object_type(lst) && type_of(lst) != pair_tag) {
     return boolean_f;
@@ -1008,6 +1278,19 @@ object Cyc_display_va_list(void *data, int argc, object x, va_list ap)
   return Cyc_display(data, x, fp);
 }
 
+/**
+ * Name of the type of record `r`, taken from the type descriptor made by
+ * `define-record-type`, or `NULL` if the descriptor does not have one
+ */
+static object Cyc_record_name(object r)
+{
+  object t = record_type_of(r);
+  if (Cyc_is_vector(t) == boolean_t && ((vector) t)->num_elements > 1) {
+    return ((vector) t)->elements[1];
+  }
+  return NULL;
+}
+
 object Cyc_display(void *data, object x, FILE * port)
 {
   object tmp = NULL;
@@ -1096,6 +1379,24 @@ object Cyc_display(void *data, object x, FILE * port)
     }
     fprintf(port, ")");
     break;
+  case record_tag:
+    has_cycle = Cyc_has_cycle(x);
+    fprintf(port, "#<");
+    if (Cyc_record_name(x)) {
+      Cyc_display(data, Cyc_record_name(x), port);
+    } else {
+      fprintf(port, "record");
+    }
+    if (has_cycle == boolean_t) {
+      fprintf(port, " ...");
+    } else {
+      for (i = 1; i < ((vector) x)->num_elements; i++) {
+        fprintf(port, " ");
+        Cyc_display(data, ((vector) x)->elements[i], port);
+      }
+    }
+    fprintf(port, ">");
+    break;
   case bytevector_tag:
     fprintf(port, "#u8(");
     for (i = 0; i < ((bytevector) x)->len; i++) {
@@ -1289,6 +1590,24 @@ static object _Cyc_write(void *data, object x, FILE * port)
     }
     fprintf(port, ")");
     break;
+  case record_tag:
+    has_cycle = Cyc_has_cycle(x);
+    fprintf(port, "#<");
+    if (Cyc_record_name(x)) {
+      _Cyc_write(data, Cyc_record_name(x), port);
+    } else {
+      fprintf(port, "record");
+    }
+    if (has_cycle == boolean_t) {
+      fprintf(port, " ...");
+    } else {
+      for (i = 1; i < ((vector) x)->num_elements; i++) {
+        fprintf(port, " ");
+        _Cyc_write(data, ((vector) x)->elements[i], port);
+      }
+    }
+    fprintf(port, ">");
+    break;
   case pair_tag:
     has_cycle = Cyc_has_cycle(x);
     fprintf(port, "(");
@@ -1465,6 +1784,563 @@ list assoc_cdr(void *data, object x, list l)
 }
 /* END member and assoc */
 
+/* Hash tables */
+
+// A hash table's entries are kept in a single Scheme vector, so the GC and
+// the write barrier treat them like any other vector. Elements 0 and 1 hold
+// the number of live entries and the number of slots in use, including
+// deleted ones. Element 2 holds #f, or a stamp made of the value of 
+// `gc_move_epoch` when the table last hashed a key by an address that may
+// change, and the slot it was read from. The slot is that of the thread
+// that hashed all such keys, or `GC_MOVE_SLOTS` if several threads did, 
+// so other threads moving their own objects do not affect it. Element 3 
+// holds #f, or `gc_weak_keys` or `gc_ephemerons` for a weak table, see
+// types.h. It is followed by three elements per slot: the key's hash, the
+// key, and the value. The hash of an empty slot is #f and that of a 
+// deleted slot is #t. The number of slots is a power of two, and keys are
+// found by linear probing from the slot picked by the low bits of their
+// hash.
+//
+// The collector deletes an entry of a weak table once its key is garbage,
+// so keys and values are read from such tables through `gc_mut_read`. 
+// Functions that return the index of a slot read its key that way.
+//
+// eq? and eqv? tables hash most objects by address. An object on the stack,
+// in the young heap, or that compaction may move, has its hash stored as 
+// -1 - hash instead. Once any object may have moved the table hashes those
+// keys again before a key is added, see `Cyc_hash_table_refresh`. Lookups
+// never write to the table, so a table may be read by several threads at
+// once, and instead look through those keys if a key is not found by its
+// hash, see `Cyc_hash_table_find_moved`.
+#define HT_COUNT 0
+#define HT_USED 1
+#define HT_EPOCH 2
+#define HT_WEAK GC_WEAK_MARKER
+#define HT_FIRST GC_WEAK_FIRST
+#define ht_capacity(v) ((((vector) (v))->num_elements - HT_FIRST) / 3)
+#define ht_slot_index(s) (HT_FIRST + ((s) * 3))
+#define ht_hash_value(h) \
+  (obj_obj2int(h) < 0 ? -1 - obj_obj2int(h) : obj_obj2int(h))
+#define HT_STAMP_SLOT_BITS 7
+#define ht_stamp(slot) \
+  obj_int2obj((((long)gc_move_epoch(slot) & \
+                (CYC_FIXNUM_MAX >> HT_STAMP_SLOT_BITS)) << HT_STAMP_SLOT_BITS) \
+              | (slot))
+#define ht_stamp_slot(st) \
+  ((int)(obj_obj2int(st) & ((1 << HT_STAMP_SLOT_BITS) - 1)))
+#define ht_is_weak(v) (((vector) (v))->elements[HT_WEAK] != boolean_f)
+
+/**
+ * Finish a hash value so that all of its bits depend on all of the input
+ */
+static uint64_t Cyc_hash_mix(uint64_t h)
+{
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+/**
+ * Hash a number so that numbers that are `eqv?` have the same hash
+ */
+static uint64_t Cyc_hash_number(object obj)
+{
+  uint64_t bits, h;
+  double d;
+  if (obj_is_int(obj)) {
+    return Cyc_hash_mix((uint64_t)(int64_t)obj_obj2int(obj));
+  }
+  switch (type_of(obj)) {
+  case integer_tag:
+    return Cyc_hash_mix((uint64_t)(int64_t)integer_value(obj));
+  case bignum_tag:
+    // Same hash as a fixnum with the same value
+    if (mp_count_bits(&bignum_value(obj)) < 63) {
+      return Cyc_hash_mix((uint64_t)mp_get_i64(&bignum_value(obj)));
+    }
+    return MurmurHash64A(bignum_value(obj).dp, 
+                         bignum_value(obj).used * sizeof(mp_digit),
+                         bignum_value(obj).sign);
+  case double_tag:
+    d = double_value(obj);
+    if (d == 0.0) {
+      d = 0.0; // Same hash for -0.0
+    }
+    memcpy(&bits, &d, sizeof(bits));
+    return Cyc_hash_mix(bits);
+  case complex_num_tag:
+    d = creal(complex_num_value(obj));
+    memcpy(&bits, &d, sizeof(bits));
+    h = Cyc_hash_mix(bits) * 31;
+    d = cimag(complex_num_value(obj));
+    memcpy(&bits, &d, sizeof(bits));
+    return h + Cyc_hash_mix(bits);
+  default:
+    return Cyc_hash_mix((uint64_t)(uintptr_t)obj);
+  }
+}
+
+/**
+ * Hash the bytes of a string, folding ASCII letters to lower case as
+ * `string-foldcase` does
+ */
+static uint64_t Cyc_hash_string_ci(const char *s)
+{
+  uint64_t h = 14695981039346656037ULL;
+  for (; *s; s++) {
+    h = (h ^ (unsigned char)tolower((unsigned char)*s)) * 1099511628211ULL;
+  }
+  return Cyc_hash_mix(h);
+}
+
+/**
+ * Hash an object so that objects that are `equal?` have the same hash.
+ * At most `*budget` elements of pairs and vectors are looked at, which 
+ * keeps hashing fast for large structures and stops it on cycles.
+ */
+static uint64_t Cyc_hash_equal(object obj, int *budget)
+{
+  uint64_t h;
+  int i, len;
+  // Fixnums are equal? to boxed integers with the same value
+  if (obj_is_int(obj)) {
+    return Cyc_hash_number(obj);
+  }
+  if (obj == NULL || is_value_type(obj)) {
+    return Cyc_hash_mix((uint64_t)(uintptr_t)obj);
+  }
+  switch (type_of(obj)) {
+  case string_tag:
+    return MurmurHash64A(string_str(obj), strlen(string_str(obj)), 0);
+  case symbol_tag:
+    return Cyc_hash_mix((uint64_t)(uintptr_t)obj);
+  case integer_tag:
+  case bignum_tag:
+  case double_tag:
+  case complex_num_tag:
+    return Cyc_hash_number(obj);
+  case bytevector_tag:
+    return MurmurHash64A(((bytevector) obj)->data, ((bytevector) obj)->len, 0);
+  case pair_tag:
+    h = pair_tag;
+    while (is_object_type(obj) && type_of(obj) == pair_tag && (*budget)-- > 0) {
+      h = h * 31 + Cyc_hash_equal(car(obj), budget);
+      obj = cdr(obj);
+    }
+    if (*budget > 0) {
+      h = h * 31 + Cyc_hash_equal(obj, budget);
+    }
+    return Cyc_hash_mix(h);
+  case vector_tag:
+  case record_tag:
+    len = ((vector) obj)->num_elements;
+    h = type_of(obj) + len;
+    for (i = 0; i < len && (*budget)-- > 0; i++) {
+      h = h * 31 + Cyc_hash_equal(((vector) obj)->elements[i], budget);
+    }
+    return Cyc_hash_mix(h);
+  default:
+    // Only equal? if eq?, but the object may still move off of the stack
+    return Cyc_hash_mix(type_of(obj));
+  }
+}
+
+/**
+ * @brief Hash an object for a hash table
+ * @param data Thread data object
+ * @param obj  Object to hash
+ * @param kind Equivalence the hash must be consistent with, see 
+ *             `Cyc_hash_table_find`
+ * @return A non-negative fixnum
+ */
+object Cyc_hash(void *data, object obj, object kind)
+{
+  uint64_t h;
+  int budget = 16;
+  switch (obj_obj2int(kind)) {
+  case 1: // eq?
+    h = Cyc_hash_mix((uint64_t)(uintptr_t)obj);
+    break;
+  case 2: // eqv?
+    if (Cyc_is_number(obj) == boolean_t) {
+      h = Cyc_hash_number(obj);
+    } else {
+      h = Cyc_hash_mix((uint64_t)(uintptr_t)obj);
+    }
+    break;
+  case 4: // string=?
+    Cyc_check_str(data, obj);
+    h = MurmurHash64A(string_str(obj), strlen(string_str(obj)), 0);
+    break;
+  case 5: // string-ci=?
+    Cyc_check_str(data, obj);
+    h = Cyc_hash_string_ci(string_str(obj));
+    break;
+  default: // equal?
+    h = Cyc_hash_equal(obj, &budget);
+    break;
+  }
+  return obj_int2obj((long)(h & CYC_FIXNUM_MAX));
+}
+
+/**
+ * Compare two strings the way `string-ci=?` does
+ */
+static int Cyc_string_ci_equal(object a, object b)
+{
+  const unsigned char *x = (const unsigned char *)string_str(a),
+                      *y = (const unsigned char *)string_str(b);
+  for (; *x && tolower(*x) == tolower(*y); x++, y++) ;
+  return *x == *y;
+}
+
+/**
+ * Hash a key of an `eq?` or `eqv?` table, in the form stored in its slot
+ */
+static object Cyc_hash_identity(gc_thread_data *thd, object key, int kind)
+{
+  long h;
+  if (kind == 2 && Cyc_is_number(key) == boolean_t) {
+    return Cyc_hash(thd, key, obj_int2obj(2));
+  }
+  h = (long)(Cyc_hash_mix((uint64_t)(uintptr_t)key) & CYC_FIXNUM_MAX);
+  if (gc_may_move(thd, key)) {
+    h = -1 - h;
+  }
+  return obj_int2obj(h);
+}
+
+/**
+ * @brief Store an entry in a free slot of a table
+ * @param data    Thread data object
+ * @param entries Entries vector of the table, it must have an empty slot
+ *                left after this one is taken
+ * @param h       Hash of the key, as stored in the slot
+ * @return Index of the slot's hash in `entries`. The caller sets the key
+ *         and value that follow it.
+ */
+static int Cyc_hash_table_insert(gc_thread_data *thd, object entries, 
+                                 object h)
+{
+  object *e = ((vector) entries)->elements;
+  int mask = ht_capacity(entries) - 1, s = ht_hash_value(h) & mask, i, slot;
+  for (;; s = (s + 1) & mask) {
+    i = ht_slot_index(s);
+    if (e[i] == boolean_f) {
+      e[HT_USED] = obj_int2obj(obj_obj2int(e[HT_USED]) + 1);
+      break;
+    } else if (e[i] == boolean_t) {
+      break;
+    }
+  }
+  e[i] = h;
+  e[HT_COUNT] = obj_int2obj(obj_obj2int(e[HT_COUNT]) + 1);
+  if (obj_obj2int(h) < 0) {
+    slot = thd->move_slot;
+    if (e[HT_EPOCH] != boolean_f && ht_stamp_slot(e[HT_EPOCH]) != slot) {
+      slot = GC_MOVE_SLOTS;
+    }
+    e[HT_EPOCH] = ht_stamp(slot);
+  }
+  return i;
+}
+
+/**
+ * @brief Determine if keys of a table may have moved since they were hashed
+ */
+static int Cyc_hash_table_stale(object entries)
+{
+  object stamp = ((vector) entries)->elements[HT_EPOCH];
+  return stamp != boolean_f && stamp != ht_stamp(ht_stamp_slot(stamp));
+}
+
+/**
+ * @brief Hash again the keys of a table that may have moved
+ * @param data    Thread data object
+ * @param entries Entries vector of the table
+ *
+ * Does nothing unless objects may have moved since the table last hashed
+ * a key by an address that may change. Otherwise every entry is put back
+ * in the table, which also drops deleted slots. Keys that may have moved
+ * are hashed again, and any other key keeps its hash.
+ */
+void Cyc_hash_table_refresh(void *data, object entries)
+{
+  gc_thread_data *thd = (gc_thread_data *) data;
+  object *e = ((vector) entries)->elements, *saved;
+  int n = ht_capacity(entries), count = obj_obj2int(e[HT_COUNT]), s, i, 
+      j = 0;
+  if (!Cyc_hash_table_stale(entries)) {
+    return;
+  }
+  saved = malloc(sizeof(object) * 3 * (count + 1));
+  if (!saved) {
+    fprintf(stderr, "Unable to allocate memory to rehash table\n");
+    exit(1);
+  }
+  for (s = 0; s < n; s++) {
+    i = ht_slot_index(s);
+    if (obj_is_int(e[i])) {
+      saved[j++] = e[i];
+      saved[j++] = e[i + 1];
+      saved[j++] = e[i + 2];
+      // Still referenced from saved, but the collector may be tracing 
+      gc_mut_update(thd, e[i + 1], boolean_f);
+      gc_mut_update(thd, e[i + 2], boolean_f);
+      e[i + 1] = boolean_f;
+      e[i + 2] = boolean_f;
+    }
+    e[i] = boolean_f;
+  }
+  e[HT_COUNT] = obj_int2obj(0);
+  e[HT_USED] = obj_int2obj(0);
+  e[HT_EPOCH] = boolean_f;
+  for (s = 0; s < j; s += 3) {
+    if (obj_obj2int(saved[s]) < 0) {
+      saved[s] = Cyc_hash_identity(thd, saved[s + 1], 1);
+    }
+    i = Cyc_hash_table_insert(thd, entries, saved[s]);
+    Cyc_vector_set_unsafe(data, entries, obj_int2obj(i + 1), saved[s + 1]);
+    Cyc_vector_set_unsafe(data, entries, obj_int2obj(i + 2), saved[s + 2]);
+  }
+  free(saved);
+}
+
+/**
+ * @brief Find a key among the keys of a table that may have moved
+ * @param entries Entries vector of the table
+ * @param key     Key to find
+ * @return Index of the slot's hash in `entries`, or #f if the key is not 
+ *         in the table
+ *
+ * Used once a key is not found by its hash, since the hash stored for a
+ * key that moved is that of its old address.
+ */
+static object Cyc_hash_table_find_moved(object entries, object key)
+{
+  object *e = ((vector) entries)->elements;
+  int n = ht_capacity(entries), s, i;
+  for (s = 0; s < n; s++) {
+    i = ht_slot_index(s);
+    if (obj_is_int(e[i]) && obj_obj2int(e[i]) < 0 && e[i + 1] == key) {
+      return obj_int2obj(i);
+    }
+  }
+  return boolean_f;
+}
+
+/**
+ * @brief Find the slot holding a key
+ * @param data    Thread data object
+ * @param entries Entries vector of the table
+ * @param kind    Equivalence used to compare keys: 1 for `eq?`, 2 for 
+ *                `eqv?`, 3 for `equal?`, 4 for `string=?`, and 5 for 
+ *                `string-ci=?`
+ * @param h       Hash of the key from `Cyc_hash`. Ignored by `eq?` and 
+ *                `eqv?` tables, which hash the key here since it may have
+ *                moved after it was hashed.
+ * @param key     Key to find
+ * @return Index of the slot's hash in `entries`, followed by its key and
+ *         value, or #f if the key is not in the table
+ *
+ * Does not write to the table.
+ */
+object Cyc_hash_table_find(void *data, object entries, object kind, object h,
+                           object key)
+{
+  object *e = ((vector) entries)->elements, k, moving;
+  int mask = ht_capacity(entries) - 1, s, i, knd = obj_obj2int(kind),
+      stale = 0;
+  if (knd == 1 || knd == 2) {
+    h = Cyc_hash_identity((gc_thread_data *) data, key, knd);
+    stale = Cyc_hash_table_stale(entries);
+  }
+  // Whether a key may move can change without it moving, so either form
+  // of its hash may be stored
+  s = ht_hash_value(h);
+  moving = obj_int2obj((-1 - s));
+  h = obj_int2obj(s);
+  for (s &= mask;; s = (s + 1) & mask) {
+    i = ht_slot_index(s);
+    if (e[i] == h || e[i] == moving) {
+      k = e[i + 1];
+      if (k == key ||
+          (knd == 2 && Cyc_eqv(k, key) == boolean_t) ||
+          (knd == 3 && equalp(k, key) == boolean_t) ||
+          (knd == 4 && strcmp(string_str(k), string_str(key)) == 0) ||
+          (knd == 5 && Cyc_string_ci_equal(k, key))) {
+        if (ht_is_weak(entries)) {
+          gc_mut_read((gc_thread_data *) data, k);
+        }
+        return obj_int2obj(i);
+      }
+    } else if (e[i] == boolean_f) {
+      return stale ? Cyc_hash_table_find_moved(entries, key) : boolean_f;
+    }
+  }
+}
+
+/**
+ * @brief Find the next slot whose key has a given hash, for tables with
+ *        an equivalence function only Scheme can call
+ * @param data    Thread data object
+ * @param entries Entries vector of the table
+ * @param h       Hash of the key
+ * @param prev    Index returned by the previous call for this key, or #f
+ *                to start from the first slot the key may be in
+ * @return Index of the slot's hash in `entries`, or #f if there are no
+ *         more keys with this hash
+ */
+object Cyc_hash_table_scan(void *data, object entries, object h, object prev)
+{
+  object *e = ((vector) entries)->elements;
+  int mask = ht_capacity(entries) - 1, s, i;
+  if (prev == boolean_f) {
+    s = obj_obj2int(h) & mask;
+  } else {
+    s = (((obj_obj2int(prev) - HT_FIRST) / 3) + 1) & mask;
+  }
+  for (;; s = (s + 1) & mask) {
+    i = ht_slot_index(s);
+    if (e[i] == h) {
+      if (ht_is_weak(entries)) {
+        gc_mut_read((gc_thread_data *) data, e[i + 1]);
+      }
+      return obj_int2obj(i);
+    } else if (e[i] == boolean_f) {
+      return boolean_f;
+    }
+  }
+}
+
+/**
+ * @brief Reserve a slot for a key that is not in a table
+ * @param data    Thread data object
+ * @param entries Entries vector of the table, it must have an empty slot
+ *                left after this one is taken, see `Cyc_hash_table_full`
+ * @param kind    Equivalence used to compare keys, see 
+ *                `Cyc_hash_table_find`
+ * @param h       Hash of the key, ignored by `eq?` and `eqv?` tables
+ * @param key     Key that will be stored in the slot
+ * @return Index of the slot's hash in `entries`. The caller sets the key
+ *         and value that follow it.
+ */
+object Cyc_hash_table_claim(void *data, object entries, object kind, 
+                            object h, object key)
+{
+  int knd = obj_obj2int(kind);
+  if (knd == 1 || knd == 2) {
+    Cyc_hash_table_refresh(data, entries);
+    h = Cyc_hash_identity((gc_thread_data *) data, key, knd);
+  }
+  return obj_int2obj(Cyc_hash_table_insert((gc_thread_data *) data, 
+                                           entries, h));
+}
+
+/**
+ * @brief Determine if a table must be resized before a key is added
+ */
+object Cyc_hash_table_full(object entries)
+{
+  object *e = ((vector) entries)->elements;
+  return make_boolean((obj_obj2int(e[HT_USED]) + 1) * 4 >= 
+                      ht_capacity(entries) * 3);
+}
+
+/**
+ * @brief Delete the entry in a slot found by `Cyc_hash_table_find`
+ */
+object Cyc_hash_table_remove(void *data, object entries, object idx)
+{
+  object *e = ((vector) entries)->elements;
+  int i = obj_obj2int(idx);
+  gc_mut_update((gc_thread_data *) data, e[i + 1], boolean_f);
+  gc_mut_update((gc_thread_data *) data, e[i + 2], boolean_f);
+  e[i] = boolean_t;
+  e[i + 1] = boolean_f;
+  e[i + 2] = boolean_f;
+  e[HT_COUNT] = obj_int2obj(obj_obj2int(e[HT_COUNT]) - 1);
+  return entries;
+}
+
+/**
+ * @brief Move every entry of a table to a new, empty entries vector
+ * @param data Thread data object
+ * @param from Entries vector of the table
+ * @param to   New entries vector, with enough slots for all of the entries
+ * @return The new entries vector
+ *
+ * Entries keep their hash, so keys are only hashed again if they may have
+ * moved, see `Cyc_hash_table_refresh`.
+ */
+object Cyc_hash_table_rehash(void *data, object from, object to)
+{
+  object *e = ((vector) from)->elements;
+  int n = ht_capacity(from), weak = ht_is_weak(from), s, i, j;
+  Cyc_hash_table_refresh(data, from);
+  for (s = 0; s < n; s++) {
+    i = ht_slot_index(s);
+    if (obj_is_int(e[i])) {
+      if (weak) {
+        gc_mut_read((gc_thread_data *) data, e[i + 1]);
+        gc_mut_read((gc_thread_data *) data, e[i + 2]);
+      }
+      j = Cyc_hash_table_insert((gc_thread_data *) data, to, e[i]);
+      Cyc_vector_set_unsafe(data, to, obj_int2obj(j + 1), e[i + 1]);
+      Cyc_vector_set_unsafe(data, to, obj_int2obj(j + 2), e[i + 2]);
+    }
+  }
+  // Keys that may move are still those of the threads that hashed them
+  ((vector) to)->elements[HT_EPOCH] = e[HT_EPOCH];
+  return to;
+}
+
+/**
+ * @brief Read an element of a table's entries
+ * @param data    Thread data object
+ * @param entries Entries vector of the table
+ * @param idx     Index of the element
+ * @return The element, which is kept from being collected if the table 
+ *         is weak
+ */
+object Cyc_hash_table_entry(void *data, object entries, object idx)
+{
+  object obj = ((vector) entries)->elements[obj_obj2int(idx)];
+  if (ht_is_weak(entries)) {
+    gc_mut_read((gc_thread_data *) data, obj);
+  }
+  return obj;
+}
+
+/**
+ * @brief Make a new, empty table weak
+ * @param entries  Entries vector of the table
+ * @param weakness 0 for a table that holds on to its keys, 1 for a table
+ *                 with weak keys, or 2 for an ephemeron table
+ * @return The entries vector
+ */
+object Cyc_hash_table_weaken(object entries, object weakness)
+{
+  int w = obj_obj2int(weakness);
+  ((vector) entries)->elements[HT_WEAK] = 
+    (w == 1 ? gc_weak_keys : w == 2 ? gc_ephemerons : boolean_f);
+  return entries;
+}
+
+/**
+ * @brief Get the weakness of a table, see `Cyc_hash_table_weaken`
+ */
+object Cyc_hash_table_weakness(object entries)
+{
+  object marker = ((vector) entries)->elements[HT_WEAK];
+  int w = (marker == gc_weak_keys ? 1 : marker == gc_ephemerons ? 2 : 0);
+  return obj_int2obj(w);
+}
+/* END hash tables */
+
 object Cyc_fast_list_2(object ptr, object a1, object a2) 
 {
   list_2_type *l = (list_2_type *)ptr;
@@ -2062,6 +2938,7 @@ object Cyc_is_immutable(object obj)
   if (is_object_type(obj) &&
       (type_of(obj) == pair_tag ||
        type_of(obj) == vector_tag ||
+       type_of(obj) == record_tag ||
        type_of(obj) == bytevector_tag ||
        type_of(obj) == string_tag
       ) &&
@@ -2287,6 +3164,95 @@ object Cyc_vector_length(void *data, object v)
   return NULL;
 }
 
+/**
+ * @brief Create a record and pass it to a continuation
+ * @param data Thread data object
+ * @param cont Continuation
+ * @param lst  Type descriptor of the record followed by its fields
+ *
+ * The record is allocated on the stack unless it is too large.
+ */
+static object Cyc_list2record(void *data, object cont, object lst)
+{
+  object r;
+  int len = obj_obj2int(Cyc_length(data, lst)), i = 0;
+  size_t element_vec_size = sizeof(object) * len;
+  make_c_opaque(opq, NULL);
+  if (element_vec_size >= MAX_STACK_OBJ) {
+    int heap_grown;
+    r = gc_alloc(((gc_thread_data *)data)->heap, 
+                 sizeof(vector_type) + element_vec_size,
+                 boolean_f, // OK to populate manually over here
+                 (gc_thread_data *)data, 
+                 &heap_grown);
+    ((vector) r)->hdr.mark = ((gc_thread_data *)data)->gc_alloc_color;
+    ((vector) r)->elements = (object *)(((char *)r) + sizeof(vector_type));
+    // Fields may be on the stack, the GC must scan the whole record
+    opaque_ptr(&opq) = r;
+    add_mutation(data, &opq, -1, r);
+  } else {
+    r = alloca(sizeof(vector_type));
+    ((vector) r)->hdr.mark = gc_color_red;
+    ((vector) r)->elements = (object *) alloca(element_vec_size);
+  }
+  ((vector) r)->hdr.grayed = 0;
+  ((vector) r)->hdr.immutable = 0;
+  ((vector) r)->tag = record_tag;
+  ((vector) r)->num_elements = len;
+  for (; lst != NULL; lst = cdr(lst)) {
+    ((vector) r)->elements[i++] = car(lst);
+    if (element_vec_size >= MAX_STACK_OBJ) {
+      gc_check_escape(data, r, car(lst));
+    }
+  }
+  _return_closcall1(data, cont, r);
+}
+
+/**
+ * @brief Create a record, used by the constructors of record types
+ * @param data Thread data object
+ * @param cont Continuation
+ * @param argc Number of arguments, including `type`
+ * @param type Type descriptor of the record, followed by its fields
+ *
+ * Records are always created this way instead of retagging a vector, so
+ * an object that is a vector never becomes a record.
+ */
+object Cyc_record(void *data, object cont, int argc, object type, ...)
+{
+  load_varargs(objs, type, argc);
+  return Cyc_list2record(data, cont, objs);
+}
+
+object Cyc_record_set_cps(void *data, object cont, object r, object type, object k, object obj)
+{
+  if (!obj_is_int(k) || Cyc_is_record_of(r, type) == boolean_f ||
+      (unsigned) obj_obj2int(k) >= (unsigned) (((vector) r)->num_elements - 1)) {
+    Cyc_invalid_record_error(data, r, type, k);
+  }
+  Cyc_verify_mutable(data, r);
+  return Cyc_record_set_unsafe_cps(data, cont, r, type, k, obj);
+}
+
+object Cyc_record_set_unsafe_cps(void *data, object cont, object r, object type, object k, object obj)
+{
+  // Fields follow the type descriptor, so mutate them as vector elements
+  int idx = obj_obj2int(k) + 1;
+  int do_gc = 0;
+  obj = transport_stack_value(data, r, obj, &do_gc);
+  gc_mut_update((gc_thread_data *) data, ((vector) r)->elements[idx], obj);
+  add_mutation(data, r, idx, obj);
+  if (do_gc) { // GC and then do assignment
+    mclosure0(clo, (function_type)Cyc_vector_set_cps_gc_return);
+    object buf[4]; buf[0] = r; buf[1] = obj_int2obj(idx); buf[2] = obj; buf[3] = cont;
+    GC(data, &clo, buf, 4);
+    return NULL;
+  } else {
+    ((vector) r)->elements[idx] = obj; // Assign now since we have heap objs
+    return r;
+  }
+}
+
 object Cyc_length(void *data, object l)
 {
   int len = 0;
@@ -2420,10 +3386,9 @@ object Cyc_string2symbol(void *data, object str)
 {
   object sym;
   Cyc_check_str(data, str);
-  sym = find_symbol_by_name(string_str(str));
-  if (!sym) {
-    sym = add_symbol_by_name(string_str(str));
-  }
+  // Not string_len, which string-set! leaves as is when it shortens a
+  // string's contents
+  sym = Cyc_intern_symbol(data, string_str(str), strlen(string_str(str)));
   return sym;
 }
 
@@ -2712,6 +3677,42 @@ object Cyc_string_byte_length(void *data, object str)
   return obj_int2obj(string_len(str));
 }
 
+/** True if the given byte continues a multi-byte UTF-8 sequence */
+#define Cyc_utf8_is_cont(b) (((uint8_t)(b) & 0xC0) == 0x80)
+
+/**
+ * @brief Find the first byte of a code point in a UTF-8 string
+ * @param str String object
+ * @param idx Index of the code point, which must be in bounds
+ * @return Pointer to the code point's first byte
+ *
+ * The scan starts from the string's cursor, or from the beginning if that
+ * is closer, and moves the cursor to the code point that was found. Code
+ * that walks a string in either direction therefore pays a constant cost
+ * per character rather than rescanning the string each time.
+ */
+static char *Cyc_string_seek(object str, int idx)
+{
+  char *raw = string_str(str), *p;
+  uint64_t cursor = string_cursor(str); // Read once, may be shared
+  int cp = (int)(cursor >> 32);
+
+  if (cp > idx && cp - idx > idx) {
+    cp = 0;
+    p = raw;
+  } else {
+    p = raw + (uint32_t)cursor;
+  }
+  for (; cp < idx; cp++) {
+    do { p++; } while (Cyc_utf8_is_cont(*p));
+  }
+  for (; cp > idx; cp--) {
+    do { p--; } while (Cyc_utf8_is_cont(*p));
+  }
+  string_cursor(str) = ((uint64_t)idx << 32) | (uint32_t)(p - raw);
+  return p;
+}
+
 object Cyc_string_set(void *data, object str, object k, object chr)
 {
   char buf[5];
@@ -2739,7 +3740,7 @@ object Cyc_string_set(void *data, object str, object k, object chr)
   idx = unbox_number(k);
   len = string_len(str);
 
-  Cyc_check_bounds(data, "string-set!", len, idx);
+  Cyc_check_bounds(data, "string-set!", string_num_cp(str), idx);
 
   if (string_num_cp(str) == string_len(str) && buf_len == 1) {
     // Take fast path if all chars are just 1 byte
@@ -2747,35 +3748,24 @@ object Cyc_string_set(void *data, object str, object k, object chr)
   } else {
     // Slower path for UTF-8, need to handle replacement differently 
     // depending upon how the new char affects length of the string
-    char *tmp = raw, *this_cp = raw;
+    char *this_cp = Cyc_string_seek(str, idx);
     char_type codepoint;
     uint32_t state = 0;
-    int i = 0, count, prev_cp_bytes = 0, cp_idx;
+    int i, prev_cp_bytes = 0;
 
-    // Find index to change, and how many bytes it is
-    for (count = 0; *tmp; ++tmp){
+    // Find how many bytes the code point to change takes up
+    do {
       prev_cp_bytes++;
-      if (!Cyc_utf8_decode(&state, &codepoint, (uint8_t)*tmp)){
-        if (count == idx) {
-          break;
-        }
-        this_cp = tmp + 1;
-        count += 1;
-        prev_cp_bytes = 0;
-      }
-      i++;
-    }
-    cp_idx = i;
+    } while (Cyc_utf8_decode(&state, &codepoint, (uint8_t)this_cp[prev_cp_bytes - 1]) 
+             && state != CYC_UTF8_REJECT);
     if (state != CYC_UTF8_ACCEPT) {
        Cyc_rt_raise2(data, "string-set! - invalid character at index", k);
     }
 
     // Perform actual mutation
     //
-    // Now we know length of start (both in codepoints and bytes),
-    // and we know the codepoint to be replaced. by calculating its length
-    // we can compute where the end portion starts, and by using str we can
-    // figure out how many remaining bytes/codepoints are in end
+    // Only bytes after the code point being replaced may move, so the
+    // cursor left at this code point by the seek remains valid.
     //
     // 3 cases: 
     // - 1) buf_len = prev_cp_bytes, just straight replace
@@ -2790,8 +3780,10 @@ object Cyc_string_set(void *data, object str, object k, object chr)
       for (i = 0; i < buf_len; i++) {
         this_cp[i] = buf[i];
       }
-      // Move string down to eliminate unneeded chars
-      memmove(this_cp + buf_len, this_cp + prev_cp_bytes, len - cp_idx);
+      // Move string down to eliminate unneeded chars, along with the
+      // terminator at the end of the buffer
+      memmove(this_cp + buf_len, this_cp + prev_cp_bytes,
+              len + 1 - (this_cp - raw) - prev_cp_bytes);
       // Null terminate the shorter string.
       // Ensure string_len is not reduced because original 
       // value still matters for GC purposes
@@ -2828,12 +3820,11 @@ object Cyc_string_ref(void *data, object str, object k)
   } else {
     char_type codepoint = 0;
     uint32_t state = 0;
-    int count;
 
-    for (count = 0; *raw; ++raw){
-      if (!Cyc_utf8_decode(&state, &codepoint, (uint8_t)*raw)){
-        if (count == idx) break; // Reached requested index
-        count += 1;
+    for (raw = Cyc_string_seek(str, idx); *raw; ++raw){
+      if (Cyc_utf8_decode(&state, &codepoint, (uint8_t)*raw) == CYC_UTF8_ACCEPT ||
+          state == CYC_UTF8_REJECT) {
+        break;
       }
     }
     if (state != CYC_UTF8_ACCEPT)
@@ -3042,6 +4033,7 @@ object Cyc_make_vector(void *data, object cont, int argc, object len, ...)
     // Otherwise if next minor GC misses fill it could be catastrophic
     car(&tmp_pair) = fill;
     add_mutation(data, &tmp_pair, -1, fill);
+    gc_check_escape(data, v, fill);
     // Add a special object to indicate full vector must be scanned by GC
     opaque_ptr(&opq) = v;
     add_mutation(data, &opq, -1, v);
@@ -3463,6 +4455,9 @@ object Cyc_list2vector(void *data, object cont, object l)
   }
   while ((lst != NULL)) {
     ((vector) v)->elements[i++] = car(lst);
+    if (element_vec_size >= MAX_STACK_OBJ) {
+      gc_check_escape(data, v, car(lst));
+    }
     lst = cdr(lst);
   }
   _return_closcall1(data, cont, v);
@@ -4978,6 +5973,12 @@ void _Cyc_91end_91thread_67(void *data, object cont, object args)
   return_closcall1(data, cont, boolean_f);
 }
 
+void _Cyc_91arena_91unwind(void *data, object cont, object args)
+{
+  Cyc_check_num_args(data, "Cyc-arena-unwind", 2, args);
+  return_closcall1(data, cont, Cyc_arena_unwind(data, car(args), cadr(args)));
+}
+
 void __87(void *data, object cont, object args)
 {
   int argc = obj_obj2int(Cyc_length(data, args));
@@ -5380,6 +6381,34 @@ void _vector_91set_67(void *data, object cont, object args)
     return_closcall1(data, cont, ref);
 }}
 
+void _Cyc_91record(void *data, object cont, object args)
+{
+  Cyc_check_num_args(data, "Cyc-record", 1, args);
+  Cyc_list2record(data, cont, args);
+}
+
+void _Cyc_91record_91of_127(void *data, object cont, object args)
+{
+  Cyc_check_num_args(data, "Cyc-record-of?", 2, args);
+  return_closcall1(data, cont, Cyc_is_record_of(car(args), cadr(args)));
+}
+
+void _Cyc_91record_91ref(void *data, object cont, object args)
+{
+  Cyc_check_num_args(data, "Cyc-record-ref", 3, args);
+  {
+    object ref = Cyc_record_ref(data, car(args), cadr(args), caddr(args));
+    return_closcall1(data, cont, ref);
+}}
+
+void _Cyc_91record_91set_67(void *data, object cont, object args)
+{
+  Cyc_check_num_args(data, "Cyc-record-set!", 4, args);
+  {
+    object ref = Cyc_record_set_cps(data, cont, car(args), cadr(args), caddr(args), cadddr(args));
+    return_closcall1(data, cont, ref);
+}}
+
 void _list_91_125vector(void *data, object cont, object args)
 {
   Cyc_check_num_args(data, "list->vector", 1, args);
@@ -5756,7 +6785,15 @@ void Cyc_start_trampoline(gc_thread_data * thd)
  */
 void gc_request_mark_globals(void)
 {
-  gc_mark_globals(Cyc_global_variables, global_table);
+  gc_mark_globals(Cyc_global_variables, &global_table);
+}
+
+/**
+ * @brief A helper function for calling `gc_compact_globals`.
+ */
+void gc_request_compact_globals(void)
+{
+  gc_compact_globals(&Cyc_global_variables, &global_table);
 }
 
 /**
@@ -5828,7 +6865,8 @@ static char *gc_move(char *obj, gc_thread_data * thd, int *alloci, int *heap_gro
           gc_alloc(heap, sizeof(double_type), obj, thd, heap_grown);
       return gc_fixup_moved_obj(thd, alloci, obj, hp);
     }
-  case vector_tag:{
+  case vector_tag:
+  case record_tag:{
       vector_type *hp = gc_alloc(heap,
                                  sizeof(vector_type) +
                                  sizeof(object) *
@@ -5936,7 +6974,8 @@ int gc_minor(void *data, object low_limit, object high_limit, closure cont,
   object temp;
   int i;
   int scani = 0, alloci = 0;
-  int heap_grown = 0;
+  int heap_grown = 0, pin_globals = 0;
+  uint64_t start_ns = gc_time_ns();
 
 #if GC_DEBUG_VERBOSE
   fprintf(stderr, "started minor GC\n");
@@ -5974,13 +7013,19 @@ int gc_minor(void *data, object low_limit, object high_limit, closure cont,
       } else if (type_of(o) == pair_tag) {
         gc_move2heap(car(o));
         gc_move2heap(cdr(o));
-      } else if (type_of(o) == vector_tag) {
-        int i;
-        object idx;
-        // For vectors, index is encoded as the next mutation
-        idx = ((gc_thread_data *) data)->mutations[l++];
-        i = obj_obj2int(idx);
-        gc_move2heap(((vector) o)->elements[i]);
+      } else if (type_of(o) == vector_tag || type_of(o) == record_tag) {
+        int i, end;
+        object card;
+        // For vectors, the mutated card is encoded as the next mutation
+        card = ((gc_thread_data *) data)->mutations[l++];
+        i = obj_obj2int(card) << GC_MUTATION_CARD_BITS;
+        end = i + (1 << GC_MUTATION_CARD_BITS);
+        if (end > ((vector) o)->num_elements) {
+          end = ((vector) o)->num_elements;
+        }
+        for (; i < end; i++) {
+          gc_move2heap(((vector) o)->elements[i]);
+        }
       } else if (type_of(o) == forward_tag) {
         // Already transported, skip
       } else if (type_of(o) == c_opaque_tag) {
@@ -6008,10 +7053,30 @@ int gc_minor(void *data, object low_limit, object high_limit, closure cont,
     // Transport globals
     gc_move2heap(Cyc_global_variables);   // Internal global used by the runtime
     {
-      list l = global_table;
-      for (; l != NULL; l = cdr(l)) {
-        cvar_type *c = (cvar_type *) car(l);
-        gc_move2heap(*(c->pvar)); // Transport underlying global, not the pvar
+      int len = ck_pr_load_int(&(global_table.len));
+      ck_pr_fence_load();
+      for (i = 0; i < len; i++) {
+        // Transport underlying global, not the pvar
+        gc_move2heap(*(gc_global_entry(&global_table, i)->pvar));
+      }
+    }
+    pin_globals = 1;
+    // Everything was just collected, so no need to check individual globals
+    if (((gc_thread_data *) data)->globals_dirty_any) {
+      ((gc_thread_data *) data)->globals_dirty_any = 0;
+      memset(((gc_thread_data *) data)->globals_dirty, 0, 
+             sizeof(uint64_t) * ((gc_thread_data *) data)->globals_dirty_len);
+    }
+  } else if (((gc_thread_data *) data)->globals_dirty_any) {
+    // Only transport globals that were set to stack objects
+    uint64_t *dirty = ((gc_thread_data *) data)->globals_dirty;
+    int w, len = ((gc_thread_data *) data)->globals_dirty_len;
+    ((gc_thread_data *) data)->globals_dirty_any = 0;
+    for (w = 0; w < len; w++) {
+      while (dirty[w]) {
+        int slot = (w * 64) + gc_bitmap_lowest_bit(dirty[w]);
+        dirty[w] &= dirty[w] - 1;
+        gc_move2heap(*(gc_global_entry(&global_table, slot)->pvar));
       }
     }
   }
@@ -6035,7 +7100,8 @@ int gc_minor(void *data, object low_limit, object high_limit, closure cont,
         }
         break;
       }
-    case vector_tag:{
+    case vector_tag:
+    case record_tag:{
         int i, n = ((vector) obj)->num_elements;
         for (i = 0; i < n; i++) {
           gc_move2heap(((vector) obj)->elements[i]);
@@ -6069,6 +7135,18 @@ int gc_minor(void *data, object low_limit, object high_limit, closure cont,
     }
     scani++;
   }
+  // Young objects the write barrier found on the stack were just moved,
+  // and globals may have been set without the write barrier
+  if (((gc_thread_data *) data)->young) {
+    gc_young_pin_escaped((gc_thread_data *) data, low_limit, 
+                         Cyc_global_variables, 
+                         pin_globals ? &global_table : NULL);
+  }
+  // Return unused allocation buffer space to the heap
+  gc_alloc_buffers_flush((gc_thread_data *) data);
+  gc_note_moved((gc_thread_data *) data);
+  ((gc_thread_data *) data)->stats_minor_gcs++;
+  ((gc_thread_data *) data)->stats_minor_gc_ns += gc_time_ns() - start_ns;
 #if GC_DEBUG_VERBOSE
   fprintf(stderr, "done with minor GC\n");
 #endif
@@ -6089,8 +7167,12 @@ void GC(void *data, closure cont, object * args, int num_args)
 long long tstamp = hrt_get_current();
 #endif
   int alloci = gc_minor(data, low_limit, high_limit, cont, args, num_args);
+  gc_stack_size_adapt((gc_thread_data *) data);
+  gc_young_collect((gc_thread_data *) data);
   // Cooperate with the collector thread
   gc_mut_cooperate((gc_thread_data *) data, alloci);
+  // Stop here if the collector is compacting the heap
+  gc_compact_park((gc_thread_data *) data);
 #ifdef CYC_HIGH_RES_TIMERS
 hrt_log_delta("minor gc", tstamp);
 #endif
@@ -6108,6 +7190,7 @@ void Cyc_make_shared_object(void *data, object k, object obj)
   gc_heap_root *heap = thd->heap;
   object buf[1];
   int tmp, *heap_grown = &tmp;
+  gc_check_escape(thd, NULL, obj); // May be used by other threads
   if (!is_object_type(obj) || // Immediates do not have to be moved
       !gc_is_stack_obj(&tmp, data, obj)) { // Not thread-local, assume already on heap
     return_closcall1(data, k, obj);
@@ -6135,6 +7218,7 @@ void Cyc_make_shared_object(void *data, object k, object obj)
   case c_opaque_tag:
   case complex_num_tag: {
     object hp = gc_alloc(heap, gc_allocated_bytes(obj, NULL, NULL), obj, thd, heap_grown);
+    gc_check_escape(thd, NULL, hp);
     return_closcall1(data, k, hp);
   }
   // Objs w/children force minor GC to guarantee everything is relocated:
@@ -6143,6 +7227,7 @@ void Cyc_make_shared_object(void *data, object k, object obj)
   case closureN_tag:
   case pair_tag:
   case vector_tag:
+  case record_tag:
     buf[0] = obj;
     GC(data, k, buf, 1);
     break;
@@ -6206,6 +7291,8 @@ static primitive_type Cyc_91spawn_91thread_67_primitive =
     { {0}, primitive_tag, "Cyc-spawn-thread!", &_Cyc_91spawn_91thread_67 };
 static primitive_type Cyc_91end_91thread_67_primitive =
     { {0}, primitive_tag, "Cyc-end-thread!", &_Cyc_91end_91thread_67 };
+static primitive_type Cyc_91arena_91unwind_primitive =
+    { {0}, primitive_tag, "Cyc-arena-unwind", &_Cyc_91arena_91unwind };
 static primitive_type _87_primitive = { {0}, primitive_tag, "+", &__87 };
 static primitive_type _91_primitive = { {0}, primitive_tag, "-", &__91 };
 static primitive_type _85_primitive = { {0}, primitive_tag, "*", &__85 };
@@ -6374,6 +7461,14 @@ static primitive_type vector_91ref_primitive =
     { {0}, primitive_tag, "vector-ref", &_vector_91ref };
 static primitive_type vector_91set_67_primitive =
     { {0}, primitive_tag, "vector-set!", &_vector_91set_67 };
+static primitive_type Cyc_91record_primitive =
+    { {0}, primitive_tag, "Cyc-record", &_Cyc_91record };
+static primitive_type Cyc_91record_91of_127_primitive =
+    { {0}, primitive_tag, "Cyc-record-of?", &_Cyc_91record_91of_127 };
+static primitive_type Cyc_91record_91ref_primitive =
+    { {0}, primitive_tag, "Cyc-record-ref", &_Cyc_91record_91ref };
+static primitive_type Cyc_91record_91set_67_primitive =
+    { {0}, primitive_tag, "Cyc-record-set!", &_Cyc_91record_91set_67 };
 static primitive_type boolean_127_primitive =
     { {0}, primitive_tag, "boolean?", &_boolean_127 };
 static primitive_type char_127_primitive =
@@ -6452,6 +7547,7 @@ const object primitive_Cyc_91has_91cycle_127 = &Cyc_91has_91cycle_127_primitive;
 const object primitive_Cyc_91spawn_91thread_67 =
     &Cyc_91spawn_91thread_67_primitive;
 const object primitive_Cyc_91end_91thread_67 = &Cyc_91end_91thread_67_primitive;
+const object primitive_Cyc_91arena_91unwind = &Cyc_91arena_91unwind_primitive;
 const object primitive__87 = &_87_primitive;
 const object primitive__91 = &_91_primitive;
 const object primitive__85 = &_85_primitive;
@@ -6485,6 +7581,10 @@ const object primitive_bytevector_91length = &bytevector_91length_primitive;
 const object primitive_vector_91length = &vector_91length_primitive;
 const object primitive_vector_91ref = &vector_91ref_primitive;
 const object primitive_vector_91set_67 = &vector_91set_67_primitive;
+const object primitive_Cyc_91record = &Cyc_91record_primitive;
+const object primitive_Cyc_91record_91of_127 = &Cyc_91record_91of_127_primitive;
+const object primitive_Cyc_91record_91ref = &Cyc_91record_91ref_primitive;
+const object primitive_Cyc_91record_91set_67 = &Cyc_91record_91set_67_primitive;
 const object primitive_set_91car_67 = &set_91car_67_primitive;
 const object primitive_set_91cdr_67 = &set_91cdr_67_primitive;
 const object primitive_car = &car_primitive;
@@ -6602,6 +7702,18 @@ void *gc_alloc_pair(gc_thread_data *data, object head, object tail)
   return p;
 }
 
+/**
+ * Size of the stack buffer requested for a new thread, or the current
+ * value of the stack-size GC parameter
+ */
+static long Cyc_thread_stack_size(vector_type *t)
+{
+  if (t->num_elements >= 8 && obj_is_int(t->elements[7])) {
+    return obj_obj2int(t->elements[7]);
+  }
+  return (long)gc_get_param(GC_PARAM_STACK_SIZE);
+}
+
 /**
  * Thread initialization function only called from within the runtime
  */
@@ -6625,7 +7737,7 @@ void *Cyc_init_thread(object thread_and_thunk, int argc, object *args)
     o = (c_opaque_type *)op;
     thd = (gc_thread_data *)(opaque_ptr(o));
   }
-  gc_thread_data_init(thd, 0, (char *)&stack_start, global_stack_size);
+  gc_thread_data_init(thd, 0, (char *)&stack_start, Cyc_thread_stack_size(t));
   thd->scm_thread_obj = car(thread_and_thunk);
   thd->gc_cont = cdr(thread_and_thunk);
   thd->gc_num_args = 1;
@@ -6667,6 +7779,7 @@ void *Cyc_init_thread(object thread_and_thunk, int argc, object *args)
   gc_add_mutator(thd);
   ck_pr_cas_int((int *)&(thd->thread_state), CYC_THREAD_STATE_NEW,
                 CYC_THREAD_STATE_RUNNABLE);
+  gc_thread_started(thd);
   Cyc_start_trampoline(thd);
   return NULL;
 }
@@ -6702,8 +7815,15 @@ to look at the lock-free structures provided by ck?
 */
   pthread_t thread;
   pthread_attr_t attr;
+  size_t cur_size, 
+    size = gc_stack_size_max(Cyc_thread_stack_size(car(thread_and_thunk))) + STACK_MARGIN;
   pthread_attr_init(&attr);
   pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  // Make sure the thread's stack buffer fits on its C stack
+  if (pthread_attr_getstacksize(&attr, &cur_size) == 0 && cur_size < size) {
+    pthread_attr_setstacksize(&attr, size);
+  }
+  gc_thread_starting(); // Keep thread_and_thunk in place for the new thread
   if (pthread_create(&thread, &attr, _Cyc_init_thread, thread_and_thunk)) {
     fprintf(stderr, "Error creating a new thread\n");
     exit(1);
@@ -6712,6 +7832,22 @@ to look at the lock-free structures provided by ck?
   return boolean_t;
 }
 
+/**
+ * @brief Leave any arenas a continuation was captured outside of
+ * @param data   Thread data object
+ * @param k      Continuation captured by call/cc that is about to be called
+ * @param result Value being passed to the continuation
+ * @return `result`
+ *
+ * Called by the escape procedures made by call/cc, since control may
+ * leave the extent of an arena without returning from it.
+ */
+object Cyc_arena_unwind(void *data, object k, object result)
+{
+  gc_arena_unwind((gc_thread_data *) data, k);
+  return result;
+}
+
 /**
  * Terminate a thread
  */
@@ -6738,6 +7874,7 @@ void Cyc_exit_thread(gc_thread_data * thd)
   gc_remove_mutator(thd);
   ck_pr_cas_int((int *)&(thd->thread_state), CYC_THREAD_STATE_RUNNABLE,
                 CYC_THREAD_STATE_TERMINATED);
+  gc_notify_handshake();
   pthread_exit(NULL);           // For now, just a proof of concept
 }
 
@@ -7347,7 +8484,7 @@ static void _read_literal_identifier(void *data, port_type *p)
       p->tok_buf[p->tok_end] = '\0'; // TODO: what if buffer is full?
       p->tok_end = 0; // Reset for next atom
       {
-        object sym = find_or_add_symbol(p->tok_buf);
+        object sym = Cyc_intern_symbol(data, p->tok_buf, strlen(p->tok_buf));
         return_thread_runnable_with_obj(data, sym, p);
       }
     } else if (c == '\\') {
@@ -7573,7 +8710,7 @@ static void _read_return_atom(void *data, object cont, port_type *p)
     make_double(d, 0.0 / 0.0);
     return_thread_runnable_with_obj(data, &d, p);
   } else {
-    sym = find_or_add_symbol(p->tok_buf);
+    sym = Cyc_intern_symbol(data, p->tok_buf, len);
     return_thread_runnable_with_obj(data, sym, p);
   }
 }
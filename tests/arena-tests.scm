@@ -0,0 +1,97 @@
+;; Tests for the (cyclone arena) library
+(import
+  (scheme base)
+  (cyclone arena)
+  (cyclone test))
+
+(define (make-data n)
+  (let loop ((i 0) (acc '()))
+    (if (= i n)
+        acc
+        (loop (+ i 1) (cons (vector i (number->string i)) acc)))))
+
+(define saved #f)
+(define box (list #f))
+
+(test-group
+  "extent"
+  (test 0 (arena-depth))
+  (test 1 (call-with-arena arena-depth))
+  (test 2 (call-with-arena (lambda () (call-with-arena arena-depth))))
+  (test 0 (arena-depth))
+  (test 5000 (call-with-arena (lambda () (length (make-data 5000))))))
+
+(test-group
+  "escapes"
+  ;; Returned from the extent
+  (let ((lst (call-with-arena (lambda () (make-data 5000)))))
+    (make-data 50000)
+    (test "4999" (vector-ref (car lst) 1)))
+  ;; Stored into an object from outside of the arena
+  (call-with-arena
+    (lambda ()
+      (set-car! box (make-data 5000))
+      #f))
+  (make-data 50000)
+  (test "4999" (vector-ref (car (car box)) 1))
+  ;; Assigned to a global
+  (call-with-arena
+    (lambda ()
+      (set! saved (make-data 5000))
+      #f))
+  (make-data 50000)
+  (test "4999" (vector-ref (car saved) 1))
+  ;; Escaped from a nested arena into the enclosing one
+  (let ((lst (call-with-arena
+               (lambda ()
+                 (let ((inner (call-with-arena (lambda () (make-data 5000)))))
+                   (make-data 50000)
+                   inner)))))
+    (make-data 50000)
+    (test 5000 (length lst))))
+
+(test-group
+  "exceptions"
+  (test 'caught
+        (call/cc
+          (lambda (k)
+            (with-exception-handler
+              (lambda (obj) (k obj))
+              (lambda ()
+                (call-with-arena
+                  (lambda ()
+                    (make-data 5000)
+                    (raise 'caught))))))))
+  (test 0 (arena-depth)))
+
+(test-group
+  "continuations"
+  ;; Leaving the extent through a continuation ends the arena, so later
+  ;; objects are allocated on the heap again
+  (test 'escaped
+        (call/cc
+          (lambda (k)
+            (call-with-arena
+              (lambda ()
+                (make-data 5000)
+                (k 'escaped))))))
+  (test 0 (arena-depth))
+  (let ((lst (make-data 5000)))
+    (make-data 50000)
+    (test "4999" (vector-ref (car lst) 1)))
+  ;; Only the arenas nested inside the continuation's extent are ended
+  (test '(1 . escaped)
+        (call-with-arena
+          (lambda ()
+            (let ((result
+                   (call/cc
+                     (lambda (k)
+                       (call-with-arena
+                         (lambda ()
+                           (call-with-arena
+                             (lambda ()
+                               (k 'escaped)))))))))
+              (cons (arena-depth) result)))))
+  (test 0 (arena-depth)))
+
+(test-exit)
@@ -0,0 +1,44 @@
+;; Allocation buffer benchmark.
+;;
+;; Bignums are always allocated on the heap, directly from C code rather
+;; than by the minor GC, so a loop doing exact arithmetic on large numbers
+;; allocates heap objects at a high rate. Each result is dropped soon
+;; after, so pages are swept and reused throughout the run. The elapsed
+;; time shows how cheap a small heap allocation is.
+;;
+;; Usage: gc-alloc-buffers [rounds]
+(import (scheme base)
+        (scheme write)
+        (scheme time)
+        (scheme process-context)
+        (bench util))
+
+(define big (expt 2 100))
+
+(define (sum-bignums n)
+  (let loop ((i 0) (acc 0))
+    (if (= i n)
+        acc
+        (loop (+ i 1) (modulo (+ acc (* big i)) (+ big 7))))))
+
+(define (run rounds)
+  (let ((start (current-jiffy)))
+    (let loop ((i 0))
+      (when (< i rounds)
+        (sum-bignums 100000)
+        (loop (+ i 1))))
+    (let ((elapsed (/ (- (current-jiffy) start)
+                      (jiffies-per-second))))
+      (display "elapsed: ")
+      (display (inexact elapsed))
+      (display " s")
+      (newline)
+      (display "peak rss: ")
+      (display (peak-rss-kb))
+      (display " kB")
+      (newline))))
+
+(run (let ((args (command-line)))
+       (if (> (length args) 1)
+           (string->number (cadr args))
+           20)))
@@ -0,0 +1,93 @@
+;; Handshake benchmark for the major collector with many blocked threads.
+;;
+;; Starts a large number of threads that spend all of their time blocked
+;; on a condition variable, as threads waiting on sockets or locks in a
+;; server would, plus a few threads that keep allocating. The collector
+;; has to handshake with every thread at the start of each major cycle,
+;; so the average cycle duration shows how much the blocked threads slow
+;; that down.
+;;
+;; Usage: gc-blocked-threads [blocked-threads [cycles]]
+(import (scheme base)
+        (scheme write)
+        (scheme time)
+        (scheme process-context)
+        (cyclone gc)
+        (srfi 18)
+        (bench util))
+
+(define lock (make-mutex))
+(define wakeup (make-condition-variable))
+(define done #f)
+
+(define (sleeper)
+  (mutex-lock! lock)
+  (let loop ()
+    (cond
+      (done (mutex-unlock! lock))
+      (else
+        (condition-variable-wait! wakeup lock)
+        (loop)))))
+
+(define (allocator)
+  (let loop ((keep '()))
+    (unless done
+      (loop (if (> (length keep) 1000)
+                '()
+                (cons (make-vector 16 keep) keep))))))
+
+(define (cycle-ns stats)
+  (+ (gc-stats-clear-mark-ns stats)
+     (gc-stats-trace-ns stats)
+     (gc-stats-sweep-ns stats)))
+
+(define (run num-blocked cycles)
+  (let ((sleepers
+          (let loop ((i 0) (acc '()))
+            (if (= i num-blocked)
+                acc
+                (loop (+ i 1) (cons (make-thread sleeper) acc)))))
+        (allocators
+          (list (make-thread allocator) (make-thread allocator))))
+    (for-each thread-start! sleepers)
+    (thread-sleep! 1)
+    (for-each thread-start! allocators)
+    (let ((before (gc-stats))
+          (start (current-jiffy)))
+      (let loop ()
+        (when (< (- (gc-stats-major-cycles (gc-stats))
+                    (gc-stats-major-cycles before))
+                 cycles)
+          (thread-sleep! 0.01)
+          (loop)))
+      (let* ((after (gc-stats))
+             (n (- (gc-stats-major-cycles after)
+                   (gc-stats-major-cycles before)))
+             (elapsed (/ (- (current-jiffy) start)
+                         (jiffies-per-second))))
+        (set! done #t)
+        (mutex-lock! lock)
+        (condition-variable-broadcast! wakeup)
+        (mutex-unlock! lock)
+        (display "elapsed: ")
+        (display (inexact elapsed))
+        (display " s")
+        (newline)
+        (display "average cycle: ")
+        (display (inexact (/ (- (cycle-ns after) (cycle-ns before)) n 1000000)))
+        (display " ms")
+        (newline)
+        (display "average handshake wait: ")
+        (display (inexact (/ (- (gc-stats-handshake-wait-ns after)
+                                (gc-stats-handshake-wait-ns before))
+                             n 1000000)))
+        (display " ms")
+        (newline)
+        (display "peak rss: ")
+        (display (peak-rss-kb))
+        (display " kB")
+        (newline)))))
+
+(let ((args (command-line)))
+  (run (if (> (length args) 1) (string->number (cadr args)) 500)
+       (if (> (length args) 2) (string->number (caddr args)) 50)))
@@ -0,0 +1,65 @@
+;; Heap compaction benchmark.
+;;
+;; Simulates a long running process that keeps a cache of large strings
+;; and vectors, too large for a size class. Entries of varying sizes are
+;; replaced at random, so the pages holding them end up with plenty of
+;; free space in total but only small free chunks. Run it with and without
+;; compaction, for example using CYC_GC_COMPACT_THRESHOLD=0.5, to compare
+;; the number of heap bytes it ends up using.
+;;
+;; Usage: gc-compact [rounds]
+(import (scheme base)
+        (scheme write)
+        (scheme time)
+        (scheme process-context)
+        (cyclone gc))
+
+(define cache-size 512)
+(define cache (make-vector cache-size #f))
+
+;; Simple linear congruential generator, so runs are repeatable
+(define seed 12345)
+(define (random n)
+  (set! seed (modulo (+ (* seed 1103515245) 12345) 2147483648))
+  (modulo (quotient seed 65536) n))
+
+(define (make-entry i)
+  (let ((size (+ 5000 (* 1000 (random 24)))))
+    (if (even? i)
+        (make-string size #\x)
+        (make-vector (quotient size 8) i))))
+
+(define (run rounds)
+  (let ((start (current-jiffy)))
+    (do ((i 0 (+ i 1)))
+        ((= i rounds))
+      ;; Replace a few entries, then drop most of them and refill with
+      ;; larger ones, leaving holes the new entries do not fit in
+      (vector-set! cache (random cache-size) (make-entry i))
+      (when (= 0 (modulo i 5000))
+        (do ((j 0 (+ j 1)))
+            ((= j cache-size))
+          (if (not (= 0 (modulo j 4)))
+              (vector-set! cache j #f)))))
+    (let ((elapsed (/ (- (current-jiffy) start)
+                      (jiffies-per-second)))
+          (stats (gc-stats)))
+      (display "elapsed: ")
+      (display (inexact elapsed))
+      (display " s")
+      (newline)
+      (display "heap bytes: ")
+      (display (gc-stats-heap-bytes stats))
+      (newline)
+      (display "major cycles: ")
+      (display (gc-stats-major-cycles stats))
+      (newline)
+      (display "compactions: ")
+      (display (gc-stats-compactions stats))
+      (display ", ")
+      (display (gc-stats-compacted-bytes stats))
+      (display " bytes moved")
+      (newline))))
+
+(let ((args (command-line)))
+  (run (if (> (length args) 1) (string->number (cadr args)) 200000)))
@@ -0,0 +1,56 @@
+;; Write barrier benchmark for the minor collector.
+;;
+;; Repeatedly stores freshly allocated objects into long-lived vectors and
+;; hash tables. Every such store makes a heap object point into the stack,
+;; so it has to be remembered until the next minor collection. Most stores
+;; hit objects and vector elements that were already stored to since the
+;; last minor collection, so the elapsed time shows how well the write
+;; barrier avoids logging the same object over and over.
+;;
+;; Usage: gc-mutations [rounds]
+(import (scheme base)
+        (scheme write)
+        (scheme time)
+        (scheme process-context)
+        (srfi 69)
+        (bench util))
+
+(define vec-size 100000)
+(define table-size 1000)
+
+(define (fill-vector! vec i)
+  (let loop ((j 0))
+    (when (< j (vector-length vec))
+      (vector-set! vec j (cons i j))
+      (loop (+ j 1)))))
+
+(define (update-table! table i)
+  (let loop ((j 0))
+    (when (< j 10000)
+      (hash-table-set! table (modulo j table-size) (list i j))
+      (loop (+ j 1)))))
+
+(define (run rounds)
+  (let ((vec (make-vector vec-size #f))
+        (table (make-hash-table))
+        (start (current-jiffy)))
+    (let loop ((i 0))
+      (when (< i rounds)
+        (fill-vector! vec i)
+        (update-table! table i)
+        (loop (+ i 1))))
+    (let ((elapsed (/ (- (current-jiffy) start)
+                      (jiffies-per-second))))
+      (display "elapsed: ")
+      (display (inexact elapsed))
+      (display " s")
+      (newline)
+      (display "peak rss: ")
+      (display (peak-rss-kb))
+      (display " kB")
+      (newline))))
+
+(run (let ((args (command-line)))
+       (if (> (length args) 1)
+           (string->number (cadr args))
+           200)))
@@ -0,0 +1,77 @@
+;; Short-lived request data benchmark.
+;;
+;; Simulates a server handling requests. Each request builds a fairly
+;; large temporary structure that survives several minor collections and
+;; then dies once the response is computed, while a small cache of
+;; long-lived results is updated now and then. The mode picks where the
+;; temporary data goes once it leaves the stack:
+;;
+;;   heap   - the heap, where major collections free it object by object
+;;   arena  - an arena per request, freed in one go once it is handled
+;;   young  - an 8 MB young heap, collected without a major collection
+;;
+;; Usage: gc-requests [heap|arena|young [requests]]
+(import (scheme base)
+        (scheme write)
+        (scheme time)
+        (scheme process-context)
+        (cyclone arena)
+        (cyclone gc)
+        (bench util))
+
+(define cache (make-vector 64 #f))
+
+(define (build-request id)
+  (let loop ((i 0) (acc '()))
+    (if (= i 2000)
+        acc
+        (loop (+ i 1)
+              (cons (vector id i (number->string i) (list i id)) acc)))))
+
+(define (respond req)
+  (let loop ((lst req) (sum 0))
+    (if (null? lst)
+        sum
+        (loop (cdr lst)
+              (+ sum (string-length (vector-ref (car lst) 2)))))))
+
+(define (handle id)
+  (respond (build-request id)))
+
+(define (run mode requests)
+  (if (eq? mode 'young)
+      (gc-set-param! 'young-heap-size (* 8 1024 1024)))
+  (let ((start (current-jiffy)))
+    (let loop ((i 0))
+      (when (< i requests)
+        (let ((n (if (eq? mode 'arena)
+                     (call-with-arena (lambda () (handle i)))
+                     (handle i))))
+          ;; Results computed outside of the arena are kept for a while
+          (if (= 0 (modulo i 10))
+              (vector-set! cache (modulo i 64) (list i n))))
+        (loop (+ i 1))))
+    (let ((elapsed (/ (- (current-jiffy) start)
+                      (jiffies-per-second)))
+          (stats (gc-stats)))
+      (display "elapsed: ")
+      (display (inexact elapsed))
+      (display " s")
+      (newline)
+      (display "peak rss: ")
+      (display (peak-rss-kb))
+      (display " kB")
+      (newline)
+      (display "major cycles: ")
+      (display (gc-stats-major-cycles stats))
+      (newline)
+      (display "young collections: ")
+      (display (gc-stats-young-collections stats))
+      (display ", ")
+      (display (gc-stats-young-survivor-bytes stats))
+      (display " bytes copied")
+      (newline))))
+
+(let ((args (command-line)))
+  (run (if (> (length args) 1) (string->symbol (cadr args)) 'heap)
+       (if (> (length args) 2) (string->number (caddr args)) 5000)))
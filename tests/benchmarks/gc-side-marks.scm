@@ -0,0 +1,58 @@
+;; Sweep throughput benchmark for the major collector.
+;;
+;; Builds a large live heap of small objects and then churns through short
+;; lived ones, so every collection has to mark and sweep many pages that
+;; are mostly live. Compare the elapsed time and peak RSS of builds with
+;; GC_SIDE_MARK_BITS set to 1 and to 0, and run each under
+;; `perf stat -e cache-misses` to compare the memory traffic of marking in
+;; object headers against marking in side bitmaps.
+;;
+;; Usage: gc-side-marks [rounds]
+(import (scheme base)
+        (scheme write)
+        (scheme time)
+        (scheme process-context)
+        (bench util))
+
+(define live-size 2000000)
+
+(define (make-live-set n)
+  (let ((v (make-vector (quotient n 1000) #f)))
+    (let loop ((i 0))
+      (when (< i (vector-length v))
+        (vector-set! v i (make-list 1000 i))
+        (loop (+ i 1))))
+    v))
+
+(define (churn live n)
+  (let loop ((i 0))
+    (when (< i n)
+      (let ((garbage (cons i (make-vector 4 i))))
+        (if (= 0 (modulo i 1024))
+            (vector-set! live
+                         (modulo i (vector-length live))
+                         (make-list 1000 garbage))))
+      (loop (+ i 1)))))
+
+(define (run rounds)
+  (let ((live (make-live-set live-size))
+        (start (current-jiffy)))
+    (let loop ((r 0))
+      (when (< r rounds)
+        (churn live 1000000)
+        (loop (+ r 1))))
+    (let ((elapsed (/ (- (current-jiffy) start)
+                      (jiffies-per-second))))
+      (display "elapsed: ")
+      (display (inexact elapsed))
+      (display " s")
+      (newline)
+      (display "peak rss: ")
+      (display (peak-rss-kb))
+      (display " kB")
+      (newline))))
+
+(run (let ((args (command-line)))
+       (if (> (length args) 1)
+           (string->number (cadr args))
+           20)))
@@ -0,0 +1,54 @@
+;; Fragmentation and throughput benchmark for the heap allocator.
+;;
+;; Allocates vectors, strings, and closures over a wide range of sizes,
+;; keeping a random subset alive for a while before replacing it. Mixed
+;; lifetimes leave holes of every size throughout the heap, which is the
+;; worst case for a first-fit free list allocator. Compare the elapsed time
+;; and peak RSS against a build of the previous allocator.
+;;
+;; Usage: gc-size-classes [rounds]
+(import (scheme base)
+        (scheme write)
+        (scheme time)
+        (scheme process-context)
+        (bench util))
+
+(define live-slots 4096)
+
+;; Simple linear congruential generator, so runs are repeatable
+(define seed 12345)
+(define (rand n)
+  (set! seed (modulo (+ (* seed 75) 74) 65537))
+  (modulo seed n))
+
+(define (make-object)
+  (let ((n (+ 1 (rand 400))))
+    (case (rand 3)
+      ((0) (make-vector n n))
+      ((1) (make-string (* 4 n) #\x))
+      (else
+       (let ((v (make-vector (quotient n 8) n)))
+         (lambda () (vector-length v)))))))
+
+(define (run rounds)
+  (let ((live (make-vector live-slots #f))
+        (start (current-jiffy)))
+    (let loop ((i 0))
+      (when (< i (* rounds 10000))
+        (vector-set! live (rand live-slots) (make-object))
+        (loop (+ i 1))))
+    (let ((elapsed (/ (- (current-jiffy) start)
+                      (jiffies-per-second))))
+      (display "elapsed: ")
+      (display (inexact elapsed))
+      (display " s")
+      (newline)
+      (display "peak rss: ")
+      (display (peak-rss-kb))
+      (display " kB")
+      (newline))))
+
+(run (let ((args (command-line)))
+       (if (> (length args) 1)
+           (string->number (cadr args))
+           200)))
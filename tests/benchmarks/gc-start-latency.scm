@@ -0,0 +1,48 @@
+;; Allocation-heavy benchmark for the major collector.
+;;
+;; Keeps a modest live set while churning through short-lived lists and
+;; vectors. The heap only stays small if a major collection begins promptly
+;; once a mutator asks for one, so peak RSS together with the elapsed time
+;; gives a good indication of collection start latency.
+;;
+;; Usage: gc-start-latency [rounds]
+(import (scheme base)
+        (scheme write)
+        (scheme time)
+        (scheme process-context)
+        (bench util))
+
+(define live-slots 256)
+
+(define (churn live n)
+  (let loop ((i 0))
+    (when (< i n)
+      (let ((garbage (make-list 64 i)))
+        (if (= 0 (modulo i 16))
+            (vector-set! live
+                         (modulo i live-slots)
+                         (make-vector 32 garbage))))
+      (loop (+ i 1)))))
+
+(define (run rounds)
+  (let ((live (make-vector live-slots #f))
+        (start (current-jiffy)))
+    (let loop ((r 0))
+      (when (< r rounds)
+        (churn live 100000)
+        (loop (+ r 1))))
+    (let ((elapsed (/ (- (current-jiffy) start)
+                      (jiffies-per-second))))
+      (display "elapsed: ")
+      (display (inexact elapsed))
+      (display " s")
+      (newline)
+      (display "peak rss: ")
+      (display (peak-rss-kb))
+      (display " kB")
+      (newline))))
+
+(run (let ((args (command-line)))
+       (if (> (length args) 1)
+           (string->number (cadr args))
+           100)))
@@ -0,0 +1,46 @@
+;; Hash table benchmark.
+;;
+;; Inserts, looks up, and deletes a number of keys in (srfi 69) hash
+;; tables, for tables keyed by fixnums, strings, symbols, and pairs, and
+;; reports the time taken by each step.
+;;
+;; Usage: hash-table [operations]
+(import (scheme base)
+        (scheme write)
+        (scheme process-context)
+        (srfi 69)
+        (bench util))
+
+(define (run name n comparison make-key)
+  ;; Keys are kept in a list, since storing objects that are still on the
+  ;; stack in a large vector forces a minor collection each time
+  (let ((keys (let loop ((i (- n 1)) (acc '()))
+                (if (< i 0) acc (loop (- i 1) (cons (make-key i) acc)))))
+        (table (make-hash-table comparison)))
+    (time-it (string-append name " insert")
+             (lambda ()
+               (let loop ((ks keys) (i 0))
+                 (when (pair? ks)
+                   (hash-table-set! table (car ks) i)
+                   (loop (cdr ks) (+ i 1))))))
+    (time-it (string-append name " lookup")
+             (lambda ()
+               (let loop ((ks keys) (sum 0))
+                 (if (pair? ks)
+                     (loop (cdr ks)
+                           (+ sum (hash-table-ref/default table (car ks) 0)))
+                     sum))))
+    (time-it (string-append name " delete")
+             (lambda ()
+               (for-each (lambda (k) (hash-table-delete! table k)) keys)))
+    (if (not (= 0 (hash-table-size table)))
+        (error "table not empty after deleting all keys" name))))
+
+(let* ((args (command-line))
+       (n (if (> (length args) 1) (string->number (cadr args)) 1000000)))
+  (run "fixnum" n eqv? (lambda (i) i))
+  (run "string" n equal? number->string)
+  (run "symbol" n eq?
+       (lambda (i) (string->symbol (string-append "k" (number->string i)))))
+  ;; Keys that start out on the stack and are moved by the collector
+  (run "pair" n eq? (lambda (i) (cons i i))))
@@ -0,0 +1,74 @@
+;; Record type benchmark.
+;;
+;; Builds a list of records and runs tight loops over it that call a
+;; record type predicate, read fields, and update a field, and reports the
+;; time taken by each step. Records are used this way throughout the
+;; compiler, for example for the AST and the analysis database.
+;;
+;; Usage: records [records] [rounds]
+(import (scheme base)
+        (scheme write)
+        (scheme process-context)
+        (bench util))
+
+(define-record-type point
+  (make-point x y z)
+  point?
+  (x point-x set-point-x!)
+  (y point-y)
+  (z point-z))
+
+(define-record-type other
+  (make-other a)
+  other?
+  (a other-a))
+
+(define (run n rounds)
+  (let ((objs (time-it "construct"
+                       (lambda ()
+                         (let loop ((i 0) (acc '()))
+                           (if (= i n)
+                               acc
+                               (loop (+ i 1)
+                                     (cons (if (= 0 (modulo i 4))
+                                               (make-other i)
+                                               (make-point i (+ i 1) (+ i 2)))
+                                           acc))))))))
+    (time-it "predicate"
+             (lambda ()
+               (do ((r 0 (+ r 1))
+                    (count 0 (let loop ((ls objs) (count count))
+                               (cond
+                                 ((null? ls) count)
+                                 ((point? (car ls)) (loop (cdr ls) (+ count 1)))
+                                 (else (loop (cdr ls) count))))))
+                   ((= r rounds) count))))
+    (time-it "access"
+             (lambda ()
+               (do ((r 0 (+ r 1))
+                    (sum 0 (let loop ((ls objs) (sum sum))
+                             (cond
+                               ((null? ls) sum)
+                               ((point? (car ls))
+                                (loop (cdr ls)
+                                      (+ sum
+                                         (point-x (car ls))
+                                         (point-y (car ls))
+                                         (point-z (car ls)))))
+                               (else
+                                (loop (cdr ls) (+ sum (other-a (car ls)))))))))
+                   ((= r rounds) sum))))
+    (time-it "update"
+             (lambda ()
+               (do ((r 0 (+ r 1)))
+                   ((= r rounds))
+                 (for-each
+                   (lambda (o)
+                     (if (point? o)
+                         (set-point-x! o (+ (point-x o) 1))))
+                   objs))))))
+
+(let* ((args (command-line))
+       (n (if (> (length args) 1) (string->number (cadr args)) 1000000))
+       (rounds (if (> (length args) 2) (string->number (caddr args)) 20)))
+  (run n rounds))
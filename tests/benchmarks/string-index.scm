@@ -0,0 +1,59 @@
+;; UTF-8 string indexing benchmark.
+;;
+;; Walks a string of mixed ASCII and multi-byte characters using
+;; string-ref, forwards and backwards, then overwrites each character
+;; using string-set!, and reports the time taken by each step. Scanning
+;; such a string from the start on each access makes these loops
+;; quadratic in the length of the string.
+;;
+;; Usage: string-index [characters] [rounds]
+(import (scheme base)
+        (scheme write)
+        (scheme process-context)
+        (bench util))
+
+;; Latin, Greek, CJK, and a character outside the BMP
+(define chars
+  (map integer->char '(97 233 955 8364 20013 119070)))
+
+(define (make-text n)
+  (let loop ((i 0) (cs chars) (acc '()))
+    (cond
+     ((= i n) (list->string acc))
+     ((null? cs) (loop i chars acc))
+     (else (loop (+ i 1) (cdr cs) (cons (car cs) acc))))))
+
+(define (run n rounds)
+  (let ((text (make-text n)))
+    (time-it "string-ref forward"
+             (lambda ()
+               (do ((r 0 (+ r 1))
+                    (sum 0 (let loop ((i 0) (sum sum))
+                             (if (= i n)
+                                 sum
+                                 (loop (+ i 1)
+                                       (+ sum (char->integer
+                                               (string-ref text i))))))))
+                   ((= r rounds) sum))))
+    (time-it "string-ref backward"
+             (lambda ()
+               (do ((r 0 (+ r 1))
+                    (sum 0 (let loop ((i (- n 1)) (sum sum))
+                             (if (< i 0)
+                                 sum
+                                 (loop (- i 1)
+                                       (+ sum (char->integer
+                                               (string-ref text i))))))))
+                   ((= r rounds) sum))))
+    (time-it "string-set!"
+             (lambda ()
+               (do ((r 0 (+ r 1)))
+                   ((= r rounds) text)
+                 (do ((i 0 (+ i 1)))
+                     ((= i n))
+                   (string-set! text i (string-ref text i))))))))
+
+(let* ((args (command-line))
+       (n (if (> (length args) 1) (string->number (cadr args)) 100000))
+       (rounds (if (> (length args) 2) (string->number (caddr args)) 10)))
+  (run n rounds))
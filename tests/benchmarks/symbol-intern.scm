@@ -0,0 +1,75 @@
+;; Multithreaded symbol interning benchmark.
+;;
+;; Several threads convert strings to symbols at the same time, both with
+;; `string->symbol` and by reading S-expressions from string ports. Most
+;; names repeat, as they would for the keys of JSON objects, but each
+;; round also interns some names no thread has seen before. The elapsed
+;; time shows how well symbol lookups and inserts scale across threads.
+;;
+;; Usage: symbol-intern [threads [rounds]]
+(import (scheme base)
+        (scheme read)
+        (scheme write)
+        (scheme time)
+        (scheme process-context)
+        (srfi 18)
+        (bench util))
+
+(define common-names
+  (let loop ((i 0) (acc '()))
+    (if (= i 64)
+        (list->vector acc)
+        (loop (+ i 1)
+              (cons (string-append "key-" (number->string i)) acc)))))
+
+(define (intern-strings id round)
+  (let loop ((i 0))
+    (when (< i 10000)
+      (string->symbol (vector-ref common-names (modulo i 64)))
+      (if (= 0 (modulo i 100))
+          (string->symbol
+            (string-append "new-" (number->string id)
+                           "-" (number->string round)
+                           "-" (number->string i))))
+      (loop (+ i 1)))))
+
+(define sexp-text
+  "((name . \"x\") (id . 1) (tags alpha beta gamma) (point (x . 1) (y . 2)))")
+
+(define (read-sexps)
+  (let loop ((i 0))
+    (when (< i 1000)
+      (read (open-input-string sexp-text))
+      (loop (+ i 1)))))
+
+(define (worker id rounds)
+  (lambda ()
+    (let loop ((round 0))
+      (when (< round rounds)
+        (intern-strings id round)
+        (read-sexps)
+        (loop (+ round 1))))))
+
+(define (run num-threads rounds)
+  (let* ((start (current-jiffy))
+         (threads
+           (let loop ((i 0) (acc '()))
+             (if (= i num-threads)
+                 acc
+                 (loop (+ i 1) (cons (make-thread (worker i rounds)) acc))))))
+    (for-each thread-start! threads)
+    (for-each thread-join! threads)
+    (let ((elapsed (/ (- (current-jiffy) start)
+                      (jiffies-per-second))))
+      (display "elapsed: ")
+      (display (inexact elapsed))
+      (display " s")
+      (newline)
+      (display "peak rss: ")
+      (display (peak-rss-kb))
+      (display " kB")
+      (newline))))
+
+(let ((args (command-line)))
+  (run (if (> (length args) 1) (string->number (cadr args)) 4)
+       (if (> (length args) 2) (string->number (caddr args)) 50)))
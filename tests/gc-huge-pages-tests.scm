@@ -0,0 +1,45 @@
+;; Check that memory used by a huge object is returned to the OS once the
+;; object is no longer live, by sampling the resident set size over time.
+(import
+  (scheme base)
+  (cyclone test))
+
+(include-c-header "<unistd.h>")
+
+;; Resident set size of this process in kilobytes, or -1 if unknown
+(define-c current-rss-kb
+  "(void *data, int argc, closure _, object k)"
+  " long size, rss = -1;
+    FILE *f = fopen(\"/proc/self/statm\", \"r\");
+    if (f) {
+      if (fscanf(f, \"%ld %ld\", &size, &rss) != 2) rss = -1;
+      fclose(f);
+    }
+    if (rss >= 0) rss = rss * (sysconf(_SC_PAGESIZE) / 1024);
+    return_closcall1(data, k, obj_int2obj(rss)); ")
+
+(define buffer-kb (* 64 1024))
+(define buffer #f)
+
+;; Keep allocating smaller huge objects, which drives collections, until
+;; the RSS falls below `limit` or we give up
+(define (rss-after-churn limit)
+  (let loop ((i 0)
+             (rss (current-rss-kb)))
+    (if (or (< rss limit) (= i 1000))
+        rss
+        (begin
+          (make-bytevector (* 2 1024 1024) 0)
+          (loop (+ i 1) (current-rss-kb))))))
+
+(test-group
+  "huge objects"
+  (when (>= (current-rss-kb) 0)
+    (set! buffer (make-bytevector (* buffer-kb 1024) 1))
+    (let ((peak (current-rss-kb)))
+      (test 1 (bytevector-u8-ref buffer (- (bytevector-length buffer) 1)))
+      (set! buffer #f)
+      (test #t (< (rss-after-churn (- peak (quotient buffer-kb 2)))
+                  (- peak (quotient buffer-kb 2)))))))
+
+(test-exit)
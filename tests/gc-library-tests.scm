@@ -0,0 +1,101 @@
+;; Tests for the (cyclone gc) library: tuning parameters, statistics, and
+;; event tracing. Also covers per-thread stack sizes.
+(import
+  (scheme base)
+  (scheme file)
+  (cyclone gc)
+  (cyclone test)
+  (srfi 18))
+
+(define trace-file "gc-library-tests-trace.txt")
+
+;; Allocate enough that objects are moved to the heap and the collector
+;; runs at least once
+(define (churn n)
+  (let loop ((i 0) (keep '()))
+    (when (< i n)
+      (loop (+ i 1)
+            (if (= 0 (modulo i 100))
+                (list (make-vector 32 i))
+                (cons (make-vector 8 i) keep))))))
+
+(define (wait-for-cycle stats)
+  (let loop ((i 0))
+    (when (and (< i 200)
+               (<= (gc-stats-major-cycles (gc-stats))
+                   (gc-stats-major-cycles stats)))
+      (churn 100000)
+      (loop (+ i 1)))))
+
+(test-group
+  "parameters"
+  (test (* 8 1024 1024) (gc-param 'heap-size))
+  (test 0 (gc-param 'adaptive))
+  (test 0 (gc-param 'adaptive-stack))
+  (test 4000000 (gc-param 'max-stack-size))
+  (gc-set-param! 'heap-size (* 16 1024 1024))
+  (test (* 16 1024 1024) (gc-param 'heap-size))
+  (gc-set-param! 'collection-threshold 0.05)
+  (test 0.05 (gc-param 'collection-threshold))
+  (test-error (gc-param 'no-such-parameter))
+  (test-error (gc-set-param! 'collection-threshold 2))
+  (gc-set-param! 'heap-size (* 8 1024 1024))
+  (gc-set-param! 'collection-threshold 0.0125))
+
+(test-group
+  "statistics"
+  (gc-set-trace-file! trace-file)
+  (let ((before (gc-stats)))
+    (test #t (gc-stats? before))
+    (wait-for-cycle before)
+    (let ((after (gc-stats)))
+      (test #t (> (gc-stats-major-cycles after)
+                  (gc-stats-major-cycles before)))
+      (test #t (> (gc-stats-minor-gcs after) (gc-stats-minor-gcs before)))
+      (test #t (> (gc-stats-heap-bytes after) 0))
+      (test #t (vector? (gc-stats-bytes-allocated after)))
+      (test #t (> (apply + (vector->list (gc-stats-pages after))) 0))
+      (test #t (>= (gc-stats-trace-ns after) (gc-stats-last-trace-ns after)))))
+  (gc-set-trace-file! #f)
+  (test #t (call-with-input-file trace-file
+             (lambda (port)
+               (let ((line (read-line port)))
+                 (and (string? line)
+                      (> (string-length line) 0)
+                      (char=? #\{ (string-ref line 0)))))))
+  (delete-file trace-file))
+
+(test-group
+  "thread stack size"
+  (let* ((result #f)
+         (t (make-thread (lambda ()
+                           (churn 10000)
+                           (set! result 'done))
+                         "large stack"
+                         (* 2 1024 1024))))
+    (thread-start! t)
+    (thread-join! t)
+    (test 'done result))
+  (test-error (make-thread (lambda () #f) "tiny stack" 1024))
+  ;; Threads started after changing the parameter use the new size, so a
+  ;; thread with a much smaller stack area needs more minor collections
+  (let ((minor-gcs
+         (lambda (stack-size)
+           (let* ((result #f)
+                  (t (begin
+                       (gc-set-param! 'stack-size stack-size)
+                       (make-thread
+                         (lambda ()
+                           (let ((before (gc-stats-minor-gcs (gc-stats))))
+                             (churn 20000)
+                             (set! result
+                               (- (gc-stats-minor-gcs (gc-stats)) before))))))))
+             (thread-start! t)
+             (thread-join! t)
+             result))))
+    (let* ((small (minor-gcs (* 64 1024)))
+           (large (minor-gcs (* 4 1024 1024))))
+      (gc-set-param! 'stack-size 500000)
+      (test #t (> small large)))))
+
+(test-exit)
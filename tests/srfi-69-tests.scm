@@ -0,0 +1,204 @@
+;; Tests for the (srfi 69) library
+(import
+  (scheme base)
+  (scheme char)
+  (srfi 69)
+  (cyclone gc)
+  (cyclone test))
+
+(define (every? pred lst)
+  (or (null? lst) (and (pred (car lst)) (every? pred (cdr lst)))))
+
+(define (fill! table n key)
+  (do ((i 0 (+ i 1)))
+      ((= i n) table)
+    (hash-table-set! table (key i) i)))
+
+(test-group
+  "basic operations"
+  (let ((t (make-hash-table)))
+    (test 0 (hash-table-size t))
+    (hash-table-set! t 'a 1)
+    (hash-table-set! t "b" 2)
+    (hash-table-set! t '(c d) 3)
+    (test 3 (hash-table-size t))
+    (test 1 (hash-table-ref t 'a))
+    (test 2 (hash-table-ref t (string #\b)))
+    (test 3 (hash-table-ref t (list 'c 'd)))
+    (test 'none (hash-table-ref t 'z (lambda () 'none)))
+    (test 'none (hash-table-ref/default t 'z 'none))
+    (hash-table-set! t 'a 10)
+    (test 10 (hash-table-ref t 'a))
+    (test 3 (hash-table-size t))
+    (test #t (hash-table-exists? t 'a))
+    (hash-table-delete! t 'a)
+    (test #f (hash-table-exists? t 'a))
+    (test 2 (hash-table-size t))
+    (hash-table-update! t "b" (lambda (x) (* x 10)))
+    (test 20 (hash-table-ref t "b"))
+    (hash-table-update!/default t 'new (lambda (x) (+ x 1)) 0)
+    (test 1 (hash-table-ref t 'new))))
+
+(test-group
+  "growing"
+  (let ((t (fill! (make-hash-table equal?) 10000 number->string)))
+    (test 10000 (hash-table-size t))
+    (test 1234 (hash-table-ref/default t "1234" #f))
+    (test 9999 (hash-table-ref/default t "9999" #f))
+    (do ((i 0 (+ i 2)))
+        ((>= i 10000))
+      (hash-table-delete! t (number->string i)))
+    (test 5000 (hash-table-size t))
+    (test #f (hash-table-ref/default t "1234" #f))
+    (test 1235 (hash-table-ref/default t "1235" #f))
+    ;; Deleted slots are reused
+    (fill! t 10000 number->string)
+    (test 10000 (hash-table-size t))
+    (test 10000 (length (hash-table-keys t)))
+    (test 49995000 (apply + (hash-table-values t)))))
+
+(test-group
+  "equivalences"
+  (let ((t (fill! (make-hash-table eqv?) 100 (lambda (i) (* i 1.5)))))
+    (test 10 (hash-table-ref/default t 15.0 #f))
+    (test #f (hash-table-ref/default t 15 #f)))
+  (let ((t (make-hash-table eq?)))
+    (hash-table-set! t 'sym 1)
+    (test 1 (hash-table-ref/default t 'sym #f))
+    (test #f (hash-table-ref/default t 'other #f)))
+  (let ((t (make-hash-table string=?)))
+    (hash-table-set! t "abc" 1)
+    (test 1 (hash-table-ref/default t "abc" #f))
+    (test #f (hash-table-ref/default t "ABC" #f)))
+  (let ((t (make-hash-table string-ci=?)))
+    (hash-table-set! t "abc" 1)
+    (test 1 (hash-table-ref/default t "ABC" #f))
+    (hash-table-set! t "aBc" 2)
+    (test 1 (hash-table-size t))
+    (test 2 (hash-table-ref/default t "abc" #f)))
+  (let ((t (make-hash-table = (lambda (n bound) (modulo (exact (floor n)) bound)))))
+    (fill! t 1000 (lambda (i) i))
+    (test 1000 (hash-table-size t))
+    (test 500 (hash-table-ref/default t 500.0 #f))
+    (hash-table-delete! t 500)
+    (test #f (hash-table-ref/default t 500 #f))
+    (test 999 (hash-table-size t))))
+
+;; Allocate enough to move any objects still on the stack to the heap
+(define (churn n)
+  (do ((i 0 (+ i 1))
+       (v #f (make-vector 8 i)))
+      ((= i n) v)))
+
+(test-group
+  "identity keys"
+  (let* ((keys (let loop ((i 0) (acc '()))
+                 (if (= i 1000)
+                     acc
+                     (loop (+ i 1) (cons (if (even? i) (list i) (vector i)) acc)))))
+         (t (make-hash-table eq?))
+         (v (make-hash-table eqv?)))
+    (for-each (lambda (k) (hash-table-set! t k k) (hash-table-set! v k k)) keys)
+    (test 1000 (hash-table-size t))
+    (churn 100000)
+    (test #t (every? (lambda (k) (eq? k (hash-table-ref/default t k #f))) keys))
+    (test #t (every? (lambda (k) (eq? k (hash-table-ref/default v k #f))) keys))
+    (test #f (hash-table-ref/default t (list 0) #f))
+    ;; Looking keys up while walking the table
+    (test 1000 (hash-table-fold
+                 t 
+                 (lambda (k val acc) 
+                   (churn 100)
+                   (if (hash-table-exists? t k) (+ acc 1) acc))
+                 0))
+    (for-each (lambda (k) (hash-table-delete! t k)) keys)
+    (test 0 (hash-table-size t))
+    (test 1000 (hash-table-size v))))
+
+(define (range n)
+  (let loop ((i (- n 1)) (acc '()))
+    (if (< i 0) acc (loop (- i 1) (cons i acc)))))
+
+;; Allocate garbage on the heap until two more major collections are done,
+;; so that any object dropped before this is called has been collected
+(define (collect-major)
+  (let ((start (gc-stats-major-cycles (gc-stats))))
+    (let loop ((i 0))
+      (when (and (< i 10000)
+                 (< (gc-stats-major-cycles (gc-stats)) (+ start 2)))
+        (make-vector 100000 i)
+        (loop (+ i 1))))))
+
+(test-group
+  "weak tables"
+  (let ((w (make-weak-key-hash-table eq?))
+        (e (make-ephemeron-hash-table eq?))
+        (kept (map list (range 100))))
+    (test 'weak-keys (hash-table-weakness w))
+    (test 'ephemeron (hash-table-weakness e))
+    (test #f (hash-table-weakness (make-hash-table)))
+    (test 'ephemeron (hash-table-weakness (hash-table-copy e)))
+    (for-each (lambda (k)
+                (hash-table-set! w k (car k))
+                (hash-table-set! e k (car k)))
+              kept)
+    ;; Keys that are only referenced from the tables
+    (for-each (lambda (i)
+                (hash-table-set! w (list i) i)
+                (hash-table-set! e (list i) i))
+              (range 1000))
+    ;; Values that refer to their own keys, the values of w keep its keys
+    ;; alive so e has keys of its own
+    (for-each (lambda (i)
+                (let ((k (list i))
+                      (k2 (list i)))
+                  (hash-table-set! w k (cons k k))
+                  (hash-table-set! e k2 (cons k2 k2))))
+              (range 100))
+    (test 1200 (hash-table-size w))
+    (collect-major)
+    (test 200 (hash-table-size w))
+    (test 100 (hash-table-size e))
+    (test #t (every? (lambda (k) (eqv? (car k) (hash-table-ref/default w k #f)))
+                     kept))
+    (test #t (every? (lambda (k) (eqv? (car k) (hash-table-ref/default e k #f)))
+                     kept))
+    (test 4950 (hash-table-fold e (lambda (k v acc) (+ v acc)) 0))
+    (test 100 (hash-table-fold 
+                w (lambda (k v acc) (if (pair? v) (+ acc 1) acc)) 0))))
+
+(test-group
+  "memoize"
+  (let* ((calls 0)
+         (square (Cyc-memoize (lambda (x) (set! calls (+ calls 1)) (* x x)))))
+    (test 16 (square 4))
+    (test 16 (square 4))
+    (test 1 calls)
+    ;; Results stay cached across major collections
+    (collect-major)
+    (test 16 (square 4))
+    (test 1 calls)))
+
+(test-group
+  "whole tables"
+  (let* ((t (alist->hash-table '((a . 1) (b . 2) (a . 3))))
+         (c (hash-table-copy t)))
+    (test 2 (hash-table-size t))
+    (test 1 (hash-table-ref t 'a))
+    (hash-table-set! c 'c 3)
+    (test #f (hash-table-exists? t 'c))
+    (test 6 (hash-table-fold c (lambda (k v acc) (+ v acc)) 0))
+    (hash-table-merge! t c)
+    (test 3 (hash-table-size t))
+    (test 3 (length (hash-table->alist t)))
+    (test 3 (cdr (assq 'c (hash-table->alist t))))))
+
+(test-group
+  "hash functions"
+  (test (hash (list 1 "two" #\3)) (hash (list 1 "two" #\3)))
+  (test (hash (vector 'a 2.5)) (hash (vector 'a 2.5)))
+  (test (string-ci-hash "Hello") (string-ci-hash "hELLO"))
+  (test #t (< (string-hash "hello" 10) 10))
+  (test #t (< (hash-by-identity 'x 7) 7)))
+
+(test-exit)
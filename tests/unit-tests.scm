@@ -177,6 +177,19 @@
 (assert:equal "UTF8 string length" (string-length (make-string 1 (integer->char 128))) 1)
 (assert:equal "UTF8 bv length" (bytevector-length (string->utf8 (make-string 1 (integer->char 128)))) 2)
 (assert:equal "UTF8 char" (string-ref (make-string 1 (integer->char 128)) 0) #\x80)
+(let* ((cps '(97 955 8364 119070 98 233))
+       (u (list->string (map integer->char cps)))
+       (refs (lambda (order)
+               (map (lambda (i) (char->integer (string-ref u i))) order))))
+  (assert:equal "UTF8 string-ref forward" (refs '(0 1 2 3 4 5)) cps)
+  (assert:equal "UTF8 string-ref backward" (refs '(5 4 3 2 1 0)) (reverse cps))
+  (assert:equal "UTF8 string-ref random" (refs '(3 0 5 1 4 2)) '(119070 97 233 955 98 8364))
+  (string-set! u 2 #\x20AC)
+  (string-set! u 1 #\z)
+  (assert:equal "UTF8 string-set! shorter" (refs '(5 4 3 2 1 0)) '(233 98 119070 8364 122 97))
+  (string-set! u 3 #\y)
+  (assert:equal "UTF8 string-set! shorter #2" u (list->string (map integer->char '(97 122 8364 121 98 233))))
+  (assert:equal "UTF8 string-set! after seek" (string-ref u 5) (integer->char 233)))
 
 ;; Recursion example:
 (letrec ((fnc (lambda (i) 
@@ -225,6 +238,10 @@
 (assert:equal "" (eqv? 0.0 0.0) #t)
 (assert:equal "" (eqv? 33333333333333 33333333333333) #t)
 (assert:equal "" (equal? (string->symbol "aa") 'aa) #t)
+(let ((s (list->string (list #\a (integer->char 955) #\c))))
+  ;; Replacing a multi-byte character with a shorter one
+  (string-set! s 1 #\b)
+  (assert:equal "string->symbol after string-set!" (eq? (string->symbol s) 'abc) #t))
 
 ;; Map
 (assert:equal "map 1" (map (lambda (x) (car x)) '((a . b) (1 . 2) (#\h #\w))) '(a 1 #\h))
@@ -389,6 +406,32 @@
   3)
 (assert:equal "Record type predicate (t)" (record? (kons 1 2)) #t)
 (assert:equal "Record type predicate (f)" (record? (cons 1 2)) #f)
+(assert:equal "Records are not vectors" (vector? (kons 1 2)) #f)
+(assert:equal "Records is-a?" (is-a? (kons 1 2) <pare>) #t)
+
+;; Constructor taking only some of the fields
+(define-record-type <pare2>
+  (kons2 y)
+  pare2?
+  (x kar2 set-kar2!)
+  (y kdr2))
+
+(assert:equal "Records constructor field order" 
+  (let ((k (kons2 2)))
+    (list (kar2 k) (kdr2 k)))
+  '(#f 2))
+(assert:equal "Records predicate, other type" (pare2? (kons 1 2)) #f)
+(assert:equal "Records equal?" (equal? (kons 1 (list 2)) (kons 1 (list 2))) #t)
+(assert:equal "Records setter, stack value"
+  (let ((k (kons2 2)))
+    (set-kar2! k (list 1 2 3))
+    (kar2 k))
+  '(1 2 3))
+(assert:equal "Records slot-ref" (slot-ref <pare> (kons 1 2) 'y) 2)
+(assert:equal "Records make-constructor/args"
+  (let ((k ((make-constructor/args "kons" <pare>) 1 2)))
+    (list (pare? k) (vector? k) (kdr k)))
+  '(#t #f 2))
 ;; END records
 
 ;; Lazy evaluation